@@ -32,6 +32,11 @@
 #if HAVE_MALLOC_H
 #include <malloc.h>
 #endif
+#if HAVE_MMAP
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 
 const int x264_bit_depth = BIT_DEPTH;
 
@@ -113,6 +118,7 @@ void x264_param_default( x264_param_t *param )
     param->rc.b_stat_write = 0;
     param->rc.psz_stat_out = "x264_2pass.log";
     param->rc.b_stat_read = 0;
+    param->rc.b_stat_binary = 0;
     param->rc.psz_stat_in = "x264_2pass.log";
     param->rc.f_qcompress = 0.6;
     param->rc.f_qblur = 0.5;
@@ -626,6 +632,13 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
                 p->cpu |= X264_CPU_SHUFFLE_IS_FAST;
         }
     }
+    OPT("asm-max")
+    {
+        for( i = 0; x264_cpu_names[i].flags && strcasecmp( value, x264_cpu_names[i].name ); i++ );
+        p->cpu_max = x264_cpu_names[i].flags;
+        if( !p->cpu_max )
+            b_error = 1;
+    }
     OPT("threads")
     {
         if( !strcmp(value, "auto") )
@@ -649,6 +662,8 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
         else
             p->i_sync_lookahead = atoi(value);
     }
+    OPT("frame-pool")
+        p->i_frame_pool = atoi(value);
     OPT2("deterministic", "n-deterministic")
         p->b_deterministic = atobool(value);
     OPT("cpu-independent")
@@ -874,6 +889,8 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
 #endif
     OPT("dump-yuv")
         p->psz_dump_yuv = strdup(value);
+    OPT("trace")
+        p->psz_trace_file = strdup(value);
     OPT2("analyse", "partitions")
     {
         p->analyse.inter = 0;
@@ -906,6 +923,8 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
         p->analyse.i_mv_range_thread = atoi(value);
     OPT2("subme", "subq")
         p->analyse.i_subpel_refine = atoi(value);
+    OPT("lazy-hpel")
+        p->analyse.b_lazy_hpel = atobool(value);
     OPT("psy-rd")
     {
         if( 2 == sscanf( value, "%f:%f", &p->analyse.f_psy_rd, &p->analyse.f_psy_trellis ) ||
@@ -959,6 +978,8 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
         p->rc.f_rf_constant_max = atof(value);
     OPT("rc-lookahead")
         p->rc.i_lookahead = atoi(value);
+    OPT("lookahead-pyramid")
+        p->rc.i_lookahead_pyramid = atoi(value);
     OPT2("qpmin", "qp-min")
         p->rc.i_qp_min = atoi(value);
     OPT2("qpmax", "qp-max")
@@ -992,6 +1013,12 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
         p->rc.psz_stat_in = strdup(value);
         p->rc.psz_stat_out = strdup(value);
     }
+    OPT("stats-binary")
+        p->rc.b_stat_binary = atobool(value);
+    OPT("chunks")
+        p->rc.i_chunks = atoi(value);
+    OPT("chunk")
+        p->rc.i_chunk = atoi(value);
     OPT("qcomp")
         p->rc.f_qcompress = atof(value);
     OPT("mbtree")
@@ -1260,6 +1287,66 @@ error:
     return NULL;
 }
 
+/****************************************************************************
+ * x264_map_file:
+ ****************************************************************************/
+void *x264_map_file( const char *filename, int64_t *size )
+{
+#if HAVE_MMAP
+    void *data = NULL;
+    struct stat file_stat;
+    int fd = open( filename, O_RDONLY );
+    if( fd < 0 )
+        return NULL;
+    if( !fstat( fd, &file_stat ) && S_ISREG( file_stat.st_mode ) && file_stat.st_size > 0 )
+    {
+        data = mmap( NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        if( data == MAP_FAILED )
+            data = NULL;
+        else
+            *size = file_stat.st_size;
+    }
+    close( fd );
+    return data;
+#else
+    int b_error = 0;
+    int64_t i_size;
+    uint8_t *buf;
+    FILE *fh = fopen( filename, "rb" );
+    if( !fh )
+        return NULL;
+    b_error |= fseek( fh, 0, SEEK_END ) < 0;
+    b_error |= ( i_size = ftell( fh ) ) <= 0;
+    b_error |= fseek( fh, 0, SEEK_SET ) < 0;
+    if( b_error || !(buf = x264_malloc( i_size )) )
+    {
+        fclose( fh );
+        return NULL;
+    }
+    b_error |= fread( buf, 1, i_size, fh ) != i_size;
+    fclose( fh );
+    if( b_error )
+    {
+        x264_free( buf );
+        return NULL;
+    }
+    *size = i_size;
+    return buf;
+#endif
+}
+
+/****************************************************************************
+ * x264_unmap_file:
+ ****************************************************************************/
+void x264_unmap_file( void *data, int64_t size )
+{
+#if HAVE_MMAP
+    munmap( data, size );
+#else
+    x264_free( data );
+#endif
+}
+
 /****************************************************************************
  * x264_param2string:
  ****************************************************************************/
@@ -1288,6 +1375,8 @@ char *x264_param2string( x264_param_t *p, int b_res )
     s += sprintf( s, " analyse=%#x:%#x", p->analyse.intra, p->analyse.inter );
     s += sprintf( s, " me=%s", x264_motion_est_names[ p->analyse.i_me_method ] );
     s += sprintf( s, " subme=%d", p->analyse.i_subpel_refine );
+    if( p->analyse.b_lazy_hpel )
+        s += sprintf( s, " lazy_hpel=%d", p->analyse.b_lazy_hpel );
     s += sprintf( s, " psy=%d", p->analyse.b_psy );
     if( p->analyse.b_psy )
         s += sprintf( s, " psy_rd=%.2f:%.2f", p->analyse.f_psy_rd, p->analyse.f_psy_trellis );
@@ -1334,6 +1423,8 @@ char *x264_param2string( x264_param_t *p, int b_res )
 
     if( p->rc.b_mb_tree || p->rc.i_vbv_buffer_size )
         s += sprintf( s, " rc_lookahead=%d", p->rc.i_lookahead );
+    if( p->rc.i_lookahead_pyramid )
+        s += sprintf( s, " lookahead_pyramid=%d", p->rc.i_lookahead_pyramid );
 
     s += sprintf( s, " rc=%s mbtree=%d", p->rc.i_rc_method == X264_RC_ABR ?
                                ( p->rc.b_stat_read ? "2pass" : p->rc.i_vbv_max_bitrate == p->rc.i_bitrate ? "cbr" : "abr" )
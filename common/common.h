@@ -57,6 +57,7 @@ do {\
 #define X264_REF_MAX 16
 #define X264_THREAD_MAX 128
 #define X264_LOOKAHEAD_THREAD_MAX 16
+#define X264_LOOKAHEAD_PYRAMID_MAX 2
 #define X264_PCM_COST (FRAME_SIZE(256*BIT_DEPTH)+16)
 #define X264_LOOKAHEAD_MAX 250
 #define QP_BD_OFFSET (6*(BIT_DEPTH-8))
@@ -225,6 +226,11 @@ void  x264_free( void * );
 /* x264_slurp_file: malloc space for the whole file and read it */
 char *x264_slurp_file( const char *filename );
 
+/* x264_map_file: map the whole file read-only (or read it if mmap is unavailable)
+ * x264_unmap_file: release a buffer returned by x264_map_file */
+void *x264_map_file( const char *filename, int64_t *size );
+void  x264_unmap_file( void *data, int64_t size );
+
 /* mdate: return the current date in microsecond */
 int64_t x264_mdate( void );
 
@@ -322,6 +328,8 @@ static ALWAYS_INLINE float x264_log2( uint32_t x )
     return x264_log2_lut[(x<<lz>>24)&0x7f] + x264_log2_lz_lut[lz];
 }
 
+#include "trace.h"
+
 /****************************************************************************
  *
  ****************************************************************************/
@@ -416,6 +424,7 @@ typedef struct x264_lookahead_t
     volatile uint8_t              b_exit_thread;
     uint8_t                       b_thread_active;
     uint8_t                       b_analyse_keyframe;
+    uint8_t                       b_share_registered;
     int                           i_last_keyframe;
     int                           i_slicetype_length;
     x264_frame_t                  *last_nonb;
@@ -423,6 +432,18 @@ typedef struct x264_lookahead_t
     x264_sync_frame_list_t        ifbuf;
     x264_sync_frame_list_t        next;
     x264_sync_frame_list_t        ofbuf;
+    /* lookahead share consumer: frames before i_share_start were published before we
+     * registered, frames before i_share_next have been read */
+    int                           i_share_start;
+    int                           i_share_next;
+    /* stats */
+    int64_t                       i_start_time;
+    int64_t                       i_busy_time;
+    int                           i_bframe_jobs;
+    int                           i_bframe_jobs_discarded;
+    int                           i_share_frames;    /* published (source) or read (consumer) */
+    int                           i_share_decisions; /* consumer: slicetype decisions taken */
+    int                           i_share_local;     /* consumer: of which the source had no answer for */
 } x264_lookahead_t;
 
 typedef struct x264_ratecontrol_t   x264_ratecontrol_t;
@@ -458,10 +479,17 @@ typedef struct
     int i_mb_field[3];
     /* Adaptive direct mv pred */
     int i_direct_score[2];
+    /* --lazy-hpel: reference mb rows whose half-pel planes this frame filtered */
+    int i_hpel_rows;
     /* Metrics */
     int64_t i_ssd[3];
     double f_ssim;
     int i_ssim_cnt;
+    /* Frame-thread row synchronisation */
+    int i_sync_waits;         /* reference rows not yet available */
+    int64_t i_sync_wait_time; /* time spent waiting for them, in us */
+    int i_sync_broadcasts;    /* row progress updates published */
+    int i_sync_wakeups;       /* of which had to wake a waiter */
 } x264_frame_stat_t;
 
 struct x264_t
@@ -479,6 +507,8 @@ struct x264_t
     int             i_threadslice_pass; /* which pass of encoding we are on */
     x264_threadpool_t *threadpool;
     x264_threadpool_t *lookaheadpool;
+    x264_threadpool_t *preprocesspool;
+    struct x264_preprocess_t *preprocess;
     x264_pthread_mutex_t mutex;
     x264_pthread_cond_t cv;
 
@@ -592,6 +622,7 @@ struct x264_t
         int64_t i_second_largest_pts;
         int b_have_lowres;  /* Whether 1/2 resolution luma planes are being used */
         int b_have_sub8x8_esa;
+        int b_pool;         /* Whether we hold a reference on the process-wide frame pool */
     } frames;
 
     /* current frame being encoded */
@@ -902,9 +933,27 @@ struct x264_t
         int     i_direct_frames[2];
         /* num p-frames weighted */
         int     i_wpred[2];
+        /* frame-thread row synchronisation */
+        int64_t i_sync_waits;
+        int64_t i_sync_wait_time;
+        int64_t i_sync_broadcasts;
+        int64_t i_sync_wakeups;
+        /* --lazy-hpel: mb rows of references filtered, out of those the references had */
+        int64_t i_hpel_rows;
+        int64_t i_hpel_rows_ref;
 
     } stat;
 
+    /* timing trace: per-macroblock stage ticks of the row being encoded */
+    struct
+    {
+        int     b_enabled;
+        int     i_row;      /* -1 if no row is open */
+        int     i_mbs;
+        int64_t i_row_start;
+        int64_t i_ticks[X264_TRACE_MB_STAGES];
+    } trace;
+
     /* 0 = luma 4x4, 1 = luma 8x8, 2 = chroma 4x4, 3 = chroma 8x8 */
     udctcoef (*nr_offset)[64];
     uint32_t (*nr_residual_sum)[64];
@@ -68,14 +68,15 @@ const x264_cpu_name_t x264_cpu_names[] =
     {"FMA4",        AVX|X264_CPU_FMA4},
     {"AVX2",        AVX|X264_CPU_AVX2},
     {"FMA3",        AVX|X264_CPU_FMA3},
+    {"AVX512",      AVX|X264_CPU_FMA3|X264_CPU_AVX2|X264_CPU_AVX512},
 #undef AVX
 #undef SSE2
     {"Cache32",         X264_CPU_CACHELINE_32},
     {"Cache64",         X264_CPU_CACHELINE_64},
     {"SSEMisalign",     X264_CPU_SSE_MISALIGN},
     {"LZCNT",           X264_CPU_LZCNT},
-    {"BMI1",            X264_CPU_BMI1},
-    {"BMI2",            X264_CPU_BMI1|X264_CPU_BMI2},
+    {"BMI1",            X264_CPU_LZCNT|X264_CPU_BMI1},
+    {"BMI2",            X264_CPU_LZCNT|X264_CPU_BMI1|X264_CPU_BMI2},
     {"TBM",             X264_CPU_TBM},
     {"Slow_mod4_stack", X264_CPU_STACK_MOD4},
     {"ARMv6",           X264_CPU_ARMV6},
@@ -161,6 +162,14 @@ uint32_t x264_cpu_detect( void )
     /* AVX2 requires OS support, but BMI1/2 don't. */
     if( (cpu&X264_CPU_AVX) && (ebx&0x00000020) )
         cpu |= X264_CPU_AVX2;
+    /* AVX-512 F/DQ/CD/BW/VL, and the OS must save opmask and both halves of the ZMM state. */
+    if( (cpu&X264_CPU_AVX2) && (ebx&0xd0030000) == 0xd0030000 )
+    {
+        uint32_t xcr0_lo, xcr0_hi;
+        x264_cpu_xgetbv( 0, &xcr0_lo, &xcr0_hi );
+        if( (xcr0_lo&0xe6) == 0xe6 )
+            cpu |= X264_CPU_AVX512;
+    }
     if( ebx&0x00000008 )
     {
         cpu |= X264_CPU_BMI1;
@@ -239,6 +248,12 @@ uint32_t x264_cpu_detect( void )
             else if( model >= 23 )
                 cpu |= X264_CPU_SHUFFLE_IS_FAST;
         }
+        if( max_extended_cap >= 0x80000001 )
+        {
+            x264_cpu_cpuid( 0x80000001, &eax, &ebx, &ecx, &edx );
+            if( ecx&0x00000020 ) /* LZCNT, Haswell and later */
+                cpu |= X264_CPU_LZCNT;
+        }
     }
 
     if( (!strcmp((char*)vendor, "GenuineIntel") || !strcmp((char*)vendor, "CyrixInstead")) && !(cpu&X264_CPU_SSE42))
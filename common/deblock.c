@@ -337,6 +337,40 @@ static ALWAYS_INLINE void deblock_edge_intra( x264_t *h, pixel *pix, intptr_t i_
     pf_intra( pix, i_stride, alpha, beta );
 }
 
+/* 4:4:4 chroma: both planes are filtered like luma, with the same parameters */
+static ALWAYS_INLINE void deblock_edge_444( x264_t *h, pixel *pix, intptr_t uvdiff, intptr_t i_stride, uint8_t bS[4],
+                                            int i_qp, int a, int b, int dir )
+{
+    int index_a = i_qp + a;
+    int index_b = i_qp + b;
+    int alpha = alpha_table(index_a) << (BIT_DEPTH-8);
+    int beta  = beta_table(index_b) << (BIT_DEPTH-8);
+    int8_t tc[4];
+
+    if( !M32(bS) || !alpha || !beta )
+        return;
+
+    tc[0] = tc0_table(index_a)[bS[0]] << (BIT_DEPTH-8);
+    tc[1] = tc0_table(index_a)[bS[1]] << (BIT_DEPTH-8);
+    tc[2] = tc0_table(index_a)[bS[2]] << (BIT_DEPTH-8);
+    tc[3] = tc0_table(index_a)[bS[3]] << (BIT_DEPTH-8);
+
+    if( h->loopf.deblock_chroma_444[dir] )
+        h->loopf.deblock_chroma_444[dir]( pix, pix + uvdiff, i_stride, alpha, beta, tc );
+    else
+    {
+        h->loopf.deblock_luma[dir]( pix, i_stride, alpha, beta, tc );
+        h->loopf.deblock_luma[dir]( pix + uvdiff, i_stride, alpha, beta, tc );
+    }
+}
+
+static ALWAYS_INLINE void deblock_edge_intra_444( x264_t *h, pixel *pix, intptr_t uvdiff, intptr_t i_stride, uint8_t bS[4],
+                                                  int i_qp, int a, int b, int dir )
+{
+    deblock_edge_intra( h, pix,          i_stride, bS, i_qp, a, b, 0, h->loopf.deblock_luma_intra[dir] );
+    deblock_edge_intra( h, pix + uvdiff, i_stride, bS, i_qp, a, b, 0, h->loopf.deblock_luma_intra[dir] );
+}
+
 static ALWAYS_INLINE void x264_macroblock_cache_load_neighbours_deblock( x264_t *h, int mb_x, int mb_y )
 {
     int deblock_on_slice_edges = h->sh.i_disable_deblocking_filter_idc != 2;
@@ -387,6 +421,9 @@ void x264_frame_deblock_row( x264_t *h, int mb_y )
     int chroma_height = 16 >> CHROMA_V_SHIFT;
     intptr_t uvdiff = chroma444 ? h->fdec->plane[2] - h->fdec->plane[1] : 1;
 
+    if( !b_interlaced )
+        x264_macroblock_deblock_strength_row( h, mb_y );
+
     for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x += (~b_interlaced | mb_y)&1, mb_y ^= b_interlaced )
     {
         x264_prefetch_fenc( h, h->fdec, mb_x, mb_y );
@@ -421,14 +458,8 @@ void x264_frame_deblock_row( x264_t *h, int mb_y )
                                      stride2y, bs[dir][edge], qp, a, b, 0,\
                                      h->loopf.deblock_luma##intra[dir] );\
                 if( CHROMA_FORMAT == CHROMA_444 )\
-                {\
-                    deblock_edge##intra( h, pixuv          + 4*edge*(dir?stride2uv:1),\
-                                         stride2uv, bs[dir][edge], chroma_qp, a, b, 0,\
-                                         h->loopf.deblock_luma##intra[dir] );\
-                    deblock_edge##intra( h, pixuv + uvdiff + 4*edge*(dir?stride2uv:1),\
-                                         stride2uv, bs[dir][edge], chroma_qp, a, b, 0,\
-                                         h->loopf.deblock_luma##intra[dir] );\
-                }\
+                    deblock_edge##intra##_444( h, pixuv + 4*edge*(dir?stride2uv:1), uvdiff,\
+                                               stride2uv, bs[dir][edge], chroma_qp, a, b, dir );\
                 else if( CHROMA_FORMAT == CHROMA_420 && !(edge & 1) )\
                 {\
                     deblock_edge##intra( h, pixuv + edge*(dir?2*stride2uv:4),\
@@ -686,6 +717,19 @@ void x264_deblock_strength_ssse3( uint8_t nnz[X264_SCAN8_SIZE], int8_t ref[2][X2
 void x264_deblock_strength_avx  ( uint8_t nnz[X264_SCAN8_SIZE], int8_t ref[2][X264_SCAN8_LUMA_SIZE],
                                   int16_t mv[2][X264_SCAN8_LUMA_SIZE][2], uint8_t bs[2][8][4],
                                   int mvy_limit, int bframe );
+void x264_deblock_strength_avx2 ( uint8_t nnz[X264_SCAN8_SIZE], int8_t ref[2][X264_SCAN8_LUMA_SIZE],
+                                  int16_t mv[2][X264_SCAN8_LUMA_SIZE][2], uint8_t bs[2][8][4],
+                                  int mvy_limit, int bframe );
+#if HIGH_BIT_DEPTH
+void x264_deblock_v_luma_avx2( pixel *pix, intptr_t stride, int alpha, int beta, int8_t *tc0 );
+void x264_deblock_v_luma_intra_avx2( pixel *pix, intptr_t stride, int alpha, int beta );
+void x264_deblock_v_chroma_avx2( pixel *pix, intptr_t stride, int alpha, int beta, int8_t *tc0 );
+void x264_deblock_v_chroma_intra_avx2( pixel *pix, intptr_t stride, int alpha, int beta );
+#else
+void x264_deblock_h_luma_avx2( pixel *pix, intptr_t stride, int alpha, int beta, int8_t *tc0 );
+void x264_deblock_v_luma_2plane_avx2( pixel *pixu, pixel *pixv, intptr_t stride, int alpha, int beta, int8_t *tc0 );
+void x264_deblock_h_luma_2plane_avx2( pixel *pixu, pixel *pixv, intptr_t stride, int alpha, int beta, int8_t *tc0 );
+#endif
 
 void x264_deblock_h_chroma_intra_mbaff_mmx2( pixel *pix, intptr_t stride, int alpha, int beta );
 void x264_deblock_h_chroma_intra_mbaff_sse2( pixel *pix, intptr_t stride, int alpha, int beta );
@@ -750,6 +794,8 @@ void x264_deblock_init( int cpu, x264_deblock_function_t *pf, int b_mbaff )
     pf->deblock_luma_intra_mbaff = deblock_h_luma_intra_mbaff_c;
     pf->deblock_chroma_420_intra_mbaff = deblock_h_chroma_intra_mbaff_c;
     pf->deblock_strength = deblock_strength_c;
+    pf->deblock_chroma_444[0] = NULL;
+    pf->deblock_chroma_444[1] = NULL;
 
 #if HAVE_MMX
     if( cpu&X264_CPU_MMX2 )
@@ -816,6 +862,28 @@ void x264_deblock_init( int cpu, x264_deblock_function_t *pf, int b_mbaff )
 #endif
             }
         }
+        if( cpu&X264_CPU_AVX2 )
+        {
+            pf->deblock_strength = x264_deblock_strength_avx2;
+#if HIGH_BIT_DEPTH
+            /* 16-bit pixels: the whole 16-pixel edge fits in one ymm register */
+#if ARCH_X86_64
+            pf->deblock_luma[1] = x264_deblock_v_luma_avx2;
+            pf->deblock_luma_intra[1] = x264_deblock_v_luma_intra_avx2;
+#endif
+            if( !(cpu&X264_CPU_STACK_MOD4) )
+            {
+                pf->deblock_chroma[1] = x264_deblock_v_chroma_avx2;
+                pf->deblock_chroma_intra[1] = x264_deblock_v_chroma_intra_avx2;
+            }
+#elif ARCH_X86_64
+            /* 8-bit pixels: 16 rows of the h filter are transposed in the two lanes,
+             * and both 4:4:4 chroma planes are filtered in one call */
+            pf->deblock_luma[0] = x264_deblock_h_luma_avx2;
+            pf->deblock_chroma_444[0] = x264_deblock_h_luma_2plane_avx2;
+            pf->deblock_chroma_444[1] = x264_deblock_v_luma_2plane_avx2;
+#endif
+        }
     }
 #endif
 
@@ -42,6 +42,182 @@ static int align_plane_size( int x, int disalign )
     return x;
 }
 
+/* The frame pool keeps the large plane buffers of deleted frames so that other
+ * encoders in the same process (e.g. the renditions of an ABR ladder) can reuse
+ * them instead of allocating and faulting in fresh memory.  Buffers are kept in
+ * size classes of 8 steps per octave, so a request is served by a buffer at most
+ * 12.5% larger than it.  Only idle buffers count towards the cap; a buffer
+ * returned while the pool is full is freed.  Idle buffers outlive the last
+ * encoder using the pool, so an encoder opened later (the next job, or a
+ * restarted rendition) still finds them. */
+
+#define FRAME_POOL_CLASSES (32*8)
+/* keeps the alignment x264_malloc gave the buffer */
+#define FRAME_POOL_HEADER 64
+
+typedef struct x264_pool_buf_t
+{
+    struct x264_pool_buf_t *next;
+    int i_size;
+} x264_pool_buf_t;
+
+typedef struct
+{
+    int     i_refcount;
+    int64_t i_max_idle;
+    int64_t i_idle;     /* bytes waiting in the class lists */
+    int64_t i_used;     /* bytes handed out to frames */
+    int64_t i_peak;     /* peak of i_idle + i_used */
+    int64_t i_hits;
+    int64_t i_misses;
+    int64_t i_drops;    /* buffers freed on return because of the cap */
+    x264_pool_buf_t *idle[FRAME_POOL_CLASSES+1];
+} x264_frame_pool_t;
+
+static x264_pthread_mutex_t frame_pool_mutex = X264_PTHREAD_MUTEX_INITIALIZER;
+static x264_frame_pool_t *frame_pool;
+
+/* rounds *size up to its class and returns the class index */
+static int frame_pool_class( int *size )
+{
+    int bits = 31 - x264_clz( *size );
+    if( bits < 3 )
+        return *size;
+    int step = 1 << (bits-3);
+    *size = (*size + step - 1) & ~(step - 1);
+    return bits*8 + (*size >> (bits-3)) - 8;
+}
+
+/* must be called with frame_pool_mutex held */
+static void frame_pool_trim( void )
+{
+    for( int i = FRAME_POOL_CLASSES; i >= 0 && frame_pool->i_idle > frame_pool->i_max_idle; i-- )
+        while( frame_pool->idle[i] && frame_pool->i_idle > frame_pool->i_max_idle )
+        {
+            x264_pool_buf_t *buf = frame_pool->idle[i];
+            frame_pool->idle[i] = buf->next;
+            frame_pool->i_idle -= buf->i_size;
+            x264_free( buf );
+        }
+}
+
+int x264_frame_pool_open( int i_max_mib )
+{
+    int ret = 0;
+    int64_t i_max_idle = (int64_t)i_max_mib << 20;
+    x264_pthread_mutex_lock( &frame_pool_mutex );
+    if( !frame_pool )
+        frame_pool = calloc( 1, sizeof(x264_frame_pool_t) );
+    if( frame_pool )
+    {
+        /* the pool is shared, so it honours the largest cap of its current users */
+        if( frame_pool->i_refcount++ )
+            frame_pool->i_max_idle = X264_MAX( frame_pool->i_max_idle, i_max_idle );
+        else
+        {
+            frame_pool->i_max_idle = i_max_idle;
+            frame_pool_trim();
+        }
+    }
+    else
+        ret = -1;
+    x264_pthread_mutex_unlock( &frame_pool_mutex );
+    return ret;
+}
+
+void x264_frame_pool_close( void )
+{
+    x264_pthread_mutex_lock( &frame_pool_mutex );
+    if( frame_pool )
+        frame_pool->i_refcount--;
+    x264_pthread_mutex_unlock( &frame_pool_mutex );
+}
+
+void x264_frame_pool_print_stats( x264_t *h )
+{
+    x264_pthread_mutex_lock( &frame_pool_mutex );
+    if( frame_pool )
+    {
+        int64_t requests = frame_pool->i_hits + frame_pool->i_misses;
+        x264_log( h, X264_LOG_INFO, "frame pool: %"PRId64" of %"PRId64" buffers reused (%.1f%%), %"PRId64" dropped, "
+                  "%.1f MiB in use, %.1f/%.1f MiB idle, peak %.1f MiB\n",
+                  frame_pool->i_hits, requests, requests ? 100.0 * frame_pool->i_hits / requests : 0.0,
+                  frame_pool->i_drops, frame_pool->i_used / 1048576.0, frame_pool->i_idle / 1048576.0,
+                  frame_pool->i_max_idle / 1048576.0, frame_pool->i_peak / 1048576.0 );
+    }
+    x264_pthread_mutex_unlock( &frame_pool_mutex );
+}
+
+static void *frame_pool_alloc( int i_size )
+{
+    x264_pool_buf_t *buf = NULL;
+    int i_class = frame_pool_class( &i_size );
+    x264_pthread_mutex_lock( &frame_pool_mutex );
+    if( frame_pool )
+    {
+        buf = frame_pool->idle[i_class];
+        if( buf )
+        {
+            frame_pool->idle[i_class] = buf->next;
+            frame_pool->i_idle -= buf->i_size;
+            frame_pool->i_hits++;
+        }
+        else
+            frame_pool->i_misses++;
+        frame_pool->i_used += i_size;
+        frame_pool->i_peak = X264_MAX( frame_pool->i_peak, frame_pool->i_used + frame_pool->i_idle );
+    }
+    x264_pthread_mutex_unlock( &frame_pool_mutex );
+    if( !buf )
+    {
+        buf = x264_malloc( i_size + FRAME_POOL_HEADER );
+        if( !buf )
+            return NULL;
+        buf->i_size = i_size;
+    }
+    return (uint8_t*)buf + FRAME_POOL_HEADER;
+}
+
+static void frame_pool_free( void *p )
+{
+    if( !p )
+        return;
+    x264_pool_buf_t *buf = (x264_pool_buf_t*)((uint8_t*)p - FRAME_POOL_HEADER);
+    x264_pthread_mutex_lock( &frame_pool_mutex );
+    if( frame_pool )
+    {
+        frame_pool->i_used -= buf->i_size;
+        if( frame_pool->i_idle + buf->i_size <= frame_pool->i_max_idle )
+        {
+            int i_size = buf->i_size;
+            int i_class = frame_pool_class( &i_size );
+            buf->next = frame_pool->idle[i_class];
+            frame_pool->idle[i_class] = buf;
+            frame_pool->i_idle += buf->i_size;
+            buf = NULL;
+        }
+        else
+            frame_pool->i_drops++;
+    }
+    x264_pthread_mutex_unlock( &frame_pool_mutex );
+    x264_free( buf );
+}
+
+#define CHECKED_BUFFER_ALLOC( var, size )\
+do {\
+    var = frame->b_pooled ? frame_pool_alloc( size ) : x264_malloc( size );\
+    if( !var )\
+        goto fail;\
+} while( 0 )
+
+static void frame_buffer_free( x264_frame_t *frame, void *p )
+{
+    if( frame->b_pooled )
+        frame_pool_free( p );
+    else
+        x264_free( p );
+}
+
 static int x264_frame_internal_csp( int external_csp )
 {
     switch( external_csp & X264_CSP_MASK )
@@ -76,6 +252,7 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     int disalign = h->param.cpu&X264_CPU_ALTIVEC ? 1<<9 : 1<<10;
 
     CHECKED_MALLOCZERO( frame, sizeof(x264_frame_t) );
+    frame->b_pooled = !!h->param.i_frame_pool;
 
     /* allocate frame data (+64 for extra data for me) */
     i_width  = h->mb.i_mb_width*16;
@@ -111,6 +288,12 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     frame->i_width_lowres = frame->i_width[0]/2;
     frame->i_lines_lowres = frame->i_lines[0]/2;
     frame->i_stride_lowres = align_stride( frame->i_width_lowres + 2*PADH, align, disalign<<1 );
+    for( int i = 0; i < h->param.rc.i_lookahead_pyramid; i++ )
+    {
+        frame->i_width_pyramid[i] = frame->i_width_lowres >> (i+1);
+        frame->i_lines_pyramid[i] = frame->i_lines_lowres >> (i+1);
+        frame->i_stride_pyramid[i] = align_stride( frame->i_width_pyramid[i] + 2*PADH, align, disalign<<1 );
+    }
 
     for( int i = 0; i < h->param.i_bframe + 2; i++ )
         for( int j = 0; j < h->param.i_bframe + 2; j++ )
@@ -123,6 +306,7 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     frame->i_frame = -1;
     frame->i_frame_num = -1;
     frame->i_lines_completed = -1;
+    frame->i_lines_waited = INT_MAX;
     frame->b_fdec = b_fdec;
     frame->i_pic_struct = PIC_STRUCT_AUTO;
     frame->i_field_cnt = -1;
@@ -139,11 +323,11 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
     {
         int chroma_padv = i_padv >> (i_csp == X264_CSP_NV12);
         int chroma_plane_size = (frame->i_stride[1] * (frame->i_lines[1] + 2*chroma_padv));
-        CHECKED_MALLOC( frame->buffer[1], chroma_plane_size * sizeof(pixel) );
+        CHECKED_BUFFER_ALLOC( frame->buffer[1], chroma_plane_size * sizeof(pixel) );
         frame->plane[1] = frame->buffer[1] + frame->i_stride[1] * chroma_padv + PADH;
         if( PARAM_INTERLACED )
         {
-            CHECKED_MALLOC( frame->buffer_fld[1], chroma_plane_size * sizeof(pixel) );
+            CHECKED_BUFFER_ALLOC( frame->buffer_fld[1], chroma_plane_size * sizeof(pixel) );
             frame->plane_fld[1] = frame->buffer_fld[1] + frame->i_stride[1] * chroma_padv + PADH;
         }
     }
@@ -157,9 +341,9 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
         if( h->param.analyse.i_subpel_refine && b_fdec )
         {
             /* FIXME: Don't allocate both buffers in non-adaptive MBAFF. */
-            CHECKED_MALLOC( frame->buffer[p], 4*luma_plane_size * sizeof(pixel) );
+            CHECKED_BUFFER_ALLOC( frame->buffer[p], 4*luma_plane_size * sizeof(pixel) );
             if( PARAM_INTERLACED )
-                CHECKED_MALLOC( frame->buffer_fld[p], 4*luma_plane_size * sizeof(pixel) );
+                CHECKED_BUFFER_ALLOC( frame->buffer_fld[p], 4*luma_plane_size * sizeof(pixel) );
             for( int i = 0; i < 4; i++ )
             {
                 frame->filtered[p][i] = frame->buffer[p] + i*luma_plane_size + frame->i_stride[p] * i_padv + PADH;
@@ -170,9 +354,9 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
         }
         else
         {
-            CHECKED_MALLOC( frame->buffer[p], luma_plane_size * sizeof(pixel) );
+            CHECKED_BUFFER_ALLOC( frame->buffer[p], luma_plane_size * sizeof(pixel) );
             if( PARAM_INTERLACED )
-                CHECKED_MALLOC( frame->buffer_fld[p], luma_plane_size * sizeof(pixel) );
+                CHECKED_BUFFER_ALLOC( frame->buffer_fld[p], luma_plane_size * sizeof(pixel) );
             frame->filtered[p][0] = frame->plane[p] = frame->buffer[p] + frame->i_stride[p] * i_padv + PADH;
             frame->filtered_fld[p][0] = frame->plane_fld[p] = frame->buffer_fld[p] + frame->i_stride[p] * i_padv + PADH;
         }
@@ -202,9 +386,11 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
         CHECKED_MALLOC( frame->i_row_bits, i_lines/16 * sizeof(int) );
         CHECKED_MALLOC( frame->f_row_qp, i_lines/16 * sizeof(float) );
         CHECKED_MALLOC( frame->f_row_qscale, i_lines/16 * sizeof(float) );
+        if( h->param.analyse.b_lazy_hpel )
+            CHECKED_MALLOC( frame->hpel_done, i_lines/16 * sizeof(uint8_t) );
         if( h->param.analyse.i_me_method >= X264_ME_ESA )
         {
-            CHECKED_MALLOC( frame->buffer[3],
+            CHECKED_BUFFER_ALLOC( frame->buffer[3],
                             frame->i_stride[0] * (frame->i_lines[0] + 2*i_padv) * sizeof(uint16_t) << h->frames.b_have_sub8x8_esa );
             frame->integral = (uint16_t*)frame->buffer[3] + frame->i_stride[0] * i_padv + PADH;
         }
@@ -219,9 +405,17 @@ static x264_frame_t *x264_frame_new( x264_t *h, int b_fdec )
         {
             int luma_plane_size = align_plane_size( frame->i_stride_lowres * (frame->i_lines[0]/2 + 2*PADV), disalign );
 
-            CHECKED_MALLOC( frame->buffer_lowres[0], 4 * luma_plane_size * sizeof(pixel) );
+            CHECKED_BUFFER_ALLOC( frame->buffer_lowres[0], 4 * luma_plane_size * sizeof(pixel) );
             for( int i = 0; i < 4; i++ )
                 frame->lowres[i] = frame->buffer_lowres[0] + (frame->i_stride_lowres * PADV + PADH) + i * luma_plane_size;
+            for( int j = 0; j < h->param.rc.i_lookahead_pyramid; j++ )
+            {
+                int stride = frame->i_stride_pyramid[j];
+                int plane_size = align_plane_size( stride * (frame->i_lines_pyramid[j] + 2*PADV), disalign );
+                CHECKED_BUFFER_ALLOC( frame->buffer_pyramid[j], 4 * plane_size * sizeof(pixel) );
+                for( int i = 0; i < 4; i++ )
+                    frame->pyramid[j][i] = frame->buffer_pyramid[j] + (stride * PADV + PADH) + i * plane_size;
+            }
 
             for( int j = 0; j <= !!h->param.i_bframe; j++ )
                 for( int i = 0; i <= h->param.i_bframe; i++ )
@@ -266,11 +460,13 @@ void x264_frame_delete( x264_frame_t *frame )
     {
         for( int i = 0; i < 4; i++ )
         {
-            x264_free( frame->buffer[i] );
-            x264_free( frame->buffer_fld[i] );
+            frame_buffer_free( frame, frame->buffer[i] );
+            frame_buffer_free( frame, frame->buffer_fld[i] );
         }
         for( int i = 0; i < 4; i++ )
-            x264_free( frame->buffer_lowres[i] );
+            frame_buffer_free( frame, frame->buffer_lowres[i] );
+        for( int i = 0; i < X264_LOOKAHEAD_PYRAMID_MAX; i++ )
+            frame_buffer_free( frame, frame->buffer_pyramid[i] );
         for( int i = 0; i < X264_BFRAME_MAX+2; i++ )
             for( int j = 0; j < X264_BFRAME_MAX+2; j++ )
                 x264_free( frame->i_row_satds[i][j] );
@@ -290,6 +486,7 @@ void x264_frame_delete( x264_frame_t *frame )
         x264_free( frame->i_row_bits );
         x264_free( frame->f_row_qp );
         x264_free( frame->f_row_qscale );
+        x264_free( (uint8_t*)frame->hpel_done );
         x264_free( frame->field );
         x264_free( frame->effective_qp );
         x264_free( frame->mb_type );
@@ -549,27 +746,41 @@ void x264_frame_expand_border_filtered( x264_t *h, x264_frame_t *frame, int mb_y
     int padh = PADH - 4;
     int padv = PADV - 8;
     for( int p = 0; p < (CHROMA444 ? 3 : 1); p++ )
-        for( int i = 1; i < 4; i++ )
-        {
-            int stride = frame->i_stride[p];
-            // buffer: 8 luma, to match the hpel filter
-            pixel *pix;
-            if( SLICE_MBAFF )
+    {
+        if( SLICE_MBAFF )
+            for( int i = 1; i < 4; i++ )
             {
-                pix = frame->filtered_fld[p][i] + (16*mb_y - 16) * stride - 4;
+                int stride = frame->i_stride[p];
+                // buffer: 8 luma, to match the hpel filter
+                pixel *pix = frame->filtered_fld[p][i] + (16*mb_y - 16) * stride - 4;
                 plane_expand_border( pix, stride*2, width, height, padh, padv, b_start, b_end, 0 );
                 plane_expand_border( pix+stride, stride*2, width, height, padh, padv, b_start, b_end, 0 );
             }
+        x264_frame_expand_border_filtered_rows( h, frame, p, 16*mb_y - 8, height << SLICE_MBAFF, b_start, b_end );
+    }
+}
 
-            pix = frame->filtered[p][i] + (16*mb_y - 8) * stride - 4;
-            plane_expand_border( pix, stride, width, height << SLICE_MBAFF, padh, padv, b_start, b_end, 0 );
-        }
+void x264_frame_expand_border_filtered_rows( x264_t *h, x264_frame_t *frame, int p, int y, int height, int b_pad_top, int b_pad_bottom )
+{
+    int stride = frame->i_stride[p];
+    for( int i = 1; i < 4; i++ )
+        plane_expand_border( frame->filtered[p][i] + y * stride - 4, stride, 16*h->mb.i_mb_width + 8, height,
+                             PADH - 4, PADV - 8, b_pad_top, b_pad_bottom, 0 );
+}
+
+void x264_frame_expand_border_lowres( x264_frame_t *frame, int y, int height )
+{
+    int stride = frame->i_stride_lowres;
+    int pad_bot = y + height == frame->i_lines_lowres;
+    for( int i = 0; i < 4; i++ )
+        plane_expand_border( frame->lowres[i] + y*stride, stride, frame->i_width_lowres, height, PADH, PADV, !y, pad_bot, 0 );
 }
 
-void x264_frame_expand_border_lowres( x264_frame_t *frame )
+void x264_frame_expand_border_pyramid( x264_frame_t *frame, int level )
 {
     for( int i = 0; i < 4; i++ )
-        plane_expand_border( frame->lowres[i], frame->i_stride_lowres, frame->i_width_lowres, frame->i_lines_lowres, PADH, PADV, 1, 1, 0 );
+        plane_expand_border( frame->pyramid[level][i], frame->i_stride_pyramid[level], frame->i_width_pyramid[level],
+                             frame->i_lines_pyramid[level], PADH, PADV, 1, 1, 0 );
 }
 
 void x264_frame_expand_border_chroma( x264_t *h, x264_frame_t *frame, int plane )
@@ -622,19 +833,48 @@ void x264_expand_border_mbpair( x264_t *h, int mb_x, int mb_y )
 }
 
 /* threading */
-void x264_frame_cond_broadcast( x264_frame_t *frame, int i_lines_completed )
+
+/* Row progress is published with a plain store fenced on both sides; the
+ * mutex/condvar is only touched when some waiter has registered a threshold
+ * that the new value crosses.  Waiters register under the mutex and then
+ * re-check the counter, and the broadcaster stores the counter before reading
+ * the registered threshold, so one of the two always sees the other. */
+#define X264_FRAME_SPIN_COUNT 256
+
+int x264_frame_cond_broadcast( x264_frame_t *frame, int i_lines_completed )
 {
-    x264_pthread_mutex_lock( &frame->mutex );
+    x264_memory_barrier();
     frame->i_lines_completed = i_lines_completed;
+    x264_memory_barrier();
+    if( frame->i_lines_waited > i_lines_completed )
+        return 0;
+    x264_pthread_mutex_lock( &frame->mutex );
+    frame->i_lines_waited = INT_MAX;
     x264_pthread_cond_broadcast( &frame->cv );
     x264_pthread_mutex_unlock( &frame->mutex );
+    return 1;
 }
 
 void x264_frame_cond_wait( x264_frame_t *frame, int i_lines_completed )
 {
+    for( int i = 0; i < X264_FRAME_SPIN_COUNT; i++ )
+        if( frame->i_lines_completed >= i_lines_completed )
+        {
+            x264_memory_barrier();
+            return;
+        }
     x264_pthread_mutex_lock( &frame->mutex );
-    while( frame->i_lines_completed < i_lines_completed )
+    while( 1 )
+    {
+        /* Several waiters may share the frame: keep the lowest threshold.
+         * The broadcaster resets it on wakeup, so unsatisfied waiters re-register. */
+        if( frame->i_lines_waited > i_lines_completed )
+            frame->i_lines_waited = i_lines_completed;
+        x264_memory_barrier();
+        if( frame->i_lines_completed >= i_lines_completed )
+            break;
         x264_pthread_cond_wait( &frame->cv, &frame->mutex );
+    }
     x264_pthread_mutex_unlock( &frame->mutex );
 }
 
@@ -73,11 +73,15 @@ typedef struct x264_frame
     int     i_stride_lowres;
     int     i_width_lowres;
     int     i_lines_lowres;
+    int     i_stride_pyramid[X264_LOOKAHEAD_PYRAMID_MAX];
+    int     i_width_pyramid[X264_LOOKAHEAD_PYRAMID_MAX];
+    int     i_lines_pyramid[X264_LOOKAHEAD_PYRAMID_MAX];
     pixel *plane[3];
     pixel *plane_fld[3];
     pixel *filtered[3][4]; /* plane[0], H, V, HV */
     pixel *filtered_fld[3][4];
     pixel *lowres[4]; /* half-size copy of input frame: Orig, H, V, HV */
+    pixel *pyramid[X264_LOOKAHEAD_PYRAMID_MAX][4]; /* lowres halved once more per level: Orig, H, V, HV */
     uint16_t *integral;
 
     /* for unrestricted mv we allocate more data than needed
@@ -85,10 +89,12 @@ typedef struct x264_frame
     pixel *buffer[4];
     pixel *buffer_fld[4];
     pixel *buffer_lowres[4];
+    pixel *buffer_pyramid[X264_LOOKAHEAD_PYRAMID_MAX];
 
     x264_weight_t weight[X264_REF_MAX][3]; /* [ref_index][plane] */
     pixel *weighted[X264_REF_MAX]; /* plane[0] weighted of the reference frames */
     int b_duplicate;
+    int b_pooled; /* plane buffers come from the process-wide frame pool */
     struct x264_frame *orig;
 
     /* motion data */
@@ -147,12 +153,17 @@ typedef struct x264_frame
     int64_t i_cpb_delay_lookahead;
 
     /* threading */
-    int     i_lines_completed; /* in pixels */
+    volatile int i_lines_completed; /* in pixels */
+    volatile int i_lines_waited; /* lowest i_lines_completed a blocked thread waits for, INT_MAX if none */
     int     i_lines_weighted; /* FIXME: this only supports weighting of one reference frame */
     int     i_reference_count; /* number of threads using this frame (not necessarily the number of pointers) */
     x264_pthread_mutex_t mutex;
     x264_pthread_cond_t  cv;
 
+    /* --lazy-hpel: per mb row, set once x264_frame_filter has run for it.
+     * NULL if the half-pel planes are filtered while the frame is encoded. */
+    volatile uint8_t *hpel_done;
+
     /* periodic intra refresh */
     float   f_pir_position;
     int     i_pir_start_col;
@@ -186,6 +197,7 @@ typedef struct
 
 typedef void (*x264_deblock_inter_t)( pixel *pix, intptr_t stride, int alpha, int beta, int8_t *tc0 );
 typedef void (*x264_deblock_intra_t)( pixel *pix, intptr_t stride, int alpha, int beta );
+typedef void (*x264_deblock_2plane_t)( pixel *pixu, pixel *pixv, intptr_t stride, int alpha, int beta, int8_t *tc0 );
 typedef struct
 {
     x264_deblock_inter_t deblock_luma[2];
@@ -204,6 +216,8 @@ typedef struct
     x264_deblock_intra_t deblock_chroma_intra_mbaff;
     x264_deblock_intra_t deblock_chroma_420_intra_mbaff;
     x264_deblock_intra_t deblock_chroma_422_intra_mbaff;
+    /* 4:4:4 chroma, both planes at once; NULL if there is no such version */
+    x264_deblock_2plane_t deblock_chroma_444[2];
     void (*deblock_strength) ( uint8_t nnz[X264_SCAN8_SIZE], int8_t ref[2][X264_SCAN8_LUMA_SIZE],
                                int16_t mv[2][X264_SCAN8_LUMA_SIZE][2], uint8_t bs[2][8][4], int mvy_limit,
                                int bframe );
@@ -215,7 +229,11 @@ int           x264_frame_copy_picture( x264_t *h, x264_frame_t *dst, x264_pictur
 
 void          x264_frame_expand_border( x264_t *h, x264_frame_t *frame, int mb_y );
 void          x264_frame_expand_border_filtered( x264_t *h, x264_frame_t *frame, int mb_y, int b_end );
-void          x264_frame_expand_border_lowres( x264_frame_t *frame );
+/* left/right borders of rows [y,y+height) of the half-pel planes of plane p, plus the top/bottom bands if asked */
+void          x264_frame_expand_border_filtered_rows( x264_t *h, x264_frame_t *frame, int p, int y, int height,
+                                                      int b_pad_top, int b_pad_bottom );
+void          x264_frame_expand_border_lowres( x264_frame_t *frame, int y, int height );
+void          x264_frame_expand_border_pyramid( x264_frame_t *frame, int level );
 void          x264_frame_expand_border_chroma( x264_t *h, x264_frame_t *frame, int plane );
 void          x264_frame_expand_border_mod16( x264_t *h, x264_frame_t *frame );
 void          x264_expand_border_mbpair( x264_t *h, int mb_x, int mb_y );
@@ -224,11 +242,15 @@ void          x264_frame_deblock_row( x264_t *h, int mb_y );
 void          x264_macroblock_deblock( x264_t *h );
 
 void          x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end );
+void          x264_frame_filter_lazy( x264_t *h, x264_frame_t *frame, int mb_start, int mb_end );
 void          x264_frame_init_lowres( x264_t *h, x264_frame_t *frame );
+void          x264_frame_init_lowres_prepare( x264_t *h, x264_frame_t *frame );
+void          x264_frame_init_lowres_rows( x264_t *h, x264_frame_t *frame, int y, int height );
+void          x264_frame_init_lowres_pyramid( x264_t *h, x264_frame_t *frame );
 
 void          x264_deblock_init( int cpu, x264_deblock_function_t *pf, int b_mbaff );
 
-void          x264_frame_cond_broadcast( x264_frame_t *frame, int i_lines_completed );
+int           x264_frame_cond_broadcast( x264_frame_t *frame, int i_lines_completed );
 void          x264_frame_cond_wait( x264_frame_t *frame, int i_lines_completed );
 
 void          x264_threadslice_cond_broadcast( x264_t *h, int pass );
@@ -246,6 +268,10 @@ void x264_weight_scale_plane( x264_t *h, pixel *dst, intptr_t i_dst_stride, pixe
 x264_frame_t *x264_frame_pop_unused( x264_t *h, int b_fdec );
 void          x264_frame_delete_list( x264_frame_t **list );
 
+int           x264_frame_pool_open( int i_max_mib );
+void          x264_frame_pool_close( void );
+void          x264_frame_pool_print_stats( x264_t *h );
+
 int           x264_sync_frame_list_init( x264_sync_frame_list_t *slist, int nelem );
 void          x264_sync_frame_list_delete( x264_sync_frame_list_t *slist );
 void          x264_sync_frame_list_push( x264_sync_frame_list_t *slist, x264_frame_t *frame );
@@ -42,6 +42,7 @@ static NOINLINE void x264_mb_mc_0xywh( x264_t *h, int x, int y, int width, int h
     int mvx   = x264_clip3( h->mb.cache.mv[0][i8][0], h->mb.mv_min[0], h->mb.mv_max[0] ) + 4*4*x;
     int mvy   = x264_clip3( h->mb.cache.mv[0][i8][1], h->mb.mv_min[1], h->mb.mv_max[1] ) + 4*4*y;
 
+    x264_mb_hpel_check_mv( h, 0, i_ref, 0, 4*height, mvx, mvy );
     MC_LUMA( 0, 0 );
 
     if( CHROMA444 )
@@ -81,6 +82,7 @@ static NOINLINE void x264_mb_mc_1xywh( x264_t *h, int x, int y, int width, int h
     int mvx   = x264_clip3( h->mb.cache.mv[1][i8][0], h->mb.mv_min[0], h->mb.mv_max[0] ) + 4*4*x;
     int mvy   = x264_clip3( h->mb.cache.mv[1][i8][1], h->mb.mv_min[1], h->mb.mv_max[1] ) + 4*4*y;
 
+    x264_mb_hpel_check_mv( h, 1, i_ref, 0, 4*height, mvx, mvy );
     MC_LUMA( 1, 0 );
 
     if( CHROMA444 )
@@ -126,6 +128,8 @@ static NOINLINE void x264_mb_mc_01xywh( x264_t *h, int x, int y, int width, int
     ALIGNED_ARRAY_16( pixel, tmp1,[16*16] );
     pixel *src0, *src1;
 
+    x264_mb_hpel_check_mv( h, 0, i_ref0, 0, 4*height, mvx0, mvy0 );
+    x264_mb_hpel_check_mv( h, 1, i_ref1, 0, 4*height, mvx1, mvy1 );
     MC_LUMA_BI( 0 );
 
     if( CHROMA444 )
@@ -387,7 +391,8 @@ int x264_macroblock_thread_allocate( x264_t *h, int b_lookahead )
     int scratch_size = 0;
     if( !b_lookahead )
     {
-        int buf_hpel = (h->thread[0]->fdec->i_width[0]+48) * sizeof(int16_t);
+        /* +32 for the 32-pixel steps of the AVX2 hpel loops */
+        int buf_hpel = (h->thread[0]->fdec->i_width[0]+48+32) * sizeof(int16_t);
         int buf_ssim = h->param.analyse.b_ssim * 8 * (h->param.i_width/4+3) * sizeof(int);
         int me_range = X264_MIN(h->param.analyse.i_me_range, h->param.analyse.i_mv_range);
         int buf_tesa = (h->param.analyse.i_me_method >= X264_ME_ESA) *
@@ -1629,6 +1634,154 @@ void x264_macroblock_deblock_strength( x264_t *h )
         x264_macroblock_deblock_strength_mbaff( h, bs );
 }
 
+/* Without MBAFF, the strengths of a whole macroblock row are computed at once, from the
+ * frame arrays, right before the row is deblocked.  This gives the same result as
+ * x264_macroblock_deblock_strength after each macroblock: neighbours the encoder did not
+ * see are loaded as the slice edge reload above does, and unavailable ones get the same
+ * fill values as in x264_macroblock_cache_load. */
+void x264_macroblock_deblock_strength_row( x264_t *h, int mb_y )
+{
+    ALIGNED_ARRAY_16( uint8_t, nnz_cache,[X264_SCAN8_SIZE] );
+    ALIGNED_ARRAY_16( int8_t, ref_cache,[2],[X264_SCAN8_LUMA_SIZE] );
+    ALIGNED_ARRAY_16( int16_t, mv_cache,[2],[X264_SCAN8_LUMA_SIZE][2] );
+    uint8_t (*nnz)[48] = h->mb.non_zero_count;
+    int deblock_on_slice_edges = h->sh.i_disable_deblocking_filter_idc != 2;
+    int bframe = h->sh.i_type == SLICE_TYPE_B;
+    int ref_dupes = h->param.analyse.i_weighted_pred == X264_WEIGHTP_SMART && h->sh.i_type == SLICE_TYPE_P;
+    int cavlc_8x8 = !h->param.b_cabac && h->pps->b_transform_8x8_mode;
+    int cbp_mask = 0xf >> CHROMA_V_SHIFT;
+    int s8x8 = h->mb.i_b8_stride;
+    int s4x4 = h->mb.i_b4_stride;
+
+    for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
+    {
+        int mb_xy = mb_y * h->mb.i_mb_stride + mb_x;
+        int top_xy = mb_xy - h->mb.i_mb_stride;
+        int left_xy = mb_xy - 1;
+        uint8_t (*bs)[8][4] = h->deblock_strength[mb_y&1][h->param.b_sliced_threads?mb_xy:mb_x];
+
+        if( IS_INTRA( h->mb.type[mb_xy] ) )
+        {
+            memset( bs[0][1], 3, 3*4*sizeof(uint8_t) );
+            memset( bs[1][1], 3, 3*4*sizeof(uint8_t) );
+            continue;
+        }
+
+        /* Early termination: in this case, nnz guarantees all edges use strength 2.*/
+        int transform_8x8 = h->mb.mb_transform_size[mb_xy];
+        if( transform_8x8 && !CHROMA444 && (h->mb.cbp[mb_xy]&cbp_mask) == cbp_mask )
+        {
+            M32( bs[0][0] ) = 0x02020202;
+            M32( bs[0][2] ) = 0x02020202;
+            M32( bs[0][4] ) = 0x02020202;
+            memset( bs[1][0], 2, 5*4*sizeof(uint8_t) ); /* [1][1] and [1][3] has to be set for 4:2:2 */
+            continue;
+        }
+
+        int b_top  = mb_y > 0 && (deblock_on_slice_edges || h->mb.slice_table[top_xy]  == h->mb.slice_table[mb_xy]);
+        int b_left = mb_x > 0 && (deblock_on_slice_edges || h->mb.slice_table[left_xy] == h->mb.slice_table[mb_xy]);
+        int i_b8 = 2*(mb_y * s8x8 + mb_x);
+        int i_b4 = 4*(mb_y * s4x4 + mb_x);
+
+        CP32( &nnz_cache[X264_SCAN8_0+0*8], &nnz[mb_xy][ 0] );
+        CP32( &nnz_cache[X264_SCAN8_0+1*8], &nnz[mb_xy][ 4] );
+        CP32( &nnz_cache[X264_SCAN8_0+2*8], &nnz[mb_xy][ 8] );
+        CP32( &nnz_cache[X264_SCAN8_0+3*8], &nnz[mb_xy][12] );
+        if( b_top )
+            CP32( &nnz_cache[X264_SCAN8_0-8], &nnz[top_xy][12] );
+        else
+            M32( &nnz_cache[X264_SCAN8_0-8] ) = 0x80808080U;
+        for( int i = 0; i < 4; i++ )
+            nnz_cache[X264_SCAN8_0-1+8*i] = b_left ? nnz[left_xy][3+4*i] : 0x80;
+
+        for( int l = 0; l <= bframe; l++ )
+        {
+            int16_t (*mv)[2] = h->mb.mv[l];
+            int8_t *ref = h->mb.ref[l];
+            int8_t *refc = ref_cache[l];
+
+            for( int i = 0; i < 4; i++ )
+            {
+                M16( &refc[X264_SCAN8_0+8*i+0] ) = (uint8_t)ref[i_b8 + (i>>1)*s8x8 + 0] * 0x0101;
+                M16( &refc[X264_SCAN8_0+8*i+2] ) = (uint8_t)ref[i_b8 + (i>>1)*s8x8 + 1] * 0x0101;
+                CP128( mv_cache[l][X264_SCAN8_0+8*i], mv[i_b4 + i*s4x4] );
+            }
+            if( b_top )
+            {
+                int top_8x8 = i_b8 - s8x8;
+                M16( &refc[X264_SCAN8_0-8+0] ) = (uint8_t)ref[top_8x8 + 0] * 0x0101;
+                M16( &refc[X264_SCAN8_0-8+2] ) = (uint8_t)ref[top_8x8 + 1] * 0x0101;
+                CP128( mv_cache[l][X264_SCAN8_0-8], mv[i_b4 - s4x4] );
+            }
+            else
+            {
+                M32( &refc[X264_SCAN8_0-8] ) = (uint8_t)(-2) * 0x01010101U;
+                M128( mv_cache[l][X264_SCAN8_0-8] ) = M128_ZERO;
+            }
+            for( int i = 0; i < 4; i++ )
+            {
+                refc[X264_SCAN8_0-1+8*i] = b_left ? ref[i_b8 - 1 + (i>>1)*s8x8] : -2;
+                if( b_left )
+                    CP32( mv_cache[l][X264_SCAN8_0-1+8*i], mv[i_b4 - 1 + i*s4x4] );
+                else
+                    M32( mv_cache[l][X264_SCAN8_0-1+8*i] ) = 0;
+            }
+        }
+
+        if( ref_dupes )
+        {
+            /* Handle reference frame duplicates */
+            int8_t *refc = ref_cache[0];
+            for( int i = 0; i < 4; i++ )
+            {
+                refc[X264_SCAN8_0-8+i] = deblock_ref_table( refc[X264_SCAN8_0-8+i] );
+                refc[X264_SCAN8_0-1+8*i] = deblock_ref_table( refc[X264_SCAN8_0-1+8*i] );
+                for( int j = 0; j < 4; j++ )
+                    refc[X264_SCAN8_0+8*i+j] = deblock_ref_table( refc[X264_SCAN8_0+8*i+j] );
+            }
+        }
+
+        /* Munge NNZ for cavlc + 8x8dct */
+        if( cavlc_8x8 )
+        {
+            if( b_top && h->mb.mb_transform_size[top_xy] )
+            {
+                int nnz_top0 = M16( &nnz[top_xy][8] ) | M16( &nnz[top_xy][12] );
+                int nnz_top1 = M16( &nnz[top_xy][10] ) | M16( &nnz[top_xy][14] );
+                M16( &nnz_cache[X264_SCAN8_0-8+0] ) = nnz_top0 ? 0x0101 : 0;
+                M16( &nnz_cache[X264_SCAN8_0-8+2] ) = nnz_top1 ? 0x0101 : 0;
+            }
+
+            if( b_left && h->mb.mb_transform_size[left_xy] )
+            {
+                int nnz_left0 = M16( &nnz[left_xy][2] ) | M16( &nnz[left_xy][6] );
+                int nnz_left1 = M16( &nnz[left_xy][10] ) | M16( &nnz[left_xy][14] );
+                nnz_cache[X264_SCAN8_0-1+8*0] =
+                nnz_cache[X264_SCAN8_0-1+8*1] = !!nnz_left0;
+                nnz_cache[X264_SCAN8_0-1+8*2] =
+                nnz_cache[X264_SCAN8_0-1+8*3] = !!nnz_left1;
+            }
+
+            if( transform_8x8 )
+            {
+                int nnz0 = M16( &nnz[mb_xy][ 0] ) | M16( &nnz[mb_xy][ 4] );
+                int nnz1 = M16( &nnz[mb_xy][ 2] ) | M16( &nnz[mb_xy][ 6] );
+                int nnz2 = M16( &nnz[mb_xy][ 8] ) | M16( &nnz[mb_xy][12] );
+                int nnz3 = M16( &nnz[mb_xy][10] ) | M16( &nnz[mb_xy][14] );
+                uint32_t nnztop = pack16to32( !!nnz0, !!nnz1 ) * 0x0101;
+                uint32_t nnzbot = pack16to32( !!nnz2, !!nnz3 ) * 0x0101;
+
+                M32( &nnz_cache[X264_SCAN8_0+8*0] ) = nnztop;
+                M32( &nnz_cache[X264_SCAN8_0+8*1] ) = nnztop;
+                M32( &nnz_cache[X264_SCAN8_0+8*2] ) = nnzbot;
+                M32( &nnz_cache[X264_SCAN8_0+8*3] ) = nnzbot;
+            }
+        }
+
+        h->loopf.deblock_strength( nnz_cache, ref_cache, mv_cache, bs, 4, bframe );
+    }
+}
+
 static void ALWAYS_INLINE x264_macroblock_store_pic( x264_t *h, int mb_x, int mb_y, int i, int b_chroma, int b_mbaff )
 {
     int height = b_chroma ? 16>>CHROMA_V_SHIFT : 16;
@@ -311,6 +311,7 @@ void x264_macroblock_thread_init( x264_t *h );
 void x264_macroblock_cache_load_progressive( x264_t *h, int mb_x, int mb_y );
 void x264_macroblock_cache_load_interlaced( x264_t *h, int mb_x, int mb_y );
 void x264_macroblock_deblock_strength( x264_t *h );
+void x264_macroblock_deblock_strength_row( x264_t *h, int mb_y );
 void x264_macroblock_cache_save( x264_t *h );
 
 void x264_macroblock_bipred_init( x264_t *h );
@@ -440,5 +441,36 @@ static ALWAYS_INLINE int x264_mb_transform_8x8_allowed( x264_t *h )
     return M32( h->mb.i_sub_partition ) == D_L0_8x8*0x01010101;
 }
 
+/* x264_mb_hpel_check:
+ *      with --lazy-hpel, filter the half-pel planes of ref where they will be
+ *      read by motion compensation of a block of height bh at row y of the
+ *      current mb, with vertical mvs in [mvy_min,mvy_max].  The last row is
+ *      clipped to the mv range of the mb row, so that with frame threads only
+ *      reconstructed rows of the reference are ever filtered. */
+static ALWAYS_INLINE void x264_mb_hpel_check( x264_t *h, x264_frame_t *ref, int y, int bh, int mvy_min, int mvy_max )
+{
+    int pix_y = 16*h->mb.i_mb_y;
+    int y0 = pix_y + y + (mvy_min >> 2);
+    int y1 = pix_y + X264_MIN( y + bh - 1 + ((mvy_max+2) >> 2), 15 + ((h->mb.mv_max_spel[1]+2) >> 2) );
+    /* mb row i covers half-pel rows [16*i-8,16*i+8) */
+    int mb_start = x264_clip3( (y0+8) >> 4, 0, h->mb.i_mb_height-1 );
+    int mb_end   = x264_clip3( (y1+8) >> 4, 0, h->mb.i_mb_height-1 );
+    for( int i = mb_start; i <= mb_end; i++ )
+        if( !ref->hpel_done[i] )
+        {
+            x264_frame_filter_lazy( h, ref, mb_start, mb_end );
+            return;
+        }
+    x264_read_barrier();
+}
+
+/* the same for the mv of a block predicted from h->fref[i_list][i_ref],
+ * fullpel mvs don't read the half-pel planes */
+static ALWAYS_INLINE void x264_mb_hpel_check_mv( x264_t *h, int i_list, int i_ref, int y, int bh, int mvx, int mvy )
+{
+    if( h->param.analyse.b_lazy_hpel && ((mvx|mvy)&3) )
+        x264_mb_hpel_check( h, h->fref[i_list][i_ref], y, bh, mvy, mvy );
+}
+
 #endif
 
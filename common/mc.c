@@ -402,7 +402,7 @@ static void integral_init8v( uint16_t *sum8, intptr_t stride )
         sum8[x] = sum8[x+8*stride] - sum8[x];
 }
 
-void x264_frame_init_lowres( x264_t *h, x264_frame_t *frame )
+void x264_frame_init_lowres_prepare( x264_t *h, x264_frame_t *frame )
 {
     pixel *src = frame->plane[0];
     int i_stride = frame->i_stride[0];
@@ -413,9 +413,6 @@ void x264_frame_init_lowres( x264_t *h, x264_frame_t *frame )
     for( int y = 0; y < i_height; y++ )
         src[i_width+y*i_stride] = src[i_width-1+y*i_stride];
     memcpy( src+i_stride*i_height, src+i_stride*(i_height-1), (i_width+1) * sizeof(pixel) );
-    h->mc.frame_init_lowres_core( src, frame->lowres[0], frame->lowres[1], frame->lowres[2], frame->lowres[3],
-                                  i_stride, frame->i_stride_lowres, frame->i_width_lowres, frame->i_lines_lowres );
-    x264_frame_expand_border_lowres( frame );
 
     memset( frame->i_cost_est, -1, sizeof(frame->i_cost_est) );
 
@@ -428,6 +425,41 @@ void x264_frame_init_lowres( x264_t *h, x264_frame_t *frame )
             frame->lowres_mvs[y][x][0][0] = 0x7FFF;
 }
 
+/* Downscales lowres rows [y, y+height); rows of the same frame can be done in parallel. */
+void x264_frame_init_lowres_rows( x264_t *h, x264_frame_t *frame, int y, int height )
+{
+    int i_stride = frame->i_stride[0];
+    int i_stride_lowres = frame->i_stride_lowres;
+    h->mc.frame_init_lowres_core( frame->plane[0] + 2*y*i_stride,
+                                  frame->lowres[0] + y*i_stride_lowres, frame->lowres[1] + y*i_stride_lowres,
+                                  frame->lowres[2] + y*i_stride_lowres, frame->lowres[3] + y*i_stride_lowres,
+                                  i_stride, i_stride_lowres, frame->i_width_lowres, height );
+    x264_frame_expand_border_lowres( frame, y, height );
+}
+
+/* Builds the coarser lookahead levels; needs the whole lowres plane. */
+void x264_frame_init_lowres_pyramid( x264_t *h, x264_frame_t *frame )
+{
+    pixel *src = frame->lowres[0];
+    int i_stride = frame->i_stride_lowres;
+    for( int i = 0; i < h->param.rc.i_lookahead_pyramid; i++ )
+    {
+        pixel **dst = frame->pyramid[i];
+        h->mc.frame_init_lowres_core( src, dst[0], dst[1], dst[2], dst[3], i_stride, frame->i_stride_pyramid[i],
+                                      frame->i_width_pyramid[i], frame->i_lines_pyramid[i] );
+        x264_frame_expand_border_pyramid( frame, i );
+        src = dst[0];
+        i_stride = frame->i_stride_pyramid[i];
+    }
+}
+
+void x264_frame_init_lowres( x264_t *h, x264_frame_t *frame )
+{
+    x264_frame_init_lowres_prepare( h, frame );
+    x264_frame_init_lowres_rows( h, frame, 0, frame->i_lines_lowres );
+    x264_frame_init_lowres_pyramid( h, frame );
+}
+
 static void frame_init_lowres_core( pixel *src0, pixel *dst0, pixel *dsth, pixel *dstv, pixel *dstc,
                                     intptr_t src_stride, intptr_t dst_stride, int width, int height )
 {
@@ -469,6 +501,81 @@ static void mbtree_propagate_cost( int *dst, uint16_t *propagate_in, uint16_t *i
     }
 }
 
+static void mbtree_propagate_list( x264_t *h, uint16_t *ref_costs, int16_t (*mvs)[2],
+                                   int *propagate_amount, uint16_t *lowres_costs,
+                                   int bipred_weight, int mb_y, int len, int list )
+{
+    unsigned stride = h->mb.i_mb_stride;
+    unsigned width = h->mb.i_mb_width;
+    unsigned height = h->mb.i_mb_height;
+
+    for( unsigned i = 0; i < len; i++ )
+    {
+        int lists_used = lowres_costs[i]>>LOWRES_COST_SHIFT;
+
+        /* Don't propagate for an intra block. */
+        if( !(lists_used & (1 << list)) || propagate_amount[i] <= 0 )
+            continue;
+
+        int listamount = propagate_amount[i];
+        /* Apply bipred weighting. */
+        if( lists_used == 3 )
+            listamount = (listamount * bipred_weight + 32) >> 6;
+
+        /* Early termination for simple case of mv0. */
+        if( !M32( mvs[i] ) )
+        {
+            MC_CLIP_ADD( ref_costs[mb_y*stride + i], listamount );
+            continue;
+        }
+
+        int x = mvs[i][0];
+        int y = mvs[i][1];
+        /* Negative positions wrap around and fail the bounds checks. */
+        unsigned mbx = (x>>5)+i;
+        unsigned mby = (y>>5)+mb_y;
+        unsigned idx0 = mbx + mby * stride;
+        unsigned idx2 = idx0 + stride;
+        x &= 31;
+        y &= 31;
+        int idx0weight = (32-y)*(32-x);
+        int idx1weight = (32-y)*x;
+        int idx2weight = y*(32-x);
+        int idx3weight = y*x;
+        idx0weight = (idx0weight * listamount + 512) >> 10;
+        idx1weight = (idx1weight * listamount + 512) >> 10;
+        idx2weight = (idx2weight * listamount + 512) >> 10;
+        idx3weight = (idx3weight * listamount + 512) >> 10;
+
+        /* We could just clip the MVs, but pixels that lie outside the frame probably shouldn't
+         * be counted. */
+        if( mbx < width-1 && mby < height-1 )
+        {
+            MC_CLIP_ADD( ref_costs[idx0+0], idx0weight );
+            MC_CLIP_ADD( ref_costs[idx0+1], idx1weight );
+            MC_CLIP_ADD( ref_costs[idx2+0], idx2weight );
+            MC_CLIP_ADD( ref_costs[idx2+1], idx3weight );
+        }
+        else /* Check offsets individually */
+        {
+            if( mby < height )
+            {
+                if( mbx < width )
+                    MC_CLIP_ADD( ref_costs[idx0+0], idx0weight );
+                if( mbx+1 < width )
+                    MC_CLIP_ADD( ref_costs[idx0+1], idx1weight );
+            }
+            if( mby+1 < height )
+            {
+                if( mbx < width )
+                    MC_CLIP_ADD( ref_costs[idx2+0], idx2weight );
+                if( mbx+1 < width )
+                    MC_CLIP_ADD( ref_costs[idx2+1], idx3weight );
+            }
+        }
+    }
+}
+
 void x264_mc_init( int cpu, x264_mc_functions_t *pf )
 {
     pf->mc_luma   = mc_luma;
@@ -523,6 +630,7 @@ void x264_mc_init( int cpu, x264_mc_functions_t *pf )
     pf->integral_init8v = integral_init8v;
 
     pf->mbtree_propagate_cost = mbtree_propagate_cost;
+    pf->mbtree_propagate_list = mbtree_propagate_list;
 
 #if HAVE_MMX
     x264_mc_init_mmx( cpu, pf );
@@ -536,22 +644,40 @@ void x264_mc_init( int cpu, x264_mc_functions_t *pf )
 #endif
 }
 
-void x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
+/* rows of half-pel planes filtered before their borders are expanded */
+#define HPEL_STRIP_HEIGHT 4
+
+static void frame_filter_hpel( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
 {
     const int b_interlaced = PARAM_INTERLACED;
     int start = mb_y*16 - 8; // buffer = 4 for deblock + 3 for 6tap, rounded to 8
     int height = (b_end ? frame->i_lines[0] + 16*PARAM_INTERLACED : (mb_y+b_interlaced)*16) + 8;
 
-    if( mb_y & b_interlaced )
-        return;
-
     for( int p = 0; p < (CHROMA444 ? 3 : 1); p++ )
     {
         int stride = frame->i_stride[p];
         const int width = frame->i_width[p];
         int offs = start*stride - 8; // buffer = 3 for 6tap, aligned to 8 for simd
 
-        if( !b_interlaced || h->mb.b_adaptive_mbaff )
+        if( !b_interlaced )
+        {
+            /* Expand the borders of each strip right after filtering it, while the
+             * ends of its rows are still in cache, instead of in a separate pass. */
+            for( int y = start; y < height; y += HPEL_STRIP_HEIGHT )
+            {
+                int rows = X264_MIN( HPEL_STRIP_HEIGHT, height - y );
+                int offs_y = y*stride - 8;
+                h->mc.hpel_filter(
+                    frame->filtered[p][1] + offs_y,
+                    frame->filtered[p][2] + offs_y,
+                    frame->filtered[p][3] + offs_y,
+                    frame->plane[p] + offs_y,
+                    stride, width + 16, rows,
+                    h->scratch_buffer );
+                x264_frame_expand_border_filtered_rows( h, frame, p, y, rows, !mb_y && y == start, b_end && y + rows == height );
+            }
+        }
+        else if( h->mb.b_adaptive_mbaff )
             h->mc.hpel_filter(
                 frame->filtered[p][1] + offs,
                 frame->filtered[p][2] + offs,
@@ -579,6 +705,20 @@ void x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
             }
         }
     }
+}
+
+void x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
+{
+    const int b_interlaced = PARAM_INTERLACED;
+    int start = mb_y*16 - 8;
+    int height = (b_end ? frame->i_lines[0] + 16*PARAM_INTERLACED : (mb_y+b_interlaced)*16) + 8;
+
+    if( mb_y & b_interlaced )
+        return;
+
+    /* with --lazy-hpel, the references filter their half-pel planes on first use */
+    if( !frame->hpel_done )
+        frame_filter_hpel( h, frame, mb_y, b_end );
 
     /* generate integral image:
      * frame->integral contains 2 planes. in the upper plane, each element is
@@ -617,3 +757,21 @@ void x264_frame_filter( x264_t *h, x264_frame_t *frame, int mb_y, int b_end )
         }
     }
 }
+
+/* Filter the half-pel planes of mb rows [mb_start,mb_end] of a reference that
+ * haven't been filtered yet.  Each row is filtered as x264_frame_filter would
+ * have done it while the reference was encoded, so the output is unchanged. */
+void x264_frame_filter_lazy( x264_t *h, x264_frame_t *frame, int mb_start, int mb_end )
+{
+    x264_pthread_mutex_lock( &frame->mutex );
+    for( int mb_y = mb_start; mb_y <= mb_end; mb_y++ )
+        if( !frame->hpel_done[mb_y] )
+        {
+            frame_filter_hpel( h, frame, mb_y, mb_y == h->mb.i_mb_height - 1 );
+            /* the planes must be visible before the flag */
+            x264_memory_barrier();
+            frame->hpel_done[mb_y] = 1;
+            h->stat.frame.i_hpel_rows++;
+        }
+    x264_pthread_mutex_unlock( &frame->mutex );
+}
@@ -95,6 +95,11 @@ typedef struct
                                          pixel *dstc, intptr_t i_dstc, pixel *src,  intptr_t i_src, int pw, int w, int h );
     void (*hpel_filter)( pixel *dsth, pixel *dstv, pixel *dstc, pixel *src,
                          intptr_t i_stride, int i_width, int i_height, int16_t *buf );
+    /* hpel_filter that also expands the left and right borders of each row it
+     * filters: dst[4] is replicated over the pad pixels before it and dst[width-5]
+     * over the pad pixels after it, pad >= 16; NULL where there is no such version */
+    void (*hpel_filter_pad)( pixel *dsth, pixel *dstv, pixel *dstc, pixel *src,
+                             intptr_t i_stride, int i_width, int i_height, int16_t *buf, int pad );
 
     /* prefetch the next few macroblocks of fenc or fdec */
     void (*prefetch_fenc)    ( pixel *pix_y, intptr_t stride_y, pixel *pix_uv, intptr_t stride_uv, int mb_x );
@@ -121,8 +126,15 @@ typedef struct
 
     void (*mbtree_propagate_cost)( int *dst, uint16_t *propagate_in, uint16_t *intra_costs,
                                    uint16_t *inter_costs, uint16_t *inv_qscales, float *fps_factor, int len );
+    /* Follows the list's lowres MVs of a row of macroblocks, adding their propagate amounts
+     * to the (up to four) macroblocks of ref_costs that each reference block overlaps. */
+    void (*mbtree_propagate_list)( x264_t *h, uint16_t *ref_costs, int16_t (*mvs)[2],
+                                   int *propagate_amount, uint16_t *lowres_costs,
+                                   int bipred_weight, int mb_y, int len, int list );
 } x264_mc_functions_t;
 
+#define MC_CLIP_ADD(s,x) (s) = X264_MIN((s)+(x),(1<<16)-1)
+
 void x264_mc_init( int cpu, x264_mc_functions_t *pf );
 
 #endif
@@ -74,6 +74,14 @@
 #endif
 #endif
 
+#ifdef __MINGW32__
+#define x264_fseek fseeko64
+#elif defined(_WIN32)
+#define x264_fseek _fseeki64
+#else
+#define x264_fseek fseeko
+#endif
+
 #ifdef __ICL
 #define DECLARE_ALIGNED( var, n ) __declspec(align(n)) var
 #else
@@ -165,6 +173,7 @@ static inline int x264_pthread_create( x264_pthread_t *t, void *a, void *(*f)(vo
 #define x264_pthread_cond_init       pthread_cond_init
 #define x264_pthread_cond_destroy    pthread_cond_destroy
 #define x264_pthread_cond_broadcast  pthread_cond_broadcast
+#define x264_pthread_cond_signal     pthread_cond_signal
 #define x264_pthread_cond_wait       pthread_cond_wait
 #define x264_pthread_attr_t          pthread_attr_t
 #define x264_pthread_attr_init       pthread_attr_init
@@ -191,6 +200,7 @@ static inline int x264_pthread_create( x264_pthread_t *t, void *a, void *(*f)(vo
 #define x264_pthread_cond_init(c,f)  0
 #define x264_pthread_cond_destroy(c)
 #define x264_pthread_cond_broadcast(c)
+#define x264_pthread_cond_signal(c)
 #define x264_pthread_cond_wait(c,m)
 #define x264_pthread_attr_t          int
 #define x264_pthread_attr_init(a)    0
@@ -198,6 +208,29 @@ static inline int x264_pthread_create( x264_pthread_t *t, void *a, void *(*f)(vo
 #define X264_PTHREAD_MUTEX_INITIALIZER 0
 #endif
 
+/* atomics: full-barrier read-modify-write on aligned 32-bit ints */
+#if defined(__GNUC__) || defined(__INTEL_COMPILER)
+#define x264_atomic_fetch_add(p,v)   __sync_fetch_and_add( p, v )
+#define x264_atomic_cas(p,o,n)       __sync_bool_compare_and_swap( p, o, n )
+#define x264_memory_barrier()        __sync_synchronize()
+#if ARCH_X86 || ARCH_X86_64
+/* x86 doesn't reorder loads with other loads */
+#define x264_read_barrier()          asm volatile( "" ::: "memory" )
+#else
+#define x264_read_barrier()          __sync_synchronize()
+#endif
+#elif HAVE_WIN32THREAD
+#define x264_atomic_fetch_add(p,v)   InterlockedExchangeAdd( (volatile LONG*)(p), v )
+#define x264_atomic_cas(p,o,n)       (InterlockedCompareExchange( (volatile LONG*)(p), n, o ) == (o))
+#define x264_memory_barrier()        MemoryBarrier()
+#define x264_read_barrier()          MemoryBarrier()
+#elif !HAVE_THREAD
+#define x264_atomic_fetch_add(p,v)   ((*(p) += (v)) - (v))
+#define x264_atomic_cas(p,o,n)       (*(p) == (o) ? (*(p) = (n), 1) : 0)
+#define x264_memory_barrier()
+#define x264_read_barrier()
+#endif
+
 #if HAVE_WIN32THREAD || PTW32_STATIC_LIB
 int x264_threading_init( void );
 #else
@@ -484,11 +484,13 @@ static void x264_pixel_satd_x4_##size##cpu( pixel *fenc, pixel *pix0, pixel *pix
     scores[2] = x264_pixel_satd_##size##cpu( fenc, FENC_STRIDE, pix2, i_stride );\
     scores[3] = x264_pixel_satd_##size##cpu( fenc, FENC_STRIDE, pix3, i_stride );\
 }
-#define SATD_X_DECL6( cpu )\
+#define SATD_X_DECL4( cpu )\
 SATD_X( 16x16, cpu )\
 SATD_X( 16x8, cpu )\
 SATD_X( 8x16, cpu )\
-SATD_X( 8x8, cpu )\
+SATD_X( 8x8, cpu )
+#define SATD_X_DECL6( cpu )\
+SATD_X_DECL4( cpu )\
 SATD_X( 8x4, cpu )\
 SATD_X( 4x8, cpu )
 #define SATD_X_DECL7( cpu )\
@@ -504,6 +506,7 @@ SATD_X_DECL7( _ssse3 )
 SATD_X_DECL7( _sse4 )
 SATD_X_DECL7( _avx )
 SATD_X_DECL7( _xop )
+SATD_X_DECL4( _avx2 )
 #endif // !HIGH_BIT_DEPTH
 #endif
 
@@ -1221,6 +1224,30 @@ void x264_pixel_init( int cpu, x264_pixel_function_t *pixf )
         pixf->var2[PIXEL_8x8] = x264_pixel_var2_8x8_xop;
         pixf->var2[PIXEL_8x16] = x264_pixel_var2_8x16_xop;
     }
+
+    if( cpu&X264_CPU_AVX2 )
+    {
+        INIT2( sad, _avx2 );
+        INIT2( sad_x3, _avx2 );
+        INIT2( sad_x4, _avx2 );
+        INIT4( satd, _avx2 );
+        INIT4( satd_x3, _avx2 );
+        INIT4( satd_x4, _avx2 );
+#if ARCH_X86_64
+        INIT2( hadamard_ac, _avx2 );
+#endif
+        pixf->sa8d[PIXEL_16x16]= x264_pixel_sa8d_16x16_avx2;
+        pixf->sa8d[PIXEL_8x8]  = x264_pixel_sa8d_8x8_avx2;
+        pixf->var[PIXEL_16x16] = x264_pixel_var_16x16_avx2;
+    }
+
+#if HAVE_AVX512
+    if( cpu&X264_CPU_AVX512 )
+    {
+        INIT2( sad_x3, _avx512 );
+        INIT2( sad_x4, _avx512 );
+    }
+#endif
 #endif //HAVE_MMX
 
 #if HAVE_ARMV6
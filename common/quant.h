@@ -33,6 +33,8 @@ typedef struct
     int (*quant_4x4)( dctcoef dct[16], udctcoef mf[16], udctcoef bias[16] );
     int (*quant_4x4_dc)( dctcoef dct[16], int mf, int bias );
     int (*quant_2x2_dc)( dctcoef dct[4], int mf, int bias );
+    /* quantizes four 4x4 blocks sharing mf/bias; returns a mask with bit i set if block i is nonzero */
+    int (*quant_4x4x4)( dctcoef dct[4][16], udctcoef mf[16], udctcoef bias[16] );
 
     void (*dequant_8x8)( dctcoef dct[64], int dequant_mf[6][64], int i_qp );
     void (*dequant_4x4)( dctcoef dct[16], int dequant_mf[6][16], int i_qp );
@@ -70,4 +72,12 @@ typedef struct
 
 void x264_quant_init( x264_t *h, int cpu, x264_quant_function_t *pf );
 
+/* C trellis, implemented in encoder/rdo.c next to the cabac tables it uses. */
+int x264_trellis_cabac_4x4( TRELLIS_PARAMS, int b_ac );
+int x264_trellis_cabac_8x8( TRELLIS_PARAMS, int b_interlaced );
+int x264_trellis_cabac_4x4_psy( TRELLIS_PARAMS, int b_ac, dctcoef *fenc_dct, int psy_trellis );
+int x264_trellis_cabac_8x8_psy( TRELLIS_PARAMS, int b_interlaced, dctcoef *fenc_dct, int psy_trellis );
+int x264_trellis_cabac_dc( TRELLIS_PARAMS, int num_coefs );
+int x264_trellis_cabac_chroma_422_dc( TRELLIS_PARAMS );
+
 #endif
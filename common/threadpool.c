@@ -25,50 +25,178 @@
 
 #include "common.h"
 
+/* Work-stealing pool.
+ *
+ * Every worker owns a ring of queued jobs.  x264_threadpool_run distributes new
+ * jobs round-robin over the rings; a worker takes jobs from its own ring and,
+ * once that is empty, steals from the other rings.  The rings are bounded
+ * multi-producer/multi-consumer queues where each cell carries a sequence
+ * number, so both pushing and popping are a single CAS and never take a lock.
+ * The pool never holds more than pool->threads jobs at once, so every ring is
+ * sized to hold all of them.  Mutexes are only used to put idle workers and
+ * waiting callers to sleep. */
+
+enum
+{
+    JOB_FREE = 0,
+    JOB_RESERVED, /* claimed by x264_threadpool_run/wait, not yet queued/released */
+    JOB_QUEUED,
+    JOB_DONE,
+};
+
 typedef struct
 {
     void *(*func)(void *);
     void *arg;
     void *ret;
+    volatile int state;
 } x264_threadpool_job_t;
 
+typedef struct
+{
+    volatile unsigned seq;
+    x264_threadpool_job_t *job;
+} x264_threadpool_cell_t;
+
+typedef struct
+{
+    x264_threadpool_t *pool;
+    int             id;
+
+    x264_threadpool_cell_t *ring;
+    volatile unsigned head;
+    volatile unsigned tail;
+
+    /* statistics, only written by the owning thread */
+    int64_t         busy_time;
+    int64_t         idle_time;
+    int             jobs;
+    int             steals;
+} x264_threadpool_worker_t;
+
 struct x264_threadpool_t
 {
-    int            exit;
+    volatile int   exit;
     int            threads;
     x264_pthread_t *thread_handle;
     void           (*init_func)(void *);
     void           *init_arg;
 
-    /* requires a synchronized list structure and associated methods,
-       so use what is already implemented for frames */
-    x264_sync_frame_list_t uninit; /* list of jobs that are awaiting use */
-    x264_sync_frame_list_t run;    /* list of jobs that are queued for processing by the pool */
-    x264_sync_frame_list_t done;   /* list of jobs that have finished processing */
+    x264_threadpool_job_t    *jobs;
+    x264_threadpool_worker_t *workers;
+    unsigned       ring_mask;
+    volatile unsigned next_worker; /* round-robin target of the next queued job */
+
+    /* number of jobs sitting in the rings, used to decide whether to sleep */
+    volatile int   queued;
+
+    /* sleeping workers */
+    x264_pthread_mutex_t idle_mutex;
+    x264_pthread_cond_t  idle_cv;
+    volatile int   sleepers;
+
+    /* callers blocked in x264_threadpool_run (no free job) or x264_threadpool_wait */
+    x264_pthread_mutex_t done_mutex;
+    x264_pthread_cond_t  done_cv;
+    volatile int   waiters;
 };
 
-static void *x264_threadpool_thread( x264_threadpool_t *pool )
+static int x264_threadpool_ring_push( x264_threadpool_worker_t *w, x264_threadpool_job_t *job )
+{
+    while( 1 )
+    {
+        unsigned tail = w->tail;
+        x264_threadpool_cell_t *cell = &w->ring[tail & w->pool->ring_mask];
+        x264_memory_barrier();
+        int diff = (int)(cell->seq - tail);
+        if( diff < 0 )
+            return -1; /* full */
+        if( !diff && x264_atomic_cas( &w->tail, tail, tail+1 ) )
+        {
+            cell->job = job;
+            x264_memory_barrier();
+            cell->seq = tail + 1;
+            return 0;
+        }
+    }
+}
+
+static x264_threadpool_job_t *x264_threadpool_ring_take( x264_threadpool_worker_t *w )
 {
+    while( 1 )
+    {
+        unsigned head = w->head;
+        x264_threadpool_cell_t *cell = &w->ring[head & w->pool->ring_mask];
+        x264_memory_barrier();
+        int diff = (int)(cell->seq - (head + 1));
+        if( diff < 0 )
+            return NULL; /* empty */
+        if( !diff && x264_atomic_cas( &w->head, head, head+1 ) )
+        {
+            x264_threadpool_job_t *job = cell->job;
+            x264_memory_barrier();
+            cell->seq = head + w->pool->ring_mask + 1;
+            return job;
+        }
+    }
+}
+
+static x264_threadpool_job_t *x264_threadpool_find_job( x264_threadpool_worker_t *w )
+{
+    x264_threadpool_t *pool = w->pool;
+    x264_threadpool_job_t *job = x264_threadpool_ring_take( w );
+    for( int i = 1; !job && i < pool->threads; i++ )
+    {
+        job = x264_threadpool_ring_take( &pool->workers[(w->id + i) % pool->threads] );
+        w->steals += !!job;
+    }
+    if( job )
+        x264_atomic_fetch_add( &pool->queued, -1 );
+    return job;
+}
+
+static void x264_threadpool_wake_waiters( x264_threadpool_t *pool )
+{
+    x264_memory_barrier();
+    if( pool->waiters )
+    {
+        x264_pthread_mutex_lock( &pool->done_mutex );
+        x264_pthread_cond_broadcast( &pool->done_cv );
+        x264_pthread_mutex_unlock( &pool->done_mutex );
+    }
+}
+
+static void *x264_threadpool_thread( x264_threadpool_worker_t *w )
+{
+    x264_threadpool_t *pool = w->pool;
     if( pool->init_func )
         pool->init_func( pool->init_arg );
 
+    int64_t t = x264_mdate();
     while( !pool->exit )
     {
-        x264_threadpool_job_t *job = NULL;
-        x264_pthread_mutex_lock( &pool->run.mutex );
-        while( !pool->exit && !pool->run.i_size )
-            x264_pthread_cond_wait( &pool->run.cv_fill, &pool->run.mutex );
-        if( pool->run.i_size )
-        {
-            job = (void*)x264_frame_shift( pool->run.list );
-            pool->run.i_size--;
-        }
-        x264_pthread_mutex_unlock( &pool->run.mutex );
+        x264_threadpool_job_t *job = x264_threadpool_find_job( w );
         if( !job )
+        {
+            x264_pthread_mutex_lock( &pool->idle_mutex );
+            x264_atomic_fetch_add( &pool->sleepers, 1 );
+            while( !pool->exit && !pool->queued )
+                x264_pthread_cond_wait( &pool->idle_cv, &pool->idle_mutex );
+            x264_atomic_fetch_add( &pool->sleepers, -1 );
+            x264_pthread_mutex_unlock( &pool->idle_mutex );
             continue;
+        }
+        int64_t t_start = x264_mdate();
+        w->idle_time += t_start - t;
         job->ret = (void*)x264_stack_align( job->func, job->arg ); /* execute the function */
-        x264_sync_frame_list_push( &pool->done, (void*)job );
+        t = x264_mdate();
+        w->busy_time += t - t_start;
+        w->jobs++;
+        x264_memory_barrier();
+        job->state = JOB_DONE;
+        x264_threadpool_wake_waiters( pool );
     }
+    w->idle_time += x264_mdate() - t;
     return NULL;
 }
 
@@ -86,21 +214,32 @@ int x264_threadpool_init( x264_threadpool_t **p_pool, int threads,
     pool->init_arg  = init_arg;
     pool->threads   = threads;
 
-    CHECKED_MALLOC( pool->thread_handle, pool->threads * sizeof(x264_pthread_t) );
-
-    if( x264_sync_frame_list_init( &pool->uninit, pool->threads ) ||
-        x264_sync_frame_list_init( &pool->run, pool->threads ) ||
-        x264_sync_frame_list_init( &pool->done, pool->threads ) )
-        goto fail;
+    int ring_size = 1;
+    while( ring_size < pool->threads )
+        ring_size <<= 1;
+    pool->ring_mask = ring_size - 1;
 
+    CHECKED_MALLOC( pool->thread_handle, pool->threads * sizeof(x264_pthread_t) );
+    CHECKED_MALLOCZERO( pool->jobs, pool->threads * sizeof(x264_threadpool_job_t) );
+    CHECKED_MALLOCZERO( pool->workers, pool->threads * sizeof(x264_threadpool_worker_t) );
     for( int i = 0; i < pool->threads; i++ )
     {
-       x264_threadpool_job_t *job;
-       CHECKED_MALLOC( job, sizeof(x264_threadpool_job_t) );
-       x264_sync_frame_list_push( &pool->uninit, (void*)job );
+        x264_threadpool_worker_t *w = pool->workers+i;
+        w->pool = pool;
+        w->id   = i;
+        CHECKED_MALLOCZERO( w->ring, ring_size * sizeof(x264_threadpool_cell_t) );
+        for( int j = 0; j < ring_size; j++ )
+            w->ring[j].seq = j;
     }
+
+    if( x264_pthread_mutex_init( &pool->idle_mutex, NULL ) ||
+        x264_pthread_mutex_init( &pool->done_mutex, NULL ) ||
+        x264_pthread_cond_init( &pool->idle_cv, NULL ) ||
+        x264_pthread_cond_init( &pool->done_cv, NULL ) )
+        goto fail;
+
     for( int i = 0; i < pool->threads; i++ )
-        if( x264_pthread_create( pool->thread_handle+i, NULL, (void*)x264_threadpool_thread, pool ) )
+        if( x264_pthread_create( pool->thread_handle+i, NULL, (void*)x264_threadpool_thread, pool->workers+i ) )
             goto fail;
 
     return 0;
@@ -108,62 +247,97 @@ fail:
     return -1;
 }
 
+/* Claim a job slot in state 'from' (whose arg matches, if match_arg is set)
+ * by moving it to JOB_RESERVED.  Returns NULL without blocking if there is none. */
+static x264_threadpool_job_t *x264_threadpool_claim( x264_threadpool_t *pool, int from, int match_arg, void *arg )
+{
+    for( int i = 0; i < pool->threads; i++ )
+    {
+        x264_threadpool_job_t *job = pool->jobs + i;
+        if( job->state == from && (!match_arg || job->arg == arg) &&
+            x264_atomic_cas( &job->state, from, JOB_RESERVED ) )
+        {
+            /* the slot may have been recycled between the arg check and the CAS */
+            if( !match_arg || job->arg == arg )
+                return job;
+            job->state = from;
+        }
+    }
+    return NULL;
+}
+
+static x264_threadpool_job_t *x264_threadpool_claim_wait( x264_threadpool_t *pool, int from, int match_arg, void *arg )
+{
+    x264_threadpool_job_t *job = x264_threadpool_claim( pool, from, match_arg, arg );
+    if( job )
+        return job;
+    x264_pthread_mutex_lock( &pool->done_mutex );
+    x264_atomic_fetch_add( &pool->waiters, 1 );
+    while( !(job = x264_threadpool_claim( pool, from, match_arg, arg )) )
+        x264_pthread_cond_wait( &pool->done_cv, &pool->done_mutex );
+    x264_atomic_fetch_add( &pool->waiters, -1 );
+    x264_pthread_mutex_unlock( &pool->done_mutex );
+    return job;
+}
+
 void x264_threadpool_run( x264_threadpool_t *pool, void *(*func)(void *), void *arg )
 {
-    x264_threadpool_job_t *job = (void*)x264_sync_frame_list_pop( &pool->uninit );
+    x264_threadpool_job_t *job = x264_threadpool_claim_wait( pool, JOB_FREE, 0, NULL );
     job->func = func;
     job->arg  = arg;
-    x264_sync_frame_list_push( &pool->run, (void*)job );
-}
+    job->state = JOB_QUEUED;
 
-void *x264_threadpool_wait( x264_threadpool_t *pool, void *arg )
-{
-    x264_threadpool_job_t *job = NULL;
+    unsigned next = x264_atomic_fetch_add( &pool->next_worker, 1 );
+    while( x264_threadpool_ring_push( &pool->workers[next++ % pool->threads], job ) < 0 );
 
-    x264_pthread_mutex_lock( &pool->done.mutex );
-    while( !job )
+    x264_atomic_fetch_add( &pool->queued, 1 );
+    if( pool->sleepers )
     {
-        for( int i = 0; i < pool->done.i_size; i++ )
-        {
-            x264_threadpool_job_t *t = (void*)pool->done.list[i];
-            if( t->arg == arg )
-            {
-                job = (void*)x264_frame_shift( pool->done.list+i );
-                pool->done.i_size--;
-            }
-        }
-        if( !job )
-            x264_pthread_cond_wait( &pool->done.cv_fill, &pool->done.mutex );
+        x264_pthread_mutex_lock( &pool->idle_mutex );
+        x264_pthread_cond_signal( &pool->idle_cv );
+        x264_pthread_mutex_unlock( &pool->idle_mutex );
     }
-    x264_pthread_mutex_unlock( &pool->done.mutex );
+}
 
+void *x264_threadpool_wait( x264_threadpool_t *pool, void *arg )
+{
+    x264_threadpool_job_t *job = x264_threadpool_claim_wait( pool, JOB_DONE, 1, arg );
     void *ret = job->ret;
-    x264_sync_frame_list_push( &pool->uninit, (void*)job );
+    x264_memory_barrier();
+    job->state = JOB_FREE;
+    x264_threadpool_wake_waiters( pool );
     return ret;
 }
 
-static void x264_threadpool_list_delete( x264_sync_frame_list_t *slist )
+int x264_threadpool_stats( x264_threadpool_t *pool, x264_threadpool_stats_t *stats )
 {
-    for( int i = 0; slist->list[i]; i++ )
+    for( int i = 0; i < pool->threads; i++ )
     {
-        x264_free( slist->list[i] );
-        slist->list[i] = NULL;
+        stats[i].i_busy_time = pool->workers[i].busy_time;
+        stats[i].i_idle_time = pool->workers[i].idle_time;
+        stats[i].i_jobs      = pool->workers[i].jobs;
+        stats[i].i_steals    = pool->workers[i].steals;
     }
-    x264_sync_frame_list_delete( slist );
+    return pool->threads;
 }
 
 void x264_threadpool_delete( x264_threadpool_t *pool )
 {
-    x264_pthread_mutex_lock( &pool->run.mutex );
+    x264_pthread_mutex_lock( &pool->idle_mutex );
     pool->exit = 1;
-    x264_pthread_cond_broadcast( &pool->run.cv_fill );
-    x264_pthread_mutex_unlock( &pool->run.mutex );
+    x264_pthread_cond_broadcast( &pool->idle_cv );
+    x264_pthread_mutex_unlock( &pool->idle_mutex );
     for( int i = 0; i < pool->threads; i++ )
         x264_pthread_join( pool->thread_handle[i], NULL );
 
-    x264_threadpool_list_delete( &pool->uninit );
-    x264_threadpool_list_delete( &pool->run );
-    x264_threadpool_list_delete( &pool->done );
+    x264_pthread_mutex_destroy( &pool->idle_mutex );
+    x264_pthread_mutex_destroy( &pool->done_mutex );
+    x264_pthread_cond_destroy( &pool->idle_cv );
+    x264_pthread_cond_destroy( &pool->done_cv );
+    for( int i = 0; i < pool->threads; i++ )
+        x264_free( pool->workers[i].ring );
+    x264_free( pool->workers );
+    x264_free( pool->jobs );
     x264_free( pool->thread_handle );
     x264_free( pool );
 }
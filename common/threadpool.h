@@ -28,17 +28,28 @@
 
 typedef struct x264_threadpool_t x264_threadpool_t;
 
+typedef struct
+{
+    int64_t i_busy_time; /* microseconds spent running jobs */
+    int64_t i_idle_time; /* microseconds spent looking for or waiting on jobs */
+    int     i_jobs;
+    int     i_steals;    /* jobs taken from another worker's queue */
+} x264_threadpool_stats_t;
+
 #if HAVE_THREAD
 int   x264_threadpool_init( x264_threadpool_t **p_pool, int threads,
                             void (*init_func)(void *), void *init_arg );
 void  x264_threadpool_run( x264_threadpool_t *pool, void *(*func)(void *), void *arg );
 void *x264_threadpool_wait( x264_threadpool_t *pool, void *arg );
 void  x264_threadpool_delete( x264_threadpool_t *pool );
+/* fills one entry per worker, returns the number of workers */
+int   x264_threadpool_stats( x264_threadpool_t *pool, x264_threadpool_stats_t *stats );
 #else
 #define x264_threadpool_init(p,t,f,a) -1
 #define x264_threadpool_run(p,f,a)
 #define x264_threadpool_wait(p,a)     NULL
 #define x264_threadpool_delete(p)
+#define x264_threadpool_stats(p,s)    0
 #endif
 
 #endif
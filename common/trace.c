@@ -0,0 +1,215 @@
+/*****************************************************************************
+ * trace.c: per-stage timing trace
+ *****************************************************************************
+ * Copyright (C) 2013 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#include "common.h"
+#if SYS_WINDOWS
+#include <windows.h>
+#endif
+
+/* Events are written as they arrive in the Chrome trace "JSON array" format,
+ * which stays loadable when the closing bracket is missing, so a trace of a
+ * crashed or killed encode is still usable.  Events are emitted at row, frame
+ * and lookahead granularity; per-macroblock stages are summed per row by the
+ * caller, so taking the mutex per event is cheap. */
+
+#define X264_TRACE_MAX_THREADS 256
+
+typedef struct
+{
+    FILE   *fh;
+    int     i_refcount;
+    int     b_first_event;
+
+    /* tick -> microsecond conversion, recalibrated against x264_mdate at every event */
+    int64_t i_ticks0;
+    int64_t i_time0;
+    double  f_ticks_per_us;
+
+    /* small sequential ids for the threads seen so far */
+    uintptr_t thread_id[X264_TRACE_MAX_THREADS];
+    int     i_threads;
+
+    int64_t i_count[X264_TRACE_STAGES];
+    int64_t i_ticks[X264_TRACE_STAGES];
+    int64_t i_max_ticks[X264_TRACE_STAGES]; /* longest span, not tracked for macroblock stages */
+} x264_trace_t;
+
+static const char * const trace_stage_names[X264_TRACE_STAGES] =
+{
+    "analyse", "encode", "write", "ratecontrol_mb",
+    "filter_row", "slicetype", "ratecontrol", "input", "filter", "output"
+};
+
+static x264_pthread_mutex_t trace_mutex = X264_PTHREAD_MUTEX_INITIALIZER;
+static x264_trace_t *trace;
+
+static uintptr_t trace_thread_self( void )
+{
+#if SYS_WINDOWS
+    return GetCurrentThreadId();
+#elif HAVE_POSIXTHREAD
+    return (uintptr_t)pthread_self();
+#else
+    return 0;
+#endif
+}
+
+/* must be called with trace_mutex held */
+static int trace_thread_index( void )
+{
+    uintptr_t self = trace_thread_self();
+    for( int i = 0; i < trace->i_threads; i++ )
+        if( trace->thread_id[i] == self )
+            return i + 1;
+    if( trace->i_threads == X264_TRACE_MAX_THREADS )
+        return 0;
+    trace->thread_id[trace->i_threads++] = self;
+    return trace->i_threads;
+}
+
+/* must be called with trace_mutex held */
+static double trace_us( int64_t ticks )
+{
+    return ticks / trace->f_ticks_per_us;
+}
+
+static void trace_recalibrate( void )
+{
+    if( !HAVE_TRACE_TSC )
+        return;
+    int64_t ticks = x264_trace_ticks();
+    int64_t elapsed = x264_mdate() - trace->i_time0;
+    /* a millisecond keeps the error from the microsecond clock below 0.1% */
+    if( elapsed >= 1000 )
+        trace->f_ticks_per_us = (double)(ticks - trace->i_ticks0) / elapsed;
+}
+
+int x264_trace_open( const char *filename )
+{
+    int ret = 0;
+    x264_pthread_mutex_lock( &trace_mutex );
+    if( trace )
+        trace->i_refcount++;
+    else
+    {
+        trace = calloc( 1, sizeof(x264_trace_t) );
+        if( !trace || !(trace->fh = fopen( filename, "w" )) )
+        {
+            free( trace );
+            trace = NULL;
+            ret = -1;
+        }
+        else
+        {
+            trace->i_refcount = 1;
+            trace->b_first_event = 1;
+            trace->i_time0 = x264_mdate();
+            trace->i_ticks0 = x264_trace_ticks();
+            /* rough starting point until a millisecond has passed */
+            trace->f_ticks_per_us = HAVE_TRACE_TSC ? 2000.0 : 1.0;
+            fprintf( trace->fh, "[\n" );
+        }
+    }
+    x264_pthread_mutex_unlock( &trace_mutex );
+    return ret;
+}
+
+void x264_trace_close( void )
+{
+    x264_pthread_mutex_lock( &trace_mutex );
+    if( trace && !--trace->i_refcount )
+    {
+        fprintf( trace->fh, "\n]\n" );
+        fclose( trace->fh );
+        free( trace );
+        trace = NULL;
+    }
+    x264_pthread_mutex_unlock( &trace_mutex );
+}
+
+int x264_trace_is_open( void )
+{
+    return !!trace;
+}
+
+void x264_trace_span( int stage, int64_t start, int64_t end )
+{
+    x264_pthread_mutex_lock( &trace_mutex );
+    if( trace )
+    {
+        trace_recalibrate();
+        trace->i_count[stage]++;
+        trace->i_ticks[stage] += end - start;
+        trace->i_max_ticks[stage] = X264_MAX( trace->i_max_ticks[stage], end - start );
+        fprintf( trace->fh, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                 trace->b_first_event ? "" : ",\n", trace_stage_names[stage], trace_thread_index(),
+                 trace_us( start - trace->i_ticks0 ), trace_us( end - start ) );
+        trace->b_first_event = 0;
+    }
+    x264_pthread_mutex_unlock( &trace_mutex );
+}
+
+void x264_trace_row( int mb_y, int64_t start, int64_t end, const int64_t *ticks, int i_mbs )
+{
+    x264_pthread_mutex_lock( &trace_mutex );
+    if( trace )
+    {
+        trace_recalibrate();
+        for( int i = 0; i < X264_TRACE_MB_STAGES; i++ )
+        {
+            trace->i_count[i] += i_mbs;
+            trace->i_ticks[i] += ticks[i];
+        }
+        fprintf( trace->fh, "%s{\"name\":\"mb_row\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                 "\"args\":{\"y\":%d,\"mbs\":%d,\"analyse\":%.3f,\"encode\":%.3f,\"write\":%.3f,\"ratecontrol\":%.3f}}",
+                 trace->b_first_event ? "" : ",\n", trace_thread_index(),
+                 trace_us( start - trace->i_ticks0 ), trace_us( end - start ), mb_y, i_mbs,
+                 trace_us( ticks[X264_TRACE_ANALYSE] ), trace_us( ticks[X264_TRACE_ENCODE] ),
+                 trace_us( ticks[X264_TRACE_WRITE] ), trace_us( ticks[X264_TRACE_RC_MB] ) );
+        trace->b_first_event = 0;
+    }
+    x264_pthread_mutex_unlock( &trace_mutex );
+}
+
+void x264_trace_print_summary( x264_t *h )
+{
+    x264_pthread_mutex_lock( &trace_mutex );
+    if( trace )
+    {
+        trace_recalibrate();
+        for( int i = 0; i < X264_TRACE_STAGES; i++ )
+        {
+            if( !trace->i_count[i] )
+                continue;
+            double total = trace_us( trace->i_ticks[i] );
+            if( i < X264_TRACE_MB_STAGES )
+                x264_log( h, X264_LOG_INFO, "trace %-14s %9.3fs in %"PRId64" mbs, %.2fus/mb\n",
+                          trace_stage_names[i], total / 1e6, trace->i_count[i], total / trace->i_count[i] );
+            else
+                x264_log( h, X264_LOG_INFO, "trace %-14s %9.3fs in %"PRId64" calls, avg:%.2fus max:%.2fus\n",
+                          trace_stage_names[i], total / 1e6, trace->i_count[i], total / trace->i_count[i],
+                          trace_us( trace->i_max_ticks[i] ) );
+        }
+    }
+    x264_pthread_mutex_unlock( &trace_mutex );
+}
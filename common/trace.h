@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * trace.h: per-stage timing trace
+ *****************************************************************************
+ * Copyright (C) 2013 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *
+ * This program is also available under a commercial proprietary license.
+ * For more information, contact us at licensing@x264.com.
+ *****************************************************************************/
+
+#ifndef X264_TRACE_H
+#define X264_TRACE_H
+
+enum trace_stage_e
+{
+    /* per macroblock, reported once per row */
+    X264_TRACE_ANALYSE = 0,
+    X264_TRACE_ENCODE,
+    X264_TRACE_WRITE,
+    X264_TRACE_RC_MB,
+    X264_TRACE_MB_STAGES,
+    /* spans */
+    X264_TRACE_FILTER = X264_TRACE_MB_STAGES, /* deblock + hpel of one row */
+    X264_TRACE_SLICETYPE,
+    X264_TRACE_RATECONTROL,
+    X264_TRACE_INPUT,
+    X264_TRACE_VFILTER,
+    X264_TRACE_OUTPUT,
+    X264_TRACE_STAGES
+};
+
+/* Timestamps are TSC ticks where available, microseconds otherwise. */
+#if (ARCH_X86 || ARCH_X86_64) && defined(__GNUC__)
+#define HAVE_TRACE_TSC 1
+#else
+#define HAVE_TRACE_TSC 0
+#endif
+
+static ALWAYS_INLINE int64_t x264_trace_ticks( void )
+{
+#if HAVE_TRACE_TSC
+    uint32_t lo, hi;
+    asm volatile( "rdtsc" : "=a"(lo), "=d"(hi) );
+    return ((int64_t)hi << 32) | lo;
+#else
+    return x264_mdate();
+#endif
+}
+
+/* The trace is process-wide so that the CLI and every encoder instance write
+ * to the same file; x264_trace_open/close are reference counted.  All other
+ * functions are no-ops while no trace is open. */
+int  x264_trace_open( const char *filename );
+void x264_trace_close( void );
+int  x264_trace_is_open( void );
+void x264_trace_span( int stage, int64_t start, int64_t end );
+/* sum of per-macroblock stage ticks over i_mbs macroblocks of row mb_y */
+void x264_trace_row( int mb_y, int64_t start, int64_t end, const int64_t *ticks, int i_mbs );
+void x264_trace_print_summary( x264_t *h );
+
+/* Stage timing for a block of code, only when tracing is enabled:
+ *     int64_t start = TRACE_START( b_trace ); ...; TRACE_END( b_trace, stage, start ); */
+#define TRACE_START(enabled) ((enabled) ? x264_trace_ticks() : 0)
+#define TRACE_END(enabled,stage,start)\
+do {\
+    if( enabled )\
+        x264_trace_span( stage, start, x264_trace_ticks() );\
+} while( 0 )
+
+/* Add the ticks since last to a macroblock stage of the row h is encoding. */
+#define TRACE_MB(h,stage,last)\
+do {\
+    if( (h)->trace.b_enabled )\
+    {\
+        int64_t trace_now = x264_trace_ticks();\
+        (h)->trace.i_ticks[stage] += trace_now - (last);\
+        (last) = trace_now;\
+    }\
+} while( 0 )
+
+#endif
@@ -390,4 +390,68 @@ INIT_XMM sse2
 ADD8x8
 INIT_XMM avx
 ADD8x8
+
+;-----------------------------------------------------------------------------
+; void sub16x16_dct8( int16_t dct[4][64], uint8_t *pix1, uint8_t *pix2 )
+;-----------------------------------------------------------------------------
+; Two 8x8 blocks side by side per pass, the left one in the low lane.
+INIT_YMM avx2
+cglobal sub16x16_dct8, 3,3,10
+%assign y 0
+%rep 2
+%assign i 0
+%rep 8
+    pmovzxbw m %+ i, [r1+(y*8+i)*FENC_STRIDE]
+    pmovzxbw m8, [r2+(y*8+i)*FDEC_STRIDE]
+    psubw    m %+ i, m8
+%assign i i+1
+%endrep
+    DCT8_1D    w, 0,1,2,3,4,5,6,7,8,9
+    TRANSPOSE8x8W 0,1,2,3,4,5,6,7,8
+    DCT8_1D    w, 0,1,2,3,4,5,6,7,8,9
+%assign i 0
+%rep 8
+    movu         [r0+y*256+i*16], xm %+ i
+    vextracti128 [r0+y*256+i*16+128], m %+ i, 1
+%assign i i+1
+%endrep
+%assign y y+1
+%endrep
+    RET
+
+;-----------------------------------------------------------------------------
+; void add16x16_idct8( uint8_t *p_dst, int16_t dct[4][64] )
+;-----------------------------------------------------------------------------
+cglobal add16x16_idct8, 2,2,10
+%assign y 0
+%rep 2
+%assign i 0
+%rep 8
+    movu        xm %+ i, [r1+y*256+i*16]
+    vinserti128 m %+ i, m %+ i, [r1+y*256+i*16+128], 1
+%assign i i+1
+%endrep
+    IDCT8_1D      w,0,1,2,3,4,5,6,7,8,9
+    TRANSPOSE8x8W 0,1,2,3,4,5,6,7,8
+    paddw         m0, [pw_32] ; rounding for the >>6 at the end
+    IDCT8_1D      w,0,1,2,3,4,5,6,7,8,9
+%assign i 0
+%rep 4
+    %assign j i*2
+    %assign k i*2+1
+    pmovzxbw     m8, [r0+(y*8+j)*FDEC_STRIDE]
+    pmovzxbw     m9, [r0+(y*8+k)*FDEC_STRIDE]
+    psraw        m %+ j, 6
+    psraw        m %+ k, 6
+    paddsw       m %+ j, m8
+    paddsw       m %+ k, m9
+    packuswb     m %+ j, m %+ k
+    vpermq       m %+ j, m %+ j, q3120
+    movu         [r0+(y*8+j)*FDEC_STRIDE], xm %+ j
+    vextracti128 [r0+(y*8+k)*FDEC_STRIDE], m %+ j, 1
+%assign i i+1
+%endrep
+%assign y y+1
+%endrep
+    RET
 %endif ; !HIGH_BIT_DEPTH
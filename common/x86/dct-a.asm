@@ -499,6 +499,166 @@ SUB_NxN_DCT  sub16x16_dct8_ssse3, sub8x8_dct8_ssse3, 128, 8, 0, 0, 11
 SUB_NxN_DCT  sub16x16_dct8_avx,   sub8x8_dct8_avx,   128, 8, 0, 0, 11
 %endif ; HIGH_BIT_DEPTH
 
+%if HIGH_BIT_DEPTH == 0
+;-----------------------------------------------------------------------------
+; AVX2: four 4x4 blocks per pass. Each ymm register holds one row (or column)
+; of blocks a,b in its low lane and of blocks c,d in its high lane, so the
+; xmm butterflies and transposes apply unchanged.
+;-----------------------------------------------------------------------------
+
+; out: m0..m3 = rows %1..%1+3 of a 16-pixel wide strip, fenc-fdec
+%macro LOAD_DIFF16x4_AVX2 1
+%assign i 0
+%rep 4
+    pmovzxbw   m %+ i, [r1+(%1+i)*FENC_STRIDE]
+    pmovzxbw   m4, [r2+(%1+i)*FDEC_STRIDE]
+    psubw      m %+ i, m4
+%assign i i+1
+%endrep
+%endmacro
+
+; in: m0..m3 = coefficient rows; %1..%4 = byte offsets of blocks a,b,c,d in r0
+%macro STORE_DCT_AVX2 4
+    punpckhqdq  m4, m0, m1  ; b0 b1 | d0 d1
+    punpcklqdq  m0, m1      ; a0 a1 | c0 c1
+    punpckhqdq  m1, m2, m3  ; b2 b3 | d2 d3
+    punpcklqdq  m2, m3      ; a2 a3 | c2 c3
+    vinserti128 m3, m0, xm2, 1
+    vperm2i128  m0, m0, m2, q0301
+    vinserti128 m2, m4, xm1, 1
+    vperm2i128  m4, m4, m1, q0301
+    movu [r0+%1], m3
+    movu [r0+%2], m2
+    movu [r0+%3], m0
+    movu [r0+%4], m4
+%endmacro
+
+; out: m0..m3 = coefficient rows of blocks a,b,c,d at byte offsets %1..%4 in r1
+%macro LOAD_IDCT_AVX2 4
+    movu        xm0, [r1+%1]
+    movu        xm1, [r1+%2]
+    movu        xm2, [r1+%1+16]
+    movu        xm3, [r1+%2+16]
+    vinserti128 m0, m0, [r1+%3], 1
+    vinserti128 m1, m1, [r1+%4], 1
+    vinserti128 m2, m2, [r1+%3+16], 1
+    vinserti128 m3, m3, [r1+%4+16], 1
+    punpckhqdq  m4, m0, m1
+    punpcklqdq  m0, m1
+    punpckhqdq  m1, m2, m3
+    punpcklqdq  m2, m3
+    SWAP 1, 4
+    SWAP 3, 4
+%endmacro
+
+%macro DCT4x4x4_AVX2 0
+    DCT4_1D 0, 1, 2, 3, 4
+    TRANSPOSE2x4x4W 0, 1, 2, 3, 4
+    DCT4_1D 0, 1, 2, 3, 4
+%endmacro
+
+%macro IDCT4x4x4_AVX2 0
+    IDCT4_1D w, 0, 1, 2, 3, 4, 5
+    TRANSPOSE2x4x4W 0, 1, 2, 3, 4
+    paddw m0, [pw_32]
+    IDCT4_1D w, 0, 1, 2, 3, 4, 5
+    psraw m0, 6
+    psraw m1, 6
+    psraw m2, 6
+    psraw m3, 6
+%endmacro
+
+; in: m%1, m%2 = residual of rows %3, %4 (low lane) and %3+4, %4+4 (high lane)
+%macro ADD_IDCT8x2_AVX2 4
+    movq        xm4, [r0+%3*FDEC_STRIDE]
+    movq        xm5, [r0+%4*FDEC_STRIDE]
+    movhps      xm4, [r0+(%3+4)*FDEC_STRIDE]
+    movhps      xm5, [r0+(%4+4)*FDEC_STRIDE]
+    pmovzxbw    m4, xm4
+    pmovzxbw    m5, xm5
+    paddsw      m%1, m4
+    paddsw      m%2, m5
+    packuswb    m%1, m%2
+    vextracti128 xm4, m%1, 1
+    movq   [r0+%3*FDEC_STRIDE], xm%1
+    movhps [r0+%4*FDEC_STRIDE], xm%1
+    movq   [r0+(%3+4)*FDEC_STRIDE], xm4
+    movhps [r0+(%4+4)*FDEC_STRIDE], xm4
+%endmacro
+
+; in: m%1, m%2 = residual of 16-pixel rows %3, %3+1
+%macro ADD_IDCT16x2_AVX2 3
+    pmovzxbw    m4, [r0+%3*FDEC_STRIDE]
+    pmovzxbw    m5, [r0+(%3+1)*FDEC_STRIDE]
+    paddsw      m%1, m4
+    paddsw      m%2, m5
+    packuswb    m%1, m%2
+    vpermq      m%1, m%1, q3120
+    movu         [r0+%3*FDEC_STRIDE], xm%1
+    vextracti128 [r0+(%3+1)*FDEC_STRIDE], m%1, 1
+%endmacro
+
+INIT_YMM avx2
+;-----------------------------------------------------------------------------
+; void sub8x8_dct( int16_t dct[4][16], uint8_t *pix1, uint8_t *pix2 )
+;-----------------------------------------------------------------------------
+cglobal sub8x8_dct, 3,3,6
+%assign i 0
+%rep 4
+    movq        xm %+ i, [r1+i*FENC_STRIDE]
+    movq        xm4, [r2+i*FDEC_STRIDE]
+    movhps      xm %+ i, [r1+(i+4)*FENC_STRIDE]
+    movhps      xm4, [r2+(i+4)*FDEC_STRIDE]
+    pmovzxbw    m %+ i, xm %+ i
+    pmovzxbw    m4, xm4
+    psubw       m %+ i, m4
+%assign i i+1
+%endrep
+    DCT4x4x4_AVX2
+    STORE_DCT_AVX2 0, 32, 64, 96
+    RET
+
+;-----------------------------------------------------------------------------
+; void sub16x16_dct( int16_t dct[16][16], uint8_t *pix1, uint8_t *pix2 )
+;-----------------------------------------------------------------------------
+cglobal sub16x16_dct, 3,3,6
+%assign y 0
+%rep 4
+    ; strip y holds 4x4 blocks {0,1,4,5}+base in x264's 8x8-major order
+    %assign base (y>>1)*8 + (y&1)*2
+    LOAD_DIFF16x4_AVX2 y*4
+    DCT4x4x4_AVX2
+    STORE_DCT_AVX2 base*32, (base+1)*32, (base+4)*32, (base+5)*32
+%assign y y+1
+%endrep
+    RET
+
+;-----------------------------------------------------------------------------
+; void add8x8_idct( uint8_t *pix, int16_t dct[4][16] )
+;-----------------------------------------------------------------------------
+cglobal add8x8_idct, 2,2,6
+    LOAD_IDCT_AVX2 0, 32, 64, 96
+    IDCT4x4x4_AVX2
+    ADD_IDCT8x2_AVX2 0, 1, 0, 1
+    ADD_IDCT8x2_AVX2 2, 3, 2, 3
+    RET
+
+;-----------------------------------------------------------------------------
+; void add16x16_idct( uint8_t *pix, int16_t dct[16][16] )
+;-----------------------------------------------------------------------------
+cglobal add16x16_idct, 2,2,6
+%assign y 0
+%rep 4
+    %assign base (y>>1)*8 + (y&1)*2
+    LOAD_IDCT_AVX2 base*32, (base+1)*32, (base+4)*32, (base+5)*32
+    IDCT4x4x4_AVX2
+    ADD_IDCT16x2_AVX2 0, 1, y*4
+    ADD_IDCT16x2_AVX2 2, 3, (y*4+2)
+%assign y y+1
+%endrep
+    RET
+%endif ; !HIGH_BIT_DEPTH
+
 %if HIGH_BIT_DEPTH
 ;-----------------------------------------------------------------------------
 ; void add8x8_idct_dc( pixel *p_dst, dctcoef *dct2x2 )
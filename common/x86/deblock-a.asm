@@ -28,9 +28,10 @@
 %include "x86inc.asm"
 %include "x86util.asm"
 
-SECTION_RODATA
+SECTION_RODATA 32
 
 transpose_shuf: db 0,4,8,12,1,5,9,13,2,6,10,14,3,7,11,15
+                db 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15 ; ymm: bs1 is left as is
 
 SECTION .text
 
@@ -63,11 +64,19 @@ cextern pw_pixel_max
     pcmpgtw %4, %5 ; 0 > |%1-%2|-%3
 %endmacro
 
+; with ymm, the moves go through the xmm halves of %1 and %2
 %macro LOAD_AB 4
+%if mmsize == 32
+    movd      xmm %+ %1, %3
+    movd      xmm %+ %2, %4
+    SPLATW     %1, xmm %+ %1
+    SPLATW     %2, xmm %+ %2
+%else
     movd       %1, %3
     movd       %2, %4
     SPLATW     %1, %1
     SPLATW     %2, %2
+%endif
 %endmacro
 
 ; in:  %2=tc reg
@@ -75,6 +84,12 @@ cextern pw_pixel_max
 %macro LOAD_TC 2
 %if mmsize == 8
     pshufw      %1, [%2-1], 0
+%elif mmsize == 32
+    vpbroadcastd %1, [%2]
+    punpcklbw   %1, %1
+    punpcklwd   %1, %1
+    vpermq      %1, %1, q1100
+    punpckldq   %1, %1         ; tc0[0..1] in the low lane, tc0[2..3] in the high lane
 %else
     movd        %1, [%2]
     punpcklbw   %1, %1
@@ -360,26 +375,27 @@ cglobal deblock_v_luma, 5,5,15
     sub         r0, r1
     sub         r0, r1
     sub         r0, r1
-    mov         r3, 2
+    mov         r3, 32/mmsize
 .loop:
-    mova        p2, [r0]
-    mova        p1, [r0+r1]
-    mova        p0, [r0+r1*2]
-    mova        q0, [r2]
-    mova        q1, [r2+r1]
-    mova        q2, [r2+r1*2]
+    MOVPIX      p2, [r0]
+    MOVPIX      p1, [r0+r1]
+    MOVPIX      p0, [r0+r1*2]
+    MOVPIX      q0, [r2]
+    MOVPIX      q1, [r2+r1]
+    MOVPIX      q2, [r2+r1*2]
     DEBLOCK_LUMA_INTER_SSE2
-    mova   [r0+r1], p1
-    mova [r0+r1*2], p0
-    mova      [r2], q0
-    mova   [r2+r1], q1
+    MOVPIX [r0+r1], p1
+    MOVPIX [r0+r1*2], p0
+    MOVPIX    [r2], q0
+    MOVPIX [r2+r1], q1
     add         r0, mmsize
     add         r2, mmsize
-    add         r4, 2
+    add         r4, mmsize/8
     dec         r3
     jg .loop
     RET
 
+%if mmsize == 16
 cglobal deblock_h_luma, 5,7,15
     add         r1, r1
     LOAD_AB    m12, m13, r2d, r3d
@@ -417,19 +433,22 @@ cglobal deblock_h_luma, 5,7,15
     dec         r6
     jg .loop
     RET
+%endif ; mmsize == 16
 %endmacro
 
 INIT_XMM sse2
 DEBLOCK_LUMA_64
 INIT_XMM avx
 DEBLOCK_LUMA_64
+INIT_YMM avx2
+DEBLOCK_LUMA_64
 %endif
 
 %macro SWAPMOVA 2
 %ifid %1
     SWAP %1, %2
 %else
-    mova %1, %2
+    MOVPIX %1, %2
 %endif
 %endmacro
 
@@ -439,7 +458,7 @@ DEBLOCK_LUMA_64
 %macro LUMA_INTRA_P012 12 ; p0..p3 in memory
 %if ARCH_X86_64
     paddw     t0, %3, %2
-    mova      t2, %4
+    MOVPIX    t2, %4
     paddw     t2, %3
 %else
     mova      t0, %3
@@ -623,16 +642,16 @@ cglobal deblock_v_luma_intra, 4,7,16
     lea     r5, [r1*3] ; 3*stride
     neg     r4
     add     r4, r0     ; pix-4*stride
-    mov     r6, 2
+    mov     r6, 32/mmsize
     mova    m0, [pw_2]
-    LOAD_AB aa, bb, r2d, r3d
+    LOAD_AB m5, m14, r2d, r3d ; aa, bb
 .loop
-    mova    p2, [r4+r1]
-    mova    p1, [r4+2*r1]
-    mova    p0, [r4+r5]
-    mova    q0, [r0]
-    mova    q1, [r0+r1]
-    mova    q2, [r0+2*r1]
+    MOVPIX  p2, [r4+r1]
+    MOVPIX  p1, [r4+2*r1]
+    MOVPIX  p0, [r4+r5]
+    MOVPIX  q0, [r0]
+    MOVPIX  q1, [r0+r1]
+    MOVPIX  q2, [r0+2*r1]
 
     LOAD_MASK p1, p0, q0, q1, aa, bb, m3, t0, t1
     mova    t2, aa
@@ -652,6 +671,7 @@ cglobal deblock_v_luma_intra, 4,7,16
     jg .loop
     RET
 
+%if mmsize == 16
 ;-----------------------------------------------------------------------------
 ; void deblock_h_luma_intra( uint16_t *pix, intptr_t stride, int alpha, int beta )
 ;-----------------------------------------------------------------------------
@@ -711,12 +731,15 @@ cglobal deblock_h_luma_intra, 4,7,16
     jg .loop
     ADD    rsp, pad
     RET
+%endif ; mmsize == 16
 %endmacro
 
 INIT_XMM sse2
 DEBLOCK_LUMA_INTRA_64
 INIT_XMM avx
 DEBLOCK_LUMA_INTRA_64
+INIT_YMM avx2
+DEBLOCK_LUMA_INTRA_64
 
 %endif
 
@@ -1028,10 +1051,10 @@ DEBLOCK_LUMA_INTRA
 ; out: m5=beta-1, m7=mask, %3=alpha-1
 ; clobbers: m4,m6
 %macro LOAD_MASK 2-3
-    movd     m4, %1
-    movd     m5, %2
-    SPLATW   m4, m4
-    SPLATW   m5, m5
+    movd     xm4, %1
+    movd     xm5, %2
+    SPLATW   m4, xm4
+    SPLATW   m5, xm5
     packuswb m4, m4  ; 16x alpha-1
     packuswb m5, m5  ; 16x beta-1
 %if %0>2
@@ -1199,6 +1222,243 @@ DEBLOCK_LUMA
 INIT_XMM avx
 DEBLOCK_LUMA
 
+; in: m0=p1 m1=p0 m2=q0 m3=q1 m10=p2 m11=q2 m8=tc (4x tc0[0], 4x tc0[1], ...)
+;     %1=alpha-1 %2=beta-1
+; out: m10=p1' m1=p0' m2=q0' m11=q1'
+; clobbers: m0,m3-m9,m12
+%macro DEBLOCK_LUMA_REGS 2
+    LOAD_MASK %1, %2
+    pcmpeqb m9, m9
+    pcmpeqb m9, m8
+    pandn   m9, m7
+    pand    m8, m9
+
+    DIFF_GT2 m1, m10, m5, m6, m7 ; |p2-p0| > beta-1
+    pand    m6, m9
+    psubb   m7, m8, m6
+    pand    m6, m8
+    mova    m12, m10
+    LUMA_Q1 m0, m12, m10, m10, m6, m4
+
+    DIFF_GT2 m2, m11, m5, m6, m12 ; |q2-q0| > beta-1
+    pand    m6, m9
+    pand    m8, m6
+    psubb   m7, m6
+    mova    m12, m11
+    LUMA_Q1 m3, m12, m11, m11, m8, m6
+
+    DEBLOCK_P0_Q0
+%endmacro
+
+; in: %1=4 rows of 4 pixels, %2=pix of the first row, %3=stride, %4=3*stride
+%macro STORE_4x4B 4
+    movd   [%2], %1
+    pextrd [%2+%3], %1, 1
+    pextrd [%2+%3*2], %1, 2
+    pextrd [%2+%4], %1, 3
+%endmacro
+
+; in: m0=row 0 .. m7=row 7, 8 pixels each, in both lanes
+; out: m0=cols 0,1 m2=cols 2,3 m4=cols 4,5 m1=cols 6,7, 8 pixels each, in both lanes
+; clobbers: m3,m5-m7
+%macro TRANSPOSE8x8B_LANES 0
+    punpcklbw m0, m1
+    punpcklbw m2, m3
+    punpcklbw m4, m5
+    punpcklbw m6, m7
+    punpckhwd m1, m0, m2
+    punpcklwd m0, m2
+    punpckhwd m5, m4, m6
+    punpcklwd m4, m6
+    punpckhdq m2, m0, m4
+    punpckldq m0, m4
+    punpckldq m4, m1, m5
+    punpckhdq m1, m5
+%endmacro
+
+; in: m10=p1 m1=p0 m2=q0 m11=q1, 16 pixels each, in both lanes
+; out: m10=rows 0-3 m1=rows 4-7 m4=rows 8-11 m3=rows 12-15, 4 pixels each, in both lanes
+; clobbers: m2,m5
+%macro TRANSPOSE4x16B_LANES 0
+    punpckhbw m4, m10, m1
+    punpcklbw m10, m1
+    punpckhbw m5, m2, m11
+    punpcklbw m2, m11
+    punpckhwd m1, m10, m2
+    punpcklwd m10, m2
+    punpckhwd m3, m4, m5
+    punpcklwd m4, m5
+%endmacro
+
+;-----------------------------------------------------------------------------
+; void deblock_h_luma( uint8_t *pix, intptr_t stride, int alpha, int beta, int8_t *tc0 )
+;-----------------------------------------------------------------------------
+; Rows 0-7 are transposed in the low lanes and rows 8-15 in the high lanes,
+; without going through memory; the filter itself runs on xmm registers.
+INIT_YMM avx2
+cglobal deblock_h_luma, 5,8,13
+    sub     r0, 4
+    lea     r5, [r1*3]
+    lea     r6, [r0+r1*4]
+    lea     r7, [r0+r1*8]
+    movq    xm0, [r0]
+    movq    xm1, [r0+r1]
+    movq    xm2, [r0+r1*2]
+    movq    xm3, [r0+r5]
+    movq    xm4, [r6]
+    movq    xm5, [r6+r1]
+    movq    xm6, [r6+r1*2]
+    movq    xm7, [r6+r5]
+    vinserti128 m0, m0, [r7], 1
+    vinserti128 m1, m1, [r7+r1], 1
+    vinserti128 m2, m2, [r7+r1*2], 1
+    vinserti128 m3, m3, [r7+r5], 1
+    lea     r7, [r6+r1*8]
+    vinserti128 m4, m4, [r7], 1
+    vinserti128 m5, m5, [r7+r1], 1
+    vinserti128 m6, m6, [r7+r1*2], 1
+    vinserti128 m7, m7, [r7+r5], 1
+    TRANSPOSE8x8B_LANES
+    vpermq  m10, m0, q3131 ; p2
+    vpermq  m0,  m2, q2020 ; p1
+    vpermq  m11, m1, q2020 ; q2
+    vpermq  m1,  m2, q3131 ; p0
+    vpermq  m2,  m4, q2020 ; q0
+    vpermq  m3,  m4, q3131 ; q1
+
+INIT_XMM cpuname
+    movd    m8, [r4] ; tc0
+    dec     r2d      ; alpha-1
+    dec     r3d      ; beta-1
+    punpcklbw m8, m8
+    punpcklbw m8, m8 ; tc = 4x tc0[3], 4x tc0[2], 4x tc0[1], 4x tc0[0]
+    DEBLOCK_LUMA_REGS r2d, r3d
+
+    TRANSPOSE4x16B_LANES
+    STORE_4x4B m10, r0+2, r1, r5
+    STORE_4x4B m1,  r6+2, r1, r5
+    lea     r6, [r0+r1*8]
+    STORE_4x4B m4,  r6+2, r1, r5
+    STORE_4x4B m3,  r7+2, r1, r5
+INIT_YMM cpuname
+    RET
+
+;-----------------------------------------------------------------------------
+; void deblock_v_luma_2plane( uint8_t *pixu, uint8_t *pixv, intptr_t stride,
+;                             int alpha, int beta, int8_t *tc0 )
+;-----------------------------------------------------------------------------
+; 4:4:4 chroma: the same luma filter on both planes, U in the low lanes and
+; V in the high lanes.
+cglobal deblock_v_luma_2plane, 6,8,13
+    lea     r6, [r2*3]
+    neg     r6
+    lea     r7, [r1+r6] ; pixv-3*stride
+    add     r6, r0      ; pixu-3*stride
+    mova    xm10, [r6]      ; p2
+    mova    xm0,  [r6+r2]   ; p1
+    mova    xm1,  [r6+r2*2] ; p0
+    mova    xm2,  [r0]      ; q0
+    mova    xm3,  [r0+r2]   ; q1
+    mova    xm11, [r0+r2*2] ; q2
+    vinserti128 m10, m10, [r7], 1
+    vinserti128 m0,  m0,  [r7+r2], 1
+    vinserti128 m1,  m1,  [r7+r2*2], 1
+    vinserti128 m2,  m2,  [r1], 1
+    vinserti128 m3,  m3,  [r1+r2], 1
+    vinserti128 m11, m11, [r1+r2*2], 1
+    vpbroadcastd m8, [r5] ; tc0
+    dec     r3d           ; alpha-1
+    dec     r4d           ; beta-1
+    punpcklbw m8, m8
+    punpcklbw m8, m8
+    DEBLOCK_LUMA_REGS r3d, r4d
+    mova    [r6+r2], xm10
+    mova    [r6+r2*2], xm1
+    mova    [r0], xm2
+    mova    [r0+r2], xm11
+    vextracti128 [r7+r2], m10, 1
+    vextracti128 [r7+r2*2], m1, 1
+    vextracti128 [r1], m2, 1
+    vextracti128 [r1+r2], m11, 1
+    RET
+
+; in: %1,%2=pixu,pixv of row 0, %3,%4=pixu,pixv of row 4
+; out: see TRANSPOSE8x8B_LANES, U in the low lanes and V in the high lanes
+%macro LOAD_TRANSPOSE_2PLANE 4
+    movq    xm0, [%1]
+    movq    xm1, [%1+r2]
+    movq    xm2, [%1+r2*2]
+    movq    xm3, [%1+r6]
+    movq    xm4, [%3]
+    movq    xm5, [%3+r2]
+    movq    xm6, [%3+r2*2]
+    movq    xm7, [%3+r6]
+    vinserti128 m0, m0, [%2], 1
+    vinserti128 m1, m1, [%2+r2], 1
+    vinserti128 m2, m2, [%2+r2*2], 1
+    vinserti128 m3, m3, [%2+r6], 1
+    vinserti128 m4, m4, [%4], 1
+    vinserti128 m5, m5, [%4+r2], 1
+    vinserti128 m6, m6, [%4+r2*2], 1
+    vinserti128 m7, m7, [%4+r6], 1
+    TRANSPOSE8x8B_LANES
+%endmacro
+
+; in: %1=rows 0-3 of both planes, %2,%3=pixu,pixv of row 0
+%macro STORE_4x4B_2PLANE 3
+    STORE_4x4B xm%1, %2, r2, r6
+    vextracti128 xm5, m%1, 1
+    STORE_4x4B xm5, %3, r2, r6
+%endmacro
+
+;-----------------------------------------------------------------------------
+; void deblock_h_luma_2plane( uint8_t *pixu, uint8_t *pixv, intptr_t stride,
+;                             int alpha, int beta, int8_t *tc0 )
+;-----------------------------------------------------------------------------
+cglobal deblock_h_luma_2plane, 6,11,13
+    sub     r0, 4
+    sub     r1, 4
+    lea     r6, [r2*3]
+    lea     r7, [r0+r2*4]
+    lea     r8, [r1+r2*4]
+    LOAD_TRANSPOSE_2PLANE r0, r1, r7, r8
+    SWAP     0, 8
+    SWAP     2, 9
+    SWAP     4, 10
+    SWAP     1, 11
+    lea     r9,  [r7+r2*8]
+    lea     r10, [r8+r2*8]
+    lea     r7,  [r0+r2*8]
+    lea     r8,  [r1+r2*8]
+    LOAD_TRANSPOSE_2PLANE r7, r8, r9, r10
+    punpckhqdq m5, m8, m0   ; p2
+    punpcklqdq m6, m9, m2   ; p1
+    punpckhqdq m9, m2       ; p0
+    punpcklqdq m7, m10, m4  ; q0
+    punpckhqdq m10, m4      ; q1
+    punpcklqdq m12, m11, m1 ; q2
+    SWAP     0, 6
+    SWAP     1, 9
+    SWAP     2, 7
+    SWAP     3, 10
+    SWAP     10, 5
+    SWAP     11, 12
+    vpbroadcastd m8, [r5] ; tc0
+    dec     r3d           ; alpha-1
+    dec     r4d           ; beta-1
+    punpcklbw m8, m8
+    punpcklbw m8, m8
+    DEBLOCK_LUMA_REGS r3d, r4d
+
+    TRANSPOSE4x16B_LANES
+    lea     r3, [r0+r2*4]
+    lea     r4, [r1+r2*4]
+    STORE_4x4B_2PLANE 10, r0+2, r1+2
+    STORE_4x4B_2PLANE 1,  r3+2, r4+2
+    STORE_4x4B_2PLANE 4,  r7+2, r8+2
+    STORE_4x4B_2PLANE 3,  r9+2, r10+2
+    RET
+
 %else
 
 %macro DEBLOCK_LUMA 2
@@ -1633,10 +1893,10 @@ DEBLOCK_LUMA_INTRA v8
 %endmacro
 
 %macro CHROMA_V_LOAD 1
-    mova        m0, [r0]    ; p1
-    mova        m1, [r0+r1] ; p0
-    mova        m2, [%1]    ; q0
-    mova        m3, [%1+r1] ; q1
+    MOVPIX      m0, [r0]    ; p1
+    MOVPIX      m1, [r0+r1] ; p0
+    MOVPIX      m2, [%1]    ; q0
+    MOVPIX      m3, [%1+r1] ; q1
 %endmacro
 
 ; clobbers: m1, m2, m3
@@ -1654,8 +1914,8 @@ DEBLOCK_LUMA_INTRA v8
 %endmacro
 
 %macro CHROMA_V_STORE 0
-    mova [r0+1*r1], m1
-    mova [r0+2*r1], m2
+    MOVPIX [r0+1*r1], m1
+    MOVPIX [r0+2*r1], m2
 %endmacro
 
 %macro DEBLOCK_CHROMA 0
@@ -1689,6 +1949,7 @@ cglobal deblock_v_chroma, 5,7,8
     jg .loop
     RET
 
+%if mmsize < 32
 ;-----------------------------------------------------------------------------
 ; void deblock_h_chroma( uint16_t *pix, intptr_t stride, int alpha, int beta, int8_t *tc0 )
 ;-----------------------------------------------------------------------------
@@ -1707,7 +1968,7 @@ cglobal deblock_h_chroma, 5,7,8
     dec         r5
     jg .loop
     RET
-
+%endif ; mmsize < 32
 
 cglobal deblock_intra_body
     LOAD_AB     m4, m5, r2d, r3d
@@ -1721,11 +1982,11 @@ cglobal deblock_intra_body
 cglobal deblock_v_chroma_intra, 4,6,8
     add         r1, r1
     mov         r5, 32/mmsize
-    movd        m5, r3d
+    movd       xm5, r3d
     mov         r4, r0
     sub         r0, r1
     sub         r0, r1
-    SPLATW      m5, m5
+    SPLATW      m5, xm5
 .loop:
     CHROMA_V_LOAD r4
     call        deblock_intra_body
@@ -1736,6 +1997,7 @@ cglobal deblock_v_chroma_intra, 4,6,8
     jg .loop
     RET
 
+%if mmsize < 32
 ;-----------------------------------------------------------------------------
 ; void deblock_h_chroma_intra( uint16_t *pix, intptr_t stride, int alpha, int beta )
 ;-----------------------------------------------------------------------------
@@ -1853,6 +2115,7 @@ cglobal deblock_h_chroma_422, 5,7,8
     dec         r5
     jg .loop
     RET
+%endif ; mmsize < 32
 %endmacro ; DEBLOCK_CHROMA
 
 %if ARCH_X86_64 == 0
@@ -1863,6 +2126,8 @@ INIT_XMM sse2
 DEBLOCK_CHROMA
 INIT_XMM avx
 DEBLOCK_CHROMA
+INIT_YMM avx2
+DEBLOCK_CHROMA
 %endif ; HIGH_BIT_DEPTH
 
 %if HIGH_BIT_DEPTH == 0
@@ -2368,3 +2633,81 @@ INIT_XMM ssse3
 DEBLOCK_STRENGTH_XMM
 INIT_XMM avx
 DEBLOCK_STRENGTH_XMM
+
+; out: m0 = left neighbors | top neighbors, m2 = cur | cur
+; clobbers: m1, m3
+%macro LOAD_BYTES_YMM 1
+    movu       xm2, [%1-4] ; FIXME could be aligned if we changed nnz's allocation
+    movu       xm1, [%1+12]
+    pslldq     xm0, xm2, 1
+    shufps     xm2, xm1, q3131 ; cur nnz, all rows
+    pslldq     xm1, 1
+    shufps     xm0, xm1, q3131 ; left neighbors
+    pslldq     xm1, xm2, 4
+    movd       xm3, [%1-8] ; could be palignr if nnz was aligned
+    por        xm1, xm3 ; top neighbors
+    vinserti128 m0, m0, xm1, 1
+    vinserti128 m2, m2, xm2, 1
+%endmacro
+
+; Both edge directions at once: the low lane holds the vertical edges (bs0)
+; and the high lane the horizontal ones (bs1).
+INIT_YMM avx2
+cglobal deblock_strength, 6,6,7
+    ; Prepare mv comparison register
+    shl      r4d, 8
+    add      r4d, 3 - (1<<8)
+    movd     xm6, r4d
+    SPLATW    m6, xm6
+    pxor      m4, m4 ; bs0 | bs1
+
+.lists:
+    ; Check refs
+    LOAD_BYTES_YMM ref
+    pxor      m0, m2
+    por       m4, m0
+
+    ; Check mvs against the left neighbors in the low lane, the top ones in the high lane
+    movu     xm0, [mv-4+4*8*0]
+    vinserti128 m0, m0, [mv+4*8*-1], 1
+    movu     xm1, [mv-4+4*8*1]
+    vinserti128 m1, m1, [mv+4*8* 0], 1
+    vbroadcasti128 m2, [mv+4*8*0]
+    vbroadcasti128 m3, [mv+4*8*1]
+    psubw     m0, m2
+    psubw     m1, m3
+    packsswb  m0, m1
+
+    movu     xm1, [mv-4+4*8*2]
+    vinserti128 m1, m1, [mv+4*8* 1], 1
+    movu     xm2, [mv-4+4*8*3]
+    vinserti128 m2, m2, [mv+4*8* 2], 1
+    vbroadcasti128 m3, [mv+4*8*2]
+    vbroadcasti128 m5, [mv+4*8*3]
+    psubw     m1, m3
+    psubw     m2, m5
+    packsswb  m1, m2
+
+    ABSB      m0, m2
+    ABSB      m1, m2
+    psubusb   m0, m6
+    psubusb   m1, m6
+    packsswb  m0, m1
+    por       m4, m0
+    add       r1, 40
+    add       r2, 4*8*5
+    dec      r5d
+    jge .lists
+
+    ; Check nnz
+    LOAD_BYTES_YMM nnz
+    por       m0, m2
+    mova      m6, [pb_1]
+    pminub    m0, m6
+    pminub    m4, m6 ; mv ? 1 : 0
+    paddb     m0, m0 ; nnz ? 2 : 0
+    pmaxub    m4, m0
+    pshufb    m4, [transpose_shuf]
+    vextracti128 [bs1], m4, 1
+    mova    [bs0], xm4
+    RET
@@ -30,12 +30,23 @@
 %include "x86inc.asm"
 %include "x86util.asm"
 
-SECTION_RODATA
+SECTION_RODATA 32
+
+filt_mul20: times 32 db 20
+filt_mul15: times 16 db 1, -5
+filt_mul51: times 16 db -5, 1
+hpel_shuf: times 2 db 0,8,1,9,2,10,3,11,4,12,5,13,6,14,7,15
+
+pad10: times 16 dw    10*PIXEL_MAX
+pad20: times 16 dw    20*PIXEL_MAX
+pad30: times 16 dw    30*PIXEL_MAX
+depad: times 8 dd 32*20*PIXEL_MAX + 512
+
+tap1: times 8 dw  1, -5
+tap2: times 8 dw 20, 20
+tap3: times 8 dw -5,  1
+pd_0f: times 8 dd 0xffff
 
-filt_mul20: times 16 db 20
-filt_mul15: times 8 db 1, -5
-filt_mul51: times 8 db -5, 1
-hpel_shuf: db 0,8,1,9,2,10,3,11,4,12,5,13,6,14,7,15
 deinterleave_shuf: db 0,2,4,6,8,10,12,14,1,3,5,7,9,11,13,15
 %if HIGH_BIT_DEPTH
 deinterleave_shuf32a: SHUFFLE_MASK_W 0,2,4,6,8,10,12,14
@@ -46,17 +57,17 @@ deinterleave_shuf32b: db 1,3,5,7,9,11,13,15,17,19,21,23,25,27,29,31
 %endif
 
 pd_16: times 4 dd 16
-pd_0f: times 4 dd 0xffff
 pf_inv256: times 8 dd 0.00390625
 
-pad10: times 8 dw    10*PIXEL_MAX
-pad20: times 8 dw    20*PIXEL_MAX
-pad30: times 8 dw    30*PIXEL_MAX
-depad: times 4 dd 32*20*PIXEL_MAX + 512
-
-tap1: times 4 dw  1, -5
-tap2: times 4 dw 20, 20
-tap3: times 4 dw -5,  1
+pd_0to7: dd 0, 1, 2, 3, 4, 5, 6, 7
+pd_0to15: dd 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15
+pd_8: times 8 dd 8
+pd_31: times 8 dd 31
+pd_512: times 8 dd 512
+pd_c000: times 8 dd 0xc000
+pd_2097151: times 8 dd (1<<21)-1
+mbtree_list_shuf: times 2 db 0,1,8,9,2,3,10,11,4,5,12,13,6,7,14,15
+pd_4: times 4 dd 4
 
 SECTION .text
 
@@ -68,6 +79,7 @@ cextern pw_00ff
 cextern pw_3fff
 cextern pw_pixel_max
 cextern pd_ffff
+cextern pd_32
 
 %macro LOAD_ADD 4
     movh       %4, %3
@@ -181,12 +193,12 @@ cglobal hpel_filter_v, 5,6,11
     mova       m7, [pw_pixel_max]
     pxor       m0, m0
 .loop:
-    mova       m1, [r1]
-    mova       m2, [r1+r3]
-    mova       m3, [r1+r3*2]
-    mova       m4, [r1+mmsize]
-    mova       m5, [r1+r3+mmsize]
-    mova       m6, [r1+r3*2+mmsize]
+    MOVPIX     m1, [r1]
+    MOVPIX     m2, [r1+r3]
+    MOVPIX     m3, [r1+r3*2]
+    MOVPIX     m4, [r1+mmsize]
+    MOVPIX     m5, [r1+r3+mmsize]
+    MOVPIX     m6, [r1+r3*2+mmsize]
     paddw      m1, [r5+r3*2]
     paddw      m2, [r5+r3]
     paddw      m3, [r5]
@@ -199,15 +211,15 @@ cglobal hpel_filter_v, 5,6,11
     mova       m6, [pw_16]
     psubw      m1, s20
     psubw      m4, s20
-    mova      [r2+r4], m1
-    mova      [r2+r4+mmsize], m4
+    MOVPIX    [r2+r4], m1
+    MOVPIX    [r2+r4+mmsize], m4
     paddw      m1, s30
     paddw      m4, s30
     FILT_PACK  m1, m4, 5, m6, w, s10
     CLIPW      m1, m0, m7
     CLIPW      m4, m0, m7
-    mova      [r0+r4], m1
-    mova      [r0+r4+mmsize], m4
+    MOVPIX    [r0+r4], m1
+    MOVPIX    [r0+r4+mmsize], m4
     add        r4, 2*mmsize
     jl .loop
     RET
@@ -234,7 +246,7 @@ cglobal hpel_filter_c, 3,3,10
 .loop:
     movu       m1, [r1+r2-4]
     movu       m2, [r1+r2-2]
-    mova       m3, [r1+r2+0]
+    MOVPIX     m3, [r1+r2+0]
     movu       m4, [r1+r2+2]
     movu       m5, [r1+r2+4]
     movu       m6, [r1+r2+6]
@@ -256,7 +268,7 @@ cglobal hpel_filter_c, 3,3,10
     pand       m1, [pd_0f]
     por        m1, m2
     CLIPW      m1, [pb_0], [pw_pixel_max]
-    mova  [r0+r2], m1
+    MOVPIX [r0+r2], m1
     add        r2, mmsize
     jl .loop
     RET
@@ -274,14 +286,14 @@ cglobal hpel_filter_h, 3,4,8
 .loop:
     movu       m1, [src-4]
     movu       m2, [src-2]
-    mova       m3, [src+0]
+    MOVPIX     m3, [src+0]
     movu       m6, [src+2]
     movu       m4, [src+4]
     movu       m5, [src+6]
     paddw      m3, m6 ; c0
     paddw      m2, m4 ; b0
     paddw      m1, m5 ; a0
-%if mmsize == 16
+%if mmsize >= 16
     movu       m4, [src-4+mmsize]
     movu       m5, [src-2+mmsize]
 %endif
@@ -290,7 +302,7 @@ cglobal hpel_filter_h, 3,4,8
     paddw      m5, m7 ; b1
     paddw      m4, m6 ; a1
     movu       m7, [src+2+mmsize]
-    mova       m6, [src+0+mmsize]
+    MOVPIX     m6, [src+0+mmsize]
     paddw      m6, m7 ; c1
     FILT_H2    m1, m2, m3, m4, m5, m6
     mova       m7, [pw_1]
@@ -298,8 +310,8 @@ cglobal hpel_filter_h, 3,4,8
     FILT_PACK  m1, m4, 1, m7, w
     CLIPW      m1, m2, m0
     CLIPW      m4, m2, m0
-    mova      [r0+r2], m1
-    mova      [r0+r2+mmsize], m4
+    MOVPIX    [r0+r2], m1
+    MOVPIX    [r0+r2+mmsize], m4
     add        r2, mmsize*2
     jl .loop
     RET
@@ -309,6 +321,8 @@ INIT_MMX mmx2
 HPEL_FILTER
 INIT_XMM sse2
 HPEL_FILTER
+INIT_YMM avx2
+HPEL_FILTER
 %endif ; HIGH_BIT_DEPTH
 
 %if HIGH_BIT_DEPTH == 0
@@ -622,6 +636,118 @@ HPEL_V 0
 HPEL_H
 %endif
 
+; The 256-bit versions store with regular unaligned writes: the rows have their
+; borders expanded right after filtering, so keeping them in cache is a win.
+INIT_YMM avx2
+;-----------------------------------------------------------------------------
+; void hpel_filter_v( uint8_t *dst, uint8_t *src, int16_t *buf, intptr_t stride, intptr_t width );
+;-----------------------------------------------------------------------------
+cglobal hpel_filter_v, 5,6,8
+    lea r5, [r1+r3]
+    sub r1, r3
+    sub r1, r3
+    add r0, r4
+    lea r2, [r2+r4*2]
+    neg r4
+    mova m0, [filt_mul15]
+.loop:
+    movu m1, [r1]
+    movu m4, [r1+r3]
+    movu m2, [r5+r3*2]
+    movu m5, [r5+r3]
+    movu m3, [r1+r3*2]
+    movu m6, [r5]
+    SBUTTERFLY bw, 1, 4, 7
+    SBUTTERFLY bw, 2, 5, 7
+    SBUTTERFLY bw, 3, 6, 7
+    pmaddubsw m1, m0
+    pmaddubsw m4, m0
+    pmaddubsw m2, m0
+    pmaddubsw m5, m0
+    pmaddubsw m3, [filt_mul20]
+    pmaddubsw m6, [filt_mul20]
+    paddw  m1, m2
+    paddw  m4, m5
+    paddw  m1, m3
+    paddw  m4, m6
+    ; the unpacks interleaved pixels 0-7,16-23 / 8-15,24-31; buf has to be linear
+    vperm2i128 m2, m1, m4, q0200
+    vperm2i128 m5, m1, m4, q0301
+    mova      m7, [pw_16]
+    movu      [r2+r4*2], m2
+    movu      [r2+r4*2+mmsize], m5
+    FILT_PACK m1, m4, 5, m7
+    movu      [r0+r4], m1
+    add r1, mmsize
+    add r5, mmsize
+    add r4, mmsize
+    jl .loop
+    RET
+
+;-----------------------------------------------------------------------------
+; void hpel_filter_c( uint8_t *dst, int16_t *buf, intptr_t width );
+;-----------------------------------------------------------------------------
+cglobal hpel_filter_c, 3,3,8
+    add r0, r2
+    lea r1, [r1+r2*2]
+    neg r2
+    %define src r1+r2*2
+    mova    m7, [pw_32]
+.loop:
+    movu    m4, [src-4]
+    movu    m5, [src-2]
+    movu    m6, [src]
+    movu    m3, [src+28]
+    movu    m2, [src+30]
+    movu    m1, [src+32]
+    paddw   m4, [src+6]
+    paddw   m5, [src+4]
+    paddw   m6, [src+2]
+    paddw   m3, [src+38]
+    paddw   m2, [src+36]
+    paddw   m1, [src+34]
+    FILT_H2 m4, m5, m6, m3, m2, m1
+    FILT_PACK m4, m3, 6, m7
+    vpermq  m4, m4, q3120 ; packuswb left pixels 0-7,16-23,8-15,24-31
+    movu [r0+r2], m4
+    add r2, mmsize
+    jl .loop
+    RET
+
+;-----------------------------------------------------------------------------
+; void hpel_filter_h( uint8_t *dst, uint8_t *src, intptr_t width );
+;-----------------------------------------------------------------------------
+cglobal hpel_filter_h, 3,3,8
+    add r0, r2
+    add r1, r2
+    neg r2
+    %define src r1+r2
+    mova      m7, [pw_16]
+.loop:
+    ; no palignr across lanes, so the taps are unaligned loads
+    movu      m0, [src-2]
+    movu      m1, [src-1]
+    movu      m2, [src+0]
+    movu      m3, [src+1]
+    movu      m4, [src+2]
+    movu      m5, [src+3]
+    pmaddubsw m0, [filt_mul15]
+    pmaddubsw m1, [filt_mul15]
+    pmaddubsw m2, [filt_mul20]
+    pmaddubsw m3, [filt_mul20]
+    pmaddubsw m4, [filt_mul51]
+    pmaddubsw m5, [filt_mul51]
+    paddw     m0, m2
+    paddw     m1, m3
+    paddw     m0, m4
+    paddw     m1, m5
+    FILT_PACK m0, m1, 5, m7
+    pshufb    m0, [hpel_shuf]
+    movu [r0+r2], m0
+    add r2, mmsize
+    jl .loop
+    RET
+
 %if ARCH_X86_64
 %macro DO_FILT_V 5
     ;The optimum prefetch distance is difficult to determine in checkasm:
@@ -631,12 +757,12 @@ HPEL_H
     ;loop iteration is going to take longer than the prefetch.
     prefetcht0 [r1+r2*2+16]
 %if cpuflag(ssse3)
-    mova m1, [r3]
-    mova m2, [r3+r2]
-    mova %3, [r3+r2*2]
-    mova m3, [r1]
-    mova %1, [r1+r2]
-    mova %2, [r1+r2*2]
+    MOVPIX m1, [r3]
+    MOVPIX m2, [r3+r2]
+    MOVPIX %3, [r3+r2*2]
+    MOVPIX m3, [r1]
+    MOVPIX %1, [r1+r2]
+    MOVPIX %2, [r1+r2*2]
     punpckhbw m4, m1, m2
     punpcklbw m1, m2
     punpckhbw m2, %1, %2
@@ -662,15 +788,37 @@ HPEL_H
     packuswb %3, %4
     FILT_V2 m1, m2, m3, m4, m5, m6
 %endif
-    add       r3, 16
-    add       r1, 16
+    add       r3, mmsize
+    add       r1, mmsize
+%if mmsize == 32
+    ; the unpacks interleaved pixels 0-7,16-23 / 8-15,24-31; filter_c wants them in order
+    vperm2i128 %1, m1, m4, q0200
+    vperm2i128 %2, m1, m4, q0301
+%else
     mova      %1, m1
     mova      %2, m4
+%endif
     FILT_PACK m1, m4, 5, m15
-    movntps  [r8+r4+%5], m1
+    HPEL_STORE [r8+r4+%5], m1
 %endmacro
 
 %macro FILT_C 4
+%if mmsize == 32
+    ; palignr only shifts within lanes, so the lanes next to the edges are paired up first
+    vperm2i128 m3, %1, %2, q0201
+    palignr   m1, %2, m3, 12
+    palignr   m2, %2, m3, 14
+    vperm2i128 %1, %2, %3, q0201
+    palignr   m3, %1, %2, 4
+    palignr   m4, %1, %2, 2
+    paddw     m3, m2
+    palignr   m2, %1, %2, 6
+    paddw     m4, %2
+    paddw     m1, m2
+    mova      %1, %3
+    FILT_H    m1, m3, m4
+    mova      %3, m1
+%else
     PALIGNR   m1, %2, %1, 12, m2
     PALIGNR   m2, %2, %1, 14, %1
     PALIGNR   m3, %3, %2, 4, %1
@@ -681,13 +829,17 @@ HPEL_H
     paddw     m4, %2
     paddw     %3, m1
     FILT_H    %3, m3, m4
+%endif
 %endmacro
 
 %macro DO_FILT_C 4
     FILT_C %1, %2, %3, 6
     FILT_C %2, %1, %4, 6
     FILT_PACK %3, %4, 6, m15
-    movntps   [r5+r4], %3
+%if mmsize == 32
+    vpermq    %3, %3, q3120 ; packuswb left pixels 0-7,16-23,8-15,24-31
+%endif
+    HPEL_STORE [r5+r4], %3
 %endmacro
 
 %macro ADD8TO16 5
@@ -700,11 +852,21 @@ HPEL_H
 %endmacro
 
 %macro DO_FILT_H 3
+%if mmsize == 32
+    vperm2i128 m3, %1, %2, q0201
+    palignr   m1, %2, m3, 14
+    palignr   m2, %2, m3, 15
+    vperm2i128 m3, %2, %3, q0201
+    palignr   m4, m3, %2, 1
+    palignr   m5, m3, %2, 2
+    palignr   m6, m3, %2, 3
+%else
     PALIGNR   m1, %2, %1, 14, m3
     PALIGNR   m2, %2, %1, 15, m3
     PALIGNR   m4, %3, %2, 1 , m3
     PALIGNR   m5, %3, %2, 2 , m3
     PALIGNR   m6, %3, %2, 3 , m3
+%endif
     mova      %1, %2
 %if cpuflag(ssse3)
     pmaddubsw m1, m12
@@ -726,18 +888,63 @@ HPEL_H
     FILT_V2   m1, m2, %2, m6, m5, m4
     FILT_PACK m1, m6, 5, m15
 %endif
-    movntps [r0+r4], m1
+    HPEL_STORE [r0+r4], m1
     mova      %2, %3
 %endmacro
 
-%macro HPEL 0
+; The 256-bit version stores with regular unaligned writes: the rows are only
+; 16-byte aligned, and hpel_filter_pad reads their ends back right away.
+%macro HPEL_STORE 2
+%if mmsize == 32
+    movu    %1, %2
+%else
+    movntps %1, %2
+%endif
+%endmacro
+
+; in: %1=dst+width-mmsize of one plane, r9=width-mmsize, r11=pad
+; replicates dst[4] over dst[4-pad..3] and dst[width-5] over dst[width-4..width-5+pad]
+; clobbers: m1, r10, r12
+%macro PAD_ROW 1
+    lea       r10, [%1+4]
+    sub       r10, r9
+    vpbroadcastb xm1, [r10]
+    mov       r12, 16
+    sub       r12, r11
+    movu [r10-16], xm1
+%%left:
+    movu [r10+r12-16], xm1
+    add       r12, 16
+    jl %%left
+    lea       r10, [%1+mmsize-4]
+    vpbroadcastb xm1, [r10-1]
+    lea       r12, [r11-16]
+    movu    [r10], xm1
+%%right:
+    movu [r10+r12], xm1
+    sub       r12, 16
+    jg %%right
+%endmacro
+
+%macro HPEL 0-1
+%ifidn %1, pad
+;-----------------------------------------------------------------------------
+; void hpel_filter_pad( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src,
+;                       intptr_t stride, int width, int height, int16_t *buf, int pad )
+;-----------------------------------------------------------------------------
+cglobal hpel_filter_pad, 7,13,16
+    movsxd    r9, r5d
+    sub       r9, mmsize
+    mov     r11d, r8m
+%else
 ;-----------------------------------------------------------------------------
 ; void hpel_filter( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc,
 ;                   uint8_t *src, intptr_t stride, int width, int height )
 ;-----------------------------------------------------------------------------
 cglobal hpel_filter, 7,9,16
+%endif
     mov       r7, r3
-    sub      r5d, 16
+    sub      r5d, mmsize
     mov       r8, r1
     and       r7, 15
     sub       r3, r7
@@ -765,17 +972,22 @@ cglobal hpel_filter, 7,9,16
     DO_FILT_V m8, m7, m13, m12, 0
 ;ALIGN 16
 .loopx:
-    DO_FILT_V m6, m5, m11, m12, 16
+    DO_FILT_V m6, m5, m11, m12, mmsize
 .lastx:
     paddw   m15, m15 ; pw_32
     DO_FILT_C m9, m8, m7, m6
     psrlw   m15, 1 ; pw_16
-    movdqa   m7, m5
+    mova     m7, m5
     DO_FILT_H m10, m13, m11
-    add      r4, 16
+    add      r4, mmsize
     jl .loopx
-    cmp      r4, 16
+    cmp      r4, mmsize
     jl .lastx
+%ifidn %1, pad
+    PAD_ROW  r0
+    PAD_ROW  r8
+    PAD_ROW  r5
+%endif
 ; setup regs for next y
     sub      r4, r7
     sub      r4, r2
@@ -787,7 +999,9 @@ cglobal hpel_filter, 7,9,16
     mov      r4, r7
     sub     r6d, 1
     jg .loopy
+%if mmsize == 16
     sfence
+%endif
     RET
 %endmacro
 
@@ -797,6 +1011,9 @@ INIT_XMM ssse3
 HPEL
 INIT_XMM avx
 HPEL
+INIT_YMM avx2
+HPEL
+HPEL pad
 %endif ; ARCH_X86_64
 
 %undef movntq
@@ -1811,3 +2028,155 @@ INIT_YMM avx
 MBTREE_AVX
 INIT_YMM avx2,fma3
 MBTREE_AVX
+
+%if HAVE_AVX512
+; 16 macroblocks per iteration. len is only padded to a multiple of 8, so the
+; loads and the store are masked with k1, which is all ones except on the last
+; iteration, where it covers just the remaining macroblocks.
+INIT_ZMM avx512
+cglobal mbtree_propagate_cost, 7,7,8
+    add            r6d, r6d
+    lea             r0, [r0+r6*2]
+    add             r1, r6
+    add             r2, r6
+    add             r3, r6
+    add             r4, r6
+    neg             r6
+    vbroadcastss  zmm6, [r5]
+    vmulps        zmm6, zmm6, [pf_inv256]{1to16}
+    kxnorw          k1, k1, k1
+    add             r6, 32
+    jg .tail
+.loop:
+    vpmovzxwd     zmm0{k1}{z}, [r2+r6-32] ; intra
+    vpmovzxwd     zmm1{k1}{z}, [r4+r6-32] ; invq
+    vpmovzxwd     zmm2{k1}{z}, [r1+r6-32] ; prop
+    vpmovzxwd     zmm3{k1}{z}, [r3+r6-32] ; inter
+    vpandd        zmm3, zmm3, [pw_3fff]{1to16}
+    vcvtdq2ps     zmm0, zmm0
+    vcvtdq2ps     zmm1, zmm1
+    vcvtdq2ps     zmm2, zmm2
+    vcvtdq2ps     zmm3, zmm3
+    vmulps        zmm1, zmm1, zmm0
+    vsubps        zmm4, zmm0, zmm3
+    vfmadd213ps   zmm1, zmm6, zmm2     ; prop + (intra*invq*fps_factor>>8)
+    vrcp14ps      zmm3, zmm0           ; 1 / intra 1st approximation
+    vmulps        zmm2, zmm0, zmm3
+    vmulps        zmm1, zmm1, zmm4     ; * (intra - inter)
+    vaddps        zmm4, zmm3, zmm3
+    vfnmadd231ps  zmm4, zmm2, zmm3     ; 2nd approximation for 1/intra
+    vmulps        zmm1, zmm1, zmm4     ; / intra
+    vcvtps2dq     zmm1, zmm1
+    vmovdqu32 [r0+r6*2-64]{k1}, zmm1
+    add             r6, 32
+    jle .loop
+.tail:
+    ; r6 is 32 minus twice the number of macroblocks left, which is at most 15
+    cmp            r6d, 32
+    jge .end
+    mov            r5d, 32
+    sub            r5d, r6d
+    shr            r5d, 1
+    vpbroadcastd  zmm7, r5d
+    vpcmpgtd        k1, zmm7, [pd_0to15]
+    jmp .loop
+.end:
+    RET
+%endif ; HAVE_AVX512
+
+; one register's worth of macroblocks, starting %1 macroblocks into the block of 8
+%macro MBTREE_PROPAGATE_LIST_STEP 1
+    movu        m0, [r0+r5*4+%1*4]  ; {x, y}
+    psraw       m1, m0, 5
+    paddw       m1, m6              ; {mbx, mby} = ({x, y}>>5) + {i, mb_y}
+%if mmsize == 32
+    paddw       m6, [pd_8]
+%else
+    paddw       m6, [pd_4]
+%endif
+    movu [r3+%1*4], m1
+
+    pmovzxwd    m2, [r2+r5*2+%1*2]  ; lowres_costs
+    pand        m2, [pd_c000]
+    pcmpeqd     m2, [pd_c000]       ; lists_used == 3
+    movu        m3, [r1+r5*4+%1*4]  ; propagate_amount
+    pmulld      m4, m3, m7
+    paddd       m4, [pd_32]
+    psrad       m4, 6               ; (propagate_amount * bipred_weight + 32) >> 6
+    pand        m4, m2
+    pandn       m2, m3
+    por         m2, m4
+    pminsd      m2, [pd_2097151]    ; keeps the products below 2^31
+
+    pand        m1, m0, [pd_31]     ; x &= 31
+    psrld       m0, 16
+    pand        m0, [pd_31]         ; y &= 31
+    mova        m3, [pd_32]
+    psubd       m4, m3, m1          ; 32 - x
+    psubd       m3, m0              ; 32 - y
+    pmaddwd     m5, m3, m4          ; idx0weight = (32-y)*(32-x)
+    pmaddwd     m3, m1              ; idx1weight = (32-y)*x
+    pmaddwd     m4, m0              ; idx2weight = y*(32-x)
+    pmaddwd     m0, m1              ; idx3weight = y*x
+    pmulld      m5, m2
+    pmulld      m3, m2
+    pmulld      m4, m2
+    pmulld      m0, m2
+    mova        m1, [pd_512]
+    paddd       m5, m1
+    paddd       m3, m1
+    paddd       m4, m1
+    paddd       m0, m1
+    psrad       m5, 10
+    psrad       m3, 10
+    psrad       m4, 10
+    psrad       m0, 10              ; (idxweight * propagate_amount + 512) >> 10
+    packusdw    m5, m3
+    packusdw    m4, m0
+    pshufb      m5, [mbtree_list_shuf]
+    pshufb      m4, [mbtree_list_shuf]
+    movu [r3+32+%1*4], m5           ; {idx0, idx1}
+    movu [r3+64+%1*4], m4           ; {idx2, idx3}
+%endmacro
+
+;-----------------------------------------------------------------------------
+; void mbtree_propagate_list_internal( int16_t (*mvs)[2], int *propagate_amount, uint16_t *lowres_costs,
+;                                      int16_t *output, int bipred_weight, int mb_y, int len )
+;-----------------------------------------------------------------------------
+%macro MBTREE_PROPAGATE_LIST 0
+cglobal mbtree_propagate_list_internal, 4,6,8
+    movu        m6, [pd_0to7]
+    movd       xm7, r5m
+    pslld      xm7, 16
+%if mmsize == 32
+    vpbroadcastd m7, xm7
+%else
+    SPLATD      m7, m7
+%endif
+    por         m6, m7              ; {i, mb_y}
+    movd       xm7, r4m
+%if mmsize == 32
+    vpbroadcastd m7, xm7            ; bipred_weight
+%else
+    SPLATD      m7, m7
+%endif
+    mov        r5d, r6m
+    lea         r0, [r0+r5*4]
+    lea         r1, [r1+r5*4]
+    lea         r2, [r2+r5*2]
+    neg         r5
+.loop:
+    MBTREE_PROPAGATE_LIST_STEP 0
+%if mmsize == 16
+    MBTREE_PROPAGATE_LIST_STEP 4
+%endif
+    add         r3, 96
+    add         r5, 8
+    jl .loop
+    RET
+%endmacro
+
+INIT_XMM sse4
+MBTREE_PROPAGATE_LIST
+INIT_YMM avx2
+MBTREE_PROPAGATE_LIST
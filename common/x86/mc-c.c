@@ -141,6 +141,12 @@ void x264_mbtree_propagate_cost_fma4( int *dst, uint16_t *propagate_in, uint16_t
                                       uint16_t *inter_costs, uint16_t *inv_qscales, float *fps_factor, int len );
 void x264_mbtree_propagate_cost_avx2_fma3( int *dst, uint16_t *propagate_in, uint16_t *intra_costs,
                                            uint16_t *inter_costs, uint16_t *inv_qscales, float *fps_factor, int len );
+void x264_mbtree_propagate_cost_avx512( int *dst, uint16_t *propagate_in, uint16_t *intra_costs,
+                                        uint16_t *inter_costs, uint16_t *inv_qscales, float *fps_factor, int len );
+void x264_mbtree_propagate_list_internal_sse4( int16_t (*mvs)[2], int *propagate_amount, uint16_t *lowres_costs,
+                                               int16_t *output, int bipred_weight, int mb_y, int len );
+void x264_mbtree_propagate_list_internal_avx2( int16_t (*mvs)[2], int *propagate_amount, uint16_t *lowres_costs,
+                                               int16_t *output, int bipred_weight, int mb_y, int len );
 
 #define MC_CHROMA(cpu)\
 void x264_mc_chroma_##cpu( pixel *dstu, pixel *dstv, intptr_t i_dst, pixel *src, intptr_t i_src,\
@@ -439,16 +445,21 @@ static void x264_hpel_filter_##cpu( pixel *dsth, pixel *dstv, pixel *dstc, pixel
 HPEL(8, mmx2, mmx2, mmx2, mmx2)
 #if HIGH_BIT_DEPTH
 HPEL(16, sse2, sse2, sse2, sse2)
+HPEL(16, avx2, avx2, avx2, avx2)
 #else // !HIGH_BIT_DEPTH
 HPEL(16, sse2_amd, mmx2, mmx2, sse2)
 #if ARCH_X86_64
 void x264_hpel_filter_sse2 ( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src, intptr_t stride, int width, int height, int16_t *buf );
 void x264_hpel_filter_ssse3( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src, intptr_t stride, int width, int height, int16_t *buf );
 void x264_hpel_filter_avx  ( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src, intptr_t stride, int width, int height, int16_t *buf );
+void x264_hpel_filter_avx2 ( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src, intptr_t stride, int width, int height, int16_t *buf );
+void x264_hpel_filter_pad_avx2( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src, intptr_t stride,
+                                int width, int height, int16_t *buf, int pad );
 #else
 HPEL(16, sse2, sse2, sse2, sse2)
 HPEL(16, ssse3, ssse3, ssse3, ssse3)
 HPEL(16, avx, avx, avx, avx)
+HPEL(16, avx2, avx2, avx2, avx2)
 #endif
 HPEL(16, sse2_misalign, sse2, sse2_misalign, sse2)
 #endif // HIGH_BIT_DEPTH
@@ -494,6 +505,110 @@ PLANE_INTERLEAVE(sse2)
 PLANE_INTERLEAVE(avx)
 #endif
 
+/* For each block of 8 macroblocks, the internal functions output the positions {mbx,mby}
+ * of the reference blocks, then the weighted amounts for the 4 macroblocks each of them
+ * overlaps, as pairs {idx0,idx1} and {idx2,idx3} saturated to 16 bits.  They process
+ * whole blocks only; the remainder of the row is prepared here.
+ * Rows are handled PROPAGATE_LIST_SPAN macroblocks at a time through a buffer on the stack,
+ * so h is only read and the function can run on any thread. */
+#define PROPAGATE_LIST_SPAN 64
+
+static void x264_mbtree_propagate_list_internal_c( int16_t (*mvs)[2], int *propagate_amount, uint16_t *lowres_costs,
+                                                   int16_t *output, int bipred_weight, int mb_y, int start, int len )
+{
+    for( int i = start; i < len; i++ )
+    {
+        int16_t *current = output + (i>>3)*48 + (i&7)*2;
+        int listamount = propagate_amount[i];
+        if( (lowres_costs[i]>>LOWRES_COST_SHIFT) == 3 )
+            listamount = (listamount * bipred_weight + 32) >> 6;
+        listamount = x264_clip3( listamount, 0, (1<<21)-1 );
+        int x = mvs[i][0];
+        int y = mvs[i][1];
+        current[0] = (x>>5)+i;
+        current[1] = (y>>5)+mb_y;
+        x &= 31;
+        y &= 31;
+        current[16] = X264_MIN( ((32-y)*(32-x) * listamount + 512) >> 10, (1<<16)-1 );
+        current[17] = X264_MIN( ((32-y)*x      * listamount + 512) >> 10, (1<<16)-1 );
+        current[32] = X264_MIN( (y*(32-x)      * listamount + 512) >> 10, (1<<16)-1 );
+        current[33] = X264_MIN( (y*x           * listamount + 512) >> 10, (1<<16)-1 );
+    }
+}
+
+#define PROPAGATE_LIST(cpu)\
+static void x264_mbtree_propagate_list_##cpu( x264_t *h, uint16_t *ref_costs, int16_t (*mvs)[2],\
+                                              int *propagate_amount, uint16_t *lowres_costs,\
+                                              int bipred_weight, int mb_y, int len, int list )\
+{\
+    ALIGNED_ARRAY_32( int16_t, buf,[PROPAGATE_LIST_SPAN/8*48] );\
+    unsigned stride = h->mb.i_mb_stride;\
+    unsigned width = h->mb.i_mb_width;\
+    unsigned height = h->mb.i_mb_height;\
+\
+    for( int span = 0; span < len; span += PROPAGATE_LIST_SPAN )\
+    {\
+        int span_len = X264_MIN( len - span, PROPAGATE_LIST_SPAN );\
+        uint16_t *current = (uint16_t*)buf;\
+        if( span_len >= 8 )\
+            x264_mbtree_propagate_list_internal_##cpu( mvs+span, propagate_amount+span, lowres_costs+span, buf,\
+                                                       bipred_weight, mb_y, span_len&~7 );\
+        x264_mbtree_propagate_list_internal_c( mvs+span, propagate_amount+span, lowres_costs+span, buf,\
+                                               bipred_weight, mb_y, span_len&~7, span_len );\
+\
+        for( int i = span; i < span + span_len; current += 32 )\
+        {\
+            int end = X264_MIN( i+8, span + span_len );\
+            for( ; i < end; i++, current += 2 )\
+            {\
+                if( !(lowres_costs[i] & (1 << (list+LOWRES_COST_SHIFT))) )\
+                    continue;\
+\
+                /* Positions are relative to the span.  Negative ones wrap around and fail the bounds checks. */\
+                unsigned mbx = (int16_t)current[0] + span;\
+                unsigned mby = (int16_t)current[1];\
+                unsigned idx0 = mbx + mby * stride;\
+                unsigned idx2 = idx0 + stride;\
+\
+                /* Shortcut for the simple/common case of zero MV */\
+                if( !M32( mvs[i] ) )\
+                {\
+                    MC_CLIP_ADD( ref_costs[idx0], current[16] );\
+                    continue;\
+                }\
+\
+                if( mbx < width-1 && mby < height-1 )\
+                {\
+                    MC_CLIP_ADD( ref_costs[idx0+0], current[16] );\
+                    MC_CLIP_ADD( ref_costs[idx0+1], current[17] );\
+                    MC_CLIP_ADD( ref_costs[idx2+0], current[32] );\
+                    MC_CLIP_ADD( ref_costs[idx2+1], current[33] );\
+                }\
+                else\
+                {\
+                    if( mby < height )\
+                    {\
+                        if( mbx < width )\
+                            MC_CLIP_ADD( ref_costs[idx0+0], current[16] );\
+                        if( mbx+1 < width )\
+                            MC_CLIP_ADD( ref_costs[idx0+1], current[17] );\
+                    }\
+                    if( mby+1 < height )\
+                    {\
+                        if( mbx < width )\
+                            MC_CLIP_ADD( ref_costs[idx2+0], current[32] );\
+                        if( mbx+1 < width )\
+                            MC_CLIP_ADD( ref_costs[idx2+1], current[33] );\
+                    }\
+                }\
+            }\
+        }\
+    }\
+}
+
+PROPAGATE_LIST(sse4)
+PROPAGATE_LIST(avx2)
+
 void x264_mc_init_mmx( int cpu, x264_mc_functions_t *pf )
 {
     if( !(cpu&X264_CPU_MMX) )
@@ -605,6 +720,9 @@ void x264_mc_init_mmx( int cpu, x264_mc_functions_t *pf )
     if( (cpu&X264_CPU_SHUFFLE_IS_FAST) && !(cpu&X264_CPU_SLOW_ATOM) )
         pf->integral_init4v = x264_integral_init4v_ssse3;
 
+    if( cpu&X264_CPU_SSE4 )
+        pf->mbtree_propagate_list = x264_mbtree_propagate_list_sse4;
+
     if( !(cpu&X264_CPU_AVX) )
         return;
 
@@ -734,6 +852,7 @@ void x264_mc_init_mmx( int cpu, x264_mc_functions_t *pf )
 
     pf->integral_init4h = x264_integral_init4h_sse4;
     pf->integral_init8h = x264_integral_init8h_sse4;
+    pf->mbtree_propagate_list = x264_mbtree_propagate_list_sse4;
 
     if( !(cpu&X264_CPU_AVX) )
         return;
@@ -762,6 +881,17 @@ void x264_mc_init_mmx( int cpu, x264_mc_functions_t *pf )
     if( !(cpu&X264_CPU_AVX2) )
         return;
 
+    pf->hpel_filter = x264_hpel_filter_avx2;
+#if !HIGH_BIT_DEPTH && ARCH_X86_64
+    pf->hpel_filter_pad = x264_hpel_filter_pad_avx2;
+#endif
+    pf->mbtree_propagate_list = x264_mbtree_propagate_list_avx2;
+
     if( cpu&X264_CPU_FMA3 )
         pf->mbtree_propagate_cost = x264_mbtree_propagate_cost_avx2_fma3;
+
+#if HAVE_AVX512
+    if( cpu&X264_CPU_AVX512 )
+        pf->mbtree_propagate_cost = x264_mbtree_propagate_cost_avx512;
+#endif
 }
@@ -34,6 +34,15 @@
 SECTION_RODATA 32
 mask_ff:   times 16 db 0xff
            times 16 db 0
+hmul_16p:  times 16 db 1
+           times 8 db 1, -1
+hmul_8p:   times 8 db 1
+           times 4 db 1, -1
+           times 8 db 1
+           times 4 db 1, -1
+mask_ac4:  times 2 dw 0, -1, -1, -1, 0, -1, -1, -1
+mask_ac4b: times 2 dw 0, -1, 0, -1, -1, -1, -1, -1
+mask_ac8:  times 2 dw 0, -1, -1, -1, -1, -1, -1, -1
 %if BIT_DEPTH == 10
 ssim_c1:   times 4 dd 6697.7856    ; .01*.01*1023*1023*64
 ssim_c2:   times 4 dd 3797644.4352 ; .03*.03*1023*1023*64*63
@@ -46,12 +55,7 @@ ssim_c2:   times 4 dd 947556       ; .03*.03*511*511*64*63
 ssim_c1:   times 4 dd 416          ; .01*.01*255*255*64
 ssim_c2:   times 4 dd 235963       ; .03*.03*255*255*64*63
 %endif
-mask_ac4:  dw 0, -1, -1, -1, 0, -1, -1, -1
-mask_ac4b: dw 0, -1, 0, -1, -1, -1, -1, -1
-mask_ac8:  dw 0, -1, -1, -1, -1, -1, -1, -1
 hmul_4p:   times 2 db 1, 1, 1, 1, 1, -1, 1, -1
-hmul_8p:   times 8 db 1
-           times 4 db 1, -1
 mask_10:   times 4 dw 0, -1
 mask_1100: times 2 dd 0, -1
 pb_pppm:   times 4 db 1,1,1,-1
@@ -805,6 +809,35 @@ INIT_XMM avx
 VAR
 INIT_XMM xop
 VAR
+
+INIT_YMM avx2
+cglobal pixel_var_16x16, 2,4,8
+    VAR_START 0
+    mov      r2d, 4
+    lea       r3, [r1*3]
+.loop:
+    pmovzxbw  m0, [r0]
+    pmovzxbw  m3, [r0+r1]
+    pmovzxbw  m1, [r0+r1*2]
+    pmovzxbw  m4, [r0+r3]
+    lea       r0, [r0+r1*4]
+    VAR_CORE
+    dec r2d
+    jg .loop
+    vextracti128 xm0, m5, 1
+    vextracti128 xm1, m6, 1
+    paddw    xm5, xm0
+    paddd    xm6, xm1
+    HADDW    xm5, xm2
+    HADDD    xm6, xm1
+%if ARCH_X86_64
+    punpckldq xm5, xm6
+    movq     rax, xm5
+%else
+    movd     eax, xm5
+    movd     edx, xm6
+%endif
+    RET
 %endif ; !HIGH_BIT_DEPTH
 
 %macro VAR2_END 1
@@ -1033,6 +1066,60 @@ VAR2_8x8_SSSE3 16, 7
 %endif
 %endmacro
 
+%macro LOAD_SUMSUB_16x2P_AVX2 9
+; 2*dst, 2*tmp, mul, 4*ptr
+    vbroadcasti128 m%1, [%6]
+    vbroadcasti128 m%3, [%7]
+    vbroadcasti128 m%2, [%8]
+    vbroadcasti128 m%4, [%9]
+    DIFF_SUMSUB_SSSE3 %1, %3, %2, %4, %5
+%endmacro
+
+%macro LOAD_SUMSUB_16x4P_AVX2 7-10 r0, r2, 0
+; 4x dest, 2x tmp, 1x mul, [2* ptr], [increment?]
+    LOAD_SUMSUB_16x2P_AVX2 %1, %2, %5, %6, %7, %8, %9, %8+r1, %9+r3
+    LOAD_SUMSUB_16x2P_AVX2 %3, %4, %5, %6, %7, %8+2*r1, %9+2*r3, %8+r4, %9+r5
+%if %10
+    lea  %8, [%8+4*r1]
+    lea  %9, [%9+4*r3]
+%endif
+%endmacro
+
+; rows 0-3 go in the low lanes and rows 4-7 in the high lanes
+; in: r4=5*stride1, r5=5*stride2
+; out: r0, r2 advanced by 2 rows
+%macro LOAD_SUMSUB_8x8P_AVX2 7 ; 4*dst, 2*tmp, mul
+    movq   xm%1, [r0]
+    movq   xm%3, [r2]
+    movq   xm%2, [r0+r1]
+    movq   xm%4, [r2+r3]
+    vinserti128 m%1, m%1, [r0+4*r1], 1
+    vinserti128 m%3, m%3, [r2+4*r3], 1
+    vinserti128 m%2, m%2, [r0+r4], 1
+    vinserti128 m%4, m%4, [r2+r5], 1
+    punpcklqdq m%1, m%1
+    punpcklqdq m%3, m%3
+    punpcklqdq m%2, m%2
+    punpcklqdq m%4, m%4
+    DIFF_SUMSUB_SSSE3 %1, %3, %2, %4, %7
+    lea      r0, [r0+2*r1]
+    lea      r2, [r2+2*r3]
+
+    movq   xm%3, [r0]
+    movq   xm%5, [r2]
+    movq   xm%4, [r0+r1]
+    movq   xm%6, [r2+r3]
+    vinserti128 m%3, m%3, [r0+4*r1], 1
+    vinserti128 m%5, m%5, [r2+4*r3], 1
+    vinserti128 m%4, m%4, [r0+r4], 1
+    vinserti128 m%6, m%6, [r2+r5], 1
+    punpcklqdq m%3, m%3
+    punpcklqdq m%5, m%5
+    punpcklqdq m%4, m%4
+    punpcklqdq m%6, m%6
+    DIFF_SUMSUB_SSSE3 %3, %5, %4, %6, %7
+%endmacro
+
 %macro LOAD_SUMSUB_16P_SSSE3 7 ; 2*dst, 2*tmp, mul, 2*ptr
     movddup m%1, [%7]
     movddup m%2, [%7+8]
@@ -3564,9 +3651,25 @@ HADAMARD_AC_WXH_MMX  8,  8
     HSUMSUB %1, %2, %3, %4, %5
 %endmacro
 
+%macro LOAD_INC_8x4W_AVX2 5
+    movu     xm%1, [r0]
+    movu     xm%2, [r0+r1]
+    movu     xm%3, [r0+r1*2]
+    movu     xm%4, [r0+r2]
+%ifidn %1, 0
+    lea       r0, [r0+r1*4]
+%endif
+    vpermq    m%1, m%1, q1100
+    vpermq    m%2, m%2, q1100
+    vpermq    m%3, m%3, q1100
+    vpermq    m%4, m%4, q1100
+    HSUMSUB %1, %2, %3, %4, %5
+%endmacro
+
 %macro HADAMARD_AC_SSE2 0
 ; in:  r0=pix, r1=stride, r2=stride*3
-; out: [esp+16]=sa8d, [esp+32]=satd, r0+=stride*4
+; out: [esp+mmsize]=sa8d, [esp+2*mmsize]=satd, r0+=stride*4
+; with ymm, the two lanes hold the 8x8 blocks at x=0 and x=8
 cglobal hadamard_ac_8x8
 %if ARCH_X86_64
     %define spill0 m8
@@ -3643,7 +3746,7 @@ cglobal hadamard_ac_8x8
     mova      m2, m6
     psubw     m7, spill2
     paddw     m3, spill2
-    mova  [rsp+gprsize+32], m1 ; save satd
+    mova  [rsp+gprsize+2*mmsize], m1 ; save satd
     mova      m1, m5
     psubw     m6, spill1
     paddw     m2, spill1
@@ -3672,15 +3775,20 @@ cglobal hadamard_ac_8x8
     ABSW      m0, m0, m7
     AC_PADD   m2, m4, [pw_1]
     AC_PADD   m2, m0, [pw_1]
-    mova [rsp+gprsize+16], m2 ; save sa8d
+    mova [rsp+gprsize+mmsize], m2 ; save sa8d
     SWAP       0, 2
     SAVE_MM_PERMUTATION
     ret
 
+%if mmsize == 32
+HADAMARD_AC_WXH_AVX2 16, 16
+HADAMARD_AC_WXH_AVX2 16,  8
+%else
 HADAMARD_AC_WXH_SSE2 16, 16
 HADAMARD_AC_WXH_SSE2  8, 16
 HADAMARD_AC_WXH_SSE2 16,  8
 HADAMARD_AC_WXH_SSE2  8,  8
+%endif
 %endmacro ; HADAMARD_AC_SSE2
 
 %macro HADAMARD_AC_WXH_SUM_SSE2 2
@@ -3756,6 +3864,42 @@ cglobal pixel_hadamard_ac_%1x%2, 2,3,11
     RET
 %endmacro ; HADAMARD_AC_WXH_SSE2
 
+%macro HADAMARD_AC_WXH_AVX2 2
+cglobal pixel_hadamard_ac_%1x%2, 2,4,11
+    mov  r3, rsp
+    and  rsp, ~31
+    sub  rsp, 3*mmsize
+    lea  r2, [r1*3]
+    call hadamard_ac_8x8
+%if %2==16
+    lea  r0, [r0+r1*4]
+    sub  rsp, 2*mmsize
+    call hadamard_ac_8x8
+%endif
+    mova    m1, [rsp+2*mmsize]
+%if %2==16
+    paddusw m0, [rsp+3*mmsize]
+    paddusw m1, [rsp+4*mmsize]
+%endif
+    vextracti128 xm2, m0, 1
+    vextracti128 xm3, m1, 1
+    paddusw xm0, xm2
+    paddusw xm1, xm3
+%if %2==16
+    psrlw   xm0, 1
+%endif
+    HADDUW  xm0, xm2
+    HADDW   xm1, xm3
+    movd   edx, xm0
+    movd   eax, xm1
+    shr    edx, 2 - (%1*%2 >> 8)
+    shr    eax, 1
+    shl    rdx, 32
+    add    rax, rdx
+    mov    rsp, r3
+    RET
+%endmacro ; HADAMARD_AC_WXH_AVX2
+
 ; instantiate satds
 
 %if ARCH_X86_64 == 0
@@ -3836,6 +3980,131 @@ INTRA_X9
 %endif
 HADAMARD_AC_SSE2
 
+%if HIGH_BIT_DEPTH == 0
+%define TRANS TRANS_SSE4
+%define LOAD_INC_8x4W LOAD_INC_8x4W_AVX2
+INIT_YMM avx2
+%if ARCH_X86_64
+HADAMARD_AC_SSE2
+%endif
+
+%macro SATD_START_AVX2 2-3 0
+%if %3
+    mova    %2, [hmul_8p]
+    lea     r4, [5*r1]
+    lea     r5, [5*r3]
+%else
+    mova    %2, [hmul_16p]
+    lea     r4, [3*r1]
+    lea     r5, [3*r3]
+%endif
+    pxor    %1, %1
+%endmacro
+
+%macro SATD_END_AVX2 0
+    vextracti128 xm0, m6, 1
+    paddw   xm0, xm6
+    HADDW   xm0, xm1
+    movd   eax, xm0
+    RET
+%endmacro
+
+cglobal pixel_satd_16x8_internal
+    LOAD_SUMSUB_16x4P_AVX2 0, 1, 2, 3, 4, 5, 7, r0, r2, 1
+    SATD_8x4_SSE 0, 0, 1, 2, 3, 4, 5, 6
+    LOAD_SUMSUB_16x4P_AVX2 0, 1, 2, 3, 4, 5, 7, r0, r2, 0
+    SATD_8x4_SSE 0, 0, 1, 2, 3, 4, 5, 6
+    ret
+
+cglobal pixel_satd_16x16, 4,6,8
+    SATD_START_AVX2 m6, m7
+    call pixel_satd_16x8_internal
+    lea  r0, [r0+4*r1]
+    lea  r2, [r2+4*r3]
+    call pixel_satd_16x8_internal
+    SATD_END_AVX2
+
+cglobal pixel_satd_16x8, 4,6,8
+    SATD_START_AVX2 m6, m7
+    call pixel_satd_16x8_internal
+    SATD_END_AVX2
+
+cglobal pixel_satd_8x8_internal
+    LOAD_SUMSUB_8x8P_AVX2 0, 1, 2, 3, 4, 5, 7
+    SATD_8x4_SSE 0, 0, 1, 2, 3, 4, 5, 6
+    ret
+
+cglobal pixel_satd_8x16, 4,6,8
+    SATD_START_AVX2 m6, m7, 1
+    call pixel_satd_8x8_internal
+    lea  r0, [r0+2*r1]
+    lea  r2, [r2+2*r3]
+    lea  r0, [r0+4*r1]
+    lea  r2, [r2+4*r3]
+    call pixel_satd_8x8_internal
+    SATD_END_AVX2
+
+cglobal pixel_satd_8x8, 4,6,8
+    SATD_START_AVX2 m6, m7, 1
+    call pixel_satd_8x8_internal
+    SATD_END_AVX2
+
+; the amax pass leaves at most 2*32*255 per word, so each block is widened to
+; dwords before accumulating into m6
+cglobal pixel_sa8d_8x8_internal
+    LOAD_SUMSUB_8x8P_AVX2 0, 1, 2, 3, 4, 5, 7
+    HADAMARD4_V 0, 1, 2, 3, 4
+    HADAMARD 8, sumsub, 0, 1, 4, 5
+    HADAMARD 8, sumsub, 2, 3, 4, 5
+    HADAMARD 2, sumsub, 0, 1, 4, 5
+    HADAMARD 2, sumsub, 2, 3, 4, 5
+    HADAMARD 1, amax, 0, 1, 4, 5
+    HADAMARD 1, amax, 2, 3, 4, 5
+    paddw   m0, m2
+    pmaddwd m0, [pw_1]
+    paddd   m6, m0
+    ret
+
+%macro SA8D_END_AVX2 0
+    vextracti128 xm1, m6, 1
+    paddd   xm6, xm1
+    HADDD   xm6, xm1
+    movd   eax, xm6
+    add    eax, 1
+    shr    eax, 1
+    RET
+%endmacro
+
+cglobal pixel_sa8d_8x8, 4,6,8
+    SATD_START_AVX2 m6, m7, 1
+    call pixel_sa8d_8x8_internal
+    SA8D_END_AVX2
+
+cglobal pixel_sa8d_16x16, 4,6,8
+    SATD_START_AVX2 m6, m7, 1
+    call pixel_sa8d_8x8_internal ; pix[0]
+    sub  r0, r1
+    sub  r0, r1
+    add  r0, 8
+    sub  r2, r3
+    sub  r2, r3
+    add  r2, 8
+    call pixel_sa8d_8x8_internal ; pix[8]
+    add  r0, r4
+    add  r0, r1
+    add  r2, r5
+    add  r2, r3
+    call pixel_sa8d_8x8_internal ; pix[8*stride+8]
+    sub  r0, r1
+    sub  r0, r1
+    sub  r0, 8
+    sub  r2, r3
+    sub  r2, r3
+    sub  r2, 8
+    call pixel_sa8d_8x8_internal ; pix[8*stride]
+    SA8D_END_AVX2
+%endif ; !HIGH_BIT_DEPTH
+
 ;=============================================================================
 ; SSIM
 ;=============================================================================
@@ -75,6 +75,9 @@ chroma_dc_dmf_mask_mmx: dw 0, 0,-1,-1, 0,-1,-1, 0
 chroma_dc_dct_mask:     dw 1, 1,-1,-1, 1, 1,-1,-1
 chroma_dc_dmf_mask:     dw 1, 1,-1,-1, 1,-1,-1, 1
 
+; restores coefficient order after packssdw+packsswb of 32 dwords in ymm registers
+deinterleave_dw:        dd 0, 4, 1, 5, 2, 6, 3, 7
+
 SECTION .text
 
 cextern pb_1
@@ -83,19 +86,29 @@ cextern pd_1
 cextern pb_01
 cextern pd_1024
 
+; Coefficient arrays are only guaranteed 16-byte alignment, so 256-bit
+; accesses to them have to be unaligned.
+%macro MOVDCT 2
+%if mmsize == 32
+    movu        %1, %2
+%else
+    mova        %1, %2
+%endif
+%endmacro
+
 %macro QUANT_DC_START 0
-    movd       m6, r1m     ; mf
-    movd       m7, r2m     ; bias
+    movd       xm6, r1m    ; mf
+    movd       xm7, r2m    ; bias
 %if HIGH_BIT_DEPTH
-    SPLATD     m6, m6
-    SPLATD     m7, m7
-%elif cpuflag(sse4) ; ssse3, but not faster on conroe
+    SPLATD     m6, xm6
+    SPLATD     m7, xm7
+%elif cpuflag(sse4) && notcpuflag(avx2) ; ssse3, but not faster on conroe
     mova       m5, [pb_01]
     pshufb     m6, m5
     pshufb     m7, m5
 %else
-    SPLATW     m6, m6
-    SPLATW     m7, m7
+    SPLATW     m6, xm6
+    SPLATW     m7, xm7
 %endif
 %endmacro
 
@@ -126,10 +139,41 @@ cextern pd_1024
     setne     al
 %endmacro
 
+; quant_4x4x4 keeps one nonzero flag per block: the accumulated coefficients of
+; block %2, in m5, are packed (with %1) into m6 for blocks 0-1 and m7 for 2-3.
+%macro QUANT_4x4x4_ACCUM 2
+%if %2 == 0
+    mova      m6, m5
+%elif %2 == 1
+    %1        m6, m5
+%elif %2 == 2
+    mova      m7, m5
+%else
+    %1        m7, m5
+%endif
+%endmacro
+
+; Reduces the flags to bytes 0-3 of xm6 and returns them as a 4-bit mask.
+%macro QUANT_4x4x4_END 0
+    packsswb  m6, m7
+%if mmsize == 32
+    vextracti128 xm7, m6, 1
+    por       xm6, xm7
+%endif
+    packsswb  xm6, xm6
+    packsswb  xm6, xm6
+    pxor      xm7, xm7
+    pcmpeqb   xm6, xm7
+    pmovmskb  eax, xm6
+    not       eax
+    and       eax, 0xf
+    RET
+%endmacro
+
 %if HIGH_BIT_DEPTH
 %macro QUANT_ONE_DC 4
 %if cpuflag(sse4)
-    mova        m0, [%1]
+    MOVDCT      m0, [%1]
     ABSD        m1, m0
     paddd       m1, %3
     pmulld      m1, %2
@@ -153,8 +197,8 @@ cextern pd_1024
 
 %macro QUANT_TWO_DC 4
 %if cpuflag(sse4)
-    mova        m0, [%1       ]
-    mova        m1, [%1+mmsize]
+    MOVDCT      m0, [%1       ]
+    MOVDCT      m1, [%1+mmsize]
     ABSD        m2, m0
     ABSD        m3, m1
     paddd       m2, %3
@@ -165,8 +209,8 @@ cextern pd_1024
     psrad       m3, 16
     PSIGND      m2, m0
     PSIGND      m3, m1
-    mova [%1       ], m2
-    mova [%1+mmsize], m3
+    MOVDCT [%1       ], m2
+    MOVDCT [%1+mmsize], m3
     ACCUM      por, 5, 2, %4
     por         m5, m3
 %else ; !sse4
@@ -196,8 +240,8 @@ cextern pd_1024
 
 %macro QUANT_TWO_AC 4
 %if cpuflag(sse4)
-    mova        m0, [%1       ]
-    mova        m1, [%1+mmsize]
+    MOVDCT      m0, [%1       ]
+    MOVDCT      m1, [%1+mmsize]
     ABSD        m2, m0
     ABSD        m3, m1
     paddd       m2, [%3       ]
@@ -208,8 +252,8 @@ cextern pd_1024
     psrad       m3, 16
     PSIGND      m2, m0
     PSIGND      m3, m1
-    mova [%1       ], m2
-    mova [%1+mmsize], m3
+    MOVDCT [%1       ], m2
+    MOVDCT [%1+mmsize], m3
     ACCUM      por, 5, 2, %4
     por         m5, m3
 %else ; !sse4
@@ -251,23 +295,50 @@ cglobal quant_%1x%2, 3,3,8
     RET
 %endmacro
 
+;-----------------------------------------------------------------------------
+; int quant_4x4x4( int32_t dct[4][16], uint32_t mf[16], uint32_t bias[16] )
+;-----------------------------------------------------------------------------
+%macro QUANT_4x4x4 0
+cglobal quant_4x4x4, 3,3,8
+%assign i 0
+%rep 4
+%assign x 0
+%rep 16/(mmsize/2)
+    QUANT_TWO_AC r0+64*i+x, r1+x, r2+x, x
+%assign x x+mmsize*2
+%endrep
+    QUANT_4x4x4_ACCUM packssdw, i
+%assign i i+1
+%endrep
+    QUANT_4x4x4_END
+%endmacro
+
 INIT_XMM sse2
 QUANT_DC 2, 2
 QUANT_DC 4, 4
 QUANT_AC 4, 4
 QUANT_AC 8, 8
+QUANT_4x4x4
 
 INIT_XMM ssse3
 QUANT_DC 2, 2
 QUANT_DC 4, 4
 QUANT_AC 4, 4
 QUANT_AC 8, 8
+QUANT_4x4x4
 
 INIT_XMM sse4
 QUANT_DC 2, 2
 QUANT_DC 4, 4
 QUANT_AC 4, 4
 QUANT_AC 8, 8
+QUANT_4x4x4
+
+INIT_YMM avx2
+QUANT_DC 4, 4
+QUANT_AC 4, 4
+QUANT_AC 8, 8
+QUANT_4x4x4
 
 %endif ; HIGH_BIT_DEPTH
 
@@ -276,18 +347,18 @@ QUANT_AC 8, 8
 ;;; %1      (m64)       dct[y][x]
 ;;; %2      (m64/mmx)   mf[y][x] or mf[0][0] (as uint16_t)
 ;;; %3      (m64/mmx)   bias[y][x] or bias[0][0] (as uint16_t)
-    mova       m1, %1   ; load dct coeffs
+    MOVDCT     m1, %1   ; load dct coeffs
     ABSW       m0, m1, sign
     paddusw    m0, %3   ; round
     pmulhuw    m0, %2   ; divide
     PSIGNW     m0, m1   ; restore sign
-    mova       %1, m0   ; store
+    MOVDCT     %1, m0   ; store
     ACCUM     por, 5, 0, %4
 %endmacro
 
 %macro QUANT_TWO 7
-    mova       m1, %1
-    mova       m3, %2
+    MOVDCT     m1, %1
+    MOVDCT     m3, %2
     ABSW       m0, m1, sign
     ABSW       m2, m3, sign
     paddusw    m0, %5
@@ -296,8 +367,8 @@ QUANT_AC 8, 8
     pmulhuw    m2, %4
     PSIGNW     m0, m1
     PSIGNW     m2, m3
-    mova       %1, m0
-    mova       %2, m2
+    MOVDCT     %1, m0
+    MOVDCT     %2, m2
     ACCUM     por, 5, 0, %7
     por        m5, m2
 %endmacro
@@ -326,15 +397,37 @@ cglobal %1, 1,1,%3
 ;-----------------------------------------------------------------------------
 %macro QUANT_AC 2
 cglobal %1, 3,3
+%if %2==1
+    QUANT_ONE [r0], [r1], [r2], 0
+%else
 %assign x 0
 %rep %2/2
     QUANT_TWO [r0+x], [r0+x+mmsize], [r1+x], [r1+x+mmsize], [r2+x], [r2+x+mmsize], x
 %assign x x+mmsize*2
 %endrep
+%endif
     QUANT_END
     RET
 %endmacro
 
+;-----------------------------------------------------------------------------
+; int quant_4x4x4( int16_t dct[4][16], uint16_t mf[16], uint16_t bias[16] )
+;-----------------------------------------------------------------------------
+%macro QUANT_4x4x4 0
+cglobal quant_4x4x4, 3,3,8
+%assign i 0
+%rep 4
+%if mmsize == 32
+    QUANT_ONE [r0+32*i], [r1], [r2], 0
+%else
+    QUANT_TWO [r0+32*i], [r0+32*i+16], [r1], [r1+16], [r2], [r2+16], 0
+%endif
+    QUANT_4x4x4_ACCUM packsswb, i
+%assign i i+1
+%endrep
+    QUANT_4x4x4_END
+%endmacro
+
 INIT_MMX mmx2
 QUANT_DC quant_2x2_dc, 1
 %if ARCH_X86_64 == 0 ; not needed because sse2 is faster
@@ -348,11 +441,13 @@ INIT_XMM sse2
 QUANT_DC quant_4x4_dc, 2, 8
 QUANT_AC quant_4x4, 2
 QUANT_AC quant_8x8, 8
+QUANT_4x4x4
 
 INIT_XMM ssse3
 QUANT_DC quant_4x4_dc, 2, 8
 QUANT_AC quant_4x4, 2
 QUANT_AC quant_8x8, 8
+QUANT_4x4x4
 
 INIT_MMX ssse3
 QUANT_DC quant_2x2_dc, 1
@@ -362,6 +457,12 @@ INIT_XMM sse4
 QUANT_DC quant_4x4_dc, 2, 8
 QUANT_AC quant_4x4, 2
 QUANT_AC quant_8x8, 8
+
+INIT_YMM avx2
+QUANT_DC quant_4x4_dc, 1, 8
+QUANT_AC quant_4x4, 1
+QUANT_AC quant_8x8, 4
+QUANT_4x4x4
 %endif ; !HIGH_BIT_DEPTH
 
 
@@ -408,6 +509,59 @@ QUANT_AC quant_8x8, 8
     mova      %1, m0
 %endmacro
 
+; 256-bit versions of DEQUANT16_L and DEQUANT32_R for the 16 coefficients at %1.
+; The 8-bit ones pair up dequant_mf with the lane order of the word<->dword packs.
+%macro DEQUANT16_L_YMM 1
+%if HIGH_BIT_DEPTH
+    movu      m0, [r1+%1*4]
+    movu      m1, [r1+%1*4+32]
+    pmaddwd   m0, [r0+%1*4]
+    pmaddwd   m1, [r0+%1*4+32]
+    pslld     m0, xm2
+    pslld     m1, xm2
+    movu      [r0+%1*4], m0
+    movu      [r0+%1*4+32], m1
+%else
+    movu      m0, [r1+%1*4]
+    packssdw  m0, [r1+%1*4+32]
+    vpermq    m0, m0, q3120
+    pmullw    m0, [r0+%1*2]
+    psllw     m0, xm2
+    movu      [r0+%1*2], m0
+%endif
+%endmacro
+
+%macro DEQUANT32_R_YMM 1
+%if HIGH_BIT_DEPTH
+    movu      m0, [r0+%1*4]
+    movu      m1, [r0+%1*4+32]
+    pmaddwd   m0, [r1+%1*4]
+    pmaddwd   m1, [r1+%1*4+32]
+    paddd     m0, m3
+    paddd     m1, m3
+    psrad     m0, xm2
+    psrad     m1, xm2
+    movu      [r0+%1*4], m0
+    movu      [r0+%1*4+32], m1
+%else
+    movu      m0, [r0+%1*2]
+    movu      xm5, [r1+%1*4]
+    vinserti128 m5, m5, [r1+%1*4+32], 1
+    punpckhwd m1, m0, m4
+    punpcklwd m0, m4
+    pmaddwd   m0, m5
+    movu      xm5, [r1+%1*4+16]
+    vinserti128 m5, m5, [r1+%1*4+48], 1
+    pmaddwd   m1, m5
+    paddd     m0, m3
+    paddd     m1, m3
+    psrad     m0, xm2
+    psrad     m1, xm2
+    packssdw  m0, m1
+    movu      [r0+%1*2], m0
+%endif
+%endmacro
+
 %macro DEQUANT_LOOP 3
 %if 8*(%2-2*%3)
     mov t0d, 8*(%2-2*%3)
@@ -476,19 +630,42 @@ cglobal dequant_%1x%1, 0,3,6
     DEQUANT_START %2+2, %2
 
 .lshift:
-    movd m2, t0d
+    movd xm2, t0d
+%if mmsize == 32
+%assign x 0
+%rep %1*%1/16
+    DEQUANT16_L_YMM x
+%assign x x+16
+%endrep
+    RET
+%else
     DEQUANT_LOOP DEQUANT16_L, %1*%1/4, %3
+%endif
 
 .rshift32:
     neg   t0d
-    movd  m2, t0d
+    movd xm2, t0d
+%if mmsize == 32
+    pcmpeqd m3, m3
+    psrld m3, 31
+%else
     mova  m3, [pd_1]
+%endif
     pxor  m4, m4
-    pslld m3, m2
+    pslld m3, xm2
     psrld m3, 1
+%if mmsize == 32
+%assign x 0
+%rep %1*%1/16
+    DEQUANT32_R_YMM x
+%assign x x+16
+%endrep
+    RET
+%else
     DEQUANT_LOOP DEQUANT32_R, %1*%1/4, %3
+%endif
 
-%if HIGH_BIT_DEPTH == 0 && notcpuflag(avx)
+%if HIGH_BIT_DEPTH == 0 && (notcpuflag(avx) || mmsize == 32)
 cglobal dequant_%1x%1_flat16, 0,3
     movifnidn t2d, r2m
 %if %1 == 8
@@ -509,8 +686,29 @@ cglobal dequant_%1x%1_flat16, 0,3
     lea  r1, [dequant%1_scale + t2]
 %endif
     movifnidn r0, r0mp
-    movd m4, t0d
+    movd xm4, t0d
+%if mmsize == 32
 %if %1 == 4
+    vbroadcasti128 m0, [r1]
+    psllw     m0, xm4
+    pmullw    m0, [r0]
+    movu    [r0], m0
+%else
+    movu      m0, [r1]          ; rows 0,1 and 4,5
+    movu     xm1, [r1+32]       ; rows 2,3 and 6,7
+    vinserti128 m1, m1, [r1+16], 1
+    psllw     m0, xm4
+    psllw     m1, xm4
+    pmullw    m2, m0, [r0]
+    pmullw    m3, m1, [r0+32]
+    pmullw    m0, [r0+64]
+    pmullw    m1, [r0+96]
+    movu    [r0], m2
+    movu [r0+32], m3
+    movu [r0+64], m0
+    movu [r0+96], m1
+%endif
+%elif %1 == 4
 %if mmsize == 8
     DEQUANT16_FLAT [r1], 0, 16
     DEQUANT16_FLAT [r1+8], 8, 24
@@ -528,7 +726,7 @@ cglobal dequant_%1x%1_flat16, 0,3
     DEQUANT16_FLAT [r1+32], 32, 96
 %endif
     RET
-%endif ; !HIGH_BIT_DEPTH && !AVX
+%endif ; !HIGH_BIT_DEPTH && (!AVX || AVX2)
 %endmacro ; DEQUANT
 
 %if HIGH_BIT_DEPTH
@@ -538,6 +736,9 @@ DEQUANT 8, 6, 1
 INIT_XMM xop
 DEQUANT 4, 4, 1
 DEQUANT 8, 6, 1
+INIT_YMM avx2
+DEQUANT 4, 4, 1
+DEQUANT 8, 6, 1
 %else
 %if ARCH_X86_64 == 0
 INIT_MMX mmx
@@ -553,6 +754,9 @@ DEQUANT 8, 6, 2
 INIT_XMM xop
 DEQUANT 4, 4, 2
 DEQUANT 8, 6, 2
+INIT_YMM avx2
+DEQUANT 4, 4, 2
+DEQUANT 8, 6, 2
 %endif
 
 %macro DEQUANT_DC 2
@@ -560,54 +764,67 @@ cglobal dequant_4x4dc, 0,3,6
     DEQUANT_START 6, 6
 
 .lshift:
-    movd     m3, [r1]
-    movd     m2, t0d
-    pslld    m3, m2
-    SPLAT%1  m3, m3, 0
+    movd    xm3, [r1]
+    movd    xm2, t0d
+    pslld   xm3, xm2
+    SPLAT%1  m3, xm3, 0
+%if SIZEOF_PIXEL*32 == mmsize
+    %2       m0, m3, [r0]
+    movu   [r0], m0
+%else
 %assign x 0
 %rep SIZEOF_PIXEL*16/mmsize
-    mova     m0, [r0+mmsize*0+x]
-    mova     m1, [r0+mmsize*1+x]
+    MOVDCT   m0, [r0+mmsize*0+x]
+    MOVDCT   m1, [r0+mmsize*1+x]
     %2       m0, m3
     %2       m1, m3
-    mova     [r0+mmsize*0+x], m0
-    mova     [r0+mmsize*1+x], m1
+    MOVDCT   [r0+mmsize*0+x], m0
+    MOVDCT   [r0+mmsize*1+x], m1
 %assign x x+mmsize*2
 %endrep
+%endif
     RET
 
 .rshift32:
     neg   t0d
-    movd  m3, t0d
+    movd xm3, t0d
+%if mmsize == 32
+    vpbroadcastd m4, [p%1_1]
+%else
     mova  m4, [p%1_1]
+%endif
     mova  m5, m4
-    pslld m4, m3
+    pslld m4, xm3
     psrld m4, 1
-    movd  m2, [r1]
+    movd xm2, [r1]
 %assign x 0
 %if HIGH_BIT_DEPTH
-    pshufd m2, m2, 0
+    SPLATD m2, xm2
 %rep SIZEOF_PIXEL*32/mmsize
-    mova      m0, [r0+x]
+    MOVDCT    m0, [r0+x]
     pmadcswd  m0, m0, m2, m4
-    psrad     m0, m3
-    mova      [r0+x], m0
+    psrad     m0, xm3
+    MOVDCT    [r0+x], m0
 %assign x x+mmsize
 %endrep
 
 %else ; !HIGH_BIT_DEPTH
+%if mmsize == 32
+    vpbroadcastw m2, xm2
+%else
     PSHUFLW   m2, m2, 0
+%endif
     punpcklwd m2, m4
 %rep SIZEOF_PIXEL*32/mmsize
-    mova      m0, [r0+x]
+    MOVDCT    m0, [r0+x]
     punpckhwd m1, m0, m5
     punpcklwd m0, m5
     pmaddwd   m0, m2
     pmaddwd   m1, m2
-    psrad     m0, m3
-    psrad     m1, m3
+    psrad     m0, xm3
+    psrad     m1, xm3
     packssdw  m0, m1
-    mova      [r0+x], m0
+    MOVDCT    [r0+x], m0
 %assign x x+mmsize
 %endrep
 %endif ; !HIGH_BIT_DEPTH
@@ -619,6 +836,8 @@ INIT_XMM sse2
 DEQUANT_DC d, pmaddwd
 INIT_XMM xop
 DEQUANT_DC d, pmaddwd
+INIT_YMM avx2
+DEQUANT_DC d, pmaddwd
 %else
 %if ARCH_X86_64 == 0
 INIT_MMX mmx2
@@ -628,6 +847,8 @@ INIT_XMM sse2
 DEQUANT_DC w, pmullw
 INIT_XMM avx
 DEQUANT_DC w, pmullw
+INIT_YMM avx2
+DEQUANT_DC w, pmullw
 %endif
 
 ; t4 is eax for return value.
@@ -852,7 +1073,28 @@ DENOISE_DCT
 ;-----------------------------------------------------------------------------
 
 %macro DECIMATE_MASK 5
-%if mmsize==16
+%if mmsize==32
+%if HIGH_BIT_DEPTH
+    movu      m0, [%3+  0]
+    movu      m1, [%3+ 64]
+    packssdw  m0, [%3+ 32]
+    packssdw  m1, [%3+ 96]
+    ABSW2     m0, m1, m0, m1, m2, m3
+    packsswb  m0, m1
+    vpermd    m0, m4, m0 ; m4 = deinterleave_dw
+%else
+    ABSW      m0, [%3+ 0], m3
+    ABSW      m1, [%3+32], m4
+    packsswb  m0, m1
+    vpermq    m0, m0, q3120
+%endif
+    pxor      m2, m2
+    pcmpeqb   m2, m0
+    pcmpgtb   m0, %4
+    pmovmskb  %1, m2
+    pmovmskb  %2, m0
+
+%elif mmsize==16
 %if HIGH_BIT_DEPTH
     movdqa   xmm0, [%3+ 0]
     movdqa   xmm1, [%3+32]
@@ -993,6 +1235,21 @@ cglobal decimate_score64, 1,5
     %define table decimate_table8
 %endif
     mova  m5, [pb_1]
+%if mmsize == 32
+%if HIGH_BIT_DEPTH
+    movu  m4, [deinterleave_dw]
+%endif
+    DECIMATE_MASK r1d, eax, r0+SIZEOF_DCTCOEF* 0, m5, null
+    test  eax, eax
+    jne  .ret9
+    DECIMATE_MASK r2d, eax, r0+SIZEOF_DCTCOEF*32, m5, null
+    shl   r2, 32
+    or    r1, r2
+    xor   r1, -1
+    je   .ret
+    test  eax, eax
+    jne  .ret9
+%else
     DECIMATE_MASK r1d, eax, r0+SIZEOF_DCTCOEF* 0, m5, null
     test  eax, eax
     jne  .ret9
@@ -1010,6 +1267,7 @@ cglobal decimate_score64, 1,5
     je   .ret
     add   eax, r3d
     jne  .ret9
+%endif
 .loop:
     tzcnt rcx, r1
     shr   r1, cl
@@ -1090,6 +1348,10 @@ INIT_XMM sse2
 DECIMATE8x8
 INIT_XMM ssse3
 DECIMATE8x8
+%if ARCH_X86_64
+INIT_YMM avx2
+DECIMATE8x8
+%endif
 
 ;-----------------------------------------------------------------------------
 ; int coeff_last( dctcoef *dct )
@@ -1328,6 +1590,57 @@ COEFF_LAST
 INIT_XMM sse2, lzcnt
 COEFF_LAST
 
+%macro LAST_MASK_AVX2 2
+%if HIGH_BIT_DEPTH
+    movu     m0, [%2+ 0]
+    packssdw m0, [%2+32]
+    movu     m1, [%2+64]
+    packssdw m1, [%2+96]
+    packsswb m0, m1
+    vpermd   m0, m3, m0 ; m3 = deinterleave_dw
+%else
+    movu     m0, [%2+ 0]
+    packsswb m0, [%2+32]
+    vpermq   m0, m0, q3120
+%endif
+    pcmpeqb  m0, m2
+    pmovmskb %1, m0
+%endmacro
+
+%macro COEFF_LAST64_AVX2 0
+cglobal coeff_last64, 1,3
+    pxor m2, m2
+%if HIGH_BIT_DEPTH
+    movu m3, [deinterleave_dw]
+%endif
+%if ARCH_X86_64
+    LAST_MASK_AVX2 r1d, r0+SIZEOF_DCTCOEF* 0
+    LAST_MASK_AVX2 r2d, r0+SIZEOF_DCTCOEF*32
+    shl  r2, 32
+    or   r1, r2
+    not  r1
+    BSR rax, r1, 0x3f
+    RET
+%else
+    LAST_MASK_AVX2 r1d, r0+SIZEOF_DCTCOEF*32
+    xor r1d, -1
+    jne .secondhalf
+    LAST_MASK_AVX2 r1d, r0+SIZEOF_DCTCOEF* 0
+    not r1d
+    BSR eax, r1d, 0x1f
+    RET
+.secondhalf:
+    BSR eax, r1d, 0x1f
+    add eax, 32
+    RET
+%endif
+%endmacro
+
+INIT_YMM avx2
+COEFF_LAST64_AVX2
+INIT_YMM avx2, lzcnt
+COEFF_LAST64_AVX2
+
 ;-----------------------------------------------------------------------------
 ; int coeff_level_run( dctcoef *dct, run_level_t *runlevel )
 ;-----------------------------------------------------------------------------
@@ -1341,6 +1654,15 @@ COEFF_LAST
     DECLARE_REG_TMP 6,3,2,1,4,5,0
 %endif
 
+; shlx takes its count from any register and leaves the flags alone
+%macro SHL_COUNT 2
+%if cpuflag(bmi2)
+    shlx   %1d, %1d, %2d
+%else
+    shl    %1d, %2b
+%endif
+%endmacro
+
 %macro COEFF_LEVELRUN 1
 cglobal coeff_level_run%1,0,7
     movifnidn t0, r0mp
@@ -1362,7 +1684,7 @@ cglobal coeff_level_run%1,0,7
     xor    t6d, t6d
     add    t5d, t5d
     sub    t4d, t3d
-    shl    t5d, t3b
+    SHL_COUNT t5, t3
     mov   [t1], t4d
 .loop:
     LZCOUNT t3d, t5d, 0x1f
@@ -1372,7 +1694,7 @@ cglobal coeff_level_run%1,0,7
     mov    t2w, [t0+t4*2]
 %endif
     inc    t3d
-    shl    t5d, t3b
+    SHL_COUNT t5, t3
 %if HIGH_BIT_DEPTH
     mov   [t1+t6*4+ 8], t2d
 %else
@@ -1406,3 +1728,12 @@ COEFF_LEVELRUN 16
 INIT_MMX mmx2, lzcnt
 COEFF_LEVELRUN 4
 COEFF_LEVELRUN 8
+INIT_XMM sse2, bmi2
+%if HIGH_BIT_DEPTH
+COEFF_LEVELRUN 8
+%endif
+COEFF_LEVELRUN 15
+COEFF_LEVELRUN 16
+INIT_MMX mmx2, bmi2
+COEFF_LEVELRUN 4
+COEFF_LEVELRUN 8
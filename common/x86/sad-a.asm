@@ -227,6 +227,56 @@ SAD_W16
 INIT_XMM sse2, aligned
 SAD_W16
 
+%macro SAD_INC_4x16P_AVX2 1
+    movu       xm1, [r2]
+    movu       xm2, [r2+r3*2]
+    vinserti128 m1, m1, [r2+r3], 1
+    vinserti128 m2, m2, [r2+r5], 1
+    movu       xm3, [r0]
+    movu       xm4, [r0+r1*2]
+    vinserti128 m3, m3, [r0+r1], 1
+    vinserti128 m4, m4, [r0+r4], 1
+    psadbw      m1, m3
+    psadbw      m2, m4
+    lea         r0, [r0+4*r1]
+    lea         r2, [r2+4*r3]
+%if %1
+    paddw       m0, m1, m2
+%else
+    paddw       m1, m2
+    paddw       m0, m1
+%endif
+%endmacro
+
+%macro SAD_END_AVX2 0
+    vextracti128 xm1, m0, 1
+    paddw   xm0, xm1
+    movhlps xm1, xm0
+    paddw   xm0, xm1
+    movd   eax, xm0
+    RET
+%endmacro
+
+;-----------------------------------------------------------------------------
+; int pixel_sad_16x16( uint8_t *, intptr_t, uint8_t *, intptr_t )
+;-----------------------------------------------------------------------------
+INIT_YMM avx2
+cglobal pixel_sad_16x16, 4,6,5
+    lea     r4, [3*r1]
+    lea     r5, [3*r3]
+    SAD_INC_4x16P_AVX2 1
+    SAD_INC_4x16P_AVX2 0
+    SAD_INC_4x16P_AVX2 0
+    SAD_INC_4x16P_AVX2 0
+    SAD_END_AVX2
+
+cglobal pixel_sad_16x8, 4,6,5
+    lea     r4, [3*r1]
+    lea     r5, [3*r3]
+    SAD_INC_4x16P_AVX2 1
+    SAD_INC_4x16P_AVX2 0
+    SAD_END_AVX2
+
 %macro SAD_INC_4x8P_SSE 1
     movq    m1, [r0]
     movq    m2, [r0+r1]
@@ -1221,6 +1271,223 @@ SAD_X_SSE2 3, 16,  8
 SAD_X_SSE2 4, 16, 16
 SAD_X_SSE2 4, 16,  8
 
+; AVX2: two rows per register. The two fenc rows are adjacent (FENC_STRIDE=16),
+; so they are used directly as the memory operand of psadbw.
+%macro SAD_X3_2x16P_AVX2 1
+    movu       xm3, [r1]
+    movu       xm4, [r2]
+    movu       xm5, [r3]
+    vinserti128 m3, m3, [r1+r4], 1
+    vinserti128 m4, m4, [r2+r4], 1
+    vinserti128 m5, m5, [r3+r4], 1
+%if %1
+    psadbw      m0, m3, [r0]
+    psadbw      m1, m4, [r0]
+    psadbw      m2, m5, [r0]
+%else
+    psadbw      m3, [r0]
+    psadbw      m4, [r0]
+    psadbw      m5, [r0]
+    paddw       m0, m3
+    paddw       m1, m4
+    paddw       m2, m5
+%endif
+    add  r0, 2*FENC_STRIDE
+    lea  r1, [r1+2*r4]
+    lea  r2, [r2+2*r4]
+    lea  r3, [r3+2*r4]
+%endmacro
+
+%macro SAD_X4_2x16P_AVX2 1
+    movu       xm4, [r1]
+    movu       xm5, [r2]
+    movu       xm6, [r3]
+    movu       xm7, [r4]
+    vinserti128 m4, m4, [r1+r5], 1
+    vinserti128 m5, m5, [r2+r5], 1
+    vinserti128 m6, m6, [r3+r5], 1
+    vinserti128 m7, m7, [r4+r5], 1
+%if %1
+    psadbw      m0, m4, [r0]
+    psadbw      m1, m5, [r0]
+    psadbw      m2, m6, [r0]
+    psadbw      m3, m7, [r0]
+%else
+    psadbw      m4, [r0]
+    psadbw      m5, [r0]
+    psadbw      m6, [r0]
+    psadbw      m7, [r0]
+    paddw       m0, m4
+    paddw       m1, m5
+    paddw       m2, m6
+    paddw       m3, m7
+%endif
+    add  r0, 2*FENC_STRIDE
+    lea  r1, [r1+2*r5]
+    lea  r2, [r2+2*r5]
+    lea  r3, [r3+2*r5]
+    lea  r4, [r4+2*r5]
+%endmacro
+
+%macro SAD_X3_END_AVX2 0
+    packssdw  m0, m1
+    packssdw  m2, m2
+    phaddd    m0, m2
+    vextracti128 xm1, m0, 1
+    paddd    xm0, xm1
+%if UNIX64
+    movq   [r5+0], xm0
+    pextrd [r5+8], xm0, 2
+%else
+    mov       r0, r5mp
+    movq   [r0+0], xm0
+    pextrd [r0+8], xm0, 2
+%endif
+    RET
+%endmacro
+
+%macro SAD_X4_END_AVX2 0
+    mov       r0, r6mp
+    packssdw  m0, m1
+    packssdw  m2, m3
+    phaddd    m0, m2
+    vextracti128 xm1, m0, 1
+    paddd    xm0, xm1
+    movu    [r0], xm0
+    RET
+%endmacro
+
+%macro SAD_X_AVX2 4
+cglobal pixel_sad_x%1_%2x%3, 2+%1,2+%1,%4
+    SAD_X%1_2x%2P_AVX2 1
+%rep %3/2-1
+    SAD_X%1_2x%2P_AVX2 0
+%endrep
+    SAD_X%1_END_AVX2
+%endmacro
+
+INIT_YMM avx2
+SAD_X_AVX2 3, 16, 16, 6
+SAD_X_AVX2 3, 16,  8, 6
+SAD_X_AVX2 4, 16, 16, 8
+SAD_X_AVX2 4, 16,  8, 8
+
+%if HAVE_AVX512
+; AVX-512: four rows per register, so the 64 bytes of fenc for those rows are
+; again a single memory operand.
+%macro LOAD_4x16P_AVX512 2 ; dst, src
+    movu          xm%1, [%2]
+    vinserti32x4   m%1, m%1, [%2+STRIDE], 1
+    lea             %2, [%2+2*STRIDE]
+    vinserti32x4   m%1, m%1, [%2], 2
+    vinserti32x4   m%1, m%1, [%2+STRIDE], 3
+    lea             %2, [%2+2*STRIDE]
+%endmacro
+
+%macro SAD_X3_4x16P_AVX512 1
+    %define STRIDE r4
+    LOAD_4x16P_AVX512 3, r1
+    LOAD_4x16P_AVX512 4, r2
+    LOAD_4x16P_AVX512 5, r3
+%if %1
+    psadbw      m0, m3, [r0]
+    psadbw      m1, m4, [r0]
+    psadbw      m2, m5, [r0]
+%else
+    psadbw      m3, [r0]
+    psadbw      m4, [r0]
+    psadbw      m5, [r0]
+    paddw       m0, m3
+    paddw       m1, m4
+    paddw       m2, m5
+%endif
+    add  r0, 4*FENC_STRIDE
+%endmacro
+
+%macro SAD_X4_4x16P_AVX512 1
+    %define STRIDE r5
+    LOAD_4x16P_AVX512 4, r1
+    LOAD_4x16P_AVX512 5, r2
+    LOAD_4x16P_AVX512 6, r3
+    LOAD_4x16P_AVX512 7, r4
+%if %1
+    psadbw      m0, m4, [r0]
+    psadbw      m1, m5, [r0]
+    psadbw      m2, m6, [r0]
+    psadbw      m3, m7, [r0]
+%else
+    psadbw      m4, [r0]
+    psadbw      m5, [r0]
+    psadbw      m6, [r0]
+    psadbw      m7, [r0]
+    paddw       m0, m4
+    paddw       m1, m5
+    paddw       m2, m6
+    paddw       m3, m7
+%endif
+    add  r0, 4*FENC_STRIDE
+%endmacro
+
+; Fold the upper 256 bits into the lower ones and finish as in AVX2.
+%macro SAD_X3_END_AVX512 0
+    vextracti64x4 ym3, m0, 1
+    vextracti64x4 ym4, m1, 1
+    vextracti64x4 ym5, m2, 1
+    paddd     ym0, ym3
+    paddd     ym1, ym4
+    paddd     ym2, ym5
+    packssdw  ym0, ym1
+    packssdw  ym2, ym2
+    phaddd    ym0, ym2
+    vextracti128 xm1, ym0, 1
+    paddd    xm0, xm1
+%if UNIX64
+    movq   [r5+0], xm0
+    pextrd [r5+8], xm0, 2
+%else
+    mov       r0, r5mp
+    movq   [r0+0], xm0
+    pextrd [r0+8], xm0, 2
+%endif
+    RET
+%endmacro
+
+%macro SAD_X4_END_AVX512 0
+    vextracti64x4 ym4, m0, 1
+    vextracti64x4 ym5, m1, 1
+    vextracti64x4 ym6, m2, 1
+    vextracti64x4 ym7, m3, 1
+    paddd     ym0, ym4
+    paddd     ym1, ym5
+    paddd     ym2, ym6
+    paddd     ym3, ym7
+    mov       r0, r6mp
+    packssdw  ym0, ym1
+    packssdw  ym2, ym3
+    phaddd    ym0, ym2
+    vextracti128 xm1, ym0, 1
+    paddd    xm0, xm1
+    movu    [r0], xm0
+    RET
+%endmacro
+
+%macro SAD_X_AVX512 4
+cglobal pixel_sad_x%1_%2x%3, 2+%1,2+%1,%4
+    SAD_X%1_4x%2P_AVX512 1
+%rep %3/4-1
+    SAD_X%1_4x%2P_AVX512 0
+%endrep
+    SAD_X%1_END_AVX512
+%endmacro
+
+INIT_ZMM avx512
+SAD_X_AVX512 3, 16, 16, 6
+SAD_X_AVX512 3, 16,  8, 6
+SAD_X_AVX512 4, 16, 16, 8
+SAD_X_AVX512 4, 16,  8, 8
+%undef STRIDE
+%endif ; HAVE_AVX512
+
 
 
 ;=============================================================================
@@ -81,9 +81,11 @@ SECTION .text
 %define LAMBDA_BITS 4
 
 %macro SQUARE 2 ; dst, tmp
-    ; could use pmuldq here, to eliminate the abs. but that would involve
-    ; templating a sse4 version of all of trellis, for negligible speedup.
-%if cpuflag(ssse3)
+    ; pmuldq eliminates the abs. it isn't worth templating a sse4 version of
+    ; all of trellis just for that, but the avx2 version gets it for free.
+%if cpuflag(sse4)
+    pmuldq  m%1, m%1
+%elif cpuflag(ssse3)
     pabsd   m%1, m%1
     pmuludq m%1, m%1
 %elif HIGH_BIT_DEPTH
@@ -586,6 +588,14 @@ TRELLIS trellis_cabac_4x4_psy, 16, 0, 1
 TRELLIS trellis_cabac_8x8_psy, 64, 0, 1
 TRELLIS trellis_cabac_dc, 16, 1, 0
 TRELLIS trellis_cabac_chroma_422_dc, 8, 1, 0
+; VEX-encoded, so there's no SSE/AVX transition when called between avx2 functions.
+INIT_XMM avx2
+TRELLIS trellis_cabac_4x4, 16, 0, 0
+TRELLIS trellis_cabac_8x8, 64, 0, 0
+TRELLIS trellis_cabac_4x4_psy, 16, 0, 1
+TRELLIS trellis_cabac_8x8_psy, 64, 0, 1
+TRELLIS trellis_cabac_dc, 16, 1, 0
+TRELLIS trellis_cabac_chroma_422_dc, 8, 1, 0
 
 
 
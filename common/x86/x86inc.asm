@@ -38,6 +38,11 @@
     %define program_name x264
 %endif
 
+; Set by configure when the assembler understands EVEX (AVX-512) encodings.
+%ifndef HAVE_AVX512
+    %define HAVE_AVX512 0
+%endif
+
 %define WIN64  0
 %define UNIX64 0
 %if ARCH_X86_64
@@ -343,7 +348,7 @@ DECLARE_REG_TMP_SIZE 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14
                 %assign stack_size_padded stack_size
                 %if xmm_regs_used > 6
                     %assign stack_size_padded stack_size_padded + (xmm_regs_used - 6) * 16
-                    %if mmsize == 32 && xmm_regs_used & 1
+                    %if mmsize >= 32 && xmm_regs_used & 1
                         ; re-align to 32 bytes
                         %assign stack_size_padded (stack_size_padded + 16)
                     %endif
@@ -368,7 +373,7 @@ DECLARE_REG_TMP_SIZE 0,1,2,3,4,5,6,7,8,9,10,11,12,13,14
 
 %macro SETUP_STACK_POINTER 1
     %ifnum %1
-        %if %1 != 0 && (HAVE_ALIGNED_STACK == 0 || mmsize == 32)
+        %if %1 != 0 && (HAVE_ALIGNED_STACK == 0 || mmsize >= 32)
             %if %1 > 0
                 %assign regs_used (regs_used + 1)
             %elif ARCH_X86_64 && regs_used == num_args && num_args <= 4 + UNIX64 * 2
@@ -450,7 +455,7 @@ DECLARE_REG 14, R15, 120
         %endif
     %endif
     %if stack_size_padded > 0
-        %if stack_size > 0 && (mmsize == 32 || HAVE_ALIGNED_STACK == 0)
+        %if stack_size > 0 && (mmsize >= 32 || HAVE_ALIGNED_STACK == 0)
             mov rsp, rstkm
         %else
             add %1, stack_size_padded
@@ -464,12 +469,12 @@ DECLARE_REG 14, R15, 120
     %assign xmm_regs_used 0
 %endmacro
 
-%define has_epilogue regs_used > 7 || xmm_regs_used > 6 || mmsize == 32 || stack_size > 0
+%define has_epilogue regs_used > 7 || xmm_regs_used > 6 || mmsize >= 32 || stack_size > 0
 
 %macro RET 0
     WIN64_RESTORE_XMM_INTERNAL rsp
     POP_IF_USED 14, 13, 12, 11, 10, 9, 8, 7
-%if mmsize == 32
+%if mmsize >= 32
     vzeroupper
 %endif
     AUTO_REP_RET
@@ -505,18 +510,18 @@ DECLARE_REG 14, R15, 72
     DEFINE_ARGS_INTERNAL %0, %4, %5
 %endmacro
 
-%define has_epilogue regs_used > 9 || mmsize == 32 || stack_size > 0
+%define has_epilogue regs_used > 9 || mmsize >= 32 || stack_size > 0
 
 %macro RET 0
 %if stack_size_padded > 0
-%if mmsize == 32 || HAVE_ALIGNED_STACK == 0
+%if mmsize >= 32 || HAVE_ALIGNED_STACK == 0
     mov rsp, rstkm
 %else
     add rsp, stack_size_padded
 %endif
 %endif
     POP_IF_USED 14, 13, 12, 11, 10, 9
-%if mmsize == 32
+%if mmsize >= 32
     vzeroupper
 %endif
     AUTO_REP_RET
@@ -561,18 +566,18 @@ DECLARE_ARG 7, 8, 9, 10, 11, 12, 13, 14
     DEFINE_ARGS_INTERNAL %0, %4, %5
 %endmacro
 
-%define has_epilogue regs_used > 3 || mmsize == 32 || stack_size > 0
+%define has_epilogue regs_used > 3 || mmsize >= 32 || stack_size > 0
 
 %macro RET 0
 %if stack_size_padded > 0
-%if mmsize == 32 || HAVE_ALIGNED_STACK == 0
+%if mmsize >= 32 || HAVE_ALIGNED_STACK == 0
     mov rsp, rstkm
 %else
     add rsp, stack_size_padded
 %endif
 %endif
     POP_IF_USED 6, 5, 4, 3
-%if mmsize == 32
+%if mmsize >= 32
     vzeroupper
 %endif
     AUTO_REP_RET
@@ -724,9 +729,10 @@ SECTION .note.GNU-stack noalloc noexec nowrite progbits
 %assign cpuflags_misalign (1<<20)
 %assign cpuflags_aligned  (1<<21) ; not a cpu feature, but a function variant
 %assign cpuflags_atom     (1<<22)
-%assign cpuflags_bmi1     (1<<23)
+%assign cpuflags_bmi1     (1<<23)|cpuflags_lzcnt ; every cpu with bmi1 also has lzcnt
 %assign cpuflags_bmi2     (1<<24)|cpuflags_bmi1
 %assign cpuflags_tbm      (1<<25)|cpuflags_bmi1
+%assign cpuflags_avx512   (1<<26)|cpuflags_avx2|cpuflags_fma3
 
 %define    cpuflag(x) ((cpuflags & (cpuflags_ %+ x)) == (cpuflags_ %+ x))
 %define notcpuflag(x) ((cpuflags & (cpuflags_ %+ x)) != (cpuflags_ %+ x))
@@ -838,6 +844,60 @@ SECTION .note.GNU-stack noalloc noexec nowrite progbits
     INIT_CPUFLAGS %1
 %endmacro
 
+; Only zmm0-15 are exposed as m#, so the xm#/ym# casts and WIN64 xmm saving
+; work unchanged; code that wants zmm16-31 has to name them explicitly.
+%macro INIT_ZMM 0-1+
+    %assign avx_enabled 1
+    %define RESET_MM_PERMUTATION INIT_ZMM %1
+    %define mmsize 64
+    %define num_mmregs 8
+    %if ARCH_X86_64
+    %define num_mmregs 16
+    %endif
+    %define mova vmovdqa32
+    %define movu vmovdqu32
+    %undef movh
+    %define movnta vmovntdq
+    %assign %%i 0
+    %rep num_mmregs
+    CAT_XDEFINE m, %%i, zmm %+ %%i
+    CAT_XDEFINE nzmm, %%i, %%i
+    %assign %%i %%i+1
+    %endrep
+    INIT_CPUFLAGS %1
+%endmacro
+
+; xm#, ym# and zm# name the xmm/ymm/zmm register underlying m#, whatever the
+; current permutation is, e.g. for the 128-bit halves of ymm registers under INIT_YMM.
+%macro DECLARE_MMCAST 1
+    %define  mmmm%1   mm%1
+    %define  mmxmm%1  mm%1
+    %define  mmymm%1  mm%1
+    %define  mmzmm%1  mm%1
+    %define xmmmm%1   mm%1
+    %define xmmxmm%1 xmm%1
+    %define xmmymm%1 xmm%1
+    %define xmmzmm%1 xmm%1
+    %define ymmmm%1   mm%1
+    %define ymmxmm%1 ymm%1
+    %define ymmymm%1 ymm%1
+    %define ymmzmm%1 ymm%1
+    %define zmmmm%1   mm%1
+    %define zmmxmm%1 zmm%1
+    %define zmmymm%1 zmm%1
+    %define zmmzmm%1 zmm%1
+    %define xm%1 xmm %+ m%1
+    %define ym%1 ymm %+ m%1
+    %define zm%1 zmm %+ m%1
+%endmacro
+
+%assign i 0
+%rep 16
+    DECLARE_MMCAST i
+%assign i i+1
+%endrep
+%undef i
+
 INIT_XMM
 
 ; I often want to use macros that permute their arguments. e.g. there's no
@@ -972,6 +1032,7 @@ INIT_XMM
     %endif
     CAT_XDEFINE sizeofxmm, i, 16
     CAT_XDEFINE sizeofymm, i, 32
+    CAT_XDEFINE sizeofzmm, i, 64
 %assign i i+1
 %endrep
 %undef i
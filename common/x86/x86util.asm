@@ -254,15 +254,31 @@
 %endif
 %endmacro
 
+; Frame rows and the scratch buffers are only guaranteed 16-byte alignment,
+; so 256-bit accesses to them have to be unaligned.
+%macro MOVPIX 2
+%if mmsize == 32
+    movu        %1, %2
+%else
+    mova        %1, %2
+%endif
+%endmacro
+
 %imacro SPLATW 2-3 0
+%if cpuflag(avx2) && %3 == 0
+    vpbroadcastw %1, %2 ; %2 must be an xmm register or memory
+%else
     PSHUFLW    %1, %2, (%3)*q1111
 %if mmsize == 16
     punpcklqdq %1, %1
 %endif
+%endif
 %endmacro
 
 %imacro SPLATD 2-3 0
-%if mmsize == 16
+%if cpuflag(avx2) && %3 == 0
+    vpbroadcastd %1, %2 ; %2 must be an xmm register or memory
+%elif mmsize == 16
     pshufd %1, %2, (%3)*q1111
 %else
     pshufw %1, %2, (%3)*q0101 + ((%3)+1)*q1010
@@ -275,7 +291,7 @@
 %endmacro
 
 %macro HADDD 2 ; sum junk
-%if mmsize == 16
+%if mmsize >= 16 ; xmm args under INIT_YMM, after the upper halves have been folded in
     movhlps %2, %1
     paddd   %1, %2
 %endif
@@ -492,7 +508,7 @@
 %endmacro
 
 %macro HADAMARD 5-6
-; %1=distance in words (0 for vertical pass, 1/2/4 for horizontal passes)
+; %1=distance in words (0 for vertical pass, 1/2/4/8 for horizontal passes)
 ; %2=sumsub/max/amax (sum and diff / maximum / maximum of absolutes)
 ; %3/%4: regs
 ; %5(%6): tmpregs
@@ -514,6 +530,10 @@
          %endif
     %elif %1==4
          SBUTTERFLY qdq, %3, %4, %5
+    %elif %1==8
+         vperm2i128 m%5, m%3, m%4, q0301 ; upper halves
+         vinserti128 m%3, m%3, xm%4, 1   ; lower halves
+         SWAP %4, %5
     %endif
 %endif
 %ifidn %2, sumsub
@@ -0,0 +1,33 @@
+#define HAVE_MALLOC_H 1
+#define ARCH_X86_64 1
+#define SYS_LINUX 1
+#define HAVE_POSIXTHREAD 1
+#define HAVE_CPU_COUNT 1
+#define HAVE_THREAD 1
+#define HAVE_LOG2F 1
+#define HAVE_MMAP 1
+#define HAVE_AUDIO 1
+#define HAVE_LSMASH 1
+#define HAVE_LAME 0
+#define HAVE_QT_AAC 0
+#define HAVE_FAAC 0
+#define HAVE_AMRWB_3GPP 0
+#define HAVE_NONFREE 0
+#define HAVE_VECTOREXT 1
+#define fseek fseeko
+#define ftell ftello
+#define HAVE_GPL 1
+#define HAVE_INTERLACED 1
+#define HAVE_ALTIVEC 0
+#define HAVE_ALTIVEC_H 0
+#define HAVE_MMX 0
+#define HAVE_ARMV6 0
+#define HAVE_ARMV6T2 0
+#define HAVE_NEON 0
+#define HAVE_BEOSTHREAD 0
+#define HAVE_WIN32THREAD 0
+#define HAVE_VISUALIZE 0
+#define HAVE_SWSCALE 0
+#define HAVE_LAVF 0
+#define HAVE_FFMS 0
+#define HAVE_AVS 0
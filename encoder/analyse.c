@@ -481,8 +481,15 @@ static void x264_mb_analyse_init( x264_t *h, x264_mb_analysis_t *a, int qp )
                 for( int i = (h->sh.i_type == SLICE_TYPE_B); i >= 0; i-- )
                     for( int j = 0; j < h->i_ref[i]; j++ )
                     {
-                        x264_frame_cond_wait( h->fref[i][j]->orig, thresh );
-                        thread_mvy_range = X264_MIN( thread_mvy_range, h->fref[i][j]->orig->i_lines_completed - pix_y );
+                        x264_frame_t *ref = h->fref[i][j]->orig;
+                        if( ref->i_lines_completed < thresh )
+                        {
+                            int64_t start = x264_mdate();
+                            x264_frame_cond_wait( ref, thresh );
+                            h->stat.frame.i_sync_wait_time += x264_mdate() - start;
+                            h->stat.frame.i_sync_waits++;
+                        }
+                        thread_mvy_range = X264_MIN( thread_mvy_range, ref->i_lines_completed - pix_y );
                     }
 
                 if( h->param.b_deterministic )
@@ -1336,6 +1343,8 @@ static void x264_intra_rd_refine( x264_t *h, x264_mb_analysis_t *a )
     (m)->integral = &h->mb.pic.p_integral[list][ref][(xoff)+(yoff)*(m)->i_stride[0]]; \
     (m)->weight = x264_weight_none; \
     (m)->i_ref = ref; \
+    (m)->hpel_ref = h->param.analyse.b_lazy_hpel ? h->fref[list][ref] : NULL; \
+    (m)->i_hpel_y = yoff; \
 }
 
 #define LOAD_WPELS(m, src, list, ref, xoff, yoff) \
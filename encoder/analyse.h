@@ -34,7 +34,7 @@ void x264_analyse_weight_frame( x264_t *h, int end );
 void x264_macroblock_analyse( x264_t *h );
 void x264_slicetype_decide( x264_t *h );
 
-void x264_slicetype_analyse( x264_t *h, int keyframe );
+void x264_slicetype_analyse( x264_t *h, int intra_minigop );
 
 int x264_weighted_reference_duplicate( x264_t *h, int i_ref, const x264_weight_t *w );
 
@@ -44,4 +44,9 @@ void x264_lookahead_put_frame( x264_t *h, x264_frame_t *frame );
 void x264_lookahead_get_frames( x264_t *h );
 void x264_lookahead_delete( x264_t *h );
 
+int  x264_lookahead_share_param( x264_t *h );
+int  x264_lookahead_share_delay( x264_t *h );
+void x264_lookahead_share_source_size( x264_t *h, int size[2] );
+int  x264_lookahead_share_read( x264_t *h );
+
 #endif
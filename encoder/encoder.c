@@ -80,6 +80,26 @@ static int x264_threadpool_wait_all( x264_t *h )
     return 0;
 }
 
+static void x264_threadpool_print_stats( x264_t *h, x264_threadpool_t *pool, const char *name )
+{
+    x264_threadpool_stats_t stats[X264_THREAD_MAX];
+    int workers = x264_threadpool_stats( pool, stats );
+    int64_t busy = 0, idle = 0;
+    int jobs = 0, steals = 0;
+    for( int i = 0; i < workers; i++ )
+    {
+        x264_log( h, X264_LOG_DEBUG, "%s worker %d: jobs:%d stolen:%d busy:%.3fs idle:%.3fs\n", name, i,
+                  stats[i].i_jobs, stats[i].i_steals, stats[i].i_busy_time / 1e6, stats[i].i_idle_time / 1e6 );
+        busy += stats[i].i_busy_time;
+        idle += stats[i].i_idle_time;
+        jobs += stats[i].i_jobs;
+        steals += stats[i].i_steals;
+    }
+    if( workers && busy + idle > 0 )
+        x264_log( h, X264_LOG_INFO, "%s: %d workers, %d jobs, %.1f%% stolen, %.1f%% busy\n", name, workers, jobs,
+                  jobs ? 100.0 * steals / jobs : 0.0, 100.0 * busy / (busy + idle) );
+}
+
 static void x264_frame_dump( x264_t *h )
 {
     FILE *f = fopen( h->param.psz_dump_yuv, "r+b" );
@@ -406,6 +426,123 @@ static void x264_lookahead_thread_init( x264_t *h )
 }
 #endif
 
+/* Pre-processing of input frames (AQ and lowres) runs on its own pool, split by rows,
+ * while the caller moves on to the next frame.  A frame enters the lookahead on the next
+ * call to x264_encoder_encode, which makes the lookahead one frame deeper. */
+typedef struct
+{
+    x264_t *h;
+    x264_frame_t *frame;
+    float *quant_offsets;
+    int b_aq;
+    int i_first_row;
+    int i_last_row;
+    uint32_t i_pixel_sum[3];
+    uint64_t i_pixel_ssd[3];
+} x264_preprocess_slice_t;
+
+typedef struct x264_preprocess_t
+{
+    x264_t *h; /* private copy of the context, the frame threads' ones change under us */
+    x264_frame_t *frame; /* frame in flight, if any */
+    float *quant_offsets;
+    int b_quant_offsets;
+    int b_aq;
+    int i_slices;
+    x264_preprocess_slice_t slice[X264_THREAD_MAX];
+} x264_preprocess_t;
+
+static void *x264_preprocess_slice( x264_preprocess_slice_t *s )
+{
+    x264_t *h = s->h;
+    x264_frame_t *frame = s->frame;
+    if( s->b_aq )
+    {
+        memset( s->i_pixel_sum, 0, sizeof(s->i_pixel_sum) );
+        memset( s->i_pixel_ssd, 0, sizeof(s->i_pixel_ssd) );
+        x264_adaptive_quant_frame_rows( h, frame, s->quant_offsets, s->i_first_row, s->i_last_row,
+                                        s->i_pixel_sum, s->i_pixel_ssd );
+    }
+    if( h->frames.b_have_lowres )
+    {
+        int y0 = frame->i_lines_lowres * s->i_first_row / h->mb.i_mb_height;
+        int y1 = frame->i_lines_lowres * s->i_last_row / h->mb.i_mb_height;
+        x264_frame_init_lowres_rows( h, frame, y0, y1 - y0 );
+    }
+    return NULL;
+}
+
+static int x264_preprocess_init( x264_t *h )
+{
+    x264_preprocess_t *pp;
+    CHECKED_MALLOCZERO( pp, sizeof(x264_preprocess_t) );
+    h->preprocess = pp;
+    CHECKED_MALLOC( pp->h, sizeof(x264_t) );
+    CHECKED_MALLOC( pp->quant_offsets, h->mb.i_mb_count * sizeof(float) );
+    pp->i_slices = X264_MIN( h->param.i_threads, h->mb.i_mb_height );
+    for( int i = 0; i < pp->i_slices; i++ )
+    {
+        pp->slice[i].h = pp->h;
+        pp->slice[i].i_first_row = h->mb.i_mb_height * i / pp->i_slices;
+        pp->slice[i].i_last_row = h->mb.i_mb_height * (i+1) / pp->i_slices;
+    }
+    return 0;
+fail:
+    return -1;
+}
+
+static void x264_preprocess_frame_start( x264_t *h, x264_frame_t *frame, float *quant_offsets, int b_aq )
+{
+    x264_preprocess_t *pp = h->preprocess;
+    pp->h->param = h->param;
+    pp->frame = frame;
+    pp->b_aq = b_aq;
+    /* the caller may reuse its offsets as soon as we return */
+    pp->b_quant_offsets = !!quant_offsets;
+    if( quant_offsets )
+        memcpy( pp->quant_offsets, quant_offsets, h->mb.i_mb_count * sizeof(float) );
+
+    if( h->frames.b_have_lowres )
+        x264_frame_init_lowres_prepare( h, frame );
+    for( int i = 0; i < pp->i_slices; i++ )
+    {
+        pp->slice[i].frame = frame;
+        pp->slice[i].quant_offsets = pp->b_quant_offsets ? pp->quant_offsets : NULL;
+        pp->slice[i].b_aq = b_aq;
+        x264_threadpool_run( h->preprocesspool, (void*)x264_preprocess_slice, &pp->slice[i] );
+    }
+}
+
+/* Waits for the frame in flight and finishes it in slice order, so the result is the same
+ * as with serial pre-processing.  Returns the frame, or NULL if there was none. */
+static x264_frame_t *x264_preprocess_frame_end( x264_t *h )
+{
+    x264_preprocess_t *pp = h->preprocess;
+    x264_frame_t *frame = pp->frame;
+    if( !frame )
+        return NULL;
+    for( int i = 0; i < pp->i_slices; i++ )
+        x264_threadpool_wait( h->preprocesspool, &pp->slice[i] );
+    if( pp->b_aq )
+    {
+        for( int i = 0; i < 3; i++ )
+        {
+            frame->i_pixel_sum[i] = 0;
+            frame->i_pixel_ssd[i] = 0;
+            for( int j = 0; j < pp->i_slices; j++ )
+            {
+                frame->i_pixel_sum[i] += pp->slice[j].i_pixel_sum[i];
+                frame->i_pixel_ssd[i] += pp->slice[j].i_pixel_ssd[i];
+            }
+        }
+        x264_stack_align( x264_adaptive_quant_frame_end, pp->h, frame, pp->b_quant_offsets ? pp->quant_offsets : NULL );
+    }
+    if( h->frames.b_have_lowres )
+        x264_frame_init_lowres_pyramid( h, frame );
+    pp->frame = NULL;
+    return frame;
+}
+
 /****************************************************************************
  *
  ****************************************************************************
@@ -431,6 +568,14 @@ static int x264_validate_parameters( x264_t *h, int b_open )
     }
 #endif
 
+    if( h->param.cpu_max )
+    {
+        const unsigned int simd_tiers = X264_CPU_MMX|X264_CPU_MMX2|X264_CPU_SSE|X264_CPU_SSE2|X264_CPU_SSE3|
+                                        X264_CPU_SSSE3|X264_CPU_SSE4|X264_CPU_SSE42|X264_CPU_AVX|X264_CPU_XOP|
+                                        X264_CPU_FMA4|X264_CPU_AVX2|X264_CPU_FMA3|X264_CPU_AVX512;
+        h->param.cpu &= ~(simd_tiers & ~h->param.cpu_max);
+    }
+
 #if HAVE_INTERLACED
     h->param.b_interlaced = !!PARAM_INTERLACED;
 #else
@@ -736,6 +881,7 @@ static int x264_validate_parameters( x264_t *h, int b_open )
         h->param.i_keyint_min = X264_MIN( h->param.i_keyint_max / 10, fps );
     h->param.i_keyint_min = x264_clip3( h->param.i_keyint_min, 1, h->param.i_keyint_max/2+1 );
     h->param.rc.i_lookahead = x264_clip3( h->param.rc.i_lookahead, 0, X264_LOOKAHEAD_MAX );
+    h->param.rc.i_lookahead_pyramid = x264_clip3( h->param.rc.i_lookahead_pyramid, 0, X264_LOOKAHEAD_PYRAMID_MAX );
     {
         int maxrate = X264_MAX( h->param.rc.i_vbv_max_bitrate, h->param.rc.i_bitrate );
         float bufsize = maxrate ? (float)h->param.rc.i_vbv_buffer_size / maxrate : 0;
@@ -759,6 +905,13 @@ static int x264_validate_parameters( x264_t *h, int b_open )
     }
     if( b_open && h->param.rc.b_stat_read )
         h->param.rc.i_lookahead = 0;
+    if( h->param.rc.i_chunks > 1 && (!h->param.rc.b_stat_read || h->param.rc.b_stat_write) )
+    {
+        x264_log( h, X264_LOG_WARNING, "chunked encoding is only supported in the last pass\n" );
+        h->param.rc.i_chunks = 0;
+    }
+    h->param.rc.i_chunks = X264_MAX( h->param.rc.i_chunks, 0 );
+    h->param.rc.i_chunk = x264_clip3( h->param.rc.i_chunk, 0, X264_MAX( h->param.rc.i_chunks-1, 0 ) );
 #if HAVE_THREAD
     if( h->param.i_sync_lookahead < 0 )
         h->param.i_sync_lookahead = h->param.i_bframe + 1;
@@ -768,6 +921,7 @@ static int x264_validate_parameters( x264_t *h, int b_open )
 #else
     h->param.i_sync_lookahead = 0;
 #endif
+    h->param.i_frame_pool = X264_MAX( h->param.i_frame_pool, 0 );
 
     h->param.i_deblocking_filter_alphac0 = x264_clip3( h->param.i_deblocking_filter_alphac0, -6, 6 );
     h->param.i_deblocking_filter_beta    = x264_clip3( h->param.i_deblocking_filter_beta, -6, 6 );
@@ -864,6 +1018,9 @@ static int x264_validate_parameters( x264_t *h, int b_open )
     h->param.analyse.i_noise_reduction = x264_clip3( h->param.analyse.i_noise_reduction, 0, 1<<16 );
     if( h->param.analyse.i_subpel_refine >= 10 && (h->param.analyse.i_trellis != 2 || !h->param.rc.i_aq_mode) )
         h->param.analyse.i_subpel_refine = 9;
+    /* subme=0 has no half-pel planes, and interlaced MC also reads the field planes */
+    if( !h->param.analyse.i_subpel_refine || PARAM_INTERLACED )
+        h->param.analyse.b_lazy_hpel = 0;
 
     {
         const x264_level_t *l = x264_levels;
@@ -1116,6 +1273,11 @@ x264_t *x264_encoder_open( x264_param_t *param )
         goto fail;
     }
 
+    if( !h->param.lookahead_share )
+        h->param.b_lookahead_source = 0;
+    else if( x264_lookahead_share_param( h ) < 0 )
+        goto fail;
+
     if( x264_validate_parameters( h, 1 ) < 0 )
         goto fail;
 
@@ -1123,6 +1285,24 @@ x264_t *x264_encoder_open( x264_param_t *param )
         if( x264_cqm_parse_file( h, h->param.psz_cqm_file ) < 0 )
             goto fail;
 
+    h->trace.i_row = -1;
+    if( h->param.psz_trace_file )
+    {
+        if( x264_trace_open( h->param.psz_trace_file ) < 0 )
+        {
+            x264_log( h, X264_LOG_ERROR, "trace: can't write to %s\n", h->param.psz_trace_file );
+            goto fail;
+        }
+        h->trace.b_enabled = 1;
+    }
+
+    if( h->param.i_frame_pool )
+    {
+        if( x264_frame_pool_open( h->param.i_frame_pool ) < 0 )
+            goto fail;
+        h->frames.b_pool = 1;
+    }
+
     if( h->param.rc.psz_stat_out )
         h->param.rc.psz_stat_out = strdup( h->param.rc.psz_stat_out );
     if( h->param.rc.psz_stat_in )
@@ -1177,6 +1357,11 @@ x264_t *x264_encoder_open( x264_param_t *param )
     h->frames.i_delay += h->i_thread_frames - 1;
     h->frames.i_delay += h->param.i_sync_lookahead;
     h->frames.i_delay += h->param.b_vfr_input;
+    /* the frame being pre-processed */
+    h->frames.i_delay += h->param.i_threads > 1;
+    /* a lookahead share consumer must not need a decision before the source has made it */
+    if( h->param.lookahead_share && !h->param.b_lookahead_source )
+        h->frames.i_delay = X264_MAX( h->frames.i_delay, x264_lookahead_share_delay( h ) + (h->param.i_threads > 1) );
     h->frames.i_bframe_delay = h->param.i_bframe ? (h->param.i_bframe_pyramid ? 2 : 1) : 0;
 
     h->frames.i_max_ref0 = h->param.i_frame_reference;
@@ -1297,6 +1482,10 @@ x264_t *x264_encoder_open( x264_param_t *param )
     if( h->param.i_lookahead_threads > 1 &&
         x264_threadpool_init( &h->lookaheadpool, h->param.i_lookahead_threads, (void*)x264_lookahead_thread_init, h ) )
         goto fail;
+    if( h->param.i_threads > 1 &&
+        (x264_threadpool_init( &h->preprocesspool, h->param.i_threads, (void*)x264_lookahead_thread_init, h ) ||
+         x264_preprocess_init( h )) )
+        goto fail;
 
     h->thread[0] = h;
     for( int i = 1; i < h->param.i_threads + !!h->param.i_sync_lookahead; i++ )
@@ -1306,6 +1495,15 @@ x264_t *x264_encoder_open( x264_param_t *param )
         {
             CHECKED_MALLOC( h->lookahead_thread[i], sizeof(x264_t) );
             *h->lookahead_thread[i] = *h;
+            /* Output of a whole-frame cost job run on this context, sized as in x264_macroblock_thread_allocate. */
+            CHECKED_MALLOC( h->lookahead_thread[i]->scratch_buffer2,
+                            (h->mb.i_mb_height + (4 + 32) * h->param.i_lookahead_threads) * sizeof(int) * 2 );
+            int buf_mbtree = h->param.rc.b_mb_tree * ((h->mb.i_mb_width+7)&~7) * sizeof(int);
+            /* MB-tree propagation of B-frames run on this context: the propagate amounts of a row,
+             * then the sums for up to 3 references. */
+            if( h->param.rc.b_mb_tree )
+                CHECKED_MALLOC( h->lookahead_thread[i]->scratch_buffer,
+                                buf_mbtree + 3 * h->mb.i_mb_count * sizeof(uint16_t) );
         }
 
     for( int i = 0; i < h->param.i_threads; i++ )
@@ -1340,6 +1538,9 @@ x264_t *x264_encoder_open( x264_param_t *param )
 
     if( x264_lookahead_init( h, i_slicetype_length ) )
         goto fail;
+    /* the pre-processing context must be complete, so take it last */
+    if( h->preprocess )
+        *h->preprocess->h = *h;
 
     for( int i = 0; i < h->param.i_threads; i++ )
         if( x264_macroblock_thread_allocate( h->thread[i], 0 ) < 0 )
@@ -1397,6 +1598,10 @@ x264_t *x264_encoder_open( x264_param_t *param )
 
     return h;
 fail:
+    if( h->trace.b_enabled )
+        x264_trace_close();
+    if( h->frames.b_pool )
+        x264_frame_pool_close();
     x264_free( h );
     return NULL;
 }
@@ -1930,6 +2135,8 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int pass )
     if( min_y < h->i_threadslice_start )
         return;
 
+    int64_t trace_start = TRACE_START( h->trace.b_enabled );
+
     if( b_deblock )
         for( int y = min_y; y < mb_y; y += (1 << SLICE_MBAFF) )
             x264_frame_deblock_row( h, y );
@@ -1953,7 +2160,9 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int pass )
         if( h->param.analyse.i_subpel_refine )
         {
             x264_frame_filter( h, h->fdec, min_y, end );
-            x264_frame_expand_border_filtered( h, h->fdec, min_y, end );
+            /* progressive frames get their borders expanded during the filter */
+            if( PARAM_INTERLACED )
+                x264_frame_expand_border_filtered( h, h->fdec, min_y, end );
         }
     }
 
@@ -1965,7 +2174,12 @@ static void x264_fdec_filter_row( x264_t *h, int mb_y, int pass )
         }
 
     if( h->i_thread_frames > 1 && h->fdec->b_kept_as_ref )
-        x264_frame_cond_broadcast( h->fdec, mb_y*16 + (b_end ? 10000 : -(X264_THREAD_HEIGHT << SLICE_MBAFF)) );
+    {
+        h->stat.frame.i_sync_wakeups += x264_frame_cond_broadcast( h->fdec, mb_y*16 + (b_end ? 10000 : -(X264_THREAD_HEIGHT << SLICE_MBAFF)) );
+        h->stat.frame.i_sync_broadcasts++;
+    }
+
+    TRACE_END( h->trace.b_enabled, X264_TRACE_FILTER, trace_start );
 
     if( b_measure_quality )
     {
@@ -2209,6 +2423,23 @@ static ALWAYS_INLINE void x264_bitstream_restore( x264_t *h, x264_bs_bak_t *bak,
     }
 }
 
+/* Close the traced row h has been accumulating macroblock stage times for. */
+static void x264_trace_row_end( x264_t *h )
+{
+    if( h->trace.i_row >= 0 )
+        x264_trace_row( h->trace.i_row, h->trace.i_row_start, x264_trace_ticks(), h->trace.i_ticks, h->trace.i_mbs );
+    h->trace.i_row = -1;
+}
+
+static void x264_trace_row_begin( x264_t *h, int mb_y )
+{
+    x264_trace_row_end( h );
+    h->trace.i_row = mb_y;
+    h->trace.i_mbs = 0;
+    h->trace.i_row_start = x264_trace_ticks();
+    memset( h->trace.i_ticks, 0, sizeof(h->trace.i_ticks) );
+}
+
 static int x264_slice_write( x264_t *h )
 {
     int i_skip;
@@ -2267,6 +2498,10 @@ static int x264_slice_write( x264_t *h )
     {
         mb_xy = i_mb_x + i_mb_y * h->mb.i_mb_width;
         int mb_spos = bs_pos(&h->out.bs) + x264_cabac_pos(&h->cabac);
+        int64_t trace_t = 0;
+
+        if( h->trace.b_enabled && (i_mb_x == 0 || h->trace.i_row < 0) )
+            x264_trace_row_begin( h, i_mb_y );
 
         if( i_mb_x == 0 )
         {
@@ -2303,11 +2538,15 @@ static int x264_slice_write( x264_t *h )
         else
             x264_macroblock_cache_load_progressive( h, i_mb_x, i_mb_y );
 
+        if( h->trace.b_enabled )
+            trace_t = x264_trace_ticks();
         x264_macroblock_analyse( h );
+        TRACE_MB( h, X264_TRACE_ANALYSE, trace_t );
 
         /* encode this macroblock -> be careful it can change the mb type to P_SKIP if needed */
 reencode:
         x264_macroblock_encode( h );
+        TRACE_MB( h, X264_TRACE_ENCODE, trace_t );
 
         if( h->param.b_cabac )
         {
@@ -2348,6 +2587,8 @@ reencode:
             }
         }
 
+        TRACE_MB( h, X264_TRACE_WRITE, trace_t );
+
         int total_bits = bs_pos(&h->out.bs) + x264_cabac_pos(&h->cabac);
         int mb_size = total_bits - mb_spos;
 
@@ -2397,7 +2638,12 @@ reencode:
         /* save cache */
         x264_macroblock_cache_save( h );
 
-        if( x264_ratecontrol_mb( h, mb_size ) < 0 )
+        if( h->trace.b_enabled )
+            trace_t = x264_trace_ticks();
+        int b_rc_retry = x264_ratecontrol_mb( h, mb_size ) < 0;
+        TRACE_MB( h, X264_TRACE_RC_MB, trace_t );
+        h->trace.i_mbs += h->trace.b_enabled;
+        if( b_rc_retry )
         {
             x264_bitstream_restore( h, &bs_bak[1], &i_skip, 1 );
             h->mb.b_reencode_mb = 1;
@@ -2478,8 +2724,9 @@ reencode:
             h->stat.frame.i_mb_field[b_intra?0:b_skip?2:1] += MB_INTERLACED;
         }
 
-        /* calculate deblock strength values (actual deblocking is done per-row along with hpel) */
-        if( b_deblock )
+        /* calculate deblock strength values (actual deblocking is done per-row along with hpel);
+         * without MBAFF, they are computed for the whole row when it is deblocked */
+        if( b_deblock && SLICE_MBAFF )
             x264_macroblock_deblock_strength( h );
 
         if( mb_xy == h->sh.i_last_mb )
@@ -2498,6 +2745,8 @@ reencode:
             i_mb_x = 0;
         }
     }
+    if( h->trace.b_enabled )
+        x264_trace_row_end( h );
     h->out.nal[h->out.i_nal].i_last_mb = h->sh.i_last_mb;
 
     if( h->param.b_cabac )
@@ -2827,22 +3076,39 @@ int     x264_encoder_encode( x264_t *h,
                 fenc->i_pic_struct = PIC_STRUCT_PROGRESSIVE;
         }
 
-        if( h->param.rc.b_mb_tree && h->param.rc.b_stat_read )
+        /* the stats file is read in order, so MB-tree offsets are never pre-processed in parallel */
+        int b_aq = !(h->param.rc.b_mb_tree && h->param.rc.b_stat_read);
+        if( !b_aq )
         {
             if( x264_macroblock_tree_read( h, fenc, pic_in->prop.quant_offsets ) )
                 return -1;
         }
+
+        if( h->preprocess )
+        {
+            /* 2: Place the previous frame into the queue for its slice type decision */
+            x264_frame_t *prev = x264_preprocess_frame_end( h );
+            if( prev )
+                x264_lookahead_put_frame( h, prev );
+            x264_preprocess_frame_start( h, fenc, b_aq ? pic_in->prop.quant_offsets : NULL, b_aq );
+
+            if( pic_in->prop.quant_offsets_free )
+                pic_in->prop.quant_offsets_free( pic_in->prop.quant_offsets );
+        }
         else
-            x264_stack_align( x264_adaptive_quant_frame, h, fenc, pic_in->prop.quant_offsets );
+        {
+            if( b_aq )
+                x264_stack_align( x264_adaptive_quant_frame, h, fenc, pic_in->prop.quant_offsets );
 
-        if( pic_in->prop.quant_offsets_free )
-            pic_in->prop.quant_offsets_free( pic_in->prop.quant_offsets );
+            if( pic_in->prop.quant_offsets_free )
+                pic_in->prop.quant_offsets_free( pic_in->prop.quant_offsets );
 
-        if( h->frames.b_have_lowres )
-            x264_frame_init_lowres( h, fenc );
+            if( h->frames.b_have_lowres )
+                x264_frame_init_lowres( h, fenc );
 
-        /* 2: Place the frame into the queue for its slice type decision */
-        x264_lookahead_put_frame( h, fenc );
+            /* 2: Place the frame into the queue for its slice type decision */
+            x264_lookahead_put_frame( h, fenc );
+        }
 
         if( h->frames.i_input <= h->frames.i_delay + 1 - h->i_thread_frames )
         {
@@ -2853,11 +3119,18 @@ int     x264_encoder_encode( x264_t *h,
     }
     else
     {
-        /* signal kills for lookahead thread */
-        x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
-        h->lookahead->b_exit_thread = 1;
-        x264_pthread_cond_broadcast( &h->lookahead->ifbuf.cv_fill );
-        x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
+        /* the last frame leaves the pre-processing stage as if it had just been input */
+        x264_frame_t *last = h->preprocess ? x264_preprocess_frame_end( h ) : NULL;
+        if( last )
+            x264_lookahead_put_frame( h, last );
+        if( !last || h->frames.i_input <= h->frames.i_delay - h->i_thread_frames )
+        {
+            /* signal kills for lookahead thread */
+            x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
+            h->lookahead->b_exit_thread = 1;
+            x264_pthread_cond_broadcast( &h->lookahead->ifbuf.cv_fill );
+            x264_pthread_mutex_unlock( &h->lookahead->ifbuf.mutex );
+        }
     }
 
     h->i_frame++;
@@ -2893,6 +3166,8 @@ int     x264_encoder_encode( x264_t *h,
     if( x264_reference_update( h ) )
         return -1;
     h->fdec->i_lines_completed = -1;
+    if( h->fdec->hpel_done )
+        memset( (uint8_t*)h->fdec->hpel_done, 0, h->mb.i_mb_height * sizeof(uint8_t) );
 
     if( !IS_X264_TYPE_I( h->fenc->i_type ) )
     {
@@ -3184,7 +3459,9 @@ int     x264_encoder_encode( x264_t *h,
 
     /* Init the rate control */
     /* FIXME: Include slice header bit cost. */
+    int64_t trace_start = TRACE_START( h->trace.b_enabled );
     x264_ratecontrol_start( h, h->fenc->i_qpplus1, overhead*8 );
+    TRACE_END( h->trace.b_enabled, X264_TRACE_RATECONTROL, trace_start );
     i_global_qp = x264_ratecontrol_qp( h );
 
     pic_out->i_qpplus1 =
@@ -3307,8 +3584,10 @@ static int x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
 
     /* update rc */
     int filler = 0;
+    int64_t trace_start = TRACE_START( h->trace.b_enabled );
     if( x264_ratecontrol_end( h, frame_size * 8, &filler ) < 0 )
         return -1;
+    TRACE_END( h->trace.b_enabled, X264_TRACE_RATECONTROL, trace_start );
 
     pic_out->hrd_timing = h->fenc->hrd_timing;
     pic_out->prop.f_crf_avg = h->fdec->f_crf_avg;
@@ -3370,6 +3649,13 @@ static int x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
                 h->stat.i_mb_count_ref[h->sh.i_type][i_list][i] += h->stat.frame.i_mb_count_ref[i_list][i];
     for( int i = 0; i < 3; i++ )
         h->stat.i_mb_field[i] += h->stat.frame.i_mb_field[i];
+    h->stat.i_sync_waits      += h->stat.frame.i_sync_waits;
+    h->stat.i_sync_wait_time  += h->stat.frame.i_sync_wait_time;
+    h->stat.i_sync_broadcasts += h->stat.frame.i_sync_broadcasts;
+    h->stat.i_sync_wakeups    += h->stat.frame.i_sync_wakeups;
+    h->stat.i_hpel_rows       += h->stat.frame.i_hpel_rows;
+    if( h->fdec->b_kept_as_ref )
+        h->stat.i_hpel_rows_ref += h->mb.i_mb_height;
     if( h->sh.i_type == SLICE_TYPE_P && h->param.analyse.i_weighted_pred >= X264_WEIGHTP_SIMPLE )
     {
         h->stat.i_wpred[0] += !!h->sh.weight[0][0].weightfn;
@@ -3503,14 +3789,32 @@ void    x264_encoder_close  ( x264_t *h )
                    || h->stat.i_mb_count[SLICE_TYPE_P][I_PCM]
                    || h->stat.i_mb_count[SLICE_TYPE_B][I_PCM];
 
+    if( h->preprocess )
+    {
+        x264_frame_t *frame = x264_preprocess_frame_end( h );
+        if( frame )
+            x264_frame_push_unused( h, frame );
+        x264_threadpool_print_stats( h, h->preprocesspool, "preprocess threadpool" );
+        x264_threadpool_delete( h->preprocesspool );
+        x264_free( h->preprocess->quant_offsets );
+        x264_free( h->preprocess->h );
+        x264_free( h->preprocess );
+    }
+
     x264_lookahead_delete( h );
 
     if( h->param.b_sliced_threads )
         x264_threadpool_wait_all( h );
     if( h->param.i_threads > 1 )
+    {
+        x264_threadpool_print_stats( h, h->threadpool, "threadpool" );
         x264_threadpool_delete( h->threadpool );
+    }
     if( h->param.i_lookahead_threads > 1 )
+    {
+        x264_threadpool_print_stats( h, h->lookaheadpool, "lookahead threadpool" );
         x264_threadpool_delete( h->lookaheadpool );
+    }
     if( h->i_thread_frames > 1 )
     {
         for( int i = 0; i < h->i_thread_frames; i++ )
@@ -3770,6 +4074,19 @@ void    x264_encoder_close  ( x264_t *h )
                 x264_log( h, X264_LOG_INFO, "ref %c L%d:%s\n", "PB"[i_slice], i_list, buf );
             }
 
+        if( h->stat.i_sync_broadcasts )
+        {
+            int i_frames = SUM3( h->stat.i_frame_count );
+            x264_log( h, X264_LOG_INFO, "frame sync: waits/frame:%.1f wait:%.3fms/frame wakeups:%.1f%% of %.1f updates/frame\n",
+                      (double)h->stat.i_sync_waits / i_frames, h->stat.i_sync_wait_time / 1000.0 / i_frames,
+                      100.0 * h->stat.i_sync_wakeups / h->stat.i_sync_broadcasts,
+                      (double)h->stat.i_sync_broadcasts / i_frames );
+        }
+
+        if( h->param.analyse.b_lazy_hpel && h->stat.i_hpel_rows_ref )
+            x264_log( h, X264_LOG_INFO, "lazy hpel: filtered %.1f%% of reference rows\n",
+                      100.0 * h->stat.i_hpel_rows / h->stat.i_hpel_rows_ref );
+
         if( h->param.analyse.b_ssim )
         {
             float ssim = SUM3( h->stat.f_ssim_mean_y ) / duration;
@@ -3790,6 +4107,16 @@ void    x264_encoder_close  ( x264_t *h )
             x264_log( h, X264_LOG_INFO, "kb/s:%.2f\n", f_bitrate );
     }
 
+    if( h->trace.b_enabled )
+    {
+        x264_trace_print_summary( h );
+        x264_trace_close();
+    }
+
+    int b_frame_pool = h->frames.b_pool;
+    if( b_frame_pool )
+        x264_frame_pool_print_stats( h );
+
     /* rc */
     x264_ratecontrol_delete( h );
 
@@ -3822,7 +4149,12 @@ void    x264_encoder_close  ( x264_t *h )
 
     if( h->param.i_lookahead_threads > 1 )
         for( int i = 0; i < h->param.i_lookahead_threads; i++ )
+        {
+            x264_free( h->lookahead_thread[i]->scratch_buffer2 );
+            if( h->param.rc.b_mb_tree )
+                x264_free( h->lookahead_thread[i]->scratch_buffer );
             x264_free( h->lookahead_thread[i] );
+        }
 
     for( int i = h->param.i_threads - 1; i >= 0; i-- )
     {
@@ -3854,6 +4186,10 @@ void    x264_encoder_close  ( x264_t *h )
         x264_pthread_cond_destroy( &h->thread[i]->cv );
         x264_free( h->thread[i] );
     }
+
+    /* after all frames have returned their buffers */
+    if( b_frame_pool )
+        x264_frame_pool_close();
 }
 
 int x264_encoder_delayed_frames( x264_t *h )
@@ -3867,6 +4203,8 @@ int x264_encoder_delayed_frames( x264_t *h )
     }
     for( int i = 0; h->frames.current[i]; i++ )
         delayed_frames++;
+    if( h->preprocess && h->preprocess->frame )
+        delayed_frames++;
     x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
     x264_pthread_mutex_lock( &h->lookahead->ifbuf.mutex );
     x264_pthread_mutex_lock( &h->lookahead->next.mutex );
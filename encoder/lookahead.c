@@ -38,6 +38,11 @@
  */
 #include "common/common.h"
 #include "analyse.h"
+#include "ratecontrol.h"
+
+static int  x264_lookahead_share_register( x264_t *h );
+static void x264_lookahead_share_unregister( x264_t *h );
+static void x264_lookahead_share_publish( x264_t *h, x264_frame_t **frames, int i_frames );
 
 static void x264_lookahead_shift( x264_sync_frame_list_t *dst, x264_sync_frame_list_t *src, int count )
 {
@@ -67,23 +72,32 @@ static void x264_lookahead_update_last_nonb( x264_t *h, x264_frame_t *new_nonb )
 #if HAVE_THREAD
 static void x264_lookahead_slicetype_decide( x264_t *h )
 {
+    int64_t start = x264_mdate();
+    int64_t trace_start = TRACE_START( h->trace.b_enabled );
     x264_stack_align( x264_slicetype_decide, h );
+    TRACE_END( h->trace.b_enabled, X264_TRACE_SLICETYPE, trace_start );
 
     x264_lookahead_update_last_nonb( h, h->lookahead->next.list[0] );
+    int shift_frames = h->lookahead->next.list[0]->i_bframes + 1;
 
     x264_pthread_mutex_lock( &h->lookahead->ofbuf.mutex );
     while( h->lookahead->ofbuf.i_size == h->lookahead->ofbuf.i_max_size )
         x264_pthread_cond_wait( &h->lookahead->ofbuf.cv_empty, &h->lookahead->ofbuf.mutex );
 
     x264_pthread_mutex_lock( &h->lookahead->next.mutex );
-    x264_lookahead_shift( &h->lookahead->ofbuf, &h->lookahead->next, h->lookahead->next.list[0]->i_bframes + 1 );
+    x264_lookahead_shift( &h->lookahead->ofbuf, &h->lookahead->next, shift_frames );
     x264_pthread_mutex_unlock( &h->lookahead->next.mutex );
 
     /* For MB-tree and VBV lookahead, we have to perform propagation analysis on I-frames too. */
     if( h->lookahead->b_analyse_keyframe && IS_X264_TYPE_I( h->lookahead->last_nonb->i_type ) )
-        x264_stack_align( x264_slicetype_analyse, h, 1 );
+    {
+        trace_start = TRACE_START( h->trace.b_enabled );
+        x264_stack_align( x264_slicetype_analyse, h, shift_frames );
+        TRACE_END( h->trace.b_enabled, X264_TRACE_SLICETYPE, trace_start );
+    }
 
     x264_pthread_mutex_unlock( &h->lookahead->ofbuf.mutex );
+    h->lookahead->i_busy_time += x264_mdate() - start;
 }
 
 static void *x264_lookahead_thread( x264_t *h )
@@ -137,7 +151,11 @@ int x264_lookahead_init( x264_t *h, int i_slicetype_length )
     look->i_last_keyframe = - h->param.i_keyint_max;
     look->b_analyse_keyframe = (h->param.rc.b_mb_tree || (h->param.rc.i_vbv_buffer_size && h->param.rc.i_lookahead))
                                && !h->param.rc.b_stat_read;
+    /* a lookahead share consumer gets the offsets of keyframes along with their type */
+    if( h->param.lookahead_share && !h->param.b_lookahead_source )
+        look->b_analyse_keyframe = 0;
     look->i_slicetype_length = i_slicetype_length;
+    look->i_start_time = x264_mdate();
 
     /* init frame lists */
     if( x264_sync_frame_list_init( &look->ifbuf, h->param.i_sync_lookahead+3 ) ||
@@ -145,6 +163,9 @@ int x264_lookahead_init( x264_t *h, int i_slicetype_length )
         x264_sync_frame_list_init( &look->ofbuf, h->frames.i_delay+3 ) )
         goto fail;
 
+    if( h->param.lookahead_share && x264_lookahead_share_register( h ) )
+        goto fail;
+
     if( !h->param.i_sync_lookahead )
         return 0;
 
@@ -162,6 +183,8 @@ int x264_lookahead_init( x264_t *h, int i_slicetype_length )
 
     return 0;
 fail:
+    if( look->b_share_registered )
+        x264_lookahead_share_unregister( h );
     x264_free( look );
     return -1;
 }
@@ -179,6 +202,13 @@ void x264_lookahead_delete( x264_t *h )
         x264_macroblock_thread_free( h->thread[h->param.i_threads], 1 );
         x264_free( h->thread[h->param.i_threads] );
     }
+    int64_t elapsed = x264_mdate() - h->lookahead->i_start_time;
+    if( elapsed > 0 )
+        x264_log( h, X264_LOG_INFO, "lookahead: busy %.3fs of %.3fs encoding (%.1f%%), B-frame jobs:%d discarded:%d\n",
+                  h->lookahead->i_busy_time / 1e6, elapsed / 1e6, 100.0 * h->lookahead->i_busy_time / elapsed,
+                  h->lookahead->i_bframe_jobs, h->lookahead->i_bframe_jobs_discarded );
+    if( h->lookahead->b_share_registered )
+        x264_lookahead_share_unregister( h );
     x264_sync_frame_list_delete( &h->lookahead->ifbuf );
     x264_sync_frame_list_delete( &h->lookahead->next );
     if( h->lookahead->last_nonb )
@@ -210,6 +240,8 @@ static void x264_lookahead_encoder_shift( x264_t *h )
     if( !h->lookahead->ofbuf.i_size )
         return;
     int i_frames = h->lookahead->ofbuf.list[0]->i_bframes + 1;
+    if( h->param.lookahead_share && h->param.b_lookahead_source )
+        x264_lookahead_share_publish( h, h->lookahead->ofbuf.list, i_frames );
     while( i_frames-- )
     {
         x264_frame_push( h->frames.current, x264_frame_shift( h->lookahead->ofbuf.list ) );
@@ -234,14 +266,315 @@ void x264_lookahead_get_frames( x264_t *h )
         if( h->frames.current[0] || !h->lookahead->next.i_size )
             return;
 
+        int64_t start = x264_mdate();
+        int64_t trace_start = TRACE_START( h->trace.b_enabled );
         x264_stack_align( x264_slicetype_decide, h );
+        TRACE_END( h->trace.b_enabled, X264_TRACE_SLICETYPE, trace_start );
         x264_lookahead_update_last_nonb( h, h->lookahead->next.list[0] );
-        x264_lookahead_shift( &h->lookahead->ofbuf, &h->lookahead->next, h->lookahead->next.list[0]->i_bframes + 1 );
+        int shift_frames = h->lookahead->next.list[0]->i_bframes + 1;
+        x264_lookahead_shift( &h->lookahead->ofbuf, &h->lookahead->next, shift_frames );
 
         /* For MB-tree and VBV lookahead, we have to perform propagation analysis on I-frames too. */
         if( h->lookahead->b_analyse_keyframe && IS_X264_TYPE_I( h->lookahead->last_nonb->i_type ) )
-            x264_stack_align( x264_slicetype_analyse, h, 1 );
+        {
+            trace_start = TRACE_START( h->trace.b_enabled );
+            x264_stack_align( x264_slicetype_analyse, h, shift_frames );
+            TRACE_END( h->trace.b_enabled, X264_TRACE_SLICETYPE, trace_start );
+        }
+        h->lookahead->i_busy_time += x264_mdate() - start;
 
         x264_lookahead_encoder_shift( h );
     }
 }
+
+/****************************************************************************
+ * Shared lookahead
+ ****************************************************************************
+ * The source publishes each minigop as it hands it to its encoding threads, when
+ * its frame types and MB-tree offsets are final.  Consumers read them in
+ * x264_slicetype_decide instead of running x264_slicetype_analyse.  Consumers
+ * have no lookahead thread and buffer at least as many frames as the source
+ * before their first decision, so with pictures fed to the source first, the
+ * source has always published (or can publish without further input) the
+ * minigop a consumer waits for. */
+
+typedef struct
+{
+    int    i_type;     /* X264_TYPE_AUTO until published */
+    int    i_pending;  /* consumers that haven't read the frame yet */
+    float *qp_delta;   /* MB-tree offsets minus AQ offsets, NULL if MB-tree left the frame alone */
+} x264_share_entry_t;
+
+struct x264_lookahead_share_t
+{
+    x264_pthread_mutex_t mutex;
+    x264_pthread_cond_t  cv;
+
+    int b_source_open;
+    int b_source_done;
+    int i_consumers;
+
+    /* the source's validated parameters and the number of frames it buffers
+     * beyond its frame threads before it starts encoding */
+    x264_param_t param;
+    int i_pull_delay;
+
+    /* frames i_first to i_first+i_size-1 */
+    x264_share_entry_t *entry;
+    int i_first;
+    int i_size;
+    int i_alloc;
+};
+
+x264_lookahead_share_t *x264_lookahead_share_new( void )
+{
+    x264_lookahead_share_t *share = calloc( 1, sizeof(x264_lookahead_share_t) );
+    if( !share )
+        return NULL;
+    if( x264_pthread_mutex_init( &share->mutex, NULL ) || x264_pthread_cond_init( &share->cv, NULL ) )
+    {
+        free( share );
+        return NULL;
+    }
+    return share;
+}
+
+void x264_lookahead_share_delete( x264_lookahead_share_t *share )
+{
+    if( !share )
+        return;
+    for( int i = 0; i < share->i_size; i++ )
+        x264_free( share->entry[i].qp_delta );
+    x264_free( share->entry );
+    x264_pthread_mutex_destroy( &share->mutex );
+    x264_pthread_cond_destroy( &share->cv );
+    free( share );
+}
+
+/* Called before the parameters are validated: consumers take the source's GOP structure. */
+int x264_lookahead_share_param( x264_t *h )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    if( h->param.rc.b_stat_read || (h->param.rc.b_stat_write && !h->param.b_lookahead_source) || PARAM_INTERLACED )
+    {
+        x264_log( h, X264_LOG_WARNING, "lookahead sharing is not compatible with multipass or interlacing, disabling\n" );
+        h->param.lookahead_share = NULL;
+        return 0;
+    }
+    if( h->param.b_lookahead_source )
+        return 0;
+
+    x264_pthread_mutex_lock( &share->mutex );
+    int b_source = share->b_source_open;
+    x264_param_t *src = &share->param;
+    if( b_source )
+    {
+        /* keyint_min is still 0 (auto) unless the caller set it */
+        if( h->param.i_keyint_max != src->i_keyint_max || (h->param.i_keyint_min && h->param.i_keyint_min != src->i_keyint_min) ||
+            h->param.i_bframe != src->i_bframe || h->param.i_bframe_pyramid != src->i_bframe_pyramid ||
+            h->param.b_open_gop != src->b_open_gop || h->param.b_bluray_compat != src->b_bluray_compat )
+            x264_log( h, X264_LOG_WARNING, "lookahead share: using the keyint and B-frame settings of the source\n" );
+        h->param.i_keyint_max = src->i_keyint_max;
+        h->param.i_keyint_min = src->i_keyint_min;
+        h->param.i_bframe = src->i_bframe;
+        h->param.i_bframe_pyramid = src->i_bframe_pyramid;
+        h->param.b_open_gop = src->b_open_gop;
+        h->param.b_bluray_compat = src->b_bluray_compat;
+        if( h->param.rc.b_mb_tree && !src->rc.b_mb_tree )
+        {
+            x264_log( h, X264_LOG_WARNING, "lookahead share: the source doesn't use mb-tree, disabling\n" );
+            h->param.rc.b_mb_tree = 0;
+        }
+        /* our decisions are cheap; a lookahead thread could only get ahead of the source */
+        h->param.i_sync_lookahead = 0;
+    }
+    x264_pthread_mutex_unlock( &share->mutex );
+
+    if( !b_source )
+    {
+        x264_log( h, X264_LOG_ERROR, "lookahead share: the source encoder must be opened first\n" );
+        return -1;
+    }
+    return 0;
+}
+
+/* Minimum frames.i_delay of a consumer. */
+int x264_lookahead_share_delay( x264_t *h )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    x264_pthread_mutex_lock( &share->mutex );
+    int i_delay = share->i_pull_delay + h->i_thread_frames;
+    x264_pthread_mutex_unlock( &share->mutex );
+    return i_delay;
+}
+
+void x264_lookahead_share_source_size( x264_t *h, int size[2] )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    x264_pthread_mutex_lock( &share->mutex );
+    size[0] = share->param.i_width;
+    size[1] = share->param.i_height;
+    x264_pthread_mutex_unlock( &share->mutex );
+}
+
+static int x264_lookahead_share_register( x264_t *h )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    int ret = 0;
+    x264_pthread_mutex_lock( &share->mutex );
+    if( h->param.b_lookahead_source )
+    {
+        if( share->b_source_open || share->b_source_done )
+        {
+            x264_log( h, X264_LOG_ERROR, "lookahead share: there is already a source\n" );
+            ret = -1;
+        }
+        else
+        {
+            share->b_source_open = 1;
+            share->param = h->param;
+            share->i_pull_delay = h->frames.i_delay - h->i_thread_frames;
+            h->lookahead->b_share_registered = 1;
+        }
+    }
+    else
+    {
+        h->lookahead->b_share_registered = 1;
+        share->i_consumers++;
+        h->lookahead->i_share_start =
+        h->lookahead->i_share_next = share->i_first + share->i_size;
+    }
+    x264_pthread_mutex_unlock( &share->mutex );
+    return ret;
+}
+
+/* must be called with the share mutex held */
+static void x264_lookahead_share_trim( x264_lookahead_share_t *share )
+{
+    int n = 0;
+    while( n < share->i_size && share->entry[n].i_type != X264_TYPE_AUTO && !share->entry[n].i_pending )
+        x264_free( share->entry[n++].qp_delta );
+    if( !n )
+        return;
+    share->i_size -= n;
+    share->i_first += n;
+    memmove( share->entry, share->entry + n, share->i_size * sizeof(x264_share_entry_t) );
+}
+
+static void x264_lookahead_share_unregister( x264_t *h )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    x264_pthread_mutex_lock( &share->mutex );
+    if( h->param.b_lookahead_source )
+    {
+        share->b_source_open = 0;
+        share->b_source_done = 1;
+        x264_pthread_cond_broadcast( &share->cv );
+        x264_log( h, X264_LOG_INFO, "lookahead share: published %d frames\n", h->lookahead->i_share_frames );
+    }
+    else
+    {
+        share->i_consumers--;
+        for( int i = X264_MAX( h->lookahead->i_share_next - share->i_first, 0 ); i < share->i_size; i++ )
+            if( share->entry[i].i_type != X264_TYPE_AUTO )
+                share->entry[i].i_pending--;
+        x264_lookahead_share_trim( share );
+        if( h->lookahead->i_share_decisions )
+            x264_log( h, X264_LOG_INFO, "lookahead share: read %d frames, %d of %d decisions made locally\n",
+                      h->lookahead->i_share_frames, h->lookahead->i_share_local, h->lookahead->i_share_decisions );
+    }
+    x264_pthread_mutex_unlock( &share->mutex );
+}
+
+/* Source: publish the minigop about to be encoded. */
+static void x264_lookahead_share_publish( x264_t *h, x264_frame_t **frames, int i_frames )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    int i_mb_count = h->mb.i_mb_count;
+    x264_pthread_mutex_lock( &share->mutex );
+    for( int i = 0; i < i_frames; i++ )
+    {
+        x264_frame_t *frame = frames[i];
+        int idx = frame->i_frame - share->i_first;
+        if( idx < 0 )
+            continue;
+        if( idx >= share->i_alloc )
+        {
+            int i_alloc = X264_MAX( 2*share->i_alloc, idx + 16 );
+            x264_share_entry_t *entry = x264_malloc( i_alloc * sizeof(x264_share_entry_t) );
+            if( !entry )
+                break;
+            memcpy( entry, share->entry, share->i_size * sizeof(x264_share_entry_t) );
+            x264_free( share->entry );
+            share->entry = entry;
+            share->i_alloc = i_alloc;
+        }
+        for( ; share->i_size <= idx; share->i_size++ )
+            memset( &share->entry[share->i_size], 0, sizeof(x264_share_entry_t) );
+
+        x264_share_entry_t *entry = &share->entry[idx];
+        if( share->param.rc.b_mb_tree && frame->i_type != X264_TYPE_B && (entry->qp_delta = x264_malloc( i_mb_count * sizeof(float) )) )
+            for( int j = 0; j < i_mb_count; j++ )
+                entry->qp_delta[j] = frame->f_qp_offset[j] - frame->f_qp_offset_aq[j];
+        entry->i_pending = share->i_consumers;
+        entry->i_type = frame->i_type;
+        h->lookahead->i_share_frames++;
+    }
+    x264_lookahead_share_trim( share );
+    x264_pthread_cond_broadcast( &share->cv );
+    x264_pthread_mutex_unlock( &share->mutex );
+}
+
+/* must be called with the share mutex held */
+static x264_share_entry_t *x264_lookahead_share_entry( x264_lookahead_share_t *share, int i_frame )
+{
+    int idx = i_frame - share->i_first;
+    if( idx < 0 || idx >= share->i_size || share->entry[idx].i_type == X264_TYPE_AUTO )
+        return NULL;
+    return &share->entry[idx];
+}
+
+/* Consumer: take the types of the frames in the lookahead from the source, waiting for
+ * the first one.  Returns 0 if the source can't provide it (it closed, or the frame
+ * predates this encoder); the caller then analyses the frames itself. */
+int x264_lookahead_share_read( x264_t *h )
+{
+    x264_lookahead_share_t *share = h->param.lookahead_share;
+    x264_lookahead_t *look = h->lookahead;
+    x264_frame_t **list = look->next.list;
+    int i_first = list[0]->i_frame;
+
+    look->i_share_decisions++;
+    /* already read along with an earlier minigop */
+    if( i_first >= look->i_share_start && i_first < look->i_share_next )
+        return 1;
+
+    x264_pthread_mutex_lock( &share->mutex );
+    if( i_first >= look->i_share_start )
+        while( !share->b_source_done && !x264_lookahead_share_entry( share, i_first ) )
+            x264_pthread_cond_wait( &share->cv, &share->mutex );
+
+    int b_read = i_first >= look->i_share_start && x264_lookahead_share_entry( share, i_first );
+    if( b_read )
+    {
+        x264_emms();
+        for( int i = 0; i < look->next.i_size; i++ )
+        {
+            x264_frame_t *frame = list[i];
+            x264_share_entry_t *entry = x264_lookahead_share_entry( share, frame->i_frame );
+            if( frame->i_frame != look->i_share_next || !entry )
+                break;
+            frame->i_type = entry->i_type;
+            if( entry->qp_delta && h->param.rc.b_mb_tree )
+                x264_macroblock_tree_share_apply( h, frame, entry->qp_delta );
+            entry->i_pending--;
+            look->i_share_next++;
+            look->i_share_frames++;
+        }
+        x264_lookahead_share_trim( share );
+    }
+    else
+        look->i_share_local++;
+    x264_pthread_mutex_unlock( &share->mutex );
+    return b_read;
+}
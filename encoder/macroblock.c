@@ -600,6 +600,7 @@ static ALWAYS_INLINE void x264_macroblock_encode_internal( x264_t *h, int plane_
             int mvy = x264_clip3( h->mb.cache.mv[0][x264_scan8[0]][1],
                                   h->mb.mv_min[1], h->mb.mv_max[1] );
 
+            x264_mb_hpel_check_mv( h, 0, 0, 0, 16, mvx, mvy );
             for( int p = 0; p < plane_count; p++ )
                 h->mc.mc_luma( h->mb.pic.p_fdec[p], FDEC_STRIDE,
                                &h->mb.pic.p_fref[0][0][p*4], h->mb.pic.i_stride[p],
@@ -811,13 +812,14 @@ static ALWAYS_INLINE void x264_macroblock_encode_internal( x264_t *h, int plane_
                 {
                     int i_decimate_8x8 = 0;
                     int cbp = 0;
+                    int nza = x264_quant_4x4x4( h, &dct4x4[i8x8*4], i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, i8x8*4 );
 
                     /* encode one 4x4 block */
                     for( int i4x4 = 0; i4x4 < 4; i4x4++ )
                     {
                         int idx = i8x8 * 4 + i4x4;
 
-                        nz = x264_quant_4x4( h, dct4x4[idx], i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, idx );
+                        nz = (nza >> i4x4) & 1;
                         h->mb.cache.non_zero_count[x264_scan8[p*16+idx]] = nz;
 
                         if( nz )
@@ -946,6 +948,7 @@ static ALWAYS_INLINE int x264_macroblock_probe_skip_internal( x264_t *h, int b_b
             /* Get the MV */
             mvp[0] = x264_clip3( h->mb.cache.pskip_mv[0], h->mb.mv_min[0], h->mb.mv_max[0] );
             mvp[1] = x264_clip3( h->mb.cache.pskip_mv[1], h->mb.mv_min[1], h->mb.mv_max[1] );
+            x264_mb_hpel_check_mv( h, 0, 0, 0, 16, mvp[0], mvp[1] );
 
             /* Motion compensation */
             h->mc.mc_luma( h->mb.pic.p_fdec[p],    FDEC_STRIDE,
@@ -1216,9 +1219,10 @@ static ALWAYS_INLINE void x264_macroblock_encode_p8x8_internal( x264_t *h, int i
                 int i_decimate_8x8 = 0, nnz8x8 = 0;
                 ALIGNED_ARRAY_16( dctcoef, dct4x4,[4],[16] );
                 h->dctf.sub8x8_dct( dct4x4, p_fenc, p_fdec );
+                int nza = x264_quant_4x4x4( h, dct4x4, i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, i8*4 );
                 for( int i4 = 0; i4 < 4; i4++ )
                 {
-                    nz = x264_quant_4x4( h, dct4x4[i4], i_qp, ctx_cat_plane[DCT_LUMA_4x4][p], 0, p, i8*4+i4 );
+                    nz = (nza >> i4) & 1;
                     h->mb.cache.non_zero_count[x264_scan8[p*16+i8*4+i4]] = nz;
                     if( nz )
                     {
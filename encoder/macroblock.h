@@ -77,6 +77,24 @@ static ALWAYS_INLINE int x264_quant_4x4( x264_t *h, dctcoef dct[16], int i_qp, i
         return h->quantf.quant_4x4( dct, h->quant4_mf[i_quant_cat][i_qp], h->quant4_bias[i_quant_cat][i_qp] );
 }
 
+/* Quantizes the four 4x4 blocks of an 8x8 at once; returns a bitmask of the nonzero blocks. */
+static ALWAYS_INLINE int x264_quant_4x4x4( x264_t *h, dctcoef dct[4][16], int i_qp, int ctx_block_cat, int b_intra, int p, int idx )
+{
+    int i_quant_cat = b_intra ? (p?CQM_4IC:CQM_4IY) : (p?CQM_4PC:CQM_4PY);
+    int nza = 0;
+    if( h->mb.b_noise_reduction )
+        for( int i = 0; i < 4; i++ )
+            h->quantf.denoise_dct( dct[i], h->nr_residual_sum[0+!!p*2], h->nr_offset[0+!!p*2], 16 );
+    if( h->mb.b_trellis )
+    {
+        for( int i = 0; i < 4; i++ )
+            nza |= x264_quant_4x4_trellis( h, dct[i], i_quant_cat, i_qp, ctx_block_cat, b_intra, !!p, idx+i+p*16 ) << i;
+        return nza;
+    }
+    else
+        return h->quantf.quant_4x4x4( dct, h->quant4_mf[i_quant_cat][i_qp], h->quant4_bias[i_quant_cat][i_qp] );
+}
+
 static ALWAYS_INLINE int x264_quant_8x8( x264_t *h, dctcoef dct[64], int i_qp, int ctx_block_cat, int b_intra, int p, int idx )
 {
     int i_quant_cat = b_intra ? (p?CQM_8IC:CQM_8IY) : (p?CQM_8PC:CQM_8PY);
@@ -57,6 +57,11 @@ static const int8_t square1[9][2] = {{0,0}, {0,-1}, {0,1}, {-1,0}, {1,0}, {-1,-1
 
 static void refine_subpel( x264_t *h, x264_me_t *m, int hpel_iters, int qpel_iters, int *p_halfpel_thresh, int b_refine_qpel );
 
+/* --lazy-hpel: filter the half-pel rows read by block m with vertical mvs in [mvy_min,mvy_max] */
+#define CHECK_HPEL_ROWS( m, mvy_min, mvy_max )\
+    if( (m)->hpel_ref )\
+        x264_mb_hpel_check( h, (m)->hpel_ref, (m)->i_hpel_y, bh, mvy_min, mvy_max );
+
 #define BITS_MVD( mx, my )\
     (p_cost_mvx[(mx)<<2] + p_cost_mvy[(my)<<2])
 
@@ -71,6 +76,7 @@ static void refine_subpel( x264_t *h, x264_me_t *m, int hpel_iters, int qpel_ite
 #define COST_MV_HPEL( mx, my ) \
 { \
     intptr_t stride2 = 16; \
+    CHECK_HPEL_ROWS( m, my, my ); \
     pixel *src = h->mc.get_ref( pix, &stride2, m->p_fref, stride, mx, my, bw, bh, &m->weight[0] ); \
     int cost = h->pixf.fpelcmp[i_pixel]( p_fenc, FENC_STRIDE, src, stride2 ) \
              + p_cost_mvx[ mx ] + p_cost_mvy[ my ]; \
@@ -844,7 +850,16 @@ static void refine_subpel( x264_t *h, x264_me_t *m, int hpel_iters, int qpel_ite
         int mx = x264_clip3( m->mvp[0], h->mb.mv_min_spel[0]+2, h->mb.mv_max_spel[0]-2 );
         int my = x264_clip3( m->mvp[1], h->mb.mv_min_spel[1]+2, h->mb.mv_max_spel[1]-2 );
         if( (mx-bmx)|(my-bmy) )
+        {
+            CHECK_HPEL_ROWS( m, my, my );
             COST_MV_SAD( mx, my );
+        }
+    }
+
+    /* each hpel iteration moves the mv by up to 2 and reads 2 beyond it, each qpel one by 1 */
+    {
+        int range = 2*hpel_iters + qpel_iters + 2;
+        CHECK_HPEL_ROWS( m, bmy - range, bmy + range );
     }
 
     /* halfpel diamond search */
@@ -1017,6 +1032,10 @@ static void ALWAYS_INLINE x264_me_refine_bidir( x264_t *h, x264_me_t *m0, x264_m
         bm0x > h->mb.mv_max_spel[0] - 8 || bm1x > h->mb.mv_max_spel[0] - 8 )
         return;
 
+    /* at most 8 passes of +-1, plus the +-1 neighbourhood cached around the mvs */
+    CHECK_HPEL_ROWS( m0, bm0y - 9, bm0y + 9 );
+    CHECK_HPEL_ROWS( m1, bm1y - 9, bm1y + 9 );
+
     if( rd && m0->i_pixel != PIXEL_16x16 && i8 != 0 )
     {
         x264_mb_predict_mv( h, 0, i8<<2, bw>>2, m0->mvp );
@@ -1207,6 +1226,7 @@ void x264_me_refine_qpel_rd( x264_t *h, x264_me_t *m, int i_lambda2, int i4, int
     pmy = m->mvp[1];
     p_cost_mvx = m->p_cost_mv - pmx;
     p_cost_mvy = m->p_cost_mv - pmy;
+    CHECK_HPEL_ROWS( m, bmy, bmy );
     COST_MV_SATD( bmx, bmy, bsatd, 0 );
     if( m->i_pixel != PIXEL_16x16 )
         COST_MV_RD( bmx, bmy, 0, 0, 0 )
@@ -1218,6 +1238,7 @@ void x264_me_refine_qpel_rd( x264_t *h, x264_me_t *m, int i_lambda2, int i4, int
         && pmx >= h->mb.mv_min_spel[0] && pmx <= h->mb.mv_max_spel[0]
         && pmy >= h->mb.mv_min_spel[1] && pmy <= h->mb.mv_max_spel[1] )
     {
+        CHECK_HPEL_ROWS( m, pmy, pmy );
         COST_MV_SATD( pmx, pmy, satd, 0 );
         COST_MV_RD  ( pmx, pmy, satd, 0, 0 );
         /* The hex motion search is guaranteed to not repeat the center candidate,
@@ -1236,6 +1257,9 @@ void x264_me_refine_qpel_rd( x264_t *h, x264_me_t *m, int i_lambda2, int i4, int
         return;
     }
 
+    /* the hexagons and the square move the mv by at most 2+2*9+1 */
+    CHECK_HPEL_ROWS( m, bmy - 21, bmy + 21 );
+
     /* subpel hex search, same pattern as ME HEX. */
     dir = -2;
     omx = bmx;
@@ -46,6 +46,8 @@ typedef struct
     pixel *p_fenc[3];
     uint16_t *integral;
     int      i_stride[3];
+    x264_frame_t *hpel_ref; /* reference to filter half-pel rows of before reading them (--lazy-hpel), else NULL */
+    int      i_hpel_y;      /* row of the block within the mb */
 
     ALIGNED_4( int16_t mvp[2] );
 
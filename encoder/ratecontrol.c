@@ -32,6 +32,7 @@
 
 #include "common/common.h"
 #include "ratecontrol.h"
+#include "analyse.h"
 #include "me.h"
 
 typedef struct
@@ -60,6 +61,79 @@ typedef struct
     int64_t i_cpb_duration;
 } ratecontrol_entry_t;
 
+/* Binary 1st pass stats (--stats-binary): a header, the options string padded to
+ * header_size, then one fixed-size record per frame in coded order.
+ * Fields are stored in host byte order; the reader rejects any layout it
+ * doesn't know, so the file is not portable across architectures. */
+#define STATS_BINARY_MAGIC "x264stat"
+#define STATS_BINARY_VERSION 1
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t header_size;   /* including the options string, multiple of 8 */
+    uint32_t record_size;
+    uint32_t options_size;  /* not NUL-terminated */
+} stats_header_t;
+
+typedef struct
+{
+    int64_t i_duration;
+    int64_t i_cpb_duration;
+    int32_t frame_in;
+    int32_t frame_out;
+    float   qp_rc;
+    float   qp_aq;
+    int32_t tex_bits;
+    int32_t mv_bits;
+    int32_t misc_bits;
+    int32_t i_count;
+    int32_t p_count;
+    int32_t s_count;
+    int32_t refcount[16];
+    int16_t i_weight_denom[2]; /* -1 if unweighted */
+    int16_t weight[3][2];
+    uint8_t refs;
+    char    type;
+    char    direct;
+    uint8_t reserved[5];
+} stats_record_t;
+
+/* Indexed MB-tree stats (--stats-binary): a header, one compressed block per
+ * reference frame, then the index and a trailer pointing at it.  Each block holds
+ * the frame's FIX8.8 qp offsets, MED-predicted from their neighbours and coded
+ * with adaptive Rice codes, so the 2nd pass can seek straight to any frame. */
+#define MBTREE_MAGIC "x264mbtr"
+#define MBTREE_INDEX_MAGIC "x264mbix"
+#define MBTREE_VERSION 1
+
+typedef struct
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t mb_width;
+    uint32_t mb_height;
+    uint32_t reserved;
+} mbtree_header_t;
+
+typedef struct
+{
+    uint64_t offset;
+    uint32_t size;
+    int32_t  frame;         /* input frame number */
+    uint8_t  type;          /* slice type */
+    uint8_t  reserved[7];
+} mbtree_index_t;
+
+typedef struct
+{
+    uint64_t index_offset;
+    uint32_t index_count;
+    uint32_t reserved;
+    char     magic[8];
+} mbtree_trailer_t;
+
 typedef struct
 {
     float coeff_min;
@@ -150,6 +224,16 @@ struct x264_ratecontrol_t
         float *coeffs[2];
         int *pos[2];
         int srcdim[2];          /* Source dimensions (W/H) */
+
+        /* Indexed stats */
+        int b_indexed;
+        int mb_width;           /* width of the stored qp arrays */
+        mbtree_index_t *index;  /* writer: blocks in coded order; reader: one entry per frame */
+        int index_count;
+        int index_alloc;
+        uint64_t file_pos;
+        uint8_t *bits_buffer;
+        int bits_buffer_size;
     } mbtree;
 
     /* MBRC stuff */
@@ -220,19 +304,20 @@ static inline double qscale2bits( ratecontrol_entry_t *rce, double qscale )
            + rce->misc_bits;
 }
 
-static ALWAYS_INLINE uint32_t ac_energy_var( uint64_t sum_ssd, int shift, x264_frame_t *frame, int i, int b_store )
+static ALWAYS_INLINE uint32_t ac_energy_var( uint64_t sum_ssd, int shift, uint32_t *pixel_sum, uint64_t *pixel_ssd, int i, int b_store )
 {
     uint32_t sum = sum_ssd;
     uint32_t ssd = sum_ssd >> 32;
     if( b_store )
     {
-        frame->i_pixel_sum[i] += sum;
-        frame->i_pixel_ssd[i] += ssd;
+        pixel_sum[i] += sum;
+        pixel_ssd[i] += ssd;
     }
     return ssd - ((uint64_t)sum * sum >> shift);
 }
 
-static ALWAYS_INLINE uint32_t ac_energy_plane( x264_t *h, int mb_x, int mb_y, x264_frame_t *frame, int i, int b_chroma, int b_field, int b_store )
+static ALWAYS_INLINE uint32_t ac_energy_plane( x264_t *h, int mb_x, int mb_y, x264_frame_t *frame, uint32_t *pixel_sum, uint64_t *pixel_ssd,
+                                                int i, int b_chroma, int b_field, int b_store )
 {
     int height = b_chroma ? 16>>CHROMA_V_SHIFT : 16;
     int stride = frame->i_stride[i];
@@ -247,15 +332,16 @@ static ALWAYS_INLINE uint32_t ac_energy_plane( x264_t *h, int mb_x, int mb_y, x2
         int shift = 7 - CHROMA_V_SHIFT;
 
         h->mc.load_deinterleave_chroma_fenc( pix, frame->plane[1] + offset, stride, height );
-        return ac_energy_var( h->pixf.var[chromapix]( pix,               FENC_STRIDE ), shift, frame, 1, b_store )
-             + ac_energy_var( h->pixf.var[chromapix]( pix+FENC_STRIDE/2, FENC_STRIDE ), shift, frame, 2, b_store );
+        return ac_energy_var( h->pixf.var[chromapix]( pix,               FENC_STRIDE ), shift, pixel_sum, pixel_ssd, 1, b_store )
+             + ac_energy_var( h->pixf.var[chromapix]( pix+FENC_STRIDE/2, FENC_STRIDE ), shift, pixel_sum, pixel_ssd, 2, b_store );
     }
     else
-        return ac_energy_var( h->pixf.var[PIXEL_16x16]( frame->plane[i] + offset, stride ), 8, frame, i, b_store );
+        return ac_energy_var( h->pixf.var[PIXEL_16x16]( frame->plane[i] + offset, stride ), 8, pixel_sum, pixel_ssd, i, b_store );
 }
 
 // Find the total AC energy of the block in all planes.
-static NOINLINE uint32_t x264_ac_energy_mb( x264_t *h, int mb_x, int mb_y, x264_frame_t *frame )
+// The per-plane sums of the pixels and their squares are accumulated into pixel_sum and pixel_ssd.
+static NOINLINE uint32_t x264_ac_energy_mb( x264_t *h, int mb_x, int mb_y, x264_frame_t *frame, uint32_t *pixel_sum, uint64_t *pixel_ssd )
 {
     /* This function contains annoying hacks because GCC has a habit of reordering emms
      * and putting it after floating point ops.  As a result, we put the emms at the end of the
@@ -268,50 +354,89 @@ static NOINLINE uint32_t x264_ac_energy_mb( x264_t *h, int mb_x, int mb_y, x264_
         /* We don't know the super-MB mode we're going to pick yet, so
          * simply try both and pick the lower of the two. */
         uint32_t var_interlaced, var_progressive;
-        var_interlaced   = ac_energy_plane( h, mb_x, mb_y, frame, 0, 0, 1, 1 );
-        var_progressive  = ac_energy_plane( h, mb_x, mb_y, frame, 0, 0, 0, 0 );
+        var_interlaced   = ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 0, 0, 1, 1 );
+        var_progressive  = ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 0, 0, 0, 0 );
         if( CHROMA444 )
         {
-            var_interlaced  += ac_energy_plane( h, mb_x, mb_y, frame, 1, 0, 1, 1 );
-            var_progressive += ac_energy_plane( h, mb_x, mb_y, frame, 1, 0, 0, 0 );
-            var_interlaced  += ac_energy_plane( h, mb_x, mb_y, frame, 2, 0, 1, 1 );
-            var_progressive += ac_energy_plane( h, mb_x, mb_y, frame, 2, 0, 0, 0 );
+            var_interlaced  += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 1, 0, 1, 1 );
+            var_progressive += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 1, 0, 0, 0 );
+            var_interlaced  += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 2, 0, 1, 1 );
+            var_progressive += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 2, 0, 0, 0 );
         }
         else
         {
-            var_interlaced  += ac_energy_plane( h, mb_x, mb_y, frame, 1, 1, 1, 1 );
-            var_progressive += ac_energy_plane( h, mb_x, mb_y, frame, 1, 1, 0, 0 );
+            var_interlaced  += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 1, 1, 1, 1 );
+            var_progressive += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 1, 1, 0, 0 );
         }
         var = X264_MIN( var_interlaced, var_progressive );
     }
     else
     {
-        var  = ac_energy_plane( h, mb_x, mb_y, frame, 0, 0, PARAM_INTERLACED, 1 );
+        var  = ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 0, 0, PARAM_INTERLACED, 1 );
         if( CHROMA444 )
         {
-            var += ac_energy_plane( h, mb_x, mb_y, frame, 1, 0, PARAM_INTERLACED, 1 );
-            var += ac_energy_plane( h, mb_x, mb_y, frame, 2, 0, PARAM_INTERLACED, 1 );
+            var += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 1, 0, PARAM_INTERLACED, 1 );
+            var += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 2, 0, PARAM_INTERLACED, 1 );
         }
         else
-            var += ac_energy_plane( h, mb_x, mb_y, frame, 1, 1, PARAM_INTERLACED, 1 );
+            var += ac_energy_plane( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd, 1, 1, PARAM_INTERLACED, 1 );
     }
     x264_emms();
     return var;
 }
 
-void x264_adaptive_quant_frame( x264_t *h, x264_frame_t *frame, float *quant_offsets )
+/* Adaptive quantization is split in two: x264_adaptive_quant_frame_rows computes everything
+ * that depends on a single macroblock and can run on any range of rows, in parallel;
+ * x264_adaptive_quant_frame_end does the frame-wide averaging afterwards, in raster order,
+ * so the result doesn't depend on how the rows were split. */
+void x264_adaptive_quant_frame_rows( x264_t *h, x264_frame_t *frame, float *quant_offsets, int mb_y_start, int mb_y_end,
+                                     uint32_t pixel_sum[3], uint64_t pixel_ssd[3] )
 {
-    /* constants chosen to result in approximately the same overall bitrate as without AQ.
-     * FIXME: while they're written in 5 significant digits, they're only tuned to 2. */
-    float strength;
-    float avg_adj = 0.f;
-    /* Initialize frame stats */
-    for( int i = 0; i < 3; i++ )
+    /* Degenerate cases */
+    if( h->param.rc.i_aq_mode == X264_AQ_NONE || h->param.rc.f_aq_strength == 0 )
     {
-        frame->i_pixel_sum[i] = 0;
-        frame->i_pixel_ssd[i] = 0;
+        /* Need variance data for weighted prediction */
+        if( h->param.analyse.i_weighted_pred )
+        {
+            for( int mb_y = mb_y_start; mb_y < mb_y_end; mb_y++ )
+                for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
+                    x264_ac_energy_mb( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd );
+        }
+    }
+    /* The average is only known once every row is done */
+    else if( h->param.rc.i_aq_mode == X264_AQ_AUTOVARIANCE )
+    {
+        for( int mb_y = mb_y_start; mb_y < mb_y_end; mb_y++ )
+            for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
+            {
+                uint32_t energy = x264_ac_energy_mb( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd );
+                frame->f_qp_offset[mb_x + mb_y*h->mb.i_mb_stride] = powf( energy + 1, 0.125f );
+            }
     }
+    else
+    {
+        /* constants chosen to result in approximately the same overall bitrate as without AQ.
+         * FIXME: while they're written in 5 significant digits, they're only tuned to 2. */
+        float strength = h->param.rc.f_aq_strength * 1.0397f;
+        for( int mb_y = mb_y_start; mb_y < mb_y_end; mb_y++ )
+            for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
+            {
+                int mb_xy = mb_x + mb_y*h->mb.i_mb_stride;
+                uint32_t energy = x264_ac_energy_mb( h, mb_x, mb_y, frame, pixel_sum, pixel_ssd );
+                float qp_adj = strength * (x264_log2( X264_MAX(energy, 1) ) - (14.427f + 2*(BIT_DEPTH-8)));
+                if( quant_offsets )
+                    qp_adj += quant_offsets[mb_xy];
+                frame->f_qp_offset[mb_xy] =
+                frame->f_qp_offset_aq[mb_xy] = qp_adj;
+                if( h->frames.b_have_lowres )
+                    frame->i_inv_qscale_factor[mb_xy] = x264_exp2fix8(qp_adj);
+            }
+    }
+}
 
+/* Expects frame->i_pixel_sum and i_pixel_ssd to hold the totals over all rows. */
+void x264_adaptive_quant_frame_end( x264_t *h, x264_frame_t *frame, float *quant_offsets )
+{
     /* Degenerate cases */
     if( h->param.rc.i_aq_mode == X264_AQ_NONE || h->param.rc.f_aq_strength == 0 )
     {
@@ -335,55 +460,31 @@ void x264_adaptive_quant_frame( x264_t *h, x264_frame_t *frame, float *quant_off
                         frame->i_inv_qscale_factor[mb_xy] = 256;
             }
         }
-        /* Need variance data for weighted prediction */
-        if( h->param.analyse.i_weighted_pred )
-        {
-            for( int mb_y = 0; mb_y < h->mb.i_mb_height; mb_y++ )
-                for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
-                    x264_ac_energy_mb( h, mb_x, mb_y, frame );
-        }
-        else
+        if( !h->param.analyse.i_weighted_pred )
             return;
     }
-    /* Actual adaptive quantization */
-    else
+    else if( h->param.rc.i_aq_mode == X264_AQ_AUTOVARIANCE )
     {
-        if( h->param.rc.i_aq_mode == X264_AQ_AUTOVARIANCE )
-        {
-            float bit_depth_correction = powf(1 << (BIT_DEPTH-8), 0.5f);
-            float avg_adj_pow2 = 0.f;
-            for( int mb_y = 0; mb_y < h->mb.i_mb_height; mb_y++ )
-                for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
-                {
-                    uint32_t energy = x264_ac_energy_mb( h, mb_x, mb_y, frame );
-                    float qp_adj = powf( energy + 1, 0.125f );
-                    frame->f_qp_offset[mb_x + mb_y*h->mb.i_mb_stride] = qp_adj;
-                    avg_adj += qp_adj;
-                    avg_adj_pow2 += qp_adj * qp_adj;
-                }
-            avg_adj /= h->mb.i_mb_count;
-            avg_adj_pow2 /= h->mb.i_mb_count;
-            strength = h->param.rc.f_aq_strength * avg_adj / bit_depth_correction;
-            avg_adj = avg_adj - 0.5f * (avg_adj_pow2 - (14.f * bit_depth_correction)) / avg_adj;
-        }
-        else
-            strength = h->param.rc.f_aq_strength * 1.0397f;
+        float bit_depth_correction = powf(1 << (BIT_DEPTH-8), 0.5f);
+        float avg_adj = 0.f;
+        float avg_adj_pow2 = 0.f;
+        for( int mb_y = 0; mb_y < h->mb.i_mb_height; mb_y++ )
+            for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
+            {
+                float qp_adj = frame->f_qp_offset[mb_x + mb_y*h->mb.i_mb_stride];
+                avg_adj += qp_adj;
+                avg_adj_pow2 += qp_adj * qp_adj;
+            }
+        avg_adj /= h->mb.i_mb_count;
+        avg_adj_pow2 /= h->mb.i_mb_count;
+        float strength = h->param.rc.f_aq_strength * avg_adj / bit_depth_correction;
+        avg_adj = avg_adj - 0.5f * (avg_adj_pow2 - (14.f * bit_depth_correction)) / avg_adj;
 
         for( int mb_y = 0; mb_y < h->mb.i_mb_height; mb_y++ )
             for( int mb_x = 0; mb_x < h->mb.i_mb_width; mb_x++ )
             {
-                float qp_adj;
                 int mb_xy = mb_x + mb_y*h->mb.i_mb_stride;
-                if( h->param.rc.i_aq_mode == X264_AQ_AUTOVARIANCE )
-                {
-                    qp_adj = frame->f_qp_offset[mb_xy];
-                    qp_adj = strength * (qp_adj - avg_adj);
-                }
-                else
-                {
-                    uint32_t energy = x264_ac_energy_mb( h, mb_x, mb_y, frame );
-                    qp_adj = strength * (x264_log2( X264_MAX(energy, 1) ) - (14.427f + 2*(BIT_DEPTH-8)));
-                }
+                float qp_adj = strength * (frame->f_qp_offset[mb_xy] - avg_adj);
                 if( quant_offsets )
                     qp_adj += quant_offsets[mb_xy];
                 frame->f_qp_offset[mb_xy] =
@@ -404,6 +505,18 @@ void x264_adaptive_quant_frame( x264_t *h, x264_frame_t *frame, float *quant_off
     }
 }
 
+void x264_adaptive_quant_frame( x264_t *h, x264_frame_t *frame, float *quant_offsets )
+{
+    /* Initialize frame stats */
+    for( int i = 0; i < 3; i++ )
+    {
+        frame->i_pixel_sum[i] = 0;
+        frame->i_pixel_ssd[i] = 0;
+    }
+    x264_adaptive_quant_frame_rows( h, frame, quant_offsets, 0, h->mb.i_mb_height, frame->i_pixel_sum, frame->i_pixel_ssd );
+    x264_adaptive_quant_frame_end( h, frame, quant_offsets );
+}
+
 static int x264_macroblock_tree_rescale_init( x264_t *h, x264_ratecontrol_t *rc )
 {
     /* Use fractional QP array dimensions to compensate for edge padding */
@@ -528,6 +641,252 @@ static void x264_macroblock_tree_rescale( x264_t *h, x264_ratecontrol_t *rc, flo
     }
 }
 
+/* Rice parameter for the next residual, from the running mean of past residuals */
+static ALWAYS_INLINE int mbtree_rice_k( int sum, int count )
+{
+    int k = 0;
+    while( (count << k) < sum && k < 15 )
+        k++;
+    return k;
+}
+
+static ALWAYS_INLINE void mbtree_rice_update( int *sum, int *count, int residual )
+{
+    *sum += abs( residual );
+    if( ++*count == 64 )
+    {
+        *sum >>= 1;
+        *count >>= 1;
+    }
+}
+
+static ALWAYS_INLINE int mbtree_predict( int16_t *qp, int x, int y, int stride )
+{
+    if( !y )
+        return x ? qp[-1] : 0;
+    if( !x )
+        return qp[-stride];
+    int a = qp[-1], b = qp[-stride], c = qp[-stride-1];
+    return x264_median( a, b, a + b - c );
+}
+
+static int x264_macroblock_tree_compress( uint8_t *dst, int dst_size, int16_t *qp, int width, int height )
+{
+    bs_t s;
+    int sum = 16, count = 1;
+    bs_init( &s, dst, dst_size );
+    for( int y = 0; y < height; y++ )
+        for( int x = 0; x < width; x++, qp++ )
+        {
+            int residual = (int16_t)(*qp - mbtree_predict( qp, x, y, width ));
+            int u = residual >= 0 ? 2*residual : -2*residual-1;
+            int k = mbtree_rice_k( sum, count );
+            int q = u >> k;
+            if( q < 16 )
+            {
+                bs_write( &s, q+1, 1 );
+                if( k )
+                    bs_write( &s, k, u & ((1<<k)-1) );
+            }
+            else
+            {
+                /* escape: 16 zeros followed by the raw value */
+                bs_write( &s, 16, 0 );
+                bs_write( &s, 16, u );
+            }
+            mbtree_rice_update( &sum, &count, residual );
+        }
+    bs_align_0( &s );
+    return bs_pos( &s ) >> 3;
+}
+
+static int x264_macroblock_tree_decompress( int16_t *qp, uint8_t *src, int src_size, int width, int height )
+{
+    uint64_t cur_bits = 0; /* MSB-first */
+    int i_left = 0, pos = 0;
+    int sum = 16, count = 1;
+    for( int y = 0; y < height; y++ )
+        for( int x = 0; x < width; x++, qp++ )
+        {
+            for( ; i_left <= 56; i_left += 8 )
+                cur_bits |= (uint64_t)(pos < src_size ? src[pos] : 0) << (56 - i_left), pos++;
+            int k = mbtree_rice_k( sum, count );
+            int q = x264_clz( (uint32_t)(cur_bits >> 32) | 0x8000 );
+            int u;
+            if( q < 16 )
+            {
+                cur_bits <<= q+1;
+                u = q << k;
+                if( k )
+                    u |= cur_bits >> (64-k);
+                cur_bits <<= k;
+                i_left -= q+1+k;
+            }
+            else
+            {
+                u = (cur_bits >> 32) & 0xffff;
+                cur_bits <<= 32;
+                i_left -= 32;
+            }
+            int residual = u&1 ? -((u+1)>>1) : u>>1;
+            *qp = mbtree_predict( qp, x, y, width ) + residual;
+            mbtree_rice_update( &sum, &count, residual );
+        }
+    /* reading past the end of the block yields zeros; make sure none were consumed */
+    return 8*pos - i_left > 8*src_size ? -1 : 0;
+}
+
+/* Set up indexed MB-tree stats: write the header, or load the index of an existing file.
+ * Old-style stats files are left to the sequential reader. */
+static int x264_macroblock_tree_index_init( x264_t *h, x264_ratecontrol_t *rc )
+{
+    mbtree_header_t header;
+    FILE *in = rc->p_mbtree_stat_file_in;
+    if( in )
+    {
+        rc->mbtree.b_indexed = fread( &header, sizeof(mbtree_header_t), 1, in ) == 1 && !memcmp( header.magic, MBTREE_MAGIC, 8 );
+        if( !rc->mbtree.b_indexed )
+            rewind( in );
+    }
+    else
+        rc->mbtree.b_indexed = h->param.rc.b_stat_binary && rc->p_mbtree_stat_file_out;
+    if( !rc->mbtree.b_indexed )
+    {
+        if( in && h->param.rc.i_chunk_start )
+        {
+            x264_log( h, X264_LOG_ERROR, "chunked encoding needs MB-tree stats written with --stats-binary\n" );
+            return -1;
+        }
+        return 0;
+    }
+
+    /* worst case is one escape code per MB, plus room for the bitwriter's word-sized stores */
+    rc->mbtree.bits_buffer_size = rc->mbtree.src_mb_count * 4 + 16;
+    CHECKED_MALLOC( rc->mbtree.bits_buffer, rc->mbtree.bits_buffer_size );
+
+    if( !in )
+    {
+        memset( &header, 0, sizeof(mbtree_header_t) );
+        memcpy( header.magic, MBTREE_MAGIC, 8 );
+        header.version = MBTREE_VERSION;
+        header.mb_width = h->mb.i_mb_width;
+        header.mb_height = h->mb.i_mb_height;
+        if( fwrite( &header, sizeof(mbtree_header_t), 1, rc->p_mbtree_stat_file_out ) != 1 )
+            return -1;
+        rc->mbtree.mb_width = header.mb_width;
+        rc->mbtree.file_pos = sizeof(mbtree_header_t);
+        return 0;
+    }
+
+    if( header.version != MBTREE_VERSION || header.mb_width * header.mb_height != rc->mbtree.src_mb_count )
+    {
+        x264_log( h, X264_LOG_ERROR, "MB-tree stats file version %u or size %ux%u not supported\n",
+                  header.version, header.mb_width, header.mb_height );
+        return -1;
+    }
+    rc->mbtree.mb_width = header.mb_width;
+
+    mbtree_trailer_t trailer;
+    if( x264_fseek( in, -(int)sizeof(mbtree_trailer_t), SEEK_END ) ||
+        fread( &trailer, sizeof(mbtree_trailer_t), 1, in ) != 1 ||
+        memcmp( trailer.magic, MBTREE_INDEX_MAGIC, 8 ) ||
+        x264_fseek( in, trailer.index_offset, SEEK_SET ) )
+    {
+        x264_log( h, X264_LOG_ERROR, "MB-tree stats file has no index\n" );
+        return -1;
+    }
+    CHECKED_MALLOCZERO( rc->mbtree.index, X264_MAX( rc->num_entries, 1 ) * sizeof(mbtree_index_t) );
+    rc->mbtree.index_count = rc->num_entries;
+    for( uint32_t i = 0; i < trailer.index_count; i++ )
+    {
+        mbtree_index_t entry;
+        if( fread( &entry, sizeof(mbtree_index_t), 1, in ) != 1 || entry.frame < 0 || entry.size > rc->mbtree.bits_buffer_size )
+        {
+            x264_log( h, X264_LOG_ERROR, "MB-tree stats index is damaged at entry %u\n", i );
+            return -1;
+        }
+        /* frames outside of this chunk */
+        int frame = entry.frame - h->param.rc.i_chunk_start;
+        if( frame >= 0 && frame < rc->num_entries )
+            rc->mbtree.index[frame] = entry;
+    }
+    return 0;
+fail:
+    return -1;
+}
+
+/* Append the index and trailer, called once all frames have been written. */
+static int x264_macroblock_tree_index_write( x264_ratecontrol_t *rc )
+{
+    mbtree_trailer_t trailer;
+    memset( &trailer, 0, sizeof(mbtree_trailer_t) );
+    trailer.index_offset = rc->mbtree.file_pos;
+    trailer.index_count = rc->mbtree.index_count;
+    memcpy( trailer.magic, MBTREE_INDEX_MAGIC, 8 );
+    if( fwrite( rc->mbtree.index, sizeof(mbtree_index_t), rc->mbtree.index_count, rc->p_mbtree_stat_file_out ) != rc->mbtree.index_count ||
+        fwrite( &trailer, sizeof(mbtree_trailer_t), 1, rc->p_mbtree_stat_file_out ) != 1 )
+        return -1;
+    return 0;
+}
+
+static int x264_macroblock_tree_write_indexed( x264_t *h, uint8_t i_type )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    /* Frames finish on different threads' contexts; the index lives in the first one. */
+    x264_ratecontrol_t *rc0 = h->thread[0]->rc;
+    int16_t *qp = (int16_t*)rc->mbtree.qp_buffer[0];
+    for( int i = 0; i < h->mb.i_mb_count; i++ )
+        qp[i] = h->fenc->f_qp_offset[i]*256.0;
+    int size = x264_macroblock_tree_compress( rc->mbtree.bits_buffer, rc->mbtree.bits_buffer_size, qp,
+                                              rc->mbtree.mb_width, h->mb.i_mb_count / rc->mbtree.mb_width );
+
+    if( rc0->mbtree.index_count == rc0->mbtree.index_alloc )
+    {
+        int alloc = X264_MAX( 2*rc0->mbtree.index_alloc, 256 );
+        mbtree_index_t *index = x264_malloc( alloc * sizeof(mbtree_index_t) );
+        if( !index )
+            return -1;
+        if( rc0->mbtree.index_count )
+            memcpy( index, rc0->mbtree.index, rc0->mbtree.index_count * sizeof(mbtree_index_t) );
+        x264_free( rc0->mbtree.index );
+        rc0->mbtree.index = index;
+        rc0->mbtree.index_alloc = alloc;
+    }
+    mbtree_index_t *entry = &rc0->mbtree.index[rc0->mbtree.index_count++];
+    memset( entry, 0, sizeof(mbtree_index_t) );
+    entry->offset = rc0->mbtree.file_pos;
+    entry->size = size;
+    entry->frame = h->fenc->i_frame;
+    entry->type = i_type;
+    rc0->mbtree.file_pos += size;
+    return fwrite( rc->mbtree.bits_buffer, 1, size, rc->p_mbtree_stat_file_out ) == size ? 0 : -1;
+}
+
+static int x264_macroblock_tree_read_indexed( x264_t *h, int i_frame, uint8_t i_type_actual )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    mbtree_index_t *entry = &rc->mbtree.index[i_frame];
+    if( !entry->size )
+    {
+        x264_log( h, X264_LOG_ERROR, "MB-tree stats missing for frame %d.\n", i_frame );
+        return -1;
+    }
+    if( entry->type != i_type_actual )
+    {
+        x264_log( h, X264_LOG_ERROR, "MB-tree frametype %d doesn't match actual frametype %d.\n", entry->type, i_type_actual );
+        return -1;
+    }
+    if( x264_fseek( rc->p_mbtree_stat_file_in, entry->offset, SEEK_SET ) ||
+        fread( rc->mbtree.bits_buffer, 1, entry->size, rc->p_mbtree_stat_file_in ) != entry->size ||
+        x264_macroblock_tree_decompress( (int16_t*)rc->mbtree.qp_buffer[0], rc->mbtree.bits_buffer, entry->size,
+                                         rc->mbtree.mb_width, rc->mbtree.src_mb_count / rc->mbtree.mb_width ) < 0 )
+    {
+        x264_log( h, X264_LOG_ERROR, "MB-tree stats damaged at frame %d.\n", i_frame );
+        return -1;
+    }
+    return 0;
+}
+
 int x264_macroblock_tree_read( x264_t *h, x264_frame_t *frame, float *quant_offsets )
 {
     x264_ratecontrol_t *rc = h->rc;
@@ -536,7 +895,13 @@ int x264_macroblock_tree_read( x264_t *h, x264_frame_t *frame, float *quant_offs
     if( rc->entry[frame->i_frame].kept_as_ref )
     {
         uint8_t i_type;
-        if( rc->mbtree.qpbuf_pos < 0 )
+        if( rc->mbtree.b_indexed )
+        {
+            if( x264_macroblock_tree_read_indexed( h, frame->i_frame, i_type_actual ) < 0 )
+                return -1;
+            rc->mbtree.qpbuf_pos = 0;
+        }
+        else if( rc->mbtree.qpbuf_pos < 0 )
         {
             do
             {
@@ -558,7 +923,8 @@ int x264_macroblock_tree_read( x264_t *h, x264_frame_t *frame, float *quant_offs
         float *dst = rc->mbtree.rescale_enabled ? rc->mbtree.scale_buffer[0] : frame->f_qp_offset;
         for( int i = 0; i < rc->mbtree.src_mb_count; i++ )
         {
-            int16_t qp_fix8 = endian_fix16( rc->mbtree.qp_buffer[rc->mbtree.qpbuf_pos][i] );
+            uint16_t qp_buf = rc->mbtree.qp_buffer[rc->mbtree.qpbuf_pos][i];
+            int16_t qp_fix8 = rc->mbtree.b_indexed ? qp_buf : endian_fix16( qp_buf );
             dst[i] = qp_fix8 * (1.f/256.f);
         }
         if( rc->mbtree.rescale_enabled )
@@ -576,6 +942,22 @@ fail:
     return -1;
 }
 
+/* Offsets from a lookahead share source are relative to its AQ, so that they can be
+ * rescaled to our resolution and applied on top of our own AQ. */
+void x264_macroblock_tree_share_apply( x264_t *h, x264_frame_t *frame, const float *qp_delta )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    if( rc->mbtree.rescale_enabled )
+    {
+        memcpy( rc->mbtree.scale_buffer[0], qp_delta, rc->mbtree.src_mb_count * sizeof(float) );
+        x264_macroblock_tree_rescale( h, rc, frame->f_qp_offset );
+    }
+    else
+        memcpy( frame->f_qp_offset, qp_delta, h->mb.i_mb_count * sizeof(float) );
+    for( int i = 0; i < h->mb.i_mb_count; i++ )
+        frame->f_qp_offset[i] += frame->f_qp_offset_aq[i];
+}
+
 int x264_reference_build_list_optimal( x264_t *h )
 {
     ratecontrol_entry_t *rce = h->rc->rce;
@@ -735,9 +1117,198 @@ void x264_ratecontrol_init_reconfigurable( x264_t *h, int b_init )
     }
 }
 
+/* check whether 1st pass options were compatible with current options */
+static int parse_stats_options( x264_t *h, char *opts, float *res_factor, float *res_factor_bits )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    int i, j;
+    uint32_t k, l;
+    char *p;
+    if( sscanf( opts, " %dx%d", &i, &j ) != 2 )
+    {
+        x264_log( h, X264_LOG_ERROR, "resolution specified in stats file not valid\n" );
+        return -1;
+    }
+    else if( h->param.rc.b_mb_tree )
+    {
+        rc->mbtree.srcdim[0] = i;
+        rc->mbtree.srcdim[1] = j;
+    }
+    *res_factor = (float)h->param.i_width * h->param.i_height / (i*j);
+    /* Change in bits relative to resolution isn't quite linear on typical sources,
+     * so we'll at least try to roughly approximate this effect. */
+    *res_factor_bits = powf( *res_factor, 0.7 );
+
+    if( ( p = strstr( opts, "timebase=" ) ) && sscanf( p, "timebase=%u/%u", &k, &l ) != 2 )
+    {
+        x264_log( h, X264_LOG_ERROR, "timebase specified in stats file not valid\n" );
+        return -1;
+    }
+    if( k != h->param.i_timebase_num || l != h->param.i_timebase_den )
+    {
+        x264_log( h, X264_LOG_ERROR, "timebase mismatch with 1st pass (%u/%u vs %u/%u)\n",
+                  h->param.i_timebase_num, h->param.i_timebase_den, k, l );
+        return -1;
+    }
+
+    CMP_OPT_FIRST_PASS( "bitdepth", BIT_DEPTH );
+    CMP_OPT_FIRST_PASS( "weightp", X264_MAX( 0, h->param.analyse.i_weighted_pred ) );
+    CMP_OPT_FIRST_PASS( "bframes", h->param.i_bframe );
+    CMP_OPT_FIRST_PASS( "b_pyramid", h->param.i_bframe_pyramid );
+    CMP_OPT_FIRST_PASS( "intra_refresh", h->param.b_intra_refresh );
+    CMP_OPT_FIRST_PASS( "open_gop", h->param.b_open_gop );
+    CMP_OPT_FIRST_PASS( "bluray_compat", h->param.b_bluray_compat );
+
+    if( (p = strstr( opts, "interlaced=" )) )
+    {
+        char *current = h->param.b_interlaced ? h->param.b_tff ? "tff" : "bff" : h->param.b_fake_interlaced ? "fake" : "0";
+        char buf[5];
+        sscanf( p, "interlaced=%4s", buf );
+        if( strcmp( current, buf ) )
+        {
+            x264_log( h, X264_LOG_ERROR, "different interlaced setting than first pass (%s vs %s)\n", current, buf );
+            return -1;
+        }
+    }
+
+    if( (p = strstr( opts, "keyint=" )) )
+    {
+        p += 7;
+        char buf[13] = "infinite ";
+        if( h->param.i_keyint_max != X264_KEYINT_MAX_INFINITE )
+            sprintf( buf, "%d ", h->param.i_keyint_max );
+        if( strncmp( p, buf, strlen(buf) ) )
+        {
+            x264_log( h, X264_LOG_ERROR, "different keyint setting than first pass (%.*s vs %.*s)\n",
+                      strlen(buf)-1, buf, strcspn(p, " "), p );
+            return -1;
+        }
+    }
+
+    if( strstr( opts, "qp=0" ) && h->param.rc.i_rc_method == X264_RC_ABR )
+        x264_log( h, X264_LOG_WARNING, "1st pass was lossless, bitrate prediction will be inaccurate\n" );
+
+    if( !strstr( opts, "direct=3" ) && h->param.analyse.i_direct_mv_pred == X264_DIRECT_PRED_AUTO )
+    {
+        x264_log( h, X264_LOG_WARNING, "direct=auto not used on the first pass\n" );
+        h->mb.b_direct_auto_write = 1;
+    }
+
+    if( ( p = strstr( opts, "b_adapt=" ) ) && sscanf( p, "b_adapt=%d", &i ) && i >= X264_B_ADAPT_NONE && i <= X264_B_ADAPT_TRELLIS )
+        h->param.i_bframe_adaptive = i;
+    else if( h->param.i_bframe )
+    {
+        x264_log( h, X264_LOG_ERROR, "b_adapt method specified in stats file not valid\n" );
+        return -1;
+    }
+
+    if( (h->param.rc.b_mb_tree || h->param.rc.i_vbv_buffer_size) && ( p = strstr( opts, "rc_lookahead=" ) ) && sscanf( p, "rc_lookahead=%d", &i ) )
+        h->param.rc.i_lookahead = i;
+    return 0;
+}
+
+static int parse_stats_type( ratecontrol_entry_t *rce, char pict_type )
+{
+    if( pict_type != 'b' )
+        rce->kept_as_ref = 1;
+    switch( pict_type )
+    {
+        case 'I':
+            rce->frame_type = X264_TYPE_IDR;
+            rce->pict_type  = SLICE_TYPE_I;
+            break;
+        case 'i':
+            rce->frame_type = X264_TYPE_I;
+            rce->pict_type  = SLICE_TYPE_I;
+            break;
+        case 'P':
+            rce->frame_type = X264_TYPE_P;
+            rce->pict_type  = SLICE_TYPE_P;
+            break;
+        case 'B':
+            rce->frame_type = X264_TYPE_BREF;
+            rce->pict_type  = SLICE_TYPE_B;
+            break;
+        case 'b':
+            rce->frame_type = X264_TYPE_B;
+            rce->pict_type  = SLICE_TYPE_B;
+            break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+static int write_stats_header( FILE *fh, const char *opts )
+{
+    static const uint8_t pad[8] = {0};
+    stats_header_t header;
+    memcpy( header.magic, STATS_BINARY_MAGIC, 8 );
+    header.version = STATS_BINARY_VERSION;
+    header.options_size = strlen( opts );
+    header.header_size = (sizeof(stats_header_t) + header.options_size + 7) & ~7;
+    header.record_size = sizeof(stats_record_t);
+    int padding = header.header_size - sizeof(stats_header_t) - header.options_size;
+    if( fwrite( &header, sizeof(stats_header_t), 1, fh ) != 1 ||
+        fwrite( opts, 1, header.options_size, fh ) != header.options_size ||
+        fwrite( pad, 1, padding, fh ) != padding )
+        return -1;
+    return 0;
+}
+
+/* Split point j of a chunked 2nd pass: the first IDR at or after an even share of the frames. */
+static int chunk_boundary( x264_ratecontrol_t *rc, int j, int chunks, int frames )
+{
+    int frame = (int64_t)j * frames / chunks;
+    if( j == 0 )
+        return 0;
+    while( frame < frames && rc->entry[frame].frame_type != X264_TYPE_IDR )
+        frame++;
+    return frame;
+}
+
+/* Keep only the stats of the segment this instance encodes.  The bits were
+ * allocated over the whole file beforehand, so every segment is encoded with
+ * the plan a single 2nd pass would have followed. */
+static void select_chunk( x264_t *h )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    int frames = rc->num_entries;
+    if( h->param.i_frame_total > 0 && h->param.i_frame_total < frames )
+        frames = h->param.i_frame_total;
+    int start = chunk_boundary( rc, h->param.rc.i_chunk, h->param.rc.i_chunks, frames );
+    int end = chunk_boundary( rc, h->param.rc.i_chunk+1, h->param.rc.i_chunks, frames );
+    int count = end - start;
+
+    h->param.rc.i_chunk_start = start;
+    h->param.i_frame_total = count;
+    if( !count )
+    {
+        rc->num_entries = 0;
+        return;
+    }
+
+    /* Continue the idr_pic_id sequence of the previous segment. */
+    for( int i = 0; i < start; i++ )
+        if( rc->entry[i].frame_type == X264_TYPE_IDR )
+            h->i_idr_pic_id ^= 1;
+    /* Start from the VBV fill the plan expects at this point. */
+    if( rc->b_vbv && start )
+        rc->buffer_fill_final = x264_clip3f( rc->entry[start-1].expected_vbv, 0, rc->buffer_size ) * h->sps->vui.i_time_scale;
+
+    uint64_t expected_bits = rc->entry[start].expected_bits;
+    memmove( rc->entry, rc->entry + start, count * sizeof(ratecontrol_entry_t) );
+    for( int i = 0; i < count; i++ )
+        rc->entry[i].expected_bits -= expected_bits;
+    rc->num_entries = count;
+}
+
 int x264_ratecontrol_new( x264_t *h )
 {
     x264_ratecontrol_t *rc;
+    uint8_t *stats_map = NULL;
+    char *stats_buf = NULL;
+    int64_t stats_size = 0;
 
     x264_emms();
 
@@ -857,138 +1428,94 @@ int x264_ratecontrol_new( x264_t *h )
     /* Load stat file and init 2pass algo */
     if( h->param.rc.b_stat_read )
     {
-        char *p, *stats_in, *stats_buf;
+        char *p, *stats_in = NULL;
+        const stats_header_t *stats_header = NULL;
 
-        /* read 1st pass stats */
+        /* read 1st pass stats: binary stats are used in place, text stats are parsed from a copy */
         assert( h->param.rc.psz_stat_in );
-        stats_buf = stats_in = x264_slurp_file( h->param.rc.psz_stat_in );
-        if( !stats_buf )
+        stats_map = x264_map_file( h->param.rc.psz_stat_in, &stats_size );
+        if( stats_map && stats_size >= sizeof(stats_header_t) && !memcmp( stats_map, STATS_BINARY_MAGIC, 8 ) )
+            stats_header = (const stats_header_t*)stats_map;
+        else
         {
-            x264_log( h, X264_LOG_ERROR, "ratecontrol_init: can't open stats file\n" );
-            return -1;
+            if( stats_map )
+                x264_unmap_file( stats_map, stats_size );
+            stats_map = NULL;
+            stats_buf = stats_in = x264_slurp_file( h->param.rc.psz_stat_in );
+            if( !stats_buf )
+            {
+                x264_log( h, X264_LOG_ERROR, "ratecontrol_init: can't open stats file\n" );
+                goto fail;
+            }
         }
         if( h->param.rc.b_mb_tree )
         {
             char *mbtree_stats_in = x264_strcat_filename( h->param.rc.psz_stat_in, ".mbtree" );
             if( !mbtree_stats_in )
-                return -1;
+                goto fail;
             rc->p_mbtree_stat_file_in = fopen( mbtree_stats_in, "rb" );
             x264_free( mbtree_stats_in );
             if( !rc->p_mbtree_stat_file_in )
             {
                 x264_log( h, X264_LOG_ERROR, "ratecontrol_init: can't open mbtree stats file\n" );
-                return -1;
+                goto fail;
             }
         }
 
-        /* check whether 1st pass options were compatible with current options */
-        if( strncmp( stats_buf, "#options:", 9 ) )
-        {
-            x264_log( h, X264_LOG_ERROR, "options list in stats file not valid\n" );
-            return -1;
-        }
-
         float res_factor, res_factor_bits;
+        int num_entries;
+        if( stats_header )
         {
-            int i, j;
-            uint32_t k, l;
-            char *opts = stats_buf;
-            stats_in = strchr( stats_buf, '\n' );
-            if( !stats_in )
-                return -1;
-            *stats_in = '\0';
-            stats_in++;
-            if( sscanf( opts, "#options: %dx%d", &i, &j ) != 2 )
-            {
-                x264_log( h, X264_LOG_ERROR, "resolution specified in stats file not valid\n" );
-                return -1;
-            }
-            else if( h->param.rc.b_mb_tree )
-            {
-                rc->mbtree.srcdim[0] = i;
-                rc->mbtree.srcdim[1] = j;
-            }
-            res_factor = (float)h->param.i_width * h->param.i_height / (i*j);
-            /* Change in bits relative to resolution isn't quite linear on typical sources,
-             * so we'll at least try to roughly approximate this effect. */
-            res_factor_bits = powf( res_factor, 0.7 );
-
-            if( ( p = strstr( opts, "timebase=" ) ) && sscanf( p, "timebase=%u/%u", &k, &l ) != 2 )
-            {
-                x264_log( h, X264_LOG_ERROR, "timebase specified in stats file not valid\n" );
-                return -1;
-            }
-            if( k != h->param.i_timebase_num || l != h->param.i_timebase_den )
+            if( stats_header->version != STATS_BINARY_VERSION )
             {
-                x264_log( h, X264_LOG_ERROR, "timebase mismatch with 1st pass (%u/%u vs %u/%u)\n",
-                          h->param.i_timebase_num, h->param.i_timebase_den, k, l );
-                return -1;
-            }
-
-            CMP_OPT_FIRST_PASS( "bitdepth", BIT_DEPTH );
-            CMP_OPT_FIRST_PASS( "weightp", X264_MAX( 0, h->param.analyse.i_weighted_pred ) );
-            CMP_OPT_FIRST_PASS( "bframes", h->param.i_bframe );
-            CMP_OPT_FIRST_PASS( "b_pyramid", h->param.i_bframe_pyramid );
-            CMP_OPT_FIRST_PASS( "intra_refresh", h->param.b_intra_refresh );
-            CMP_OPT_FIRST_PASS( "open_gop", h->param.b_open_gop );
-            CMP_OPT_FIRST_PASS( "bluray_compat", h->param.b_bluray_compat );
-
-            if( (p = strstr( opts, "interlaced=" )) )
-            {
-                char *current = h->param.b_interlaced ? h->param.b_tff ? "tff" : "bff" : h->param.b_fake_interlaced ? "fake" : "0";
-                char buf[5];
-                sscanf( p, "interlaced=%4s", buf );
-                if( strcmp( current, buf ) )
-                {
-                    x264_log( h, X264_LOG_ERROR, "different interlaced setting than first pass (%s vs %s)\n", current, buf );
-                    return -1;
-                }
+                x264_log( h, X264_LOG_ERROR, "binary stats file version %u not supported\n", stats_header->version );
+                goto fail;
             }
-
-            if( (p = strstr( opts, "keyint=" )) )
+            if( stats_header->record_size != sizeof(stats_record_t) )
             {
-                p += 7;
-                char buf[13] = "infinite ";
-                if( h->param.i_keyint_max != X264_KEYINT_MAX_INFINITE )
-                    sprintf( buf, "%d ", h->param.i_keyint_max );
-                if( strncmp( p, buf, strlen(buf) ) )
-                {
-                    x264_log( h, X264_LOG_ERROR, "different keyint setting than first pass (%.*s vs %.*s)\n",
-                              strlen(buf)-1, buf, strcspn(p, " "), p );
-                    return -1;
-                }
+                x264_log( h, X264_LOG_ERROR, "binary stats record size %u does not match %u\n",
+                          stats_header->record_size, (unsigned)sizeof(stats_record_t) );
+                goto fail;
             }
-
-            if( strstr( opts, "qp=0" ) && h->param.rc.i_rc_method == X264_RC_ABR )
-                x264_log( h, X264_LOG_WARNING, "1st pass was lossless, bitrate prediction will be inaccurate\n" );
-
-            if( !strstr( opts, "direct=3" ) && h->param.analyse.i_direct_mv_pred == X264_DIRECT_PRED_AUTO )
+            if( (stats_header->header_size & 7) || stats_header->header_size > stats_size ||
+                sizeof(stats_header_t) + stats_header->options_size > stats_header->header_size )
             {
-                x264_log( h, X264_LOG_WARNING, "direct=auto not used on the first pass\n" );
-                h->mb.b_direct_auto_write = 1;
+                x264_log( h, X264_LOG_ERROR, "binary stats file header is damaged\n" );
+                goto fail;
             }
-
-            if( ( p = strstr( opts, "b_adapt=" ) ) && sscanf( p, "b_adapt=%d", &i ) && i >= X264_B_ADAPT_NONE && i <= X264_B_ADAPT_TRELLIS )
-                h->param.i_bframe_adaptive = i;
-            else if( h->param.i_bframe )
+            char *opts;
+            CHECKED_MALLOC( opts, stats_header->options_size + 1 );
+            memcpy( opts, stats_header + 1, stats_header->options_size );
+            opts[stats_header->options_size] = '\0';
+            int ret = parse_stats_options( h, opts, &res_factor, &res_factor_bits );
+            x264_free( opts );
+            if( ret < 0 )
+                goto fail;
+            num_entries = (stats_size - stats_header->header_size) / sizeof(stats_record_t);
+        }
+        else
+        {
+            if( strncmp( stats_buf, "#options:", 9 ) )
             {
-                x264_log( h, X264_LOG_ERROR, "b_adapt method specified in stats file not valid\n" );
-                return -1;
+                x264_log( h, X264_LOG_ERROR, "options list in stats file not valid\n" );
+                goto fail;
             }
+            stats_in = strchr( stats_buf, '\n' );
+            if( !stats_in )
+                goto fail;
+            *stats_in++ = '\0';
+            if( parse_stats_options( h, stats_buf + 9, &res_factor, &res_factor_bits ) < 0 )
+                goto fail;
 
-            if( (h->param.rc.b_mb_tree || h->param.rc.i_vbv_buffer_size) && ( p = strstr( opts, "rc_lookahead=" ) ) && sscanf( p, "rc_lookahead=%d", &i ) )
-                h->param.rc.i_lookahead = i;
+            /* find number of pics */
+            p = stats_in;
+            for( num_entries = -1; p; num_entries++ )
+                p = strchr( p + 1, ';' );
         }
-
-        /* find number of pics */
-        p = stats_in;
-        int num_entries;
-        for( num_entries = -1; p; num_entries++ )
-            p = strchr( p + 1, ';' );
         if( !num_entries )
         {
             x264_log( h, X264_LOG_ERROR, "empty stats file\n" );
-            return -1;
+            goto fail;
         }
         rc->num_entries = num_entries;
 
@@ -1001,7 +1528,7 @@ int x264_ratecontrol_new( x264_t *h )
         {
             x264_log( h, X264_LOG_ERROR, "2nd pass has more frames than 1st pass (%d vs %d)\n",
                       h->param.i_frame_total, rc->num_entries );
-            return -1;
+            goto fail;
         }
 
         CHECKED_MALLOCZERO( rc->entry, rc->num_entries * sizeof(ratecontrol_entry_t) );
@@ -1017,116 +1544,140 @@ int x264_ratecontrol_new( x264_t *h )
         }
 
         /* read stats */
-        p = stats_in;
         double total_qp_aq = 0;
-        for( int i = 0; i < rc->num_entries; i++ )
+        if( stats_header )
         {
-            ratecontrol_entry_t *rce;
-            int frame_number;
-            char pict_type;
-            int e;
-            char *next;
-            float qp_rc, qp_aq;
-            int ref;
-
-            next= strchr(p, ';');
-            if( next )
-                *next++ = 0; //sscanf is unbelievably slow on long strings
-            e = sscanf( p, " in:%d ", &frame_number );
-
-            if( frame_number < 0 || frame_number >= rc->num_entries )
+            const stats_record_t *rec = (const stats_record_t*)(stats_map + stats_header->header_size);
+            for( int i = 0; i < rc->num_entries; i++, rec++ )
             {
-                x264_log( h, X264_LOG_ERROR, "bad frame number (%d) at stats line %d\n", frame_number, i );
-                return -1;
+                if( rec->frame_in < 0 || rec->frame_in >= rc->num_entries )
+                {
+                    x264_log( h, X264_LOG_ERROR, "bad frame number (%d) at stats record %d\n", rec->frame_in, i );
+                    goto fail;
+                }
+                ratecontrol_entry_t *rce = &rc->entry[rec->frame_in];
+                if( rec->refs > 16 || parse_stats_type( rce, rec->type ) < 0 )
+                {
+                    x264_log( h, X264_LOG_ERROR, "statistics are damaged at record %d\n", i );
+                    goto fail;
+                }
+                rce->i_duration     = rec->i_duration;
+                rce->i_cpb_duration = rec->i_cpb_duration;
+                rce->tex_bits       = rec->tex_bits  * res_factor_bits;
+                rce->mv_bits        = rec->mv_bits   * res_factor_bits;
+                rce->misc_bits      = rec->misc_bits * res_factor_bits;
+                rce->i_count        = rec->i_count * res_factor;
+                rce->p_count        = rec->p_count * res_factor;
+                rce->s_count        = rec->s_count * res_factor;
+                rce->direct_mode    = rec->direct;
+                rce->refs           = rec->refs;
+                for( int ref = 0; ref < rec->refs; ref++ )
+                    rce->refcount[ref] = rec->refcount[ref];
+                memcpy( rce->i_weight_denom, rec->i_weight_denom, sizeof(rce->i_weight_denom) );
+                memcpy( rce->weight, rec->weight, sizeof(rce->weight) );
+                rce->qscale = qp2qscale( rec->qp_rc );
+                total_qp_aq += rec->qp_aq;
             }
-            rce = &rc->entry[frame_number];
-            rce->direct_mode = 0;
-
-            e += sscanf( p, " in:%*d out:%*d type:%c dur:%"SCNd64" cpbdur:%"SCNd64" q:%f aq:%f tex:%d mv:%d misc:%d imb:%d pmb:%d smb:%d d:%c",
-                   &pict_type, &rce->i_duration, &rce->i_cpb_duration, &qp_rc, &qp_aq, &rce->tex_bits,
-                   &rce->mv_bits, &rce->misc_bits, &rce->i_count, &rce->p_count,
-                   &rce->s_count, &rce->direct_mode );
-            rce->tex_bits  *= res_factor_bits;
-            rce->mv_bits   *= res_factor_bits;
-            rce->misc_bits *= res_factor_bits;
-            rce->i_count   *= res_factor;
-            rce->p_count   *= res_factor;
-            rce->s_count   *= res_factor;
-
-            p = strstr( p, "ref:" );
-            if( !p )
-                goto parse_error;
-            p += 4;
-            for( ref = 0; ref < 16; ref++ )
+        }
+        else
+        {
+            p = stats_in;
+            for( int i = 0; i < rc->num_entries; i++ )
             {
-                if( sscanf( p, " %d", &rce->refcount[ref] ) != 1 )
-                    break;
-                p = strchr( p+1, ' ' );
+                ratecontrol_entry_t *rce;
+                int frame_number;
+                char pict_type;
+                int e;
+                char *next;
+                float qp_rc, qp_aq;
+                int ref;
+
+                next= strchr(p, ';');
+                if( next )
+                    *next++ = 0; //sscanf is unbelievably slow on long strings
+                e = sscanf( p, " in:%d ", &frame_number );
+
+                if( frame_number < 0 || frame_number >= rc->num_entries )
+                {
+                    x264_log( h, X264_LOG_ERROR, "bad frame number (%d) at stats line %d\n", frame_number, i );
+                    goto fail;
+                }
+                rce = &rc->entry[frame_number];
+                rce->direct_mode = 0;
+
+                e += sscanf( p, " in:%*d out:%*d type:%c dur:%"SCNd64" cpbdur:%"SCNd64" q:%f aq:%f tex:%d mv:%d misc:%d imb:%d pmb:%d smb:%d d:%c",
+                       &pict_type, &rce->i_duration, &rce->i_cpb_duration, &qp_rc, &qp_aq, &rce->tex_bits,
+                       &rce->mv_bits, &rce->misc_bits, &rce->i_count, &rce->p_count,
+                       &rce->s_count, &rce->direct_mode );
+                rce->tex_bits  *= res_factor_bits;
+                rce->mv_bits   *= res_factor_bits;
+                rce->misc_bits *= res_factor_bits;
+                rce->i_count   *= res_factor;
+                rce->p_count   *= res_factor;
+                rce->s_count   *= res_factor;
+
+                p = strstr( p, "ref:" );
                 if( !p )
                     goto parse_error;
-            }
-            rce->refs = ref;
+                p += 4;
+                for( ref = 0; ref < 16; ref++ )
+                {
+                    if( sscanf( p, " %d", &rce->refcount[ref] ) != 1 )
+                        break;
+                    p = strchr( p+1, ' ' );
+                    if( !p )
+                        goto parse_error;
+                }
+                rce->refs = ref;
 
-            /* find weights */
-            rce->i_weight_denom[0] = rce->i_weight_denom[1] = -1;
-            char *w = strchr( p, 'w' );
-            if( w )
-            {
-                int count = sscanf( w, "w:%hd,%hd,%hd,%hd,%hd,%hd,%hd,%hd",
-                                    &rce->i_weight_denom[0], &rce->weight[0][0], &rce->weight[0][1],
-                                    &rce->i_weight_denom[1], &rce->weight[1][0], &rce->weight[1][1],
-                                    &rce->weight[2][0], &rce->weight[2][1] );
-                if( count == 3 )
-                    rce->i_weight_denom[1] = -1;
-                else if ( count != 8 )
-                    rce->i_weight_denom[0] = rce->i_weight_denom[1] = -1;
-            }
+                /* find weights */
+                rce->i_weight_denom[0] = rce->i_weight_denom[1] = -1;
+                char *w = strchr( p, 'w' );
+                if( w )
+                {
+                    int count = sscanf( w, "w:%hd,%hd,%hd,%hd,%hd,%hd,%hd,%hd",
+                                        &rce->i_weight_denom[0], &rce->weight[0][0], &rce->weight[0][1],
+                                        &rce->i_weight_denom[1], &rce->weight[1][0], &rce->weight[1][1],
+                                        &rce->weight[2][0], &rce->weight[2][1] );
+                    if( count == 3 )
+                        rce->i_weight_denom[1] = -1;
+                    else if ( count != 8 )
+                        rce->i_weight_denom[0] = rce->i_weight_denom[1] = -1;
+                }
 
-            if( pict_type != 'b' )
-                rce->kept_as_ref = 1;
-            switch( pict_type )
-            {
-                case 'I':
-                    rce->frame_type = X264_TYPE_IDR;
-                    rce->pict_type  = SLICE_TYPE_I;
-                    break;
-                case 'i':
-                    rce->frame_type = X264_TYPE_I;
-                    rce->pict_type  = SLICE_TYPE_I;
-                    break;
-                case 'P':
-                    rce->frame_type = X264_TYPE_P;
-                    rce->pict_type  = SLICE_TYPE_P;
-                    break;
-                case 'B':
-                    rce->frame_type = X264_TYPE_BREF;
-                    rce->pict_type  = SLICE_TYPE_B;
-                    break;
-                case 'b':
-                    rce->frame_type = X264_TYPE_B;
-                    rce->pict_type  = SLICE_TYPE_B;
-                    break;
-                default:  e = -1; break;
-            }
-            if( e < 13 )
-            {
+                if( parse_stats_type( rce, pict_type ) < 0 )
+                    e = -1;
+                if( e < 13 )
+                {
 parse_error:
-                x264_log( h, X264_LOG_ERROR, "statistics are damaged at line %d, parser out=%d\n", i, e );
-                return -1;
+                    x264_log( h, X264_LOG_ERROR, "statistics are damaged at line %d, parser out=%d\n", i, e );
+                    goto fail;
+                }
+                rce->qscale = qp2qscale( qp_rc );
+                total_qp_aq += qp_aq;
+                p = next;
             }
-            rce->qscale = qp2qscale( qp_rc );
-            total_qp_aq += qp_aq;
-            p = next;
         }
         h->pps->i_pic_init_qp = SPEC_QP( (int)(total_qp_aq / rc->num_entries + 0.5) );
 
+        if( stats_map )
+            x264_unmap_file( stats_map, stats_size );
         x264_free( stats_buf );
+        stats_map = NULL;
+        stats_buf = NULL;
 
         if( h->param.rc.i_rc_method == X264_RC_ABR )
         {
             if( init_pass2( h ) < 0 )
                 return -1;
         } /* else we're using constant quant, so no need to run the bitrate allocation */
+
+        if( h->param.rc.i_chunks > 1 )
+        {
+            select_chunk( h );
+            x264_log( h, X264_LOG_DEBUG, "chunk %d/%d: frames %d-%d\n", h->param.rc.i_chunk+1, h->param.rc.i_chunks,
+                      h->param.rc.i_chunk_start, h->param.rc.i_chunk_start + h->param.i_frame_total - 1 );
+        }
     }
 
     /* Open output file */
@@ -1147,7 +1698,16 @@ parse_error:
         }
 
         p = x264_param2string( &h->param, 1 );
-        if( p )
+        if( p && h->param.rc.b_stat_binary )
+        {
+            if( write_stats_header( rc->p_stat_file_out, p ) < 0 )
+            {
+                x264_log( h, X264_LOG_ERROR, "ratecontrol_init: can't write stats file\n" );
+                x264_free( p );
+                return -1;
+            }
+        }
+        else if( p )
             fprintf( rc->p_stat_file_out, "#options: %s\n", p );
         x264_free( p );
         if( h->param.rc.b_mb_tree && !h->param.rc.b_stat_read )
@@ -1175,6 +1735,14 @@ parse_error:
         }
         if( x264_macroblock_tree_rescale_init( h, rc ) < 0 )
             return -1;
+        if( x264_macroblock_tree_index_init( h, rc ) < 0 )
+            return -1;
+    }
+    else if( h->param.rc.b_mb_tree && h->param.lookahead_share && !h->param.b_lookahead_source )
+    {
+        x264_lookahead_share_source_size( h, rc->mbtree.srcdim );
+        if( x264_macroblock_tree_rescale_init( h, rc ) < 0 )
+            return -1;
     }
 
     for( int i = 0; i<h->param.i_threads; i++ )
@@ -1191,6 +1759,9 @@ parse_error:
 
     return 0;
 fail:
+    if( stats_map )
+        x264_unmap_file( stats_map, stats_size );
+    x264_free( stats_buf );
     return -1;
 }
 
@@ -1347,6 +1918,11 @@ void x264_ratecontrol_delete( x264_t *h )
     if( rc->p_mbtree_stat_file_out )
     {
         b_regular_file = x264_is_regular_file( rc->p_mbtree_stat_file_out );
+        if( rc->mbtree.b_indexed && x264_macroblock_tree_index_write( rc ) < 0 )
+        {
+            x264_log( h, X264_LOG_ERROR, "failed to write MB-tree stats index\n" );
+            b_regular_file = 0;
+        }
         fclose( rc->p_mbtree_stat_file_out );
         if( h->i_frame >= rc->num_entries && b_regular_file )
             if( rename( rc->psz_mbtree_stat_file_tmpname, rc->psz_mbtree_stat_file_name ) != 0 )
@@ -1363,6 +1939,8 @@ void x264_ratecontrol_delete( x264_t *h )
     x264_free( rc->pred_b_from_p );
     x264_free( rc->entry );
     x264_macroblock_tree_rescale_destroy( rc );
+    x264_free( rc->mbtree.index );
+    x264_free( rc->mbtree.bits_buffer );
     if( rc->zones )
     {
         x264_free( rc->zones[0].param );
@@ -1775,6 +2353,55 @@ void x264_ratecontrol_set_weights( x264_t *h, x264_frame_t *frm )
 }
 
 /* After encoding one frame, save stats and update ratecontrol state */
+static int write_stats_record( x264_t *h, char c_type, char c_direct )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    stats_record_t rec;
+    memset( &rec, 0, sizeof(stats_record_t) );
+    rec.i_duration     = h->fenc->i_duration;
+    rec.i_cpb_duration = h->fenc->i_cpb_duration;
+    rec.frame_in       = h->fenc->i_frame;
+    rec.frame_out      = h->i_frame;
+    rec.qp_rc          = rc->qpa_rc;
+    rec.qp_aq          = h->fdec->f_qp_avg_aq;
+    rec.tex_bits       = h->stat.frame.i_tex_bits;
+    rec.mv_bits        = h->stat.frame.i_mv_bits;
+    rec.misc_bits      = h->stat.frame.i_misc_bits;
+    rec.i_count        = h->stat.frame.i_mb_count_i;
+    rec.p_count        = h->stat.frame.i_mb_count_p;
+    rec.s_count        = h->stat.frame.i_mb_count_skip;
+    rec.type           = c_type;
+    rec.direct         = c_direct;
+
+    /* Only write information for reference reordering once. */
+    int use_old_stats = h->param.rc.b_stat_read && rc->rce->refs > 1;
+    rec.refs = use_old_stats ? rc->rce->refs : h->i_ref[0];
+    for( int i = 0; i < rec.refs; i++ )
+        rec.refcount[i] = use_old_stats         ? rc->rce->refcount[i]
+                        : PARAM_INTERLACED      ? h->stat.frame.i_mb_count_ref[0][i*2]
+                                                + h->stat.frame.i_mb_count_ref[0][i*2+1]
+                        :                         h->stat.frame.i_mb_count_ref[0][i];
+
+    rec.i_weight_denom[0] = rec.i_weight_denom[1] = -1;
+    if( h->param.analyse.i_weighted_pred >= X264_WEIGHTP_SIMPLE && h->sh.weight[0][0].weightfn )
+    {
+        rec.i_weight_denom[0] = h->sh.weight[0][0].i_denom;
+        rec.weight[0][0] = h->sh.weight[0][0].i_scale;
+        rec.weight[0][1] = h->sh.weight[0][0].i_offset;
+        if( h->sh.weight[0][1].weightfn || h->sh.weight[0][2].weightfn )
+        {
+            rec.i_weight_denom[1] = h->sh.weight[0][1].i_denom;
+            for( int i = 1; i < 3; i++ )
+            {
+                rec.weight[i][0] = h->sh.weight[0][i].i_scale;
+                rec.weight[i][1] = h->sh.weight[0][i].i_offset;
+            }
+        }
+    }
+
+    return fwrite( &rec, sizeof(stats_record_t), 1, rc->p_stat_file_out ) == 1 ? 0 : -1;
+}
+
 int x264_ratecontrol_end( x264_t *h, int bits, int *filler )
 {
     x264_ratecontrol_t *rc = h->rc;
@@ -1803,54 +2430,67 @@ int x264_ratecontrol_end( x264_t *h, int bits, int *filler )
                         ( dir_frame>0 ? 's' : dir_frame<0 ? 't' :
                           dir_avg>0 ? 's' : dir_avg<0 ? 't' : '-' )
                         : '-';
-        if( fprintf( rc->p_stat_file_out,
-                 "in:%d out:%d type:%c dur:%"PRId64" cpbdur:%"PRId64" q:%.2f aq:%.2f tex:%d mv:%d misc:%d imb:%d pmb:%d smb:%d d:%c ref:",
-                 h->fenc->i_frame, h->i_frame,
-                 c_type, h->fenc->i_duration,
-                 h->fenc->i_cpb_duration,
-                 rc->qpa_rc, h->fdec->f_qp_avg_aq,
-                 h->stat.frame.i_tex_bits,
-                 h->stat.frame.i_mv_bits,
-                 h->stat.frame.i_misc_bits,
-                 h->stat.frame.i_mb_count_i,
-                 h->stat.frame.i_mb_count_p,
-                 h->stat.frame.i_mb_count_skip,
-                 c_direct) < 0 )
-            goto fail;
-
-        /* Only write information for reference reordering once. */
-        int use_old_stats = h->param.rc.b_stat_read && rc->rce->refs > 1;
-        for( int i = 0; i < (use_old_stats ? rc->rce->refs : h->i_ref[0]); i++ )
+        if( h->param.rc.b_stat_binary )
         {
-            int refcount = use_old_stats         ? rc->rce->refcount[i]
-                         : PARAM_INTERLACED      ? h->stat.frame.i_mb_count_ref[0][i*2]
-                                                 + h->stat.frame.i_mb_count_ref[0][i*2+1]
-                         :                         h->stat.frame.i_mb_count_ref[0][i];
-            if( fprintf( rc->p_stat_file_out, "%d ", refcount ) < 0 )
+            if( write_stats_record( h, c_type, c_direct ) < 0 )
                 goto fail;
         }
-
-        if( h->param.analyse.i_weighted_pred >= X264_WEIGHTP_SIMPLE && h->sh.weight[0][0].weightfn )
+        else
         {
-            if( fprintf( rc->p_stat_file_out, "w:%d,%d,%d",
-                         h->sh.weight[0][0].i_denom, h->sh.weight[0][0].i_scale, h->sh.weight[0][0].i_offset ) < 0 )
+            if( fprintf( rc->p_stat_file_out,
+                     "in:%d out:%d type:%c dur:%"PRId64" cpbdur:%"PRId64" q:%.2f aq:%.2f tex:%d mv:%d misc:%d imb:%d pmb:%d smb:%d d:%c ref:",
+                     h->fenc->i_frame, h->i_frame,
+                     c_type, h->fenc->i_duration,
+                     h->fenc->i_cpb_duration,
+                     rc->qpa_rc, h->fdec->f_qp_avg_aq,
+                     h->stat.frame.i_tex_bits,
+                     h->stat.frame.i_mv_bits,
+                     h->stat.frame.i_misc_bits,
+                     h->stat.frame.i_mb_count_i,
+                     h->stat.frame.i_mb_count_p,
+                     h->stat.frame.i_mb_count_skip,
+                     c_direct) < 0 )
                 goto fail;
-            if( h->sh.weight[0][1].weightfn || h->sh.weight[0][2].weightfn )
+
+            /* Only write information for reference reordering once. */
+            int use_old_stats = h->param.rc.b_stat_read && rc->rce->refs > 1;
+            for( int i = 0; i < (use_old_stats ? rc->rce->refs : h->i_ref[0]); i++ )
             {
-                if( fprintf( rc->p_stat_file_out, ",%d,%d,%d,%d,%d ",
-                             h->sh.weight[0][1].i_denom, h->sh.weight[0][1].i_scale, h->sh.weight[0][1].i_offset,
-                             h->sh.weight[0][2].i_scale, h->sh.weight[0][2].i_offset ) < 0 )
+                int refcount = use_old_stats         ? rc->rce->refcount[i]
+                             : PARAM_INTERLACED      ? h->stat.frame.i_mb_count_ref[0][i*2]
+                                                     + h->stat.frame.i_mb_count_ref[0][i*2+1]
+                             :                         h->stat.frame.i_mb_count_ref[0][i];
+                if( fprintf( rc->p_stat_file_out, "%d ", refcount ) < 0 )
                     goto fail;
             }
-            else if( fprintf( rc->p_stat_file_out, " " ) < 0 )
+
+            if( h->param.analyse.i_weighted_pred >= X264_WEIGHTP_SIMPLE && h->sh.weight[0][0].weightfn )
+            {
+                if( fprintf( rc->p_stat_file_out, "w:%d,%d,%d",
+                             h->sh.weight[0][0].i_denom, h->sh.weight[0][0].i_scale, h->sh.weight[0][0].i_offset ) < 0 )
+                    goto fail;
+                if( h->sh.weight[0][1].weightfn || h->sh.weight[0][2].weightfn )
+                {
+                    if( fprintf( rc->p_stat_file_out, ",%d,%d,%d,%d,%d ",
+                                 h->sh.weight[0][1].i_denom, h->sh.weight[0][1].i_scale, h->sh.weight[0][1].i_offset,
+                                 h->sh.weight[0][2].i_scale, h->sh.weight[0][2].i_offset ) < 0 )
+                        goto fail;
+                }
+                else if( fprintf( rc->p_stat_file_out, " " ) < 0 )
+                    goto fail;
+            }
+
+            if( fprintf( rc->p_stat_file_out, ";\n") < 0 )
                 goto fail;
         }
 
-        if( fprintf( rc->p_stat_file_out, ";\n") < 0 )
-            goto fail;
-
         /* Don't re-write the data in multi-pass mode. */
-        if( h->param.rc.b_mb_tree && h->fenc->b_kept_as_ref && !h->param.rc.b_stat_read )
+        if( h->param.rc.b_mb_tree && h->fenc->b_kept_as_ref && !h->param.rc.b_stat_read && rc->mbtree.b_indexed )
+        {
+            if( x264_macroblock_tree_write_indexed( h, h->sh.i_type ) < 0 )
+                goto fail;
+        }
+        else if( h->param.rc.b_mb_tree && h->fenc->b_kept_as_ref && !h->param.rc.b_stat_read )
         {
             uint8_t i_type = h->sh.i_type;
             /* Values are stored as big-endian FIX8.8 */
@@ -2425,12 +3065,13 @@ static float rate_estimate_qscale( x264_t *h )
             diff = predicted_bits - (int64_t)rce.expected_bits;
             q = rce.new_qscale;
             q /= x264_clip3f((double)(abr_buffer - diff) / abr_buffer, .5, 2);
-            if( ((h->i_frame + 1 - h->i_thread_frames) >= rcc->fps) &&
+            /* in a chunked 2nd pass, count the frames of the preceding chunks */
+            if( ((h->i_frame + h->param.rc.i_chunk_start + 1 - h->i_thread_frames) >= rcc->fps) &&
                 (rcc->expected_bits_sum > 0))
             {
                 /* Adjust quant based on the difference between
                  * achieved and expected bitrate so far */
-                double cur_time = (double)h->i_frame / rcc->num_entries;
+                double cur_time = (double)(h->i_frame + h->param.rc.i_chunk_start) / (rcc->num_entries + h->param.rc.i_chunk_start);
                 double w = x264_clip3f( cur_time*100, 0.0, 1.0 );
                 q *= pow( (double)total_bits / rcc->expected_bits_sum, w );
             }
@@ -45,7 +45,11 @@ void x264_ratecontrol_delete( x264_t * );
 void x264_ratecontrol_init_reconfigurable( x264_t *h, int b_init );
 
 void x264_adaptive_quant_frame( x264_t *h, x264_frame_t *frame, float *quant_offsets );
+void x264_adaptive_quant_frame_rows( x264_t *h, x264_frame_t *frame, float *quant_offsets, int mb_y_start, int mb_y_end,
+                                     uint32_t pixel_sum[3], uint64_t pixel_ssd[3] );
+void x264_adaptive_quant_frame_end( x264_t *h, x264_frame_t *frame, float *quant_offsets );
 int  x264_macroblock_tree_read( x264_t *h, x264_frame_t *frame, float *quant_offsets );
+void x264_macroblock_tree_share_apply( x264_t *h, x264_frame_t *frame, const float *qp_delta );
 int  x264_reference_build_list_optimal( x264_t *h );
 void x264_thread_sync_ratecontrol( x264_t *cur, x264_t *prev, x264_t *next );
 void x264_ratecontrol_start( x264_t *, int i_force_qp, int overhead );
@@ -404,19 +404,21 @@ void x264_rdo_init( void )
     }
 }
 
-typedef struct
-{
-    uint64_t score;
-    int level_idx; // index into level_tree[]
-    uint8_t cabac_state[4]; // just contexts 0,4,8,9 of the 10 relevant to coding abs_level_m1
-} trellis_node_t;
-
 typedef struct
 {
     uint16_t next;
     uint16_t abs_level;
 } trellis_level_t;
 
+/* All 8 nodes of one coef, as a struct-of-arrays indexed by node_ctx (same layout as trellis-64.asm),
+ * so that the loops across node_ctxs are plain array loops that the compiler can vectorize. */
+typedef struct
+{
+    uint64_t score[8];
+    int level_idx[8]; // index into level_tree[]
+    uint8_t cabac_state[8][4]; // just contexts 0,4,8,9 of the 10 relevant to coding abs_level_m1
+} trellis_nodes_t;
+
 // TODO:
 // save cabac state between blocks?
 // use trellis' RD score instead of x264_mb_decimate_score?
@@ -439,15 +441,30 @@ typedef struct
 
 #define SIGN(x,y) ((x^(y >> 31))-(y >> 31))
 
-#define SET_LEVEL(ndst, nsrc, l) {\
+#define SET_LEVEL( idx_dst, idx_src, l ) {\
     if( sizeof(trellis_level_t) == sizeof(uint32_t) )\
-        M32( &level_tree[levels_used] ) = pack16to32( nsrc.level_idx, l );\
+        M32( &level_tree[levels_used] ) = pack16to32( idx_src, l );\
     else\
-        level_tree[levels_used] = (trellis_level_t){ nsrc.level_idx, l };\
-    ndst.level_idx = levels_used;\
+        level_tree[levels_used] = (trellis_level_t){ idx_src, l };\
+    idx_dst = levels_used;\
     levels_used++;\
 }
 
+// give node_ctxs 1..ctx_end-1 a level of 0 at the current coef.
+// invalid nodes are updated too: that's harmless, and keeps the loop free of branches.
+static ALWAYS_INLINE
+int trellis_zero_levels( int ctx_end, int *idx_dst, int *idx_src,
+                         trellis_level_t *level_tree, int levels_used )
+{
+    for( int j = 1; j < ctx_end; j++ )
+    {
+        level_tree[levels_used+j-1].next = idx_src[j];
+        level_tree[levels_used+j-1].abs_level = 0;
+        idx_dst[j] = levels_used+j-1;
+    }
+    return levels_used + ctx_end-1;
+}
+
 // encode all values of the dc coef in a block which is known to have no ac
 static NOINLINE
 int trellis_dc_shortcut( int sign_coef, int quant_coef, int unquant_mf, int coef_weight, int lambda2, uint8_t *cabac_state, int cost_sig )
@@ -484,18 +501,18 @@ int trellis_dc_shortcut( int sign_coef, int quant_coef, int unquant_mf, int coef
 static ALWAYS_INLINE
 int trellis_coef( int j, int const_level, int abs_level, int prefix, int suffix_cost,
                   int node_ctx, int level1_ctx, int levelgt1_ctx, uint64_t ssd, int cost_siglast[3],
-                  trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+                  trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                   trellis_level_t *level_tree, int levels_used, int lambda2, uint8_t *level_state )
 {
-    uint64_t score = nodes_prev[j].score + ssd;
+    uint64_t score = nodes_prev->score[j] + ssd;
     /* code the proposed level, and count how much entropy it would take */
     unsigned f8_bits = cost_siglast[ j ? 1 : 2 ];
-    uint8_t level1_state = (j >= 3) ? nodes_prev[j].cabac_state[level1_ctx>>2] : level_state[level1_ctx];
+    uint8_t level1_state = (j >= 3) ? nodes_prev->cabac_state[j][level1_ctx>>2] : level_state[level1_ctx];
     f8_bits += x264_cabac_entropy[level1_state ^ (const_level > 1)];
     uint8_t levelgt1_state;
     if( const_level > 1 )
     {
-        levelgt1_state = j >= 6 ? nodes_prev[j].cabac_state[levelgt1_ctx-6] : level_state[levelgt1_ctx];
+        levelgt1_state = j >= 6 ? nodes_prev->cabac_state[j][levelgt1_ctx-6] : level_state[levelgt1_ctx];
         f8_bits += x264_cabac_size_unary[prefix][levelgt1_state] + suffix_cost;
     }
     else
@@ -503,19 +520,18 @@ int trellis_coef( int j, int const_level, int abs_level, int prefix, int suffix_
     score += (uint64_t)f8_bits * lambda2 >> ( CABAC_SIZE_BITS - LAMBDA_BITS );
 
     /* save the node if it's better than any existing node with the same cabac ctx */
-    if( score < nodes_cur[node_ctx].score )
+    if( score < nodes_cur->score[node_ctx] )
     {
-        nodes_cur[node_ctx].score = score;
+        nodes_cur->score[node_ctx] = score;
         if( j == 2 || (j <= 3 && node_ctx == 4) ) // init from input state
-            M32(nodes_cur[node_ctx].cabac_state) = M32(level_state+12);
+            M32(nodes_cur->cabac_state[node_ctx]) = M32(level_state+12);
         else if( j >= 3 )
-            M32(nodes_cur[node_ctx].cabac_state) = M32(nodes_prev[j].cabac_state);
+            M32(nodes_cur->cabac_state[node_ctx]) = M32(nodes_prev->cabac_state[j]);
         if( j >= 3 ) // skip the transition if we're not going to reuse the context
-            nodes_cur[node_ctx].cabac_state[level1_ctx>>2] = x264_cabac_transition[level1_state][const_level > 1];
+            nodes_cur->cabac_state[node_ctx][level1_ctx>>2] = x264_cabac_transition[level1_state][const_level > 1];
         if( const_level > 1 && node_ctx == 7 )
-            nodes_cur[node_ctx].cabac_state[levelgt1_ctx-6] = x264_cabac_transition_unary[prefix][levelgt1_state];
-        nodes_cur[node_ctx].level_idx = nodes_prev[j].level_idx;
-        SET_LEVEL( nodes_cur[node_ctx], nodes_prev[j], abs_level );
+            nodes_cur->cabac_state[node_ctx][levelgt1_ctx-6] = x264_cabac_transition_unary[prefix][levelgt1_state];
+        SET_LEVEL( nodes_cur->level_idx[node_ctx], nodes_prev->level_idx[j], abs_level );
     }
     return levels_used;
 }
@@ -524,40 +540,31 @@ int trellis_coef( int j, int const_level, int abs_level, int prefix, int suffix_
 // in ctx_lo, the set of live nodes is contiguous and starts at ctx0, so return as soon as we've seen one failure.
 // in ctx_hi, they're contiguous within each block of 4 ctxs, but not necessarily starting at the beginning,
 // so exploiting that would be more complicated.
+// coef0 doesn't need either: copying an invalid node just leaves it invalid.
 static NOINLINE
-int trellis_coef0_0( uint64_t ssd0, trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+int trellis_coef0_0( uint64_t ssd0, trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                      trellis_level_t *level_tree, int levels_used )
 {
-    nodes_cur[0].score = nodes_prev[0].score + ssd0;
-    nodes_cur[0].level_idx = nodes_prev[0].level_idx;
-    for( int j = 1; j < 4 && (int64_t)nodes_prev[j].score >= 0; j++ )
-    {
-        nodes_cur[j].score = nodes_prev[j].score;
-        if( j >= 3 )
-            M32(nodes_cur[j].cabac_state) = M32(nodes_prev[j].cabac_state);
-        SET_LEVEL( nodes_cur[j], nodes_prev[j], 0 );
-    }
-    return levels_used;
+    nodes_cur->score[0] = nodes_prev->score[0] + ssd0;
+    nodes_cur->level_idx[0] = nodes_prev->level_idx[0];
+    for( int j = 1; j < 4; j++ )
+        nodes_cur->score[j] = nodes_prev->score[j];
+    M32(nodes_cur->cabac_state[3]) = M32(nodes_prev->cabac_state[3]);
+    return trellis_zero_levels( 4, nodes_cur->level_idx, nodes_prev->level_idx, level_tree, levels_used );
 }
 
 static NOINLINE
-int trellis_coef0_1( uint64_t ssd0, trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+int trellis_coef0_1( uint64_t ssd0, trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                      trellis_level_t *level_tree, int levels_used )
 {
     for( int j = 1; j < 8; j++ )
-        // this branch only affects speed, not function; there's nothing wrong with updating invalid nodes in coef0.
-        if( (int64_t)nodes_prev[j].score >= 0 )
-        {
-            nodes_cur[j].score = nodes_prev[j].score;
-            if( j >= 3 )
-                M32(nodes_cur[j].cabac_state) = M32(nodes_prev[j].cabac_state);
-            SET_LEVEL( nodes_cur[j], nodes_prev[j], 0 );
-        }
-    return levels_used;
+        nodes_cur->score[j] = nodes_prev->score[j];
+    memcpy( nodes_cur->cabac_state[3], nodes_prev->cabac_state[3], 5*4 );
+    return trellis_zero_levels( 8, nodes_cur->level_idx, nodes_prev->level_idx, level_tree, levels_used );
 }
 
 #define COEF(const_level, ctx_hi, j, ...)\
-    if( !j || (int64_t)nodes_prev[j].score >= 0 )\
+    if( !j || (int64_t)nodes_prev->score[j] >= 0 )\
         levels_used = trellis_coef( j, const_level, abs_level, prefix, suffix_cost, __VA_ARGS__,\
                                     j?ssd1:ssd0, cost_siglast, nodes_cur, nodes_prev,\
                                     level_tree, levels_used, lambda2, level_state );\
@@ -566,7 +573,7 @@ int trellis_coef0_1( uint64_t ssd0, trellis_node_t *nodes_cur, trellis_node_t *n
 
 static NOINLINE
 int trellis_coef1_0( uint64_t ssd0, uint64_t ssd1, int cost_siglast[3],
-                     trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+                     trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                      trellis_level_t *level_tree, int levels_used, int lambda2,
                      uint8_t *level_state )
 {
@@ -580,7 +587,7 @@ int trellis_coef1_0( uint64_t ssd0, uint64_t ssd1, int cost_siglast[3],
 
 static NOINLINE
 int trellis_coef1_1( uint64_t ssd0, uint64_t ssd1, int cost_siglast[3],
-                     trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+                     trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                      trellis_level_t *level_tree, int levels_used, int lambda2,
                      uint8_t *level_state )
 {
@@ -597,7 +604,7 @@ int trellis_coef1_1( uint64_t ssd0, uint64_t ssd1, int cost_siglast[3],
 
 static NOINLINE
 int trellis_coefn_0( int abs_level, uint64_t ssd0, uint64_t ssd1, int cost_siglast[3],
-                     trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+                     trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                      trellis_level_t *level_tree, int levels_used, int lambda2,
                      uint8_t *level_state, int levelgt1_ctx )
 {
@@ -612,7 +619,7 @@ int trellis_coefn_0( int abs_level, uint64_t ssd0, uint64_t ssd1, int cost_sigla
 
 static NOINLINE
 int trellis_coefn_1( int abs_level, uint64_t ssd0, uint64_t ssd1, int cost_siglast[3],
-                     trellis_node_t *nodes_cur, trellis_node_t *nodes_prev,
+                     trellis_nodes_t *nodes_cur, trellis_nodes_t *nodes_prev,
                      trellis_level_t *level_tree, int levels_used, int lambda2,
                      uint8_t *level_state, int levelgt1_ctx )
 {
@@ -628,91 +635,17 @@ int trellis_coefn_1( int abs_level, uint64_t ssd0, uint64_t ssd1, int cost_sigla
     return levels_used;
 }
 
+/* The C version of quantf.trellis_cabac_*: it takes the same arguments as trellis-64.asm,
+ * so the two can be swapped freely and compared in checkasm. */
 static ALWAYS_INLINE
-int quant_trellis_cabac( x264_t *h, dctcoef *dct,
-                         udctcoef *quant_mf, udctcoef *quant_bias, const int *unquant_mf,
-                         const uint8_t *zigzag, int ctx_block_cat, int lambda2, int b_ac,
-                         int b_chroma, int dc, int num_coefs, int idx )
+int trellis_cabac( TRELLIS_PARAMS, int b_ac, int dc, int num_coefs, int b_interlaced,
+                   dctcoef *fenc_dct, int psy_trellis )
 {
-    ALIGNED_ARRAY_16( dctcoef, orig_coefs, [64] );
-    ALIGNED_ARRAY_16( dctcoef, quant_coefs, [64] );
+    dctcoef *orig_coefs = coefs;
     const uint32_t *coef_weight1 = num_coefs == 64 ? x264_dct8_weight_tab : x264_dct4_weight_tab;
     const uint32_t *coef_weight2 = num_coefs == 64 ? x264_dct8_weight2_tab : x264_dct4_weight2_tab;
-    const int b_interlaced = MB_INTERLACED;
-    uint8_t *cabac_state_sig = &h->cabac.state[ significant_coeff_flag_offset[b_interlaced][ctx_block_cat] ];
-    uint8_t *cabac_state_last = &h->cabac.state[ last_coeff_flag_offset[b_interlaced][ctx_block_cat] ];
-    int levelgt1_ctx = b_chroma && dc ? 8 : 9;
-
-    if( dc )
-    {
-        if( num_coefs == 16 )
-        {
-            memcpy( orig_coefs, dct, sizeof(dctcoef)*16 );
-            if( !h->quantf.quant_4x4_dc( dct, quant_mf[0] >> 1, quant_bias[0] << 1 ) )
-                return 0;
-            h->zigzagf.scan_4x4( quant_coefs, dct );
-        }
-        else
-        {
-            memcpy( orig_coefs, dct, sizeof(dctcoef)*num_coefs );
-            int nz = h->quantf.quant_2x2_dc( &dct[0], quant_mf[0] >> 1, quant_bias[0] << 1 );
-            if( num_coefs == 8 )
-                nz |= h->quantf.quant_2x2_dc( &dct[4], quant_mf[0] >> 1, quant_bias[0] << 1 );
-            if( !nz )
-                return 0;
-            for( int i = 0; i < num_coefs; i++ )
-                quant_coefs[i] = dct[zigzag[i]];
-        }
-    }
-    else
-    {
-        if( num_coefs == 64 )
-        {
-            h->mc.memcpy_aligned( orig_coefs, dct, sizeof(dctcoef)*64 );
-            if( !h->quantf.quant_8x8( dct, quant_mf, quant_bias ) )
-                return 0;
-            h->zigzagf.scan_8x8( quant_coefs, dct );
-        }
-        else //if( num_coefs == 16 )
-        {
-            memcpy( orig_coefs, dct, sizeof(dctcoef)*16 );
-            if( !h->quantf.quant_4x4( dct, quant_mf, quant_bias ) )
-                return 0;
-            h->zigzagf.scan_4x4( quant_coefs, dct );
-        }
-    }
-
-    int last_nnz = h->quantf.coeff_last[ctx_block_cat]( quant_coefs+b_ac )+b_ac;
-    uint8_t *cabac_state = &h->cabac.state[ coeff_abs_level_m1_offset[ctx_block_cat] ];
-
-    /* shortcut for dc-only blocks.
-     * this doesn't affect the output, but saves some unnecessary computation. */
-    if( last_nnz == 0 && !dc )
-    {
-        int cost_sig = x264_cabac_size_decision_noup2( &cabac_state_sig[0], 1 )
-                     + x264_cabac_size_decision_noup2( &cabac_state_last[0], 1 );
-        dct[0] = trellis_dc_shortcut( orig_coefs[0], quant_coefs[0], unquant_mf[0], coef_weight2[0], lambda2, cabac_state, cost_sig );
-        return !!dct[0];
-    }
-
-#if HAVE_MMX && ARCH_X86_64
-#define TRELLIS_ARGS unquant_mf, zigzag, lambda2, last_nnz, orig_coefs, quant_coefs, dct,\
-                     cabac_state_sig, cabac_state_last, M64(cabac_state), M16(cabac_state+8)
-    if( num_coefs == 16 && !dc )
-        if( b_chroma || !h->mb.i_psy_trellis )
-            return h->quantf.trellis_cabac_4x4( TRELLIS_ARGS, b_ac );
-        else
-            return h->quantf.trellis_cabac_4x4_psy( TRELLIS_ARGS, b_ac, h->mb.pic.fenc_dct4[idx&15], h->mb.i_psy_trellis );
-    else if( num_coefs == 64 && !dc )
-        if( b_chroma || !h->mb.i_psy_trellis )
-            return h->quantf.trellis_cabac_8x8( TRELLIS_ARGS, b_interlaced );
-        else
-            return h->quantf.trellis_cabac_8x8_psy( TRELLIS_ARGS, b_interlaced, h->mb.pic.fenc_dct8[idx&3], h->mb.i_psy_trellis);
-    else if( num_coefs == 8 && dc )
-        return h->quantf.trellis_cabac_chroma_422_dc( TRELLIS_ARGS );
-    else if( dc )
-        return h->quantf.trellis_cabac_dc( TRELLIS_ARGS, num_coefs-1 );
-#endif
+    /* only 4:2:2 chroma dc has 8 coefs */
+    int levelgt1_ctx = dc && num_coefs == 8 ? 8 : 9;
 
     // (# of coefs) * (# of ctx) * (# of levels tried) = 1024
     // we don't need to keep all of those: (# of coefs) * (# of ctx) would be enough,
@@ -720,24 +653,23 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
     trellis_level_t level_tree[64*8*2];
     int levels_used = 1;
     /* init trellis */
-    trellis_node_t nodes[2][8];
-    trellis_node_t *nodes_cur = nodes[0];
-    trellis_node_t *nodes_prev = nodes[1];
-    trellis_node_t *bnode;
+    trellis_nodes_t nodes[2];
+    trellis_nodes_t *nodes_cur = &nodes[0];
+    trellis_nodes_t *nodes_prev = &nodes[1];
+    int bnode;
     for( int j = 1; j < 4; j++ )
-        nodes_cur[j].score = TRELLIS_SCORE_MAX;
-    nodes_cur[0].score = TRELLIS_SCORE_BIAS;
-    nodes_cur[0].level_idx = 0;
+        nodes_cur->score[j] = TRELLIS_SCORE_MAX;
+    nodes_cur->score[0] = TRELLIS_SCORE_BIAS;
+    nodes_cur->level_idx[0] = 0;
     level_tree[0].abs_level = 0;
     level_tree[0].next = 0;
     ALIGNED_4( uint8_t level_state[16] );
-    memcpy( level_state, cabac_state, 10 );
-    level_state[12] = cabac_state[0]; // packed subset for copying into trellis_node_t
-    level_state[13] = cabac_state[4];
-    level_state[14] = cabac_state[8];
-    level_state[15] = cabac_state[9];
-
-    idx &= num_coefs == 64 ? 3 : 15;
+    memcpy( level_state, &level_state0, 8 );
+    memcpy( level_state+8, &level_state1, 2 );
+    level_state[12] = level_state[0]; // packed subset for copying into trellis_nodes_t
+    level_state[13] = level_state[4];
+    level_state[14] = level_state[8];
+    level_state[15] = level_state[9];
 
     // coefs are processed in reverse order, because that's how the abs value is coded.
     // last_coef and significant_coef flags are normally coded in forward order, but
@@ -759,13 +691,13 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
             if( !ctx_hi )\
             {\
                 int sigindex = !dc && num_coefs == 64 ? x264_significant_coeff_flag_offset_8x8[b_interlaced][i] :\
-                               b_chroma && dc && num_coefs == 8 ? x264_coeff_flag_offset_chroma_422_dc[i] : i;\
+                               dc && num_coefs == 8 ? x264_coeff_flag_offset_chroma_422_dc[i] : i;\
                 uint64_t cost_sig0 = x264_cabac_size_decision_noup2( &cabac_state_sig[sigindex], 0 )\
                                    * (uint64_t)lambda2 >> ( CABAC_SIZE_BITS - LAMBDA_BITS );\
-                nodes_cur[0].score -= cost_sig0;\
+                nodes_cur->score[0] -= cost_sig0;\
             }\
-            for( int j = 1; j < (ctx_hi?8:4); j++ )\
-                SET_LEVEL( nodes_cur[j], nodes_cur[j], 0 );\
+            levels_used = trellis_zero_levels( ctx_hi?8:4, nodes_cur->level_idx, nodes_cur->level_idx,\
+                                               level_tree, levels_used );\
             continue;\
         }\
 \
@@ -773,16 +705,16 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
         int abs_coef = abs( sign_coef );\
         int q = abs( quant_coefs[i] );\
         int cost_siglast[3]; /* { zero, nonzero, nonzero-and-last } */\
-        XCHG( trellis_node_t*, nodes_cur, nodes_prev );\
+        XCHG( trellis_nodes_t*, nodes_cur, nodes_prev );\
         for( int j = ctx_hi; j < 8; j++ )\
-            nodes_cur[j].score = TRELLIS_SCORE_MAX;\
+            nodes_cur->score[j] = TRELLIS_SCORE_MAX;\
 \
         if( i < num_coefs-1 || ctx_hi )\
         {\
             int sigindex  = !dc && num_coefs == 64 ? x264_significant_coeff_flag_offset_8x8[b_interlaced][i] :\
-                            b_chroma && dc && num_coefs == 8 ? x264_coeff_flag_offset_chroma_422_dc[i] : i;\
+                            dc && num_coefs == 8 ? x264_coeff_flag_offset_chroma_422_dc[i] : i;\
             int lastindex = !dc && num_coefs == 64 ? x264_last_coeff_flag_offset_8x8[i] :\
-                            b_chroma && dc && num_coefs == 8 ? x264_coeff_flag_offset_chroma_422_dc[i] : i;\
+                            dc && num_coefs == 8 ? x264_coeff_flag_offset_chroma_422_dc[i] : i;\
             cost_siglast[0] = x264_cabac_size_decision_noup2( &cabac_state_sig[sigindex], 0 );\
             int cost_sig1   = x264_cabac_size_decision_noup2( &cabac_state_sig[sigindex], 1 );\
             cost_siglast[1] = x264_cabac_size_decision_noup2( &cabac_state_last[lastindex], 0 ) + cost_sig1;\
@@ -805,12 +737,12 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
             int unquant_abs_level = (((dc?unquant_mf[0]<<1:unquant_mf[zigzag[i]]) * abs_level + 128) >> 8);\
             int d = abs_coef - unquant_abs_level;\
             /* Psy trellis: bias in favor of higher AC coefficients in the reconstructed frame. */\
-            if( h->mb.i_psy_trellis && i && !dc && !b_chroma )\
+            if( psy_trellis && i && !dc )\
             {\
-                int orig_coef = (num_coefs == 64) ? h->mb.pic.fenc_dct8[idx][zigzag[i]] : h->mb.pic.fenc_dct4[idx][zigzag[i]];\
+                int orig_coef = fenc_dct[zigzag[i]];\
                 int predicted_coef = orig_coef - sign_coef;\
                 int psy_value = abs(unquant_abs_level + SIGN(predicted_coef, sign_coef));\
-                int psy_weight = coef_weight1[zigzag[i]] * h->mb.i_psy_trellis;\
+                int psy_weight = coef_weight1[zigzag[i]] * psy_trellis;\
                 ssd1[k] = (uint64_t)d*d * coef_weight2[zigzag[i]] - psy_weight * psy_value;\
             }\
             else\
@@ -845,16 +777,16 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
         next##ctx_hi:;\
     }\
     /* output levels from the best path through the trellis */\
-    bnode = &nodes_cur[ctx_hi];\
+    bnode = ctx_hi;\
     for( int j = ctx_hi+1; j < (ctx_hi?8:4); j++ )\
-        if( nodes_cur[j].score < bnode->score )\
-            bnode = &nodes_cur[j];
+        if( nodes_cur->score[j] < nodes_cur->score[bnode] )\
+            bnode = j;
 
     // keep 2 versions of the main quantization loop, depending on which subsets of the node_ctxs are live
     // node_ctx 0..3, i.e. having not yet encountered any coefs that might be quantized to >1
     TRELLIS_LOOP(0);
 
-    if( bnode == &nodes_cur[0] )
+    if( bnode == 0 )
     {
         /* We only need to zero an empty 4x4 block. 8x8 can be
            implicitly emptied via zero nnz, as can dc. */
@@ -869,7 +801,7 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
         TRELLIS_LOOP(1);
     }
 
-    int level = bnode->level_idx;
+    int level = nodes_cur->level_idx[bnode];
     for( i = b_ac; i <= last_nnz; i++ )
     {
         dct[zigzag[i]] = SIGN(level_tree[level].abs_level, dct[zigzag[i]]);
@@ -879,6 +811,131 @@ int quant_trellis_cabac( x264_t *h, dctcoef *dct,
     return 1;
 }
 
+int x264_trellis_cabac_4x4( TRELLIS_PARAMS, int b_ac )
+{
+    return trellis_cabac( unquant_mf, zigzag, lambda2, last_nnz, coefs, quant_coefs, dct, cabac_state_sig,
+                          cabac_state_last, level_state0, level_state1, b_ac, 0, 16, 0, NULL, 0 );
+}
+
+int x264_trellis_cabac_8x8( TRELLIS_PARAMS, int b_interlaced )
+{
+    return trellis_cabac( unquant_mf, zigzag, lambda2, last_nnz, coefs, quant_coefs, dct, cabac_state_sig,
+                          cabac_state_last, level_state0, level_state1, 0, 0, 64, b_interlaced, NULL, 0 );
+}
+
+int x264_trellis_cabac_4x4_psy( TRELLIS_PARAMS, int b_ac, dctcoef *fenc_dct, int psy_trellis )
+{
+    return trellis_cabac( unquant_mf, zigzag, lambda2, last_nnz, coefs, quant_coefs, dct, cabac_state_sig,
+                          cabac_state_last, level_state0, level_state1, b_ac, 0, 16, 0, fenc_dct, psy_trellis );
+}
+
+int x264_trellis_cabac_8x8_psy( TRELLIS_PARAMS, int b_interlaced, dctcoef *fenc_dct, int psy_trellis )
+{
+    return trellis_cabac( unquant_mf, zigzag, lambda2, last_nnz, coefs, quant_coefs, dct, cabac_state_sig,
+                          cabac_state_last, level_state0, level_state1, 0, 0, 64, b_interlaced, fenc_dct, psy_trellis );
+}
+
+/* num_coefs is passed minus one, as in the asm */
+int x264_trellis_cabac_dc( TRELLIS_PARAMS, int num_coefs )
+{
+    return trellis_cabac( unquant_mf, zigzag, lambda2, last_nnz, coefs, quant_coefs, dct, cabac_state_sig,
+                          cabac_state_last, level_state0, level_state1, 0, 1, num_coefs+1, 0, NULL, 0 );
+}
+
+int x264_trellis_cabac_chroma_422_dc( TRELLIS_PARAMS )
+{
+    return trellis_cabac( unquant_mf, zigzag, lambda2, last_nnz, coefs, quant_coefs, dct, cabac_state_sig,
+                          cabac_state_last, level_state0, level_state1, 0, 1, 8, 0, NULL, 0 );
+}
+
+static ALWAYS_INLINE
+int quant_trellis_cabac( x264_t *h, dctcoef *dct,
+                         udctcoef *quant_mf, udctcoef *quant_bias, const int *unquant_mf,
+                         const uint8_t *zigzag, int ctx_block_cat, int lambda2, int b_ac,
+                         int b_chroma, int dc, int num_coefs, int idx )
+{
+    ALIGNED_ARRAY_16( dctcoef, orig_coefs, [64] );
+    ALIGNED_ARRAY_16( dctcoef, quant_coefs, [64] );
+    const uint32_t *coef_weight2 = num_coefs == 64 ? x264_dct8_weight2_tab : x264_dct4_weight2_tab;
+    const int b_interlaced = MB_INTERLACED;
+    uint8_t *cabac_state_sig = &h->cabac.state[ significant_coeff_flag_offset[b_interlaced][ctx_block_cat] ];
+    uint8_t *cabac_state_last = &h->cabac.state[ last_coeff_flag_offset[b_interlaced][ctx_block_cat] ];
+
+    if( dc )
+    {
+        if( num_coefs == 16 )
+        {
+            memcpy( orig_coefs, dct, sizeof(dctcoef)*16 );
+            if( !h->quantf.quant_4x4_dc( dct, quant_mf[0] >> 1, quant_bias[0] << 1 ) )
+                return 0;
+            h->zigzagf.scan_4x4( quant_coefs, dct );
+        }
+        else
+        {
+            memcpy( orig_coefs, dct, sizeof(dctcoef)*num_coefs );
+            int nz = h->quantf.quant_2x2_dc( &dct[0], quant_mf[0] >> 1, quant_bias[0] << 1 );
+            if( num_coefs == 8 )
+                nz |= h->quantf.quant_2x2_dc( &dct[4], quant_mf[0] >> 1, quant_bias[0] << 1 );
+            if( !nz )
+                return 0;
+            for( int i = 0; i < num_coefs; i++ )
+                quant_coefs[i] = dct[zigzag[i]];
+        }
+    }
+    else
+    {
+        if( num_coefs == 64 )
+        {
+            h->mc.memcpy_aligned( orig_coefs, dct, sizeof(dctcoef)*64 );
+            if( !h->quantf.quant_8x8( dct, quant_mf, quant_bias ) )
+                return 0;
+            h->zigzagf.scan_8x8( quant_coefs, dct );
+        }
+        else //if( num_coefs == 16 )
+        {
+            memcpy( orig_coefs, dct, sizeof(dctcoef)*16 );
+            if( !h->quantf.quant_4x4( dct, quant_mf, quant_bias ) )
+                return 0;
+            h->zigzagf.scan_4x4( quant_coefs, dct );
+        }
+    }
+
+    int last_nnz = h->quantf.coeff_last[ctx_block_cat]( quant_coefs+b_ac )+b_ac;
+    uint8_t *cabac_state = &h->cabac.state[ coeff_abs_level_m1_offset[ctx_block_cat] ];
+
+    /* shortcut for dc-only blocks.
+     * this doesn't affect the output, but saves some unnecessary computation. */
+    if( last_nnz == 0 && !dc )
+    {
+        int cost_sig = x264_cabac_size_decision_noup2( &cabac_state_sig[0], 1 )
+                     + x264_cabac_size_decision_noup2( &cabac_state_last[0], 1 );
+        dct[0] = trellis_dc_shortcut( orig_coefs[0], quant_coefs[0], unquant_mf[0], coef_weight2[0], lambda2, cabac_state, cost_sig );
+        return !!dct[0];
+    }
+
+    /* the 10 abs_level_m1 contexts, by value; cabac_state isn't necessarily aligned. */
+    uint64_t level_state0;
+    uint16_t level_state1;
+    memcpy( &level_state0, cabac_state, 8 );
+    memcpy( &level_state1, cabac_state+8, 2 );
+#define TRELLIS_ARGS unquant_mf, zigzag, lambda2, last_nnz, orig_coefs, quant_coefs, dct,\
+                     cabac_state_sig, cabac_state_last, level_state0, level_state1
+    if( num_coefs == 16 && !dc )
+        if( b_chroma || !h->mb.i_psy_trellis )
+            return h->quantf.trellis_cabac_4x4( TRELLIS_ARGS, b_ac );
+        else
+            return h->quantf.trellis_cabac_4x4_psy( TRELLIS_ARGS, b_ac, h->mb.pic.fenc_dct4[idx&15], h->mb.i_psy_trellis );
+    else if( num_coefs == 64 && !dc )
+        if( b_chroma || !h->mb.i_psy_trellis )
+            return h->quantf.trellis_cabac_8x8( TRELLIS_ARGS, b_interlaced );
+        else
+            return h->quantf.trellis_cabac_8x8_psy( TRELLIS_ARGS, b_interlaced, h->mb.pic.fenc_dct8[idx&3], h->mb.i_psy_trellis);
+    else if( num_coefs == 8 && dc )
+        return h->quantf.trellis_cabac_chroma_422_dc( TRELLIS_ARGS );
+    else
+        return h->quantf.trellis_cabac_dc( TRELLIS_ARGS, num_coefs-1 );
+}
+
 /* FIXME: This is a gigantic hack.  See below.
  *
  * CAVLC is much more difficult to trellis than CABAC.
@@ -435,6 +435,115 @@ static void x264_weights_analyse( x264_t *h, x264_frame_t *fenc, x264_frame_t *r
 #define NUM_ROWS 3
 #define ROW_SATD (NUM_INTS + (h->mb.i_mb_y - h->i_threadslice_start))
 
+/* With --lookahead-pyramid, motion is searched on a coarse level of the lowres pyramid, where
+ * each 8x8 block covers 2^n x 2^n lowres blocks, and all of them start from its MV.  The costs
+ * are still measured on lowres, so they need no rescaling and keep their usual magnitude. */
+static void x264_slicetype_mb_search_coarse( x264_t *h, x264_mb_analysis_t *a,
+                                             x264_frame_t **frames, int p0, int p1, int b, int do_search[2] )
+{
+    x264_frame_t *fenc = frames[b];
+    const int level = h->param.rc.i_lookahead_pyramid;
+    const int i_mb_x = h->mb.i_mb_x;
+    const int i_mb_y = h->mb.i_mb_y;
+    const int i_mb_width = (h->mb.i_mb_width + (1 << level) - 1) >> level;
+    const int i_mb_height = (h->mb.i_mb_height + (1 << level) - 1) >> level;
+    const int i_mb_stride = h->mb.i_mb_width;
+    const int i_mb_xy = (i_mb_x + i_mb_y * i_mb_stride) << level;
+    const int x1 = X264_MIN( (i_mb_x+1) << level, h->mb.i_mb_width ) - (i_mb_x << level);
+    const int y1 = X264_MIN( (i_mb_y+1) << level, h->mb.i_mb_height ) - (i_mb_y << level);
+    const int i_stride = fenc->i_stride_pyramid[level-1];
+    const int i_pel_offset = 8 * (i_mb_x + i_mb_y * i_stride);
+    x264_frame_t *fref[2] = { frames[p0], frames[p1] };
+    int16_t (*fenc_mvs[2])[2] = { &fenc->lowres_mvs[0][b-p0-1][i_mb_xy], &fenc->lowres_mvs[1][p1-b-1][i_mb_xy] };
+    x264_me_t m;
+
+    h->mb.pic.p_fenc[0] = h->mb.pic.fenc_buf;
+    h->mc.copy[PIXEL_8x8]( h->mb.pic.p_fenc[0], FENC_STRIDE, &fenc->pyramid[level-1][0][i_pel_offset], i_stride, 8 );
+
+    h->mb.mv_min_fpel[0] = -8*i_mb_x - 4;
+    h->mb.mv_max_fpel[0] = 8*( i_mb_width - i_mb_x - 1 ) + 4;
+    h->mb.mv_min_spel[0] = 4*( h->mb.mv_min_fpel[0] - 8 );
+    h->mb.mv_max_spel[0] = 4*( h->mb.mv_max_fpel[0] + 8 );
+    h->mb.mv_min_fpel[1] = -8*i_mb_y - 4;
+    h->mb.mv_max_fpel[1] = 8*( i_mb_height - i_mb_y - 1 ) + 4;
+    h->mb.mv_min_spel[1] = 4*( h->mb.mv_min_fpel[1] - 8 );
+    h->mb.mv_max_spel[1] = 4*( h->mb.mv_max_fpel[1] + 8 );
+
+    m.i_pixel = PIXEL_8x8;
+    m.p_cost_mv = a->p_cost_mv;
+    m.i_stride[0] = i_stride;
+    m.p_fenc[0] = h->mb.pic.p_fenc[0];
+    m.weight = x264_weight_none;
+    m.i_ref = 0;
+    m.hpel_ref = NULL;
+
+    for( int l = 0; l < 2; l++ )
+    {
+        if( !do_search[l] )
+            continue;
+        int16_t (*fenc_mv)[2] = fenc_mvs[l];
+        int i_mvc = 0;
+        ALIGNED_4( int16_t mvc[4][2] );
+        for( int i = 0; i < 4; i++ )
+            m.p_fref[i] = &fref[l]->pyramid[level-1][i][i_pel_offset];
+        m.p_fref_w = m.p_fref[0];
+
+        /* Reverse-order MV prediction from the coarse blocks already searched. */
+        M32( mvc[0] ) = 0;
+        M32( mvc[2] ) = 0;
+#define MVC(mv) { mvc[i_mvc][0] = (mv)[0] >> level; mvc[i_mvc][1] = (mv)[1] >> level; i_mvc++; }
+        if( i_mb_x < i_mb_width - 1 )
+            MVC( fenc_mv[1 << level] );
+        if( ((i_mb_y+1) << level) < h->i_threadslice_end )
+        {
+            MVC( fenc_mv[i_mb_stride << level] );
+            if( i_mb_x > 0 )
+                MVC( fenc_mv[(i_mb_stride-1) << level] );
+            if( i_mb_x < i_mb_width - 1 )
+                MVC( fenc_mv[(i_mb_stride+1) << level] );
+        }
+#undef MVC
+        if( i_mvc <= 1 )
+            CP32( m.mvp, mvc[0] );
+        else
+            x264_median_mv( m.mvp, mvc[0], mvc[1], mvc[2] );
+
+        if( !M32( m.mvp ) && h->pixf.mbcmp[PIXEL_8x8]( m.p_fenc[0], FENC_STRIDE, m.p_fref[0], i_stride ) < 64 )
+            M32( m.mv ) = 0;
+        else
+            x264_me_search( h, &m, mvc, i_mvc );
+
+        for( int y = 0; y < y1; y++ )
+            for( int x = 0; x < x1; x++ )
+            {
+                fenc_mv[x + y * i_mb_stride][0] = m.mv[0] * (1 << level);
+                fenc_mv[x + y * i_mb_stride][1] = m.mv[1] * (1 << level);
+            }
+    }
+}
+
+/* Measures the MV found on the pyramid level, and the predictor, on lowres: a full search
+ * there is what the pyramid saves. */
+static void x264_slicetype_me_check( x264_t *h, x264_me_t *m, int16_t *mv_coarse )
+{
+    ALIGNED_ARRAY_16( pixel, pix,[8*16] );
+    int16_t mvs[2][2];
+    mvs[0][0] = x264_clip3( mv_coarse[0], h->mb.mv_min_spel[0], h->mb.mv_max_spel[0] );
+    mvs[0][1] = x264_clip3( mv_coarse[1], h->mb.mv_min_spel[1], h->mb.mv_max_spel[1] );
+    CP32( mvs[1], m->mvp );
+    m->cost = COST_MAX;
+    for( int i = 0; i < 1 + (M32( mvs[0] ) != M32( mvs[1] )); i++ )
+    {
+        intptr_t stride = 16;
+        pixel *src = h->mc.get_ref( pix, &stride, m->p_fref, m->i_stride[0], mvs[i][0], mvs[i][1], 8, 8, m->weight );
+        int cost = h->pixf.mbcmp[PIXEL_8x8]( m->p_fenc[0], FENC_STRIDE, src, stride )
+                 + m->p_cost_mv[mvs[i][0] - m->mvp[0]] + m->p_cost_mv[mvs[i][1] - m->mvp[1]];
+        COPY2_IF_LT( m->cost, cost, M32( m->mv ), M32( mvs[i] ) );
+    }
+    m->i_ref_cost = 0;
+    x264_me_refine_qpel( h, m );
+}
+
 static void x264_slicetype_mb_cost( x264_t *h, x264_mb_analysis_t *a,
                                     x264_frame_t **frames, int p0, int p1, int b,
                                     int dist_scale_factor, int do_search[2], const x264_weight_t *w,
@@ -531,6 +640,7 @@ static void x264_slicetype_mb_cost( x264_t *h, x264_mb_analysis_t *a,
     m[0].p_fenc[0] = h->mb.pic.p_fenc[0];
     m[0].weight = w;
     m[0].i_ref = 0;
+    m[0].hpel_ref = NULL;
     LOAD_HPELS_LUMA( m[0].p_fref, fref0->lowres );
     m[0].p_fref_w = m[0].p_fref[0];
     if( w[0].weightfn )
@@ -547,6 +657,7 @@ static void x264_slicetype_mb_cost( x264_t *h, x264_mb_analysis_t *a,
         m[1].p_fenc[0] = h->mb.pic.p_fenc[0];
         m[1].i_ref = 0;
         m[1].weight = x264_weight_none;
+        m[1].hpel_ref = NULL;
         LOAD_HPELS_LUMA( m[1].p_fref, fref1->lowres );
         m[1].p_fref_w = m[1].p_fref[0];
 
@@ -609,7 +720,10 @@ static void x264_slicetype_mb_cost( x264_t *h, x264_mb_analysis_t *a,
                 }
             }
 
-            x264_me_search( h, &m[l], mvc, i_mvc );
+            if( h->param.rc.i_lookahead_pyramid )
+                x264_slicetype_me_check( h, &m[l], fenc_mvs[l][0] );
+            else
+                x264_me_search( h, &m[l], mvc, i_mvc );
             m[l].cost -= a->p_cost_mv[0]; // remove mvcost from skip mbs
             if( M32( m[l].mv ) )
                 m[l].cost += 5 * a->i_lambda;
@@ -744,15 +858,25 @@ static void x264_slicetype_slice_cost( x264_slicetype_slice_t *s )
     int start_x = h->mb.i_mb_width - 2 + do_edges;
     int end_x = 1 - do_edges;
 
+    /* Slices are aligned to whole blocks of the pyramid level. */
+    int level = h->param.rc.i_lookahead_pyramid;
+    if( level && (s->do_search[0] || s->do_search[1]) )
+        for( h->mb.i_mb_y = (h->i_threadslice_end - 1) >> level; h->mb.i_mb_y >= h->i_threadslice_start >> level; h->mb.i_mb_y-- )
+            for( h->mb.i_mb_x = (h->mb.i_mb_width - 1) >> level; h->mb.i_mb_x >= 0; h->mb.i_mb_x-- )
+                x264_slicetype_mb_search_coarse( h, s->a, s->frames, s->p0, s->p1, s->b, s->do_search );
+
     for( h->mb.i_mb_y = start_y; h->mb.i_mb_y >= end_y; h->mb.i_mb_y-- )
         for( h->mb.i_mb_x = start_x; h->mb.i_mb_x >= end_x; h->mb.i_mb_x-- )
             x264_slicetype_mb_cost( h, s->a, s->frames, s->p0, s->p1, s->b, s->dist_scale_factor,
                                     s->do_search, s->w, s->output_inter, s->output_intra );
 }
 
-static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
-                                      x264_frame_t **frames, int p0, int p1, int b,
-                                      int b_intra_penalty )
+/* With lookahead threads, the row slices of a frame normally run on the lookahead pool.
+ * If t is set they are instead run one after another on t, writing to output_buf, so that
+ * whole frames can be costed as independent jobs with the same result. */
+static int x264_slicetype_frame_cost_internal( x264_t *h, x264_t *t, int *output_buf, x264_mb_analysis_t *a,
+                                               x264_frame_t **frames, int p0, int p1, int b,
+                                               int b_intra_penalty )
 {
     int i_score = 0;
     int do_search[2];
@@ -790,7 +914,7 @@ static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
         int output_buf_size = h->mb.i_mb_height + (NUM_INTS + PAD_SIZE) * h->param.i_lookahead_threads;
         int *output_inter[X264_LOOKAHEAD_THREAD_MAX+1];
         int *output_intra[X264_LOOKAHEAD_THREAD_MAX+1];
-        output_inter[0] = h->scratch_buffer2;
+        output_inter[0] = output_buf;
         output_intra[0] = output_inter[0] + output_buf_size;
 
         if( h->param.i_lookahead_threads > 1 )
@@ -799,20 +923,27 @@ static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
 
             for( int i = 0; i < h->param.i_lookahead_threads; i++ )
             {
-                x264_t *t = h->lookahead_thread[i];
+                x264_t *st = t ? t : h->lookahead_thread[i];
 
                 /* FIXME move this somewhere else */
-                t->mb.i_me_method = h->mb.i_me_method;
-                t->mb.i_subpel_refine = h->mb.i_subpel_refine;
-                t->mb.b_chroma_me = h->mb.b_chroma_me;
+                st->mb.i_me_method = h->mb.i_me_method;
+                st->mb.i_subpel_refine = h->mb.i_subpel_refine;
+                st->mb.b_chroma_me = h->mb.b_chroma_me;
 
-                s[i] = (x264_slicetype_slice_t){ t, a, frames, p0, p1, b, dist_scale_factor, do_search, w,
+                s[i] = (x264_slicetype_slice_t){ st, a, frames, p0, p1, b, dist_scale_factor, do_search, w,
                                                  output_inter[i], output_intra[i] };
 
-                t->i_threadslice_start = ((h->mb.i_mb_height *  i    + h->param.i_lookahead_threads/2) / h->param.i_lookahead_threads);
-                t->i_threadslice_end   = ((h->mb.i_mb_height * (i+1) + h->param.i_lookahead_threads/2) / h->param.i_lookahead_threads);
+                st->i_threadslice_start = ((h->mb.i_mb_height *  i    + h->param.i_lookahead_threads/2) / h->param.i_lookahead_threads);
+                st->i_threadslice_end   = ((h->mb.i_mb_height * (i+1) + h->param.i_lookahead_threads/2) / h->param.i_lookahead_threads);
+                if( h->param.rc.i_lookahead_pyramid )
+                {
+                    int mask = (1 << h->param.rc.i_lookahead_pyramid) - 1;
+                    st->i_threadslice_start &= ~mask;
+                    if( i < h->param.i_lookahead_threads - 1 )
+                        st->i_threadslice_end &= ~mask;
+                }
 
-                int thread_height = t->i_threadslice_end - t->i_threadslice_start;
+                int thread_height = st->i_threadslice_end - st->i_threadslice_start;
                 int thread_output_size = thread_height + NUM_INTS;
                 memset( output_inter[i], 0, thread_output_size * sizeof(int) );
                 memset( output_intra[i], 0, thread_output_size * sizeof(int) );
@@ -821,10 +952,14 @@ static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
                 output_inter[i+1] = output_inter[i] + thread_output_size + PAD_SIZE;
                 output_intra[i+1] = output_intra[i] + thread_output_size + PAD_SIZE;
 
-                x264_threadpool_run( h->lookaheadpool, (void*)x264_slicetype_slice_cost, &s[i] );
+                if( t )
+                    x264_slicetype_slice_cost( &s[i] );
+                else
+                    x264_threadpool_run( h->lookaheadpool, (void*)x264_slicetype_slice_cost, &s[i] );
             }
-            for( int i = 0; i < h->param.i_lookahead_threads; i++ )
-                x264_threadpool_wait( h->lookaheadpool, &s[i] );
+            if( !t )
+                for( int i = 0; i < h->param.i_lookahead_threads; i++ )
+                    x264_threadpool_wait( h->lookaheadpool, &s[i] );
         }
         else
         {
@@ -894,6 +1029,13 @@ static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
     return i_score;
 }
 
+static int x264_slicetype_frame_cost( x264_t *h, x264_mb_analysis_t *a,
+                                      x264_frame_t **frames, int p0, int p1, int b,
+                                      int b_intra_penalty )
+{
+    return x264_slicetype_frame_cost_internal( h, NULL, h->scratch_buffer2, a, frames, p0, p1, b, b_intra_penalty );
+}
+
 /* If MB-tree changes the quantizers, we need to recalculate the frame cost without
  * re-running lookahead. */
 static int x264_slicetype_frame_cost_recalculate( x264_t *h, x264_frame_t **frames, int p0, int p1, int b )
@@ -945,15 +1087,19 @@ static void x264_macroblock_tree_finish( x264_t *h, x264_frame_t *frame, float a
     }
 }
 
-static void x264_macroblock_tree_propagate( x264_t *h, x264_frame_t **frames, float average_duration, int p0, int p1, int b, int referenced )
+/* Adds the propagate amounts of frames[b] to ref_costs, the propagate costs of frames[p0] and frames[p1].
+ * t only provides the scratch buffer: lookahead thread contexts are copied before the macroblock
+ * geometry is set up, so the geometry always comes from h. */
+static void x264_macroblock_tree_propagate_internal( x264_t *h, x264_t *t, uint16_t *ref_costs[2], x264_frame_t **frames,
+                                                     float average_duration, int p0, int p1, int b, int referenced )
 {
-    uint16_t *ref_costs[2] = {frames[p0]->i_propagate_cost,frames[p1]->i_propagate_cost};
     int dist_scale_factor = ( ((b-p0) << 8) + ((p1-p0) >> 1) ) / (p1-p0);
     int i_bipred_weight = h->param.analyse.b_weighted_bipred ? 64 - (dist_scale_factor>>2) : 32;
     int16_t (*mvs[2])[2] = { frames[b]->lowres_mvs[0][b-p0-1], frames[b]->lowres_mvs[1][p1-b-1] };
     int bipred_weights[2] = {i_bipred_weight, 64 - i_bipred_weight};
-    int *buf = h->scratch_buffer;
+    int *buf = t->scratch_buffer;
     uint16_t *propagate_cost = frames[b]->i_propagate_cost;
+    uint16_t *lowres_costs = frames[b]->lowres_costs[b-p0][p1-b];
 
     x264_emms();
     float fps_factor = CLIP_DURATION(frames[b]->f_duration) / CLIP_DURATION(average_duration);
@@ -962,83 +1108,110 @@ static void x264_macroblock_tree_propagate( x264_t *h, x264_frame_t **frames, fl
     if( !referenced )
         memset( frames[b]->i_propagate_cost, 0, h->mb.i_mb_width * sizeof(uint16_t) );
 
-    for( h->mb.i_mb_y = 0; h->mb.i_mb_y < h->mb.i_mb_height; h->mb.i_mb_y++ )
+    for( int mb_y = 0; mb_y < h->mb.i_mb_height; mb_y++ )
     {
-        int mb_index = h->mb.i_mb_y*h->mb.i_mb_stride;
+        int mb_index = mb_y*h->mb.i_mb_stride;
         h->mc.mbtree_propagate_cost( buf, propagate_cost,
-            frames[b]->i_intra_cost+mb_index, frames[b]->lowres_costs[b-p0][p1-b]+mb_index,
+            frames[b]->i_intra_cost+mb_index, lowres_costs+mb_index,
             frames[b]->i_inv_qscale_factor+mb_index, &fps_factor, h->mb.i_mb_width );
         if( referenced )
             propagate_cost += h->mb.i_mb_width;
-        for( h->mb.i_mb_x = 0; h->mb.i_mb_x < h->mb.i_mb_width; h->mb.i_mb_x++, mb_index++ )
-        {
-            int propagate_amount = buf[h->mb.i_mb_x];
-            /* Don't propagate for an intra block. */
-            if( propagate_amount > 0 )
-            {
-                /* Access width-2 bitfield. */
-                int lists_used = frames[b]->lowres_costs[b-p0][p1-b][mb_index] >> LOWRES_COST_SHIFT;
-                /* Follow the MVs to the previous frame(s). */
-                for( int list = 0; list < 2; list++ )
-                    if( (lists_used >> list)&1 )
-                    {
-#define CLIP_ADD(s,x) (s) = X264_MIN((s)+(x),(1<<16)-1)
-                        int listamount = propagate_amount;
-                        /* Apply bipred weighting. */
-                        if( lists_used == 3 )
-                            listamount = (listamount * bipred_weights[list] + 32) >> 6;
-
-                        /* Early termination for simple case of mv0. */
-                        if( !M32( mvs[list][mb_index] ) )
-                        {
-                            CLIP_ADD( ref_costs[list][mb_index], listamount );
-                            continue;
-                        }
-
-                        int x = mvs[list][mb_index][0];
-                        int y = mvs[list][mb_index][1];
-                        int mbx = (x>>5)+h->mb.i_mb_x;
-                        int mby = (y>>5)+h->mb.i_mb_y;
-                        int idx0 = mbx + mby * h->mb.i_mb_stride;
-                        int idx1 = idx0 + 1;
-                        int idx2 = idx0 + h->mb.i_mb_stride;
-                        int idx3 = idx0 + h->mb.i_mb_stride + 1;
-                        x &= 31;
-                        y &= 31;
-                        int idx0weight = (32-y)*(32-x);
-                        int idx1weight = (32-y)*x;
-                        int idx2weight = y*(32-x);
-                        int idx3weight = y*x;
-
-                        /* We could just clip the MVs, but pixels that lie outside the frame probably shouldn't
-                         * be counted. */
-                        if( mbx < h->mb.i_mb_width-1 && mby < h->mb.i_mb_height-1 && mbx >= 0 && mby >= 0 )
-                        {
-                            CLIP_ADD( ref_costs[list][idx0], (listamount*idx0weight+512)>>10 );
-                            CLIP_ADD( ref_costs[list][idx1], (listamount*idx1weight+512)>>10 );
-                            CLIP_ADD( ref_costs[list][idx2], (listamount*idx2weight+512)>>10 );
-                            CLIP_ADD( ref_costs[list][idx3], (listamount*idx3weight+512)>>10 );
-                        }
-                        else /* Check offsets individually */
-                        {
-                            if( mbx < h->mb.i_mb_width && mby < h->mb.i_mb_height && mbx >= 0 && mby >= 0 )
-                                CLIP_ADD( ref_costs[list][idx0], (listamount*idx0weight+512)>>10 );
-                            if( mbx+1 < h->mb.i_mb_width && mby < h->mb.i_mb_height && mbx+1 >= 0 && mby >= 0 )
-                                CLIP_ADD( ref_costs[list][idx1], (listamount*idx1weight+512)>>10 );
-                            if( mbx < h->mb.i_mb_width && mby+1 < h->mb.i_mb_height && mbx >= 0 && mby+1 >= 0 )
-                                CLIP_ADD( ref_costs[list][idx2], (listamount*idx2weight+512)>>10 );
-                            if( mbx+1 < h->mb.i_mb_width && mby+1 < h->mb.i_mb_height && mbx+1 >= 0 && mby+1 >= 0 )
-                                CLIP_ADD( ref_costs[list][idx3], (listamount*idx3weight+512)>>10 );
-                        }
-                    }
-            }
-        }
+
+        h->mc.mbtree_propagate_list( h, ref_costs[0], &mvs[0][mb_index], buf, &lowres_costs[mb_index],
+                                     bipred_weights[0], mb_y, h->mb.i_mb_width, 0 );
+        if( b != p1 )
+            h->mc.mbtree_propagate_list( h, ref_costs[1], &mvs[1][mb_index], buf, &lowres_costs[mb_index],
+                                         bipred_weights[1], mb_y, h->mb.i_mb_width, 1 );
     }
+}
+
+static void x264_macroblock_tree_propagate( x264_t *h, x264_frame_t **frames, float average_duration, int p0, int p1, int b, int referenced )
+{
+    uint16_t *ref_costs[2] = {frames[p0]->i_propagate_cost,frames[p1]->i_propagate_cost};
+    x264_macroblock_tree_propagate_internal( h, h, ref_costs, frames, average_duration, p0, p1, b, referenced );
 
     if( h->param.rc.i_vbv_buffer_size && h->param.rc.i_lookahead && referenced )
         x264_macroblock_tree_finish( h, frames[b], average_duration, b == p1 ? b - p0 : 0 );
 }
 
+/* Unreferenced B-frames of a mini-GOP only add to the propagate costs of their references, and
+ * the additions saturate, so they can be summed in any order.  With lookahead threads, each
+ * lookahead context propagates a share of the B-frames into private sums, one per reference,
+ * which are then added to the references: the result is the same as the serial loop's. */
+#define X264_MBTREE_JOB_TARGETS 3
+
+typedef struct
+{
+    x264_t *h;
+    x264_t *t;
+    x264_frame_t **frames;
+    float average_duration;
+    int (*bframe)[3];  /* p0, p1, b */
+    int i_bframes;
+    int i_first;
+    /* frame indices of the references summed into t's buffers, -1 if unused */
+    int target[X264_MBTREE_JOB_TARGETS];
+} x264_mbtree_job_t;
+
+static uint16_t *x264_macroblock_tree_job_sum( x264_mbtree_job_t *j, int target )
+{
+    int i = 0;
+    while( j->target[i] != target && j->target[i] >= 0 )
+        i++;
+    assert( i < X264_MBTREE_JOB_TARGETS );
+    uint16_t *sum = (uint16_t*)((int*)j->t->scratch_buffer + ((j->h->mb.i_mb_width+7)&~7)) + i * j->h->mb.i_mb_count;
+    if( j->target[i] < 0 )
+    {
+        j->target[i] = target;
+        memset( sum, 0, j->h->mb.i_mb_count * sizeof(uint16_t) );
+    }
+    return sum;
+}
+
+static void x264_macroblock_tree_propagate_job( x264_mbtree_job_t *j )
+{
+    int threads = j->h->param.i_lookahead_threads;
+    for( int i = j->i_first; i < j->i_bframes; i += threads )
+    {
+        int p0 = j->bframe[i][0];
+        int p1 = j->bframe[i][1];
+        int b  = j->bframe[i][2];
+        uint16_t *ref_costs[2] = { x264_macroblock_tree_job_sum( j, p0 ), x264_macroblock_tree_job_sum( j, p1 ) };
+        x264_macroblock_tree_propagate_internal( j->h, j->t, ref_costs, j->frames, j->average_duration, p0, p1, b, 0 );
+    }
+}
+
+static void x264_macroblock_tree_propagate_bframes( x264_t *h, x264_frame_t **frames, float average_duration,
+                                                    int (*bframe)[3], int count )
+{
+    int threads = h->param.i_lookahead_threads;
+    if( threads == 1 || count < 2 )
+    {
+        for( int i = 0; i < count; i++ )
+            x264_macroblock_tree_propagate( h, frames, average_duration, bframe[i][0], bframe[i][1], bframe[i][2], 0 );
+        return;
+    }
+
+    x264_mbtree_job_t job[X264_LOOKAHEAD_THREAD_MAX];
+    int jobs = X264_MIN( threads, count );
+    for( int i = 0; i < jobs; i++ )
+    {
+        job[i] = (x264_mbtree_job_t){ h, h->lookahead_thread[i], frames, average_duration, bframe, count, i, {-1,-1,-1} };
+        x264_threadpool_run( h->lookaheadpool, (void*)x264_macroblock_tree_propagate_job, &job[i] );
+    }
+    for( int i = 0; i < jobs; i++ )
+        x264_threadpool_wait( h->lookaheadpool, &job[i] );
+
+    for( int i = 0; i < jobs; i++ )
+        for( int k = 0; k < X264_MBTREE_JOB_TARGETS && job[i].target[k] >= 0; k++ )
+        {
+            uint16_t *sum = x264_macroblock_tree_job_sum( &job[i], job[i].target[k] );
+            uint16_t *ref_costs = frames[job[i].target[k]]->i_propagate_cost;
+            for( int mb = 0; mb < h->mb.i_mb_count; mb++ )
+                MC_CLIP_ADD( ref_costs[mb], sum[mb] );
+        }
+}
+
 static void x264_macroblock_tree( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames, int num_frames, int b_intra )
 {
     int idx = !b_intra;
@@ -1091,6 +1264,8 @@ static void x264_macroblock_tree( x264_t *h, x264_mb_analysis_t *a, x264_frame_t
         x264_slicetype_frame_cost( h, a, frames, cur_nonb, last_nonb, last_nonb, 0 );
         memset( frames[cur_nonb]->i_propagate_cost, 0, h->mb.i_mb_count * sizeof(uint16_t) );
         bframes = last_nonb - cur_nonb - 1;
+        int bframe[X264_BFRAME_MAX][3];
+        int count = 0;
         if( h->param.i_bframe_pyramid && bframes > 1 )
         {
             int middle = (bframes + 1)/2 + cur_nonb;
@@ -1103,10 +1278,13 @@ static void x264_macroblock_tree( x264_t *h, x264_mb_analysis_t *a, x264_frame_t
                 if( i != middle )
                 {
                     x264_slicetype_frame_cost( h, a, frames, p0, p1, i, 0 );
-                    x264_macroblock_tree_propagate( h, frames, average_duration, p0, p1, i, 0 );
+                    bframe[count][0] = p0;
+                    bframe[count][1] = p1;
+                    bframe[count++][2] = i;
                 }
                 i--;
             }
+            x264_macroblock_tree_propagate_bframes( h, frames, average_duration, bframe, count );
             x264_macroblock_tree_propagate( h, frames, average_duration, cur_nonb, last_nonb, middle, 1 );
         }
         else
@@ -1114,9 +1292,12 @@ static void x264_macroblock_tree( x264_t *h, x264_mb_analysis_t *a, x264_frame_t
             while( i > cur_nonb )
             {
                 x264_slicetype_frame_cost( h, a, frames, cur_nonb, last_nonb, i, 0 );
-                x264_macroblock_tree_propagate( h, frames, average_duration, cur_nonb, last_nonb, i, 0 );
+                bframe[count][0] = cur_nonb;
+                bframe[count][1] = last_nonb;
+                bframe[count++][2] = i;
                 i--;
             }
+            x264_macroblock_tree_propagate_bframes( h, frames, average_duration, bframe, count );
         }
         x264_macroblock_tree_propagate( h, frames, average_duration, cur_nonb, last_nonb, last_nonb, 1 );
         last_nonb = cur_nonb;
@@ -1236,8 +1417,92 @@ static void x264_vbv_lookahead( x264_t *h, x264_mb_analysis_t *a, x264_frame_t *
     frames[next_nonb]->i_planned_type[idx] = X264_TYPE_AUTO;
 }
 
+typedef struct
+{
+    x264_t *h;
+    x264_t *t;
+    x264_mb_analysis_t *a;
+    x264_frame_t **frames;
+    int p0;
+    int p1;
+    int b;
+    int i_score;
+    /* what the job may cache in frames[b], to roll back an evaluation the serial search wouldn't have made */
+    int i_cost_est[2];
+    int i_cost_est_aq[2];
+    int i_row_satd;
+    int16_t lowres_mv[2][2];
+} x264_slicetype_bframe_job_t;
+
+static void x264_slicetype_bframe_cost_job( x264_slicetype_bframe_job_t *j )
+{
+    j->i_score = x264_slicetype_frame_cost_internal( j->h, j->t, j->t->scratch_buffer2, j->a, j->frames, j->p0, j->p1, j->b, 0 );
+}
+
+/* Adds the costs of the B-frames of a mini-GOP in order, until the total reaches threshold.
+ * The B-frames only read their references, which are costed first, so with lookahead threads
+ * they run as one batch of whole-frame jobs.  Jobs beyond the point where the serial loop
+ * stops have their cached results rolled back, which keeps the decision bit-exact. */
+static int x264_slicetype_bframes_cost( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames,
+                                        x264_slicetype_bframe_job_t *job, int count, int cost, int threshold )
+{
+    int threads = h->param.i_lookahead_threads;
+    if( threads == 1 || count < 2 || cost >= threshold )
+    {
+        for( int i = 0; i < count && cost < threshold; i++ )
+            cost += x264_slicetype_frame_cost( h, a, frames, job[i].p0, job[i].p1, job[i].b, 0 );
+        return cost;
+    }
+
+    for( int i = 0; i < count; i++ )
+    {
+        x264_frame_t *fenc = frames[job[i].b];
+        int d0 = job[i].b - job[i].p0;
+        int d1 = job[i].p1 - job[i].b;
+        job[i].i_cost_est[0] = fenc->i_cost_est[0][0];
+        job[i].i_cost_est[1] = fenc->i_cost_est[d0][d1];
+        job[i].i_cost_est_aq[0] = fenc->i_cost_est_aq[0][0];
+        job[i].i_cost_est_aq[1] = fenc->i_cost_est_aq[d0][d1];
+        job[i].i_row_satd = fenc->i_row_satds[d0][d1][0];
+        CP32( job[i].lowres_mv[0], fenc->lowres_mvs[0][d0-1][0] );
+        CP32( job[i].lowres_mv[1], fenc->lowres_mvs[1][d1-1][0] );
+
+        /* Each lookahead context runs one job at a time. */
+        if( i >= threads )
+            x264_threadpool_wait( h->lookaheadpool, &job[i-threads] );
+        job[i].h = h;
+        job[i].t = h->lookahead_thread[i%threads];
+        job[i].a = a;
+        job[i].frames = frames;
+        x264_threadpool_run( h->lookaheadpool, (void*)x264_slicetype_bframe_cost_job, &job[i] );
+    }
+    for( int i = X264_MAX( count - threads, 0 ); i < count; i++ )
+        x264_threadpool_wait( h->lookaheadpool, &job[i] );
+    h->lookahead->i_bframe_jobs += count;
+
+    int i = 0;
+    for( ; i < count && cost < threshold; i++ )
+        cost += job[i].i_score;
+    for( ; i < count; i++ )
+    {
+        x264_frame_t *fenc = frames[job[i].b];
+        int d0 = job[i].b - job[i].p0;
+        int d1 = job[i].p1 - job[i].b;
+        fenc->i_cost_est[0][0] = job[i].i_cost_est[0];
+        fenc->i_cost_est[d0][d1] = job[i].i_cost_est[1];
+        fenc->i_cost_est_aq[0][0] = job[i].i_cost_est_aq[0];
+        fenc->i_cost_est_aq[d0][d1] = job[i].i_cost_est_aq[1];
+        fenc->i_row_satds[d0][d1][0] = job[i].i_row_satd;
+        CP32( fenc->lowres_mvs[0][d0-1][0], job[i].lowres_mv[0] );
+        CP32( fenc->lowres_mvs[1][d1-1][0], job[i].lowres_mv[1] );
+        h->lookahead->i_bframe_jobs_discarded++;
+    }
+    return cost;
+}
+
 static int x264_slicetype_path_cost( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames, char *path, int threshold )
 {
+    x264_slicetype_bframe_job_t job[X264_BFRAME_MAX];
     int loc = 1;
     int cost = 0;
     int cur_p = 0;
@@ -1255,18 +1520,20 @@ static int x264_slicetype_path_cost( x264_t *h, x264_mb_analysis_t *a, x264_fram
         if( cost > threshold )
             break;
 
+        int count = 0;
         if( h->param.i_bframe_pyramid && next_p - cur_p > 2 )
         {
             int middle = cur_p + (next_p - cur_p)/2;
             cost += x264_slicetype_frame_cost( h, a, frames, cur_p, next_p, middle, 0 );
-            for( int next_b = loc; next_b < middle && cost < threshold; next_b++ )
-                cost += x264_slicetype_frame_cost( h, a, frames, cur_p, middle, next_b, 0 );
-            for( int next_b = middle+1; next_b < next_p && cost < threshold; next_b++ )
-                cost += x264_slicetype_frame_cost( h, a, frames, middle, next_p, next_b, 0 );
+            for( int next_b = loc; next_b < middle; next_b++ )
+                job[count++] = (x264_slicetype_bframe_job_t){ .p0 = cur_p, .p1 = middle, .b = next_b };
+            for( int next_b = middle+1; next_b < next_p; next_b++ )
+                job[count++] = (x264_slicetype_bframe_job_t){ .p0 = middle, .p1 = next_p, .b = next_b };
         }
         else
-            for( int next_b = loc; next_b < next_p && cost < threshold; next_b++ )
-                cost += x264_slicetype_frame_cost( h, a, frames, cur_p, next_p, next_b, 0 );
+            for( int next_b = loc; next_b < next_p; next_b++ )
+                job[count++] = (x264_slicetype_bframe_job_t){ .p0 = cur_p, .p1 = next_p, .b = next_b };
+        cost = x264_slicetype_bframes_cost( h, a, frames, job, count, cost, threshold );
 
         loc = next_p + 1;
         cur_p = next_p;
@@ -1393,7 +1660,7 @@ static int scenecut( x264_t *h, x264_mb_analysis_t *a, x264_frame_t **frames, in
     return scenecut_internal( h, a, frames, p0, p1, real_scenecut );
 }
 
-void x264_slicetype_analyse( x264_t *h, int keyframe )
+void x264_slicetype_analyse( x264_t *h, int intra_minigop )
 {
     x264_mb_analysis_t a;
     x264_frame_t *frames[X264_LOOKAHEAD_MAX+3] = { NULL, };
@@ -1402,8 +1669,12 @@ void x264_slicetype_analyse( x264_t *h, int keyframe )
     int cost1p0, cost2p0, cost1b1, cost2p1;
     int i_max_search = X264_MIN( h->lookahead->next.i_size, X264_LOOKAHEAD_MAX );
     int vbv_lookahead = h->param.rc.i_vbv_buffer_size && h->param.rc.i_lookahead;
+    int keyframe = !!intra_minigop;
+    /* For determinism, only search the frames the lookahead is sure to have at this point
+     * (all of them at the end of the stream): i_slicetype_length + 1 for a normal decision,
+     * minus the intra_minigop frames already shifted out for the analysis of an I-frame. */
     if( h->param.b_deterministic )
-        i_max_search = X264_MIN( i_max_search, h->lookahead->i_slicetype_length + !keyframe );
+        i_max_search = X264_MIN( i_max_search, h->lookahead->i_slicetype_length + 1 - intra_minigop );
 
     assert( h->frames.b_have_lowres );
 
@@ -1613,6 +1884,10 @@ void x264_slicetype_decide( x264_t *h )
             h->lookahead->next.list[i]->i_type =
                 x264_ratecontrol_slice_type( h, h->lookahead->next.list[i]->i_frame );
     }
+    else if( h->param.lookahead_share && !h->param.b_lookahead_source && x264_lookahead_share_read( h ) )
+    {
+        /* Use the frame types and MB-tree offsets of the shared lookahead's source */
+    }
     else if( (h->param.i_bframe && h->param.i_bframe_adaptive)
              || h->param.i_scenecut_threshold
              || h->param.rc.b_mb_tree
@@ -44,7 +44,7 @@ static int init( hnd_t *handle, cli_vid_filter_t *filter, video_info_t *info, x2
         return -1;
     h->cur_frame = -1;
 
-    if( cli_input.picture_alloc( &h->pic, info->csp, info->width, info->height ) )
+    if( cli_input.picture_alloc( &h->pic, *handle, info->csp, info->width, info->height ) )
         return -1;
 
     h->hin = *handle;
@@ -58,8 +58,13 @@ static int get_frame( hnd_t handle, cli_pic_t *output, int frame )
 {
     source_hnd_t *h = handle;
     /* do not allow requesting of frames from before the current position */
-    if( frame <= h->cur_frame || cli_input.read_frame( &h->pic, h->hin, frame ) )
+    if( frame <= h->cur_frame )
         return -1;
+    int b_trace = x264_trace_is_open();
+    int64_t trace_start = TRACE_START( b_trace );
+    if( cli_input.read_frame( &h->pic, h->hin, frame ) )
+        return -1;
+    TRACE_END( b_trace, X264_TRACE_INPUT, trace_start );
     h->cur_frame = frame;
     *output = h->pic;
     return 0;
@@ -76,7 +81,7 @@ static int release_frame( hnd_t handle, cli_pic_t *pic, int frame )
 static void free_filter( hnd_t handle )
 {
     source_hnd_t *h = handle;
-    cli_input.picture_clean( &h->pic );
+    cli_input.picture_clean( &h->pic, h->hin );
     cli_input.close_file( h->hin );
     free( h );
 }
@@ -25,6 +25,11 @@
 
 #include "input.h"
 
+#if HAVE_MMAP
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
 const x264_cli_csp_t x264_cli_csps[] = {
     [X264_CSP_I420] = { "i420", 3, { 1, .5, .5 }, { 1, .5, .5 }, 2, 2 },
     [X264_CSP_I422] = { "i422", 3, { 1, .5, .5 }, { 1,  1,  1 }, 2, 1 },
@@ -74,7 +79,7 @@ uint64_t x264_cli_pic_size( int csp, int width, int height )
     return size;
 }
 
-int x264_cli_pic_alloc( cli_pic_t *pic, int csp, int width, int height )
+int x264_cli_pic_init_noalloc( cli_pic_t *pic, int csp, int width, int height )
 {
     memset( pic, 0, sizeof(cli_pic_t) );
     int csp_mask = csp & X264_CSP_MASK;
@@ -85,12 +90,20 @@ int x264_cli_pic_alloc( cli_pic_t *pic, int csp, int width, int height )
     pic->img.csp    = csp;
     pic->img.width  = width;
     pic->img.height = height;
+    for( int i = 0; i < pic->img.planes; i++ )
+        pic->img.stride[i] = width * x264_cli_csps[csp_mask].width[i] * x264_cli_csp_depth_factor( csp );
+
+    return 0;
+}
+
+int x264_cli_pic_alloc( cli_pic_t *pic, int csp, int width, int height )
+{
+    x264_cli_pic_init_noalloc( pic, csp, width, height );
     for( int i = 0; i < pic->img.planes; i++ )
     {
          pic->img.plane[i] = x264_malloc( x264_cli_pic_plane_size( csp, width, height, i ) );
          if( !pic->img.plane[i] )
              return -1;
-         pic->img.stride[i] = width * x264_cli_csps[csp_mask].width[i] * x264_cli_csp_depth_factor( csp );
     }
 
     return 0;
@@ -109,3 +122,63 @@ const x264_cli_csp_t *x264_cli_get_csp( int csp )
         return NULL;
     return x264_cli_csps + (csp&X264_CSP_MASK);
 }
+
+/* Upconvert samples of less than 16 bits to 16 bits using the same algorithm as the
+ * depth filter.  Four samples are shifted at once in a 64-bit word; the mask drops
+ * the bits each sample would push into its neighbour. */
+void x264_cli_plane_upshift( uint16_t *plane, uint64_t pixel_count, int lshift )
+{
+    uint64_t mask = 0x0001000100010001ULL * (uint16_t)(0xffff << lshift);
+    uint64_t i = 0;
+    for( ; i < pixel_count && ((intptr_t)(plane+i) & 7); i++ )
+        plane[i] <<= lshift;
+    for( ; i + 4 <= pixel_count; i += 4 )
+        M64( plane+i ) = (M64( plane+i ) << lshift) & mask;
+    for( ; i < pixel_count; i++ )
+        plane[i] <<= lshift;
+}
+
+int x264_cli_mmap_init( cli_mmap_t *h, FILE *fh )
+{
+#if HAVE_MMAP
+    struct stat file_stat;
+    h->fd = fileno( fh );
+    h->align_mask = sysconf( _SC_PAGESIZE ) - 1;
+    if( h->align_mask > 0 && !fstat( h->fd, &file_stat ) && S_ISREG( file_stat.st_mode ) && file_stat.st_size > 0 )
+    {
+        h->size = file_stat.st_size;
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+void *x264_cli_mmap( cli_mmap_t *h, int64_t offset, int64_t size )
+{
+#if HAVE_MMAP
+    if( offset < 0 || offset + size > h->size )
+        return NULL;
+    int align = offset & h->align_mask;
+    /* private and writable so that samples can be upconverted in place */
+    uint8_t *base = mmap( NULL, size + align, PROT_READ|PROT_WRITE, MAP_PRIVATE, h->fd, offset - align );
+    if( base != MAP_FAILED )
+    {
+        /* start reading the frame in now rather than on first access */
+#ifdef MADV_WILLNEED
+        madvise( base, size + align, MADV_WILLNEED );
+#endif
+        return base + align;
+    }
+#endif
+    return NULL;
+}
+
+int x264_cli_munmap( cli_mmap_t *h, void *addr, int64_t size )
+{
+#if HAVE_MMAP
+    int align = (intptr_t)addr & h->align_mask;
+    return munmap( (uint8_t*)addr - align, size + align );
+#else
+    return -1;
+#endif
+}
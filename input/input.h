@@ -44,6 +44,7 @@ typedef struct
     int output_csp; /* convert to this csp, if applicable */
     int output_range; /* user desired output range */
     int input_range; /* user override input range */
+    int thread_depth; /* frames read ahead by threaded input */
 } cli_input_opt_t;
 
 /* properties of the source given by the demuxer */
@@ -88,10 +89,10 @@ typedef struct
 typedef struct
 {
     int (*open_file)( char *psz_filename, hnd_t *p_handle, video_info_t *info, cli_input_opt_t *opt );
-    int (*picture_alloc)( cli_pic_t *pic, int csp, int width, int height );
+    int (*picture_alloc)( cli_pic_t *pic, hnd_t handle, int csp, int width, int height );
     int (*read_frame)( cli_pic_t *pic, hnd_t handle, int i_frame );
     int (*release_frame)( cli_pic_t *pic, hnd_t handle );
-    void (*picture_clean)( cli_pic_t *pic );
+    void (*picture_clean)( cli_pic_t *pic, hnd_t handle );
     int (*close_file)( hnd_t handle );
     hnd_t (*open_audio)( hnd_t handle, int track );
 } cli_input_t;
@@ -125,9 +126,23 @@ extern const x264_cli_csp_t x264_cli_csps[];
 int      x264_cli_csp_is_invalid( int csp );
 int      x264_cli_csp_depth_factor( int csp );
 int      x264_cli_pic_alloc( cli_pic_t *pic, int csp, int width, int height );
+int      x264_cli_pic_init_noalloc( cli_pic_t *pic, int csp, int width, int height );
 void     x264_cli_pic_clean( cli_pic_t *pic );
 uint64_t x264_cli_pic_plane_size( int csp, int width, int height, int plane );
 uint64_t x264_cli_pic_size( int csp, int width, int height );
 const x264_cli_csp_t *x264_cli_get_csp( int csp );
+void     x264_cli_plane_upshift( uint16_t *plane, uint64_t pixel_count, int lshift );
+
+/* per-frame mappings of a regular input file */
+typedef struct
+{
+    int fd;
+    int align_mask;
+    int64_t size;
+} cli_mmap_t;
+
+int   x264_cli_mmap_init( cli_mmap_t *h, FILE *fh );
+void *x264_cli_mmap( cli_mmap_t *h, int64_t offset, int64_t size );
+int   x264_cli_munmap( cli_mmap_t *h, void *addr, int64_t size );
 
 #endif
@@ -35,6 +35,8 @@ typedef struct
     uint64_t plane_size[4];
     uint64_t frame_size;
     int bit_depth;
+    int use_mmap;
+    cli_mmap_t mmap;
 } raw_hnd_t;
 
 static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, cli_input_opt_t *opt )
@@ -93,6 +95,8 @@ static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, c
         uint64_t size = ftell( h->fh );
         fseek( h->fh, 0, SEEK_SET );
         info->num_frames = size / h->frame_size;
+        /* map frames straight from the file instead of reading them into buffers */
+        h->use_mmap = !x264_cli_mmap_init( &h->mmap, h->fh );
     }
 
     *p_handle = h;
@@ -105,17 +109,15 @@ static int read_frame_internal( cli_pic_t *pic, raw_hnd_t *h )
     int pixel_depth = x264_cli_csp_depth_factor( pic->img.csp );
     for( int i = 0; i < pic->img.planes && !error; i++ )
     {
-        error |= fread( pic->img.plane[i], pixel_depth, h->plane_size[i], h->fh ) != h->plane_size[i];
-        if( h->bit_depth & 7 )
+        if( h->use_mmap )
         {
-            /* upconvert non 16bit high depth planes to 16bit using the same
-             * algorithm as used in the depth filter. */
-            uint16_t *plane = (uint16_t*)pic->img.plane[i];
-            uint64_t pixel_count = h->plane_size[i];
-            int lshift = 16 - h->bit_depth;
-            for( uint64_t j = 0; j < pixel_count; j++ )
-                plane[j] = plane[j] << lshift;
+            if( i )
+                pic->img.plane[i] = pic->img.plane[i-1] + pixel_depth * h->plane_size[i-1];
         }
+        else
+            error |= fread( pic->img.plane[i], pixel_depth, h->plane_size[i], h->fh ) != h->plane_size[i];
+        if( h->bit_depth & 7 )
+            x264_cli_plane_upshift( (uint16_t*)pic->img.plane[i], h->plane_size[i], 16 - h->bit_depth );
     }
     return error;
 }
@@ -124,7 +126,13 @@ static int read_frame( cli_pic_t *pic, hnd_t handle, int i_frame )
 {
     raw_hnd_t *h = handle;
 
-    if( i_frame > h->next_frame )
+    if( h->use_mmap )
+    {
+        pic->img.plane[0] = x264_cli_mmap( &h->mmap, i_frame * h->frame_size, h->frame_size );
+        if( !pic->img.plane[0] )
+            return -1;
+    }
+    else if( i_frame > h->next_frame )
     {
         if( x264_is_regular_file( h->fh ) )
             fseek( h->fh, i_frame * h->frame_size, SEEK_SET );
@@ -144,6 +152,36 @@ static int read_frame( cli_pic_t *pic, hnd_t handle, int i_frame )
     return 0;
 }
 
+static int release_frame( cli_pic_t *pic, hnd_t handle )
+{
+    raw_hnd_t *h = handle;
+    if( h->use_mmap && pic->img.plane[0] )
+    {
+        if( x264_cli_munmap( &h->mmap, pic->img.plane[0], h->frame_size ) )
+            return -1;
+        memset( pic->img.plane, 0, sizeof(pic->img.plane) );
+    }
+    return 0;
+}
+
+static int picture_alloc( cli_pic_t *pic, hnd_t handle, int csp, int width, int height )
+{
+    raw_hnd_t *h = handle;
+    return (h->use_mmap ? x264_cli_pic_init_noalloc : x264_cli_pic_alloc)( pic, csp, width, height );
+}
+
+static void picture_clean( cli_pic_t *pic, hnd_t handle )
+{
+    raw_hnd_t *h = handle;
+    if( h->use_mmap )
+    {
+        release_frame( pic, h );
+        memset( pic, 0, sizeof(cli_pic_t) );
+    }
+    else
+        x264_cli_pic_clean( pic );
+}
+
 static int close_file( hnd_t handle )
 {
     raw_hnd_t *h = handle;
@@ -154,4 +192,4 @@ static int close_file( hnd_t handle )
     return 0;
 }
 
-const cli_input_t raw_input = { open_file, x264_cli_pic_alloc, read_frame, NULL, x264_cli_pic_clean, close_file };
+const cli_input_t raw_input = { open_file, picture_alloc, read_frame, release_frame, picture_clean, close_file };
@@ -26,42 +26,61 @@
 
 #include "input.h"
 
+/* Frames are read ahead into a single-producer/single-consumer ring: the reader
+ * job fills slots at tail, read_frame swaps them out at head.  Neither side takes
+ * a lock unless the ring is full or empty, in which case it sleeps until the
+ * other side moves. */
+
+typedef struct
+{
+    cli_pic_t pic;
+    int status;
+} thread_slot_t;
+
 typedef struct
 {
     cli_input_t input;
     hnd_t p_handle;
-    cli_pic_t pic;
     x264_threadpool_t *pool;
-    int next_frame;
     int frame_total;
-    struct thread_input_arg_t *next_args;
-} thread_hnd_t;
 
-typedef struct thread_input_arg_t
-{
-    thread_hnd_t *h;
-    cli_pic_t *pic;
-    int i_frame;
-    int status;
-} thread_input_arg_t;
+    thread_slot_t *ring;
+    int depth;
+    volatile unsigned head;     /* only written by the consumer */
+    volatile unsigned tail;     /* only written by the reader */
+    int next_frame;             /* frame expected at head, -1 if the reader is not running */
+    int reader_frame;           /* next frame the reader reads */
+    volatile int exit;
+    volatile int done;          /* reader has stopped, nothing more will be queued */
+
+    x264_pthread_mutex_t mutex;
+    x264_pthread_cond_t  cv;
+    volatile int sleepers;
+
+    /* stall statistics */
+    int     consumer_stalls;
+    int64_t consumer_stall_time;
+    int     reader_stalls;
+    int     frames;
+} thread_hnd_t;
 
 static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, cli_input_opt_t *opt )
 {
-    thread_hnd_t *h = malloc( sizeof(thread_hnd_t) );
-    FAIL_IF_ERR( !h || cli_input.picture_alloc( &h->pic, info->csp, info->width, info->height ),
-                 "x264", "malloc failed\n" )
+    thread_hnd_t *h = calloc( 1, sizeof(thread_hnd_t) );
+    FAIL_IF_ERR( !h, "x264", "malloc failed\n" )
     h->input = cli_input;
     h->p_handle = *p_handle;
     h->next_frame = -1;
-    h->next_args = malloc( sizeof(thread_input_arg_t) );
-    if( !h->next_args )
-        return -1;
-    h->next_args->h = h;
-    h->next_args->status = 0;
     h->frame_total = info->num_frames;
-    thread_input.picture_alloc = h->input.picture_alloc;
-    thread_input.picture_clean = h->input.picture_clean;
+    h->depth = opt && opt->thread_depth > 0 ? opt->thread_depth : 4;
+    h->ring = calloc( h->depth, sizeof(thread_slot_t) );
+    FAIL_IF_ERR( !h->ring, "x264", "malloc failed\n" )
+    for( int i = 0; i < h->depth; i++ )
+        FAIL_IF_ERR( cli_input.picture_alloc( &h->ring[i].pic, h->p_handle, info->csp, info->width, info->height ),
+                     "x264", "malloc failed\n" )
 
+    if( x264_pthread_mutex_init( &h->mutex, NULL ) || x264_pthread_cond_init( &h->cv, NULL ) )
+        return -1;
     if( x264_threadpool_init( &h->pool, 1, NULL, NULL ) )
         return -1;
 
@@ -69,37 +88,105 @@ static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, c
     return 0;
 }
 
-static void read_frame_thread_int( thread_input_arg_t *i )
+static void wake( thread_hnd_t *h )
+{
+    x264_memory_barrier();
+    if( h->sleepers )
+    {
+        x264_pthread_mutex_lock( &h->mutex );
+        x264_pthread_cond_broadcast( &h->cv );
+        x264_pthread_mutex_unlock( &h->mutex );
+    }
+}
+
+static void *read_frames_thread( thread_hnd_t *h )
+{
+    while( !h->exit && (!h->frame_total || h->reader_frame < h->frame_total) )
+    {
+        if( h->tail - h->head == h->depth )
+        {
+            h->reader_stalls++;
+            x264_pthread_mutex_lock( &h->mutex );
+            x264_atomic_fetch_add( &h->sleepers, 1 );
+            while( !h->exit && h->tail - h->head == h->depth )
+                x264_pthread_cond_wait( &h->cv, &h->mutex );
+            x264_atomic_fetch_add( &h->sleepers, -1 );
+            x264_pthread_mutex_unlock( &h->mutex );
+            continue;
+        }
+        thread_slot_t *slot = &h->ring[h->tail % h->depth];
+        slot->status = h->input.read_frame( &slot->pic, h->p_handle, h->reader_frame++ );
+        x264_memory_barrier();
+        h->tail++;
+        wake( h );
+        if( slot->status )
+            break;
+    }
+    h->done = 1;
+    wake( h );
+    return NULL;
+}
+
+static void stop_reader( thread_hnd_t *h )
+{
+    if( h->next_frame < 0 )
+        return;
+    h->exit = 1;
+    wake( h );
+    x264_threadpool_wait( h->pool, h );
+    h->next_frame = -1;
+}
+
+static void start_reader( thread_hnd_t *h, int i_frame )
 {
-    i->status = i->h->input.read_frame( i->pic, i->h->p_handle, i->i_frame );
+    h->head = h->tail = 0;
+    h->exit = h->done = 0;
+    h->next_frame = h->reader_frame = i_frame;
+    x264_threadpool_run( h->pool, (void*)read_frames_thread, h );
 }
 
 static int read_frame( cli_pic_t *p_pic, hnd_t handle, int i_frame )
 {
     thread_hnd_t *h = handle;
-    int ret = 0;
 
-    if( h->next_frame >= 0 )
+    /* (re)start reading ahead from the requested frame */
+    if( h->next_frame != i_frame )
     {
-        x264_threadpool_wait( h->pool, h->next_args );
-        ret |= h->next_args->status;
+        stop_reader( h );
+        if( h->frame_total && i_frame >= h->frame_total )
+            return h->input.read_frame( p_pic, h->p_handle, i_frame );
+        start_reader( h, i_frame );
     }
 
-    if( h->next_frame == i_frame )
-        XCHG( cli_pic_t, *p_pic, h->pic );
-    else
-        ret |= h->input.read_frame( p_pic, h->p_handle, i_frame );
-
-    if( !h->frame_total || i_frame+1 < h->frame_total )
+    if( h->tail == h->head )
     {
-        h->next_frame =
-        h->next_args->i_frame = i_frame+1;
-        h->next_args->pic = &h->pic;
-        x264_threadpool_run( h->pool, (void*)read_frame_thread_int, h->next_args );
+        int64_t t = x264_mdate();
+        h->consumer_stalls += h->frames > 0;
+        x264_pthread_mutex_lock( &h->mutex );
+        x264_atomic_fetch_add( &h->sleepers, 1 );
+        while( h->tail == h->head && !h->done )
+            x264_pthread_cond_wait( &h->cv, &h->mutex );
+        x264_atomic_fetch_add( &h->sleepers, -1 );
+        x264_pthread_mutex_unlock( &h->mutex );
+        if( h->frames > 0 )
+            h->consumer_stall_time += x264_mdate() - t;
+        x264_memory_barrier();
+        /* the reader stopped without queueing this frame */
+        if( h->tail == h->head )
+        {
+            stop_reader( h );
+            return h->input.read_frame( p_pic, h->p_handle, i_frame );
+        }
     }
-    else
-        h->next_frame = -1;
 
+    thread_slot_t *slot = &h->ring[h->head % h->depth];
+    int ret = slot->status;
+    XCHG( cli_pic_t, *p_pic, slot->pic );
+    x264_memory_barrier();
+    h->head++;
+    h->next_frame++;
+    h->frames++;
+    wake( h );
     return ret;
 }
 
@@ -111,15 +198,34 @@ static int release_frame( cli_pic_t *pic, hnd_t handle )
     return 0;
 }
 
+static int picture_alloc( cli_pic_t *pic, hnd_t handle, int csp, int width, int height )
+{
+    thread_hnd_t *h = handle;
+    return h->input.picture_alloc( pic, h->p_handle, csp, width, height );
+}
+
+static void picture_clean( cli_pic_t *pic, hnd_t handle )
+{
+    thread_hnd_t *h = handle;
+    h->input.picture_clean( pic, h->p_handle );
+}
+
 static int close_file( hnd_t handle )
 {
     thread_hnd_t *h = handle;
+    stop_reader( h );
     x264_threadpool_delete( h->pool );
+    if( h->frames )
+        x264_cli_log( "thread", X264_LOG_INFO, "read ahead %d frames: encoder waited %d times (%.2fs), reader waited %d times\n",
+                      h->depth, h->consumer_stalls, h->consumer_stall_time / 1000000., h->reader_stalls );
+    for( int i = 0; i < h->depth; i++ )
+        h->input.picture_clean( &h->ring[i].pic, h->p_handle );
     h->input.close_file( h->p_handle );
-    h->input.picture_clean( &h->pic );
-    free( h->next_args );
+    x264_pthread_cond_destroy( &h->cv );
+    x264_pthread_mutex_destroy( &h->mutex );
+    free( h->ring );
     free( h );
     return 0;
 }
 
-cli_input_t thread_input = { open_file, NULL, read_frame, release_frame, NULL, close_file };
+cli_input_t thread_input = { open_file, picture_alloc, read_frame, release_frame, picture_clean, close_file };
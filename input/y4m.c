@@ -36,6 +36,8 @@ typedef struct
     uint64_t frame_size;
     uint64_t plane_size[3];
     int bit_depth;
+    int use_mmap;
+    cli_mmap_t mmap;
 } y4m_hnd_t;
 
 #define Y4M_MAGIC "YUV4MPEG2"
@@ -77,6 +79,7 @@ static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, c
         return -1;
 
     h->next_frame = 0;
+    h->use_mmap = 0;
     info->vfr = 0;
 
     if( !strcmp( psz_filename, "-" ) )
@@ -218,6 +221,17 @@ static int open_file( char *psz_filename, hnd_t *p_handle, video_info_t *info, c
         uint64_t i_size = ftell( h->fh );
         fseek( h->fh, init_pos, SEEK_SET );
         info->num_frames = (i_size - h->seq_header_len) / h->frame_size;
+
+        /* Frames can only be mapped at a known offset, which needs the plain frame header. */
+        if( !x264_cli_mmap_init( &h->mmap, h->fh ) )
+        {
+            char *frame_header = x264_cli_mmap( &h->mmap, h->seq_header_len, h->frame_header_len );
+            if( frame_header )
+            {
+                h->use_mmap = !memcmp( frame_header, Y4M_FRAME_MAGIC "\n", h->frame_header_len );
+                x264_cli_munmap( &h->mmap, frame_header, h->frame_header_len );
+            }
+        }
     }
 
     *p_handle = h;
@@ -231,43 +245,78 @@ static int read_frame_internal( cli_pic_t *pic, y4m_hnd_t *h )
     int i = 0;
     char header[16];
 
-    /* Read frame header - without terminating '\n' */
-    if( fread( header, 1, slen, h->fh ) != slen )
-        return -1;
-
-    header[slen] = 0;
-    FAIL_IF_ERROR( strncmp( header, Y4M_FRAME_MAGIC, slen ), "bad header magic (%"PRIx32" <=> %s)\n",
-                   M32(header), header )
-
-    /* Skip most of it */
-    while( i < MAX_FRAME_HEADER && fgetc( h->fh ) != '\n' )
-        i++;
-    FAIL_IF_ERROR( i == MAX_FRAME_HEADER, "bad frame header!\n" )
-    h->frame_size = h->frame_size - h->frame_header_len + i+slen+1;
-    h->frame_header_len = i+slen+1;
+    if( h->use_mmap )
+    {
+        /* the frame was mapped with its header */
+        char *frame_header = (char*)pic->img.plane[0] - h->frame_header_len;
+        FAIL_IF_ERROR( memcmp( frame_header, Y4M_FRAME_MAGIC "\n", h->frame_header_len ),
+                       "frame parameters are not supported with memory-mapped input\n" )
+    }
+    else
+    {
+        /* Read frame header - without terminating '\n' */
+        if( fread( header, 1, slen, h->fh ) != slen )
+            return -1;
+
+        header[slen] = 0;
+        FAIL_IF_ERROR( strncmp( header, Y4M_FRAME_MAGIC, slen ), "bad header magic (%"PRIx32" <=> %s)\n",
+                       M32(header), header )
+
+        /* Skip most of it */
+        while( i < MAX_FRAME_HEADER && fgetc( h->fh ) != '\n' )
+            i++;
+        FAIL_IF_ERROR( i == MAX_FRAME_HEADER, "bad frame header!\n" )
+        h->frame_size = h->frame_size - h->frame_header_len + i+slen+1;
+        h->frame_header_len = i+slen+1;
+    }
 
     int error = 0;
     for( i = 0; i < pic->img.planes && !error; i++ )
     {
-        error |= fread( pic->img.plane[i], pixel_depth, h->plane_size[i], h->fh ) != h->plane_size[i];
-        if( h->bit_depth & 7 )
+        if( h->use_mmap )
         {
-            /* upconvert non 16bit high depth planes to 16bit using the same
-             * algorithm as used in the depth filter. */
-            uint16_t *plane = (uint16_t*)pic->img.plane[i];
-            uint64_t pixel_count = h->plane_size[i];
-            int lshift = 16 - h->bit_depth;
-            for( uint64_t j = 0; j < pixel_count; j++ )
-                plane[j] = plane[j] << lshift;
+            if( i )
+                pic->img.plane[i] = pic->img.plane[i-1] + pixel_depth * h->plane_size[i-1];
         }
+        else
+            error |= fread( pic->img.plane[i], pixel_depth, h->plane_size[i], h->fh ) != h->plane_size[i];
+        if( h->bit_depth & 7 )
+            x264_cli_plane_upshift( (uint16_t*)pic->img.plane[i], h->plane_size[i], 16 - h->bit_depth );
     }
     return error;
 }
 
+static int release_frame( cli_pic_t *pic, hnd_t handle )
+{
+    y4m_hnd_t *h = handle;
+    if( h->use_mmap && pic->img.plane[0] )
+    {
+        if( x264_cli_munmap( &h->mmap, pic->img.plane[0] - h->frame_header_len, h->frame_size ) )
+            return -1;
+        memset( pic->img.plane, 0, sizeof(pic->img.plane) );
+    }
+    return 0;
+}
+
 static int read_frame( cli_pic_t *pic, hnd_t handle, int i_frame )
 {
     y4m_hnd_t *h = handle;
 
+    if( h->use_mmap )
+    {
+        uint8_t *frame = x264_cli_mmap( &h->mmap, h->frame_size * i_frame + h->seq_header_len, h->frame_size );
+        if( !frame )
+            return -1;
+        pic->img.plane[0] = frame + h->frame_header_len;
+        if( read_frame_internal( pic, h ) )
+        {
+            release_frame( pic, h );
+            return -1;
+        }
+        h->next_frame = i_frame+1;
+        return 0;
+    }
+
     if( i_frame > h->next_frame )
     {
         if( x264_is_regular_file( h->fh ) )
@@ -288,6 +337,24 @@ static int read_frame( cli_pic_t *pic, hnd_t handle, int i_frame )
     return 0;
 }
 
+static int picture_alloc( cli_pic_t *pic, hnd_t handle, int csp, int width, int height )
+{
+    y4m_hnd_t *h = handle;
+    return (h->use_mmap ? x264_cli_pic_init_noalloc : x264_cli_pic_alloc)( pic, csp, width, height );
+}
+
+static void picture_clean( cli_pic_t *pic, hnd_t handle )
+{
+    y4m_hnd_t *h = handle;
+    if( h->use_mmap )
+    {
+        release_frame( pic, h );
+        memset( pic, 0, sizeof(cli_pic_t) );
+    }
+    else
+        x264_cli_pic_clean( pic );
+}
+
 static int close_file( hnd_t handle )
 {
     y4m_hnd_t *h = handle;
@@ -298,4 +365,4 @@ static int close_file( hnd_t handle )
     return 0;
 }
 
-const cli_input_t y4m_input = { open_file, x264_cli_pic_alloc, read_frame, NULL, x264_cli_pic_clean, close_file };
+const cli_input_t y4m_input = { open_file, picture_alloc, read_frame, release_frame, picture_clean, close_file };
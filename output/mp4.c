@@ -118,6 +118,7 @@ typedef struct
     uint64_t i_prev_dts;
     uint32_t i_sei_size;
     uint8_t *p_sei_buffer;
+    lsmash_sample_t sample;     /* reused for every video frame, its data points at the caller's NAL buffer */
     int i_numframe;
     int64_t i_init_delta;
     int i_delay_frames;
@@ -130,6 +131,7 @@ typedef struct
     uint32_t i_display_width;
     uint32_t i_display_height;
     int b_no_remux;
+    int b_reserve_moov;
     int b_no_pasp;
     int b_force_display_size;
     int b_fragments;
@@ -1045,7 +1047,7 @@ static int close_file( hnd_t handle, int64_t largest_pts, int64_t second_largest
             cb_param.start = x264_mdate();
             lsmash_adhoc_remux_t remux_info;
             remux_info.func = remux_callback;
-            remux_info.buffer_size = 4*1024*1024; // 4MiB
+            remux_info.buffer_size = 32*1024*1024; // 32MiB
             remux_info.param = &cb_param;
             MP4_LOG_IF_ERR( lsmash_finish_movie( p_mp4->p_root, &remux_info ), "failed to finish movie.\n" );
         }
@@ -1109,6 +1111,7 @@ static int open_file( char *psz_filename, hnd_t *p_handle, cli_output_opt_t *opt
     p_mp4->psz_language         = opt->language;
     p_mp4->b_no_pasp            = opt->no_sar;
     p_mp4->b_no_remux           = opt->no_remux;
+    p_mp4->b_reserve_moov       = opt->reserve_moov;
     p_mp4->i_display_width      = opt->display_width * (1<<16);
     p_mp4->i_display_height     = opt->display_height * (1<<16);
     p_mp4->b_force_display_size = p_mp4->i_display_height || p_mp4->i_display_height;
@@ -1148,6 +1151,34 @@ static int open_file( char *psz_filename, hnd_t *p_handle, cli_output_opt_t *opt
     return 0;
 }
 
+/* Estimate an upper bound of the size of the Movie Box from the number of frames.
+ * Per sample: stsz (4), ctts (8), sdtp (1) and stts (8) for VFR.
+ * Per chunk, which is at most 0.5 seconds long: stco/co64 (8) and stsc (12).
+ * Per keyframe: stss (4) and the sample groups (16).
+ * Returns 0 if the number of frames is unknown. */
+static uint64_t estimate_moov_size( mp4_hnd_t *p_mp4, x264_param_t *p_param )
+{
+    if( p_param->i_frame_total <= 0 || !p_param->i_fps_num || !p_param->i_fps_den )
+        return 0;
+    uint64_t i_frames = p_param->i_frame_total;
+    double duration = (double)i_frames * p_param->i_fps_den / p_param->i_fps_num;
+    uint64_t i_chunks = duration * 2 + 1;
+    uint64_t i_keyframes = i_frames / X264_MAX( p_param->i_keyint_min, 1 ) + 1;
+    uint64_t i_size = i_frames * 21 + i_chunks * 20 + i_keyframes * 20;
+#if HAVE_ANY_AUDIO
+    mp4_audio_hnd_t *p_audio = p_mp4->audio_hnd;
+    if( p_audio && p_audio->summary && p_audio->summary->frequency )
+    {
+        uint32_t i_samples_in_frame = p_audio->summary->samples_in_frame ? p_audio->summary->samples_in_frame : 1024;
+        uint64_t i_audio_frames = duration * p_audio->summary->frequency / i_samples_in_frame + 1;
+        i_size += i_audio_frames * 5 + i_chunks * 20;
+    }
+#endif
+    /* fixed-size boxes, sample descriptions and chapters */
+    i_size += 16384;
+    return X264_MIN( i_size + i_size / 8, UINT32_MAX );
+}
+
 static int set_param( hnd_t handle, x264_param_t *p_param )
 {
     mp4_hnd_t *p_mp4 = handle;
@@ -1291,6 +1322,16 @@ static int set_param( hnd_t handle, x264_param_t *p_param )
                      "failed to set audio param\n" );
 #endif
 
+    if( p_mp4->b_reserve_moov && !p_mp4->b_fragments && !p_mp4->b_no_remux )
+    {
+        uint64_t i_reserve = estimate_moov_size( p_mp4, p_param );
+        if( !i_reserve )
+            MP4_LOG_WARNING( "--reserve-moov needs the number of frames; ignoring it.\n" );
+        else
+            MP4_LOG_IF_ERR( lsmash_reserve_moov_space( p_mp4->p_root, i_reserve ),
+                            "failed to reserve space for the movie box.\n" );
+    }
+
     return 0;
 }
 
@@ -1398,19 +1439,25 @@ static int write_frame( hnd_t handle, uint8_t *p_nalu, int i_size, x264_picture_
         }
     }
 
-    lsmash_sample_t *p_sample = lsmash_create_sample( i_size + p_mp4->i_sei_size );
-    MP4_FAIL_IF_ERR( !p_sample,
-                     "failed to create a video sample data.\n" );
+    lsmash_sample_t *p_sample = &p_mp4->sample;
+    memset( &p_sample->prop, 0, sizeof(p_sample->prop) );
 
     if( p_mp4->p_sei_buffer )
     {
-        memcpy( p_sample->data, p_mp4->p_sei_buffer, p_mp4->i_sei_size );
-        free( p_mp4->p_sei_buffer );
-        p_mp4->p_sei_buffer = NULL;
+        /* Only the first frame is preceded by the SEI, so it alone needs its own buffer. */
+        uint8_t *p_data = realloc( p_mp4->p_sei_buffer, p_mp4->i_sei_size + i_size );
+        MP4_FAIL_IF_ERR( !p_data,
+                         "failed to create a video sample data.\n" );
+        memcpy( p_data + p_mp4->i_sei_size, p_nalu, i_size );
+        p_mp4->p_sei_buffer = p_data;
+        p_sample->data = p_data;
+        p_sample->length = p_mp4->i_sei_size + i_size;
+    }
+    else
+    {
+        p_sample->data = p_nalu;
+        p_sample->length = i_size;
     }
-
-    memcpy( p_sample->data + p_mp4->i_sei_size, p_nalu, i_size );
-    p_mp4->i_sei_size = 0;
 
     if( p_mp4->b_dts_compress )
     {
@@ -1485,9 +1532,17 @@ static int write_frame( hnd_t handle, uint8_t *p_nalu, int i_size, x264_picture_
                          "failed to create a movie fragment.\n" );
     }
 
-    /* Append data per sample. */
-    MP4_FAIL_IF_ERR( lsmash_append_sample( p_mp4->p_root, p_mp4->i_track, p_sample ),
+    /* Append data per sample. The payload is copied straight from p_nalu into the chunk. */
+    MP4_FAIL_IF_ERR( lsmash_append_sample_external( p_mp4->p_root, p_mp4->i_track, p_sample ),
                      "failed to append a video frame.\n" );
+    p_sample->data = NULL;
+
+    if( p_mp4->p_sei_buffer )
+    {
+        free( p_mp4->p_sei_buffer );
+        p_mp4->p_sei_buffer = NULL;
+        p_mp4->i_sei_size = 0;
+    }
 
     p_mp4->i_prev_dts = dts;
     p_mp4->i_numframe++;
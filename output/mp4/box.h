@@ -1701,6 +1701,8 @@ struct lsmash_root_tag
         double max_async_tolerance;         /* max tolerance, in seconds, for amount of interleaving asynchronization between tracks */
         uint64_t max_chunk_size;            /* max size per chunk in bytes. */
         uint64_t max_read_size;             /* max size of reading from a chunk at a time. */
+        uint64_t moov_reserve;              /* size of the Free Space Box reserved in front of the Media Data Box for the Movie Box */
+        uint64_t moov_reserve_pos;          /* position of the reserved Free Space Box */
         uint8_t file_type_written;          /* whether File Type Box was written */
         uint8_t qt_compatible;              /* compatibility with QuickTime file format */
         uint8_t isom_compatible;            /* compatibility with ISO Base Media file format */
@@ -2236,6 +2238,16 @@ void isom_remove_unknown_box( isom_unknown_box_t *unknown_box );
         return -1; \
     }
 
+/* Sample tables grow by one entry per sample, so keep their entries in pooled lists. */
+#define isom_create_pooled_list_box( box_name, parent_name, box_type, entry_type ) \
+    isom_create_box( box_name, parent_name, box_type ); \
+    box_name->list = lsmash_create_pooled_entry_list( sizeof(entry_type) ); \
+    if( !box_name->list ) \
+    { \
+        free( box_name ); \
+        return -1; \
+    }
+
 #define isom_copy_fields( dst, src, box_name ) \
     lsmash_root_t *root   = dst->box_name->root; \
     isom_box_t *parent    = dst->box_name->parent; \
@@ -39,6 +39,13 @@
 #include "timeline.h"
 #endif
 
+#if HAVE_THREAD && !defined(_WIN32)
+#include <unistd.h>
+#define ISOM_OVERLAPPED_REMUX 1
+#else
+#define ISOM_OVERLAPPED_REMUX 0
+#endif
+
 
 /*---- ----*/
 char *isom_4cc2str( uint32_t fourcc )
@@ -460,16 +467,11 @@ static int isom_add_stts_entry( isom_stbl_t *stbl, uint32_t sample_delta )
 {
     if( !stbl || !stbl->stts || !stbl->stts->list )
         return -1;
-    isom_stts_entry_t *data = malloc( sizeof(isom_stts_entry_t) );
+    isom_stts_entry_t *data = lsmash_add_pooled_entry( stbl->stts->list );
     if( !data )
         return -1;
     data->sample_count = 1;
     data->sample_delta = sample_delta;
-    if( lsmash_add_entry( stbl->stts->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -477,16 +479,11 @@ static int isom_add_ctts_entry( isom_stbl_t *stbl, uint32_t sample_offset )
 {
     if( !stbl || !stbl->ctts || !stbl->ctts->list )
         return -1;
-    isom_ctts_entry_t *data = malloc( sizeof(isom_ctts_entry_t) );
+    isom_ctts_entry_t *data = lsmash_add_pooled_entry( stbl->ctts->list );
     if( !data )
         return -1;
     data->sample_count = 1;
     data->sample_offset = sample_offset;
-    if( lsmash_add_entry( stbl->ctts->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -494,17 +491,12 @@ static int isom_add_stsc_entry( isom_stbl_t *stbl, uint32_t first_chunk, uint32_
 {
     if( !stbl || !stbl->stsc || !stbl->stsc->list )
         return -1;
-    isom_stsc_entry_t *data = malloc( sizeof(isom_stsc_entry_t) );
+    isom_stsc_entry_t *data = lsmash_add_pooled_entry( stbl->stsc->list );
     if( !data )
         return -1;
     data->first_chunk = first_chunk;
     data->samples_per_chunk = samples_per_chunk;
     data->sample_description_index = sample_description_index;
-    if( lsmash_add_entry( stbl->stsc->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -525,32 +517,22 @@ static int isom_add_stsz_entry( isom_stbl_t *stbl, uint32_t entry_size )
     /* found sample_size varies, create sample_size list */
     if( !stsz->list )
     {
-        stsz->list = lsmash_create_entry_list();
+        stsz->list = lsmash_create_pooled_entry_list( sizeof(isom_stsz_entry_t) );
         if( !stsz->list )
             return -1;
         for( uint32_t i = 0; i < stsz->sample_count; i++ )
         {
-            isom_stsz_entry_t *data = malloc( sizeof(isom_stsz_entry_t) );
+            isom_stsz_entry_t *data = lsmash_add_pooled_entry( stsz->list );
             if( !data )
                 return -1;
             data->entry_size = stsz->sample_size;
-            if( lsmash_add_entry( stsz->list, data ) )
-            {
-                free( data );
-                return -1;
-            }
         }
         stsz->sample_size = 0;
     }
-    isom_stsz_entry_t *data = malloc( sizeof(isom_stsz_entry_t) );
+    isom_stsz_entry_t *data = lsmash_add_pooled_entry( stsz->list );
     if( !data )
         return -1;
     data->entry_size = entry_size;
-    if( lsmash_add_entry( stsz->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     ++ stsz->sample_count;
     return 0;
 }
@@ -559,15 +541,10 @@ static int isom_add_stss_entry( isom_stbl_t *stbl, uint32_t sample_number )
 {
     if( !stbl || !stbl->stss || !stbl->stss->list )
         return -1;
-    isom_stss_entry_t *data = malloc( sizeof(isom_stss_entry_t) );
+    isom_stss_entry_t *data = lsmash_add_pooled_entry( stbl->stss->list );
     if( !data )
         return -1;
     data->sample_number = sample_number;
-    if( lsmash_add_entry( stbl->stss->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -575,15 +552,10 @@ static int isom_add_stps_entry( isom_stbl_t *stbl, uint32_t sample_number )
 {
     if( !stbl || !stbl->stps || !stbl->stps->list )
         return -1;
-    isom_stps_entry_t *data = malloc( sizeof(isom_stps_entry_t) );
+    isom_stps_entry_t *data = lsmash_add_pooled_entry( stbl->stps->list );
     if( !data )
         return -1;
     data->sample_number = sample_number;
-    if( lsmash_add_entry( stbl->stps->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -600,7 +572,7 @@ static int isom_add_sdtp_entry( isom_box_t *parent, lsmash_sample_property_t *pr
         assert( 0 );
     if( !sdtp || !sdtp->list )
         return -1;
-    isom_sdtp_entry_t *data = malloc( sizeof(isom_sdtp_entry_t) );
+    isom_sdtp_entry_t *data = lsmash_add_pooled_entry( sdtp->list );
     if( !data )
         return -1;
     /* isom_sdtp_entry_t is smaller than lsmash_sample_property_t. */
@@ -608,11 +580,6 @@ static int isom_add_sdtp_entry( isom_box_t *parent, lsmash_sample_property_t *pr
     data->sample_depends_on     = prop->independent & 0x03;
     data->sample_is_depended_on = prop->disposable & 0x03;
     data->sample_has_redundancy = prop->redundant & 0x03;
-    if( lsmash_add_entry( sdtp->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -620,7 +587,7 @@ static int isom_add_co64( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->stco )
         return -1;
-    isom_create_list_box( stco, stbl, ISOM_BOX_TYPE_CO64 );
+    isom_create_pooled_list_box( stco, stbl, ISOM_BOX_TYPE_CO64, isom_co64_entry_t );
     stco->large_presentation = 1;
     stbl->stco = stco;
     return 0;
@@ -630,7 +597,7 @@ static int isom_add_stco( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->stco )
         return -1;
-    isom_create_list_box( stco, stbl, ISOM_BOX_TYPE_STCO );
+    isom_create_pooled_list_box( stco, stbl, ISOM_BOX_TYPE_STCO, isom_stco_entry_t );
     stco->large_presentation = 0;
     stbl->stco = stco;
     return 0;
@@ -640,15 +607,10 @@ static int isom_add_co64_entry( isom_stbl_t *stbl, uint64_t chunk_offset )
 {
     if( !stbl || !stbl->stco || !stbl->stco->list )
         return -1;
-    isom_co64_entry_t *data = malloc( sizeof(isom_co64_entry_t) );
+    isom_co64_entry_t *data = lsmash_add_pooled_entry( stbl->stco->list );
     if( !data )
         return -1;
     data->chunk_offset = chunk_offset;
-    if( lsmash_add_entry( stbl->stco->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -683,15 +645,10 @@ static int isom_add_stco_entry( isom_stbl_t *stbl, uint64_t chunk_offset )
             return -1;
         return isom_add_co64_entry( stbl, chunk_offset );
     }
-    isom_stco_entry_t *data = malloc( sizeof(isom_stco_entry_t) );
+    isom_stco_entry_t *data = lsmash_add_pooled_entry( stbl->stco->list );
     if( !data )
         return -1;
     data->chunk_offset = (uint32_t)chunk_offset;
-    if( lsmash_add_entry( stbl->stco->list, data ) )
-    {
-        free( data );
-        return -1;
-    }
     return 0;
 }
 
@@ -1347,7 +1304,7 @@ static int isom_add_stts( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->stts )
         return -1;
-    isom_create_list_box( stts, stbl, ISOM_BOX_TYPE_STTS );
+    isom_create_pooled_list_box( stts, stbl, ISOM_BOX_TYPE_STTS, isom_stts_entry_t );
     stbl->stts = stts;
     return 0;
 }
@@ -1356,7 +1313,7 @@ static int isom_add_ctts( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->ctts )
         return -1;
-    isom_create_list_box( ctts, stbl, ISOM_BOX_TYPE_CTTS );
+    isom_create_pooled_list_box( ctts, stbl, ISOM_BOX_TYPE_CTTS, isom_ctts_entry_t );
     stbl->ctts = ctts;
     return 0;
 }
@@ -1374,7 +1331,7 @@ static int isom_add_stsc( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->stsc )
         return -1;
-    isom_create_list_box( stsc, stbl, ISOM_BOX_TYPE_STSC );
+    isom_create_pooled_list_box( stsc, stbl, ISOM_BOX_TYPE_STSC, isom_stsc_entry_t );
     stbl->stsc = stsc;
     return 0;
 }
@@ -1392,7 +1349,7 @@ static int isom_add_stss( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->stss )
         return -1;
-    isom_create_list_box( stss, stbl, ISOM_BOX_TYPE_STSS );
+    isom_create_pooled_list_box( stss, stbl, ISOM_BOX_TYPE_STSS, isom_stss_entry_t );
     stbl->stss = stss;
     return 0;
 }
@@ -1401,7 +1358,7 @@ static int isom_add_stps( isom_stbl_t *stbl )
 {
     if( !stbl || stbl->stps )
         return -1;
-    isom_create_list_box( stps, stbl, QT_BOX_TYPE_STPS );
+    isom_create_pooled_list_box( stps, stbl, QT_BOX_TYPE_STPS, isom_stps_entry_t );
     stbl->stps = stps;
     return 0;
 }
@@ -1415,7 +1372,7 @@ static int isom_add_sdtp( isom_box_t *parent )
         isom_stbl_t *stbl = (isom_stbl_t *)parent;
         if( stbl->sdtp )
             return -1;
-        isom_create_list_box( sdtp, stbl, ISOM_BOX_TYPE_SDTP );
+        isom_create_pooled_list_box( sdtp, stbl, ISOM_BOX_TYPE_SDTP, isom_sdtp_entry_t );
         stbl->sdtp = sdtp;
     }
     else if( lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_TRAF ) )
@@ -1423,7 +1380,7 @@ static int isom_add_sdtp( isom_box_t *parent )
         isom_traf_entry_t *traf = (isom_traf_entry_t *)parent;
         if( traf->sdtp )
             return -1;
-        isom_create_list_box( sdtp, traf, ISOM_BOX_TYPE_SDTP );
+        isom_create_pooled_list_box( sdtp, traf, ISOM_BOX_TYPE_SDTP, isom_sdtp_entry_t );
         traf->sdtp = sdtp;
     }
     else
@@ -5719,6 +5676,285 @@ static int isom_write_fragment_random_access_info( lsmash_root_t *root )
     return isom_write_mfra( root->bs, root->mfra );
 }
 
+int lsmash_reserve_moov_space( lsmash_root_t *root, uint64_t size )
+{
+    /* The reserved area must be decided before any chunk offset is decided. */
+    if( !root || root->fragment || root->mdat
+     || (size && size < ISOM_BASEBOX_COMMON_SIZE) || size > UINT32_MAX )
+        return -1;
+    root->moov_reserve = size;
+    return 0;
+}
+
+static int isom_write_moov_reserve( lsmash_root_t *root )
+{
+    static uint8_t zero[4096];
+    lsmash_bs_t *bs = root->bs;
+    root->moov_reserve_pos = lsmash_ftell( bs->stream );
+    lsmash_bs_put_be32( bs, root->moov_reserve );
+    lsmash_bs_put_be32( bs, ISOM_BOX_TYPE_FREE.fourcc );
+    for( uint64_t rest = root->moov_reserve - ISOM_BASEBOX_COMMON_SIZE; rest; )
+    {
+        uint32_t size = LSMASH_MIN( rest, sizeof(zero) );
+        lsmash_bs_put_bytes( bs, size, zero );
+        if( lsmash_bs_write_data( bs ) )
+            return -1;
+        rest -= size;
+    }
+    if( lsmash_bs_write_data( bs ) )
+        return -1;
+    root->size += root->moov_reserve;
+    return 0;
+}
+
+/* Write the Movie Box and the Meta Box into the area reserved by lsmash_reserve_moov_space
+ * and cover the rest of it with a Free Space Box.
+ * Return 1 if they don't fit into it. */
+static int isom_write_moov_into_reserve( lsmash_root_t *root, uint64_t mtf_size )
+{
+    if( mtf_size > root->moov_reserve )
+        return 1;
+    uint64_t rest = root->moov_reserve - mtf_size;
+    if( rest && rest < ISOM_BASEBOX_COMMON_SIZE )
+        return 1;
+    lsmash_bs_t *bs = root->bs;
+    FILE *stream = bs->stream;
+    uint64_t current_pos = lsmash_ftell( stream );
+    if( lsmash_fseek( stream, root->moov_reserve_pos, SEEK_SET )
+     || isom_write_moov( root )
+     || isom_write_meta( bs, root->meta ) )
+        return -1;
+    if( rest )
+    {
+        lsmash_bs_put_be32( bs, rest );
+        lsmash_bs_put_be32( bs, ISOM_BOX_TYPE_FREE.fourcc );
+        if( lsmash_bs_write_data( bs ) )
+            return -1;
+    }
+    return lsmash_fseek( stream, current_pos, SEEK_SET );
+}
+
+#if ISOM_OVERLAPPED_REMUX
+/* Moving the media data toward the tail by the size of the boxes moved to front.
+ * A reader thread fills a ring of buffers with pread() while the caller writes them back with pwrite(),
+ * so reading and writing overlap.  Since the data moves by 'shift' <= 'block_size', the writing of the block N
+ * clobbers the head of the block N+1, therefore it waits until the block N+1 has been read.
+ * The writing of the block N never reaches the block N+2, so the reader can run ahead by the ring size. */
+#define ISOM_REMUX_BUFFERS 4
+
+typedef struct
+{
+    int      fd;
+    uint64_t src_pos;       /* start of the media data to be moved */
+    uint64_t block_size;
+    uint64_t last_block_size;
+    uint32_t num_blocks;
+    uint8_t *buf[ISOM_REMUX_BUFFERS];
+    uint32_t blocks_read;
+    uint32_t blocks_written;
+    int      error;
+    x264_pthread_mutex_t mutex;
+    x264_pthread_cond_t  cv;
+} isom_remux_engine_t;
+
+static int isom_pread( int fd, uint8_t *buf, uint64_t size, uint64_t pos )
+{
+    while( size )
+    {
+        ssize_t ret = pread( fd, buf, size, pos );
+        if( ret <= 0 )
+            return -1;
+        buf  += ret;
+        pos  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static int isom_pwrite( int fd, uint8_t *buf, uint64_t size, uint64_t pos )
+{
+    while( size )
+    {
+        ssize_t ret = pwrite( fd, buf, size, pos );
+        if( ret <= 0 )
+            return -1;
+        buf  += ret;
+        pos  += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+static void isom_remux_set_progress( isom_remux_engine_t *engine, uint32_t *progress, uint32_t value, int error )
+{
+    x264_pthread_mutex_lock( &engine->mutex );
+    *progress = value;
+    engine->error |= error;
+    x264_pthread_cond_broadcast( &engine->cv );
+    x264_pthread_mutex_unlock( &engine->mutex );
+}
+
+/* Wait until the other side reaches 'value'.  Return nonzero if the other side failed. */
+static int isom_remux_wait_progress( isom_remux_engine_t *engine, uint32_t *progress, uint32_t value )
+{
+    x264_pthread_mutex_lock( &engine->mutex );
+    while( !engine->error && *progress < value )
+        x264_pthread_cond_wait( &engine->cv, &engine->mutex );
+    int error = engine->error;
+    x264_pthread_mutex_unlock( &engine->mutex );
+    return error;
+}
+
+static void *isom_remux_reader( isom_remux_engine_t *engine )
+{
+    for( uint32_t i = 0; i < engine->num_blocks; i++ )
+    {
+        if( i >= ISOM_REMUX_BUFFERS
+         && isom_remux_wait_progress( engine, &engine->blocks_written, i - ISOM_REMUX_BUFFERS + 1 ) )
+            break;
+        uint64_t size = i == engine->num_blocks - 1 ? engine->last_block_size : engine->block_size;
+        int error = isom_pread( engine->fd, engine->buf[i % ISOM_REMUX_BUFFERS], size, engine->src_pos + i * engine->block_size );
+        isom_remux_set_progress( engine, &engine->blocks_read, i + 1, error );
+        if( error )
+            break;
+    }
+    return NULL;
+}
+
+static int isom_remux_overlapped( lsmash_root_t *root, lsmash_adhoc_remux_t *remux, uint64_t mtf_size )
+{
+    FILE *stream = root->bs->stream;
+    isom_mdat_t *mdat = root->mdat;
+    uint64_t total = root->size + mtf_size;
+    if( fflush( stream ) || lsmash_fseek( stream, 0, SEEK_END ) )
+        return -1;
+    uint64_t src_end = lsmash_ftell( stream );
+    if( src_end <= mdat->placeholder_pos )
+        return -1;
+
+    isom_remux_engine_t engine = { 0 };
+    engine.fd      = fileno( stream );
+    engine.src_pos = mdat->placeholder_pos;
+    /* Each buffer must hold at least the boxes moved to front. Use 64KiB granularity for the I/O. */
+    engine.block_size = LSMASH_MAX( remux->buffer_size / ISOM_REMUX_BUFFERS, mtf_size );
+    engine.block_size = (engine.block_size + 0xffff) & ~(uint64_t)0xffff;
+    engine.num_blocks = (src_end - engine.src_pos + engine.block_size - 1) / engine.block_size;
+    engine.last_block_size = src_end - engine.src_pos - (uint64_t)(engine.num_blocks - 1) * engine.block_size;
+
+    uint8_t *alloc = malloc( ISOM_REMUX_BUFFERS * engine.block_size + 4095 );
+    if( !alloc )
+        return -1;
+    for( int i = 0; i < ISOM_REMUX_BUFFERS; i++ )
+        engine.buf[i] = (uint8_t *)(((uintptr_t)alloc + 4095) & ~(uintptr_t)4095) + i * engine.block_size;
+    if( x264_pthread_mutex_init( &engine.mutex, NULL ) )
+    {
+        free( alloc );
+        return -1;
+    }
+    if( x264_pthread_cond_init( &engine.cv, NULL ) )
+    {
+        x264_pthread_mutex_destroy( &engine.mutex );
+        free( alloc );
+        return -1;
+    }
+    x264_pthread_t reader;
+    int ret = -1;
+    if( x264_pthread_create( &reader, NULL, (void *)isom_remux_reader, &engine ) )
+        goto fail;
+
+    /* The starting area of mdat is backed up in the first buffer, so write moov + meta there instead. */
+    int error = isom_remux_wait_progress( &engine, &engine.blocks_read, 1 );
+    if( !error )
+        error = lsmash_fseek( stream, mdat->placeholder_pos, SEEK_SET )
+             || isom_write_moov( root )
+             || isom_write_meta( root->bs, root->meta )
+             || fflush( stream );
+    for( uint32_t i = 0; !error && i < engine.num_blocks; i++ )
+    {
+        error = isom_remux_wait_progress( &engine, &engine.blocks_read, LSMASH_MIN( i + 2, engine.num_blocks ) );
+        if( error )
+            break;
+        uint64_t size = i == engine.num_blocks - 1 ? engine.last_block_size : engine.block_size;
+        uint64_t write_pos = engine.src_pos + i * engine.block_size + mtf_size;
+        error = isom_pwrite( engine.fd, engine.buf[i % ISOM_REMUX_BUFFERS], size, write_pos );
+        isom_remux_set_progress( &engine, &engine.blocks_written, i + 1, error );
+        if( !error && remux->func )
+            remux->func( remux->param, i == engine.num_blocks - 1 ? total : write_pos + size, total );
+    }
+    x264_pthread_join( reader, NULL );
+    if( error || engine.error || lsmash_fseek( stream, 0, SEEK_END ) )
+        goto fail;
+
+    mdat->placeholder_pos += mtf_size; /* update placeholder */
+    ret = 0;
+fail:
+    x264_pthread_cond_destroy( &engine.cv );
+    x264_pthread_mutex_destroy( &engine.mutex );
+    free( alloc );
+    return ret;
+}
+#else
+static int isom_remux_serial( lsmash_root_t *root, lsmash_adhoc_remux_t *remux, uint64_t mtf_size )
+{
+    /* buffer size must be at least mtf_size * 2 */
+    remux->buffer_size = LSMASH_MAX( remux->buffer_size, mtf_size * 2 );
+
+    uint8_t* buf[2];
+    if( (buf[0] = (uint8_t*)malloc( remux->buffer_size )) == NULL )
+        return -1; /* NOTE: i think we still can fallback to "return isom_write_moov( root );" here. */
+    uint64_t size = remux->buffer_size / 2;
+    buf[1] = buf[0] + size; /* split to 2 buffers */
+
+    lsmash_bs_t *bs = root->bs;
+    FILE *stream = bs->stream;
+    isom_mdat_t *mdat = root->mdat;
+    uint64_t total = root->size + mtf_size;
+    uint64_t readnum;
+    /* backup starting area of mdat and write moov + meta there instead */
+    if( lsmash_fseek( stream, mdat->placeholder_pos, SEEK_SET ) )
+        goto fail;
+    readnum = fread( buf[0], 1, size, stream );
+    uint64_t read_pos = lsmash_ftell( stream );
+
+    /* write moov + meta there instead */
+    if( lsmash_fseek( stream, mdat->placeholder_pos, SEEK_SET )
+     || isom_write_moov( root )
+     || isom_write_meta( bs, root->meta ) )
+        goto fail;
+    uint64_t write_pos = lsmash_ftell( stream );
+
+    mdat->placeholder_pos += mtf_size; /* update placeholder */
+
+    /* copy-pastan */
+    int buf_switch = 1;
+    while( readnum == size )
+    {
+        if( lsmash_fseek( stream, read_pos, SEEK_SET ) )
+            goto fail;
+        readnum = fread( buf[buf_switch], 1, size, stream );
+        read_pos = lsmash_ftell( stream );
+
+        buf_switch ^= 0x1;
+
+        if( lsmash_fseek( stream, write_pos, SEEK_SET )
+         || fwrite( buf[buf_switch], 1, size, stream ) != size )
+            goto fail;
+        write_pos = lsmash_ftell( stream );
+        if( remux->func ) remux->func( remux->param, write_pos, total ); // FIXME:
+    }
+    if( fwrite( buf[buf_switch^0x1], 1, readnum, stream ) != readnum )
+        goto fail;
+    if( remux->func ) remux->func( remux->param, total, total ); // FIXME:
+
+    free( buf[0] );
+    return 0;
+
+fail:
+    free( buf[0] );
+    return -1;
+}
+#endif
+
 int lsmash_finish_movie( lsmash_root_t *root, lsmash_adhoc_remux_t* remux )
 {
     if( !root || !root->bs || !root->moov || !root->moov->trak_list )
@@ -5774,6 +6010,13 @@ int lsmash_finish_movie( lsmash_root_t *root, lsmash_adhoc_remux_t* remux )
 
     lsmash_bs_t *bs = root->bs;
     uint64_t meta_size = root->meta ? root->meta->size : 0;
+    if( root->moov_reserve )
+    {
+        /* The chunk offsets don't change since the media data stays where it is. */
+        int ret = isom_write_moov_into_reserve( root, moov->size + meta_size );
+        if( ret <= 0 )
+            return ret;
+    }
     if( !remux )
     {
         if( isom_write_moov( root )
@@ -5806,15 +6049,6 @@ int lsmash_finish_movie( lsmash_root_t *root, lsmash_adhoc_remux_t* remux )
     /* now the amount of offset is fixed. */
     uint64_t mtf_size = moov->size + meta_size;     /* sum of size of boxes moved to front */
 
-    /* buffer size must be at least mtf_size * 2 */
-    remux->buffer_size = LSMASH_MAX( remux->buffer_size, mtf_size * 2 );
-
-    uint8_t* buf[2];
-    if( (buf[0] = (uint8_t*)malloc( remux->buffer_size )) == NULL )
-        return -1; /* NOTE: i think we still can fallback to "return isom_write_moov( root );" here. */
-    uint64_t size = remux->buffer_size / 2;
-    buf[1] = buf[0] + size; /* split to 2 buffers */
-
     /* now the amount of offset is fixed. apply that to stco/co64 */
     for( lsmash_entry_t* entry = moov->trak_list->head; entry; entry = entry->next )
     {
@@ -5827,53 +6061,14 @@ int lsmash_finish_movie( lsmash_root_t *root, lsmash_adhoc_remux_t* remux )
                 ((isom_stco_entry_t*)stco_entry->data)->chunk_offset += mtf_size;
     }
 
-    FILE *stream = bs->stream;
-    isom_mdat_t *mdat = root->mdat;
-    uint64_t total = root->size + mtf_size;
-    uint64_t readnum;
-    /* backup starting area of mdat and write moov + meta there instead */
-    if( lsmash_fseek( stream, mdat->placeholder_pos, SEEK_SET ) )
-        goto fail;
-    readnum = fread( buf[0], 1, size, stream );
-    uint64_t read_pos = lsmash_ftell( stream );
-
-    /* write moov + meta there instead */
-    if( lsmash_fseek( stream, mdat->placeholder_pos, SEEK_SET )
-     || isom_write_moov( root )
-     || isom_write_meta( bs, root->meta ) )
-        goto fail;
-    uint64_t write_pos = lsmash_ftell( stream );
-
-    mdat->placeholder_pos += mtf_size; /* update placeholder */
-
-    /* copy-pastan */
-    int buf_switch = 1;
-    while( readnum == size )
-    {
-        if( lsmash_fseek( stream, read_pos, SEEK_SET ) )
-            goto fail;
-        readnum = fread( buf[buf_switch], 1, size, stream );
-        read_pos = lsmash_ftell( stream );
-
-        buf_switch ^= 0x1;
-
-        if( lsmash_fseek( stream, write_pos, SEEK_SET )
-         || fwrite( buf[buf_switch], 1, size, stream ) != size )
-            goto fail;
-        write_pos = lsmash_ftell( stream );
-        if( remux->func ) remux->func( remux->param, write_pos, total ); // FIXME:
-    }
-    if( fwrite( buf[buf_switch^0x1], 1, readnum, stream ) != readnum )
-        goto fail;
-    if( remux->func ) remux->func( remux->param, total, total ); // FIXME:
-
+#if ISOM_OVERLAPPED_REMUX
+    if( isom_remux_overlapped( root, remux, mtf_size ) )
+#else
+    if( isom_remux_serial( root, remux, mtf_size ) )
+#endif
+        return -1;
     root->size += mtf_size;
-    free( buf[0] );
     return 0;
-
-fail:
-    free( buf[0] );
-    return -1;
 }
 
 #define GET_MOST_USED( box_name, index, flag_name ) \
@@ -5967,9 +6162,8 @@ static int isom_output_fragment_media_data( lsmash_root_t *root )
     for( lsmash_entry_t* entry = fragment->pool->head; entry; entry = entry->next )
     {
         isom_sample_pool_t *pool = (isom_sample_pool_t *)entry->data;
-        if( !pool )
+        if( !pool || lsmash_bs_write_bytes( root->bs, pool->size, pool->data ) )
             return -1;
-        lsmash_bs_put_bytes( root->bs, pool->size, pool->data );
     }
     if( lsmash_bs_write_data( root->bs ) )
         return -1;
@@ -7227,8 +7421,7 @@ static int isom_write_pooled_samples( lsmash_root_t *root, isom_sample_pool_t *p
 {
     if( !root || !root->mdat || !root->bs || !root->bs->stream )
         return -1;
-    lsmash_bs_put_bytes( root->bs, pool->size, pool->data );
-    if( lsmash_bs_write_data( root->bs ) )
+    if( lsmash_bs_write_bytes( root->bs, pool->size, pool->data ) )
         return -1;
     root->mdat->size  += pool->size;
     root->size        += pool->size;
@@ -7325,7 +7518,6 @@ static int isom_pool_sample( isom_sample_pool_t *pool, lsmash_sample_t *sample )
     memcpy( pool->data + pool->size, sample->data, sample->length );
     pool->size = pool_size;
     pool->sample_count += 1;
-    lsmash_delete_sample( sample );
     return 0;
 }
 
@@ -7385,6 +7577,8 @@ static int isom_append_sample( lsmash_root_t *root, uint32_t track_ID, lsmash_sa
     /* If there is no available Media Data Box to write samples, add and write a new one before any chunk offset is decided. */
     if( !root->mdat )
     {
+        if( root->moov_reserve && isom_write_moov_reserve( root ) )
+            return -1;
         if( isom_new_mdat( root, 0 ) )
             return -1;
         /* Add the size of the Media Data Box and the placeholder. */
@@ -7400,26 +7594,18 @@ static int isom_append_sample( lsmash_root_t *root, uint32_t track_ID, lsmash_sa
             return isom_append_sample_internal( trak, sample );
         else if( sample->length < frame_size )
             return -1;
-        /* Append samples splitted into each LPCMFrame. */
-        uint64_t dts = sample->dts;
-        uint64_t cts = sample->cts;
+        /* Append samples splitted into each LPCMFrame.
+         * Each frame is a view into the data of the original sample; pooling copies it. */
+        lsmash_sample_t lpcm_sample = *sample;
+        lpcm_sample.length = frame_size;
         for( uint32_t offset = 0; offset < sample->length; offset += frame_size )
         {
-            lsmash_sample_t *lpcm_sample = lsmash_create_sample( frame_size );
-            if( !lpcm_sample )
-                return -1;
-            memcpy( lpcm_sample->data, sample->data + offset, frame_size );
-            lpcm_sample->dts = dts++;
-            lpcm_sample->cts = cts++;
-            lpcm_sample->prop = sample->prop;
-            lpcm_sample->index = sample->index;
-            if( isom_append_sample_internal( trak, lpcm_sample ) )
-            {
-                lsmash_delete_sample( lpcm_sample );
+            lpcm_sample.data = sample->data + offset;
+            if( isom_append_sample_internal( trak, &lpcm_sample ) )
                 return -1;
-            }
+            ++ lpcm_sample.dts;
+            ++ lpcm_sample.cts;
         }
-        lsmash_delete_sample( sample );
         return 0;
     }
     return isom_append_sample_internal( trak, sample );
@@ -7816,32 +8002,24 @@ static int isom_append_fragment_sample( lsmash_root_t *root, uint32_t track_ID,
             return append_sample_func( track_fragment, sample );
         else if( sample->length < frame_size )
             return -1;
-        /* Append samples splitted into each LPCMFrame. */
-        uint64_t dts = sample->dts;
-        uint64_t cts = sample->cts;
+        /* Append samples splitted into each LPCMFrame.
+         * Each frame is a view into the data of the original sample; pooling copies it. */
+        lsmash_sample_t lpcm_sample = *sample;
+        lpcm_sample.length = frame_size;
         for( uint32_t offset = 0; offset < sample->length; offset += frame_size )
         {
-            lsmash_sample_t *lpcm_sample = lsmash_create_sample( frame_size );
-            if( !lpcm_sample )
-                return -1;
-            memcpy( lpcm_sample->data, sample->data + offset, frame_size );
-            lpcm_sample->dts = dts++;
-            lpcm_sample->cts = cts++;
-            lpcm_sample->prop = sample->prop;
-            lpcm_sample->index = sample->index;
-            if( append_sample_func( track_fragment, lpcm_sample ) )
-            {
-                lsmash_delete_sample( lpcm_sample );
+            lpcm_sample.data = sample->data + offset;
+            if( append_sample_func( track_fragment, &lpcm_sample ) )
                 return -1;
-            }
+            ++ lpcm_sample.dts;
+            ++ lpcm_sample.cts;
         }
-        lsmash_delete_sample( sample );
         return 0;
     }
     return append_sample_func( track_fragment, sample );
 }
 
-int lsmash_append_sample( lsmash_root_t *root, uint32_t track_ID, lsmash_sample_t *sample )
+int lsmash_append_sample_external( lsmash_root_t *root, uint32_t track_ID, lsmash_sample_t *sample )
 {
     /* We think max_chunk_duration == 0, which means all samples will be cached on memory, should be prevented.
      * This means removal of a feature that we used to have, but anyway very alone chunk does not make sense. */
@@ -7856,6 +8034,14 @@ int lsmash_append_sample( lsmash_root_t *root, uint32_t track_ID, lsmash_sample_
     return isom_append_sample( root, track_ID, sample );
 }
 
+int lsmash_append_sample( lsmash_root_t *root, uint32_t track_ID, lsmash_sample_t *sample )
+{
+    if( lsmash_append_sample_external( root, track_ID, sample ) )
+        return -1;
+    lsmash_delete_sample( sample );
+    return 0;
+}
+
 /*---- misc functions ----*/
 
 int lsmash_delete_explicit_timeline_map( lsmash_root_t *root, uint32_t track_ID )
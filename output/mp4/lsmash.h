@@ -1179,9 +1179,17 @@ lsmash_sample_t *lsmash_create_sample( uint32_t size );
 int lsmash_sample_alloc( lsmash_sample_t *sample, uint32_t size );
 void lsmash_delete_sample( lsmash_sample_t *sample );
 int lsmash_append_sample( lsmash_root_t *root, uint32_t track_ID, lsmash_sample_t *sample );
+/* Same as lsmash_append_sample, except that the caller keeps the ownership of the sample and its data.
+ * The data is copied once into the chunk being built, so both can be reused as soon as this returns. */
+int lsmash_append_sample_external( lsmash_root_t *root, uint32_t track_ID, lsmash_sample_t *sample );
 int lsmash_flush_pooled_samples( lsmash_root_t *root, uint32_t track_ID, uint32_t last_sample_delta );
 int lsmash_update_track_duration( lsmash_root_t *root, uint32_t track_ID, uint32_t last_sample_delta );
 int lsmash_finish_movie( lsmash_root_t *root, lsmash_adhoc_remux_t* remux );
+/* Reserve 'size' bytes in front of the Media Data Box for the Movie Box.
+ * Must be called before the first sample is appended.
+ * If the Movie Box and the Meta Box fit into the reserved area when finishing the movie,
+ * they are written there and no moving of the media data is needed. */
+int lsmash_reserve_moov_space( lsmash_root_t *root, uint64_t size );
 void lsmash_destroy_root( lsmash_root_t *root );
 int lsmash_get_movie_parameters( lsmash_root_t *root, lsmash_movie_parameters_t *param );
 uint32_t lsmash_get_track_ID( lsmash_root_t *root, uint32_t track_number );
@@ -153,6 +153,24 @@ int lsmash_bs_write_data( lsmash_bs_t *bs )
     return 0;
 }
 
+/* Write a block straight to the stream without staging it in the buffer.
+ * Anything already stored on the buffer is written out first to keep the order. */
+int lsmash_bs_write_bytes( lsmash_bs_t *bs, uint64_t size, void *value )
+{
+    if( lsmash_bs_write_data( bs ) )
+        return -1;
+    if( !size || !value )
+        return 0;
+    if( bs->error || !bs->stream || fwrite( value, 1, size, bs->stream ) != size )
+    {
+        lsmash_bs_free( bs );
+        bs->error = 1;
+        return -1;
+    }
+    bs->written += size;
+    return 0;
+}
+
 lsmash_bs_t* lsmash_bs_create( char* filename )
 {
     lsmash_bs_t* bs = lsmash_malloc_zero( sizeof(lsmash_bs_t) );
@@ -501,6 +519,9 @@ void lsmash_init_entry_list( lsmash_entry_list_t *list )
     list->last_accessed_entry = NULL;
     list->last_accessed_number = 0;
     list->entry_count = 0;
+    list->data_size = 0;
+    list->pool = NULL;
+    list->free_slots = NULL;
 }
 
 lsmash_entry_list_t *lsmash_create_entry_list( void )
@@ -512,13 +533,69 @@ lsmash_entry_list_t *lsmash_create_entry_list( void )
     return list;
 }
 
-int lsmash_add_entry( lsmash_entry_list_t *list, void *data )
+lsmash_entry_list_t *lsmash_create_pooled_entry_list( uint32_t data_size )
 {
+    if( !data_size )
+        return NULL;
+    lsmash_entry_list_t *list = lsmash_create_entry_list();
     if( !list )
-        return -1;
-    lsmash_entry_t *entry = malloc( sizeof(lsmash_entry_t) );
-    if( !entry )
-        return -1;
+        return NULL;
+    list->data_size = data_size;
+    return list;
+}
+
+/* Keep inline data 8-byte aligned even where pointers are 4 bytes wide. */
+#define LSMASH_ENTRY_POOL_ALIGN( x )    (((x) + 7) & ~(size_t)7)
+#define LSMASH_ENTRY_POOL_HEADER_SIZE   LSMASH_ENTRY_POOL_ALIGN( sizeof(lsmash_entry_pool_t) )
+#define LSMASH_ENTRY_INLINE_DATA_OFFSET LSMASH_ENTRY_POOL_ALIGN( sizeof(lsmash_entry_t) )
+#define LSMASH_ENTRY_POOL_MIN_SLOTS     256
+#define LSMASH_ENTRY_POOL_MAX_SLOTS     65536
+
+static inline int lsmash_entry_has_inline_data( lsmash_entry_list_t *list, lsmash_entry_t *entry )
+{
+    return list->data_size && entry->data == (uint8_t *)entry + LSMASH_ENTRY_INLINE_DATA_OFFSET;
+}
+
+static lsmash_entry_t *lsmash_alloc_entry( lsmash_entry_list_t *list )
+{
+    if( !list->data_size )
+        return malloc( sizeof(lsmash_entry_t) );
+    lsmash_entry_t *entry = list->free_slots;
+    if( entry )
+    {
+        list->free_slots = entry->next;
+        return entry;
+    }
+    size_t slot_size = LSMASH_ENTRY_INLINE_DATA_OFFSET + LSMASH_ENTRY_POOL_ALIGN( list->data_size );
+    lsmash_entry_pool_t *pool = list->pool;
+    if( !pool || pool->used == pool->capacity )
+    {
+        /* Grow geometrically so that short tables stay small and long ones need few allocations. */
+        uint32_t capacity = pool ? LSMASH_MIN( pool->capacity * 2, LSMASH_ENTRY_POOL_MAX_SLOTS ) : LSMASH_ENTRY_POOL_MIN_SLOTS;
+        lsmash_entry_pool_t *new_pool = malloc( LSMASH_ENTRY_POOL_HEADER_SIZE + capacity * slot_size );
+        if( !new_pool )
+            return NULL;
+        new_pool->next     = pool;
+        new_pool->capacity = capacity;
+        new_pool->used     = 0;
+        list->pool = pool = new_pool;
+    }
+    return (lsmash_entry_t *)((uint8_t *)pool + LSMASH_ENTRY_POOL_HEADER_SIZE + pool->used++ * slot_size);
+}
+
+static void lsmash_free_entry( lsmash_entry_list_t *list, lsmash_entry_t *entry )
+{
+    if( !list->data_size )
+    {
+        free( entry );
+        return;
+    }
+    entry->next = list->free_slots;
+    list->free_slots = entry;
+}
+
+static void lsmash_link_entry( lsmash_entry_list_t *list, lsmash_entry_t *entry, void *data )
+{
     entry->next = NULL;
     entry->prev = list->tail;
     entry->data = data;
@@ -528,9 +605,34 @@ int lsmash_add_entry( lsmash_entry_list_t *list, void *data )
         list->head = entry;
     list->tail = entry;
     list->entry_count += 1;
+}
+
+int lsmash_add_entry( lsmash_entry_list_t *list, void *data )
+{
+    if( !list )
+        return -1;
+    lsmash_entry_t *entry = lsmash_alloc_entry( list );
+    if( !entry )
+        return -1;
+    lsmash_link_entry( list, entry, data );
     return 0;
 }
 
+/* Append an entry whose data lives in the slot itself and return the zero-cleared data.
+ * The data is released together with the slot, so it must not be freed by the caller or an eliminator. */
+void *lsmash_add_pooled_entry( lsmash_entry_list_t *list )
+{
+    if( !list || !list->data_size )
+        return NULL;
+    lsmash_entry_t *entry = lsmash_alloc_entry( list );
+    if( !entry )
+        return NULL;
+    void *data = (uint8_t *)entry + LSMASH_ENTRY_INLINE_DATA_OFFSET;
+    memset( data, 0, list->data_size );
+    lsmash_link_entry( list, entry, data );
+    return data;
+}
+
 int lsmash_remove_entry_direct( lsmash_entry_list_t *list, lsmash_entry_t *entry, void* eliminator )
 {
     if( !entry )
@@ -547,7 +649,7 @@ int lsmash_remove_entry_direct( lsmash_entry_list_t *list, lsmash_entry_t *entry
         list->tail = prev;
     else
         next->prev = prev;
-    if( entry->data )
+    if( entry->data && !lsmash_entry_has_inline_data( list, entry ) )
         ((lsmash_entry_data_eliminator)eliminator)( entry->data );
     if( entry == list->last_accessed_entry )
     {
@@ -571,7 +673,7 @@ int lsmash_remove_entry_direct( lsmash_entry_list_t *list, lsmash_entry_t *entry
         list->last_accessed_entry = NULL;
         list->last_accessed_number = 0;
     }
-    free( entry );
+    lsmash_free_entry( list, entry );
     list->entry_count -= 1;
     return 0;
 }
@@ -591,12 +693,21 @@ void lsmash_remove_entries( lsmash_entry_list_t *list, void* eliminator )
     for( lsmash_entry_t *entry = list->head; entry; )
     {
         lsmash_entry_t *next = entry->next;
-        if( entry->data )
+        if( entry->data && !lsmash_entry_has_inline_data( list, entry ) )
             ((lsmash_entry_data_eliminator)eliminator)( entry->data );
-        free( entry );
+        if( !list->data_size )
+            free( entry );
         entry = next;
     }
+    for( lsmash_entry_pool_t *pool = list->pool; pool; )
+    {
+        lsmash_entry_pool_t *next = pool->next;
+        free( pool );
+        pool = next;
+    }
+    uint32_t data_size = list->data_size;
     lsmash_init_entry_list( list );
+    list->data_size = data_size;
 }
 
 void lsmash_remove_list( lsmash_entry_list_t *list, void* eliminator )
@@ -60,6 +60,7 @@ void lsmash_bs_put_be16_from_64( lsmash_bs_t *bs, uint64_t value );
 void lsmash_bs_put_be24_from_64( lsmash_bs_t *bs, uint64_t value );
 void lsmash_bs_put_be32_from_64( lsmash_bs_t *bs, uint64_t value );
 int lsmash_bs_write_data( lsmash_bs_t *bs );
+int lsmash_bs_write_bytes( lsmash_bs_t *bs, uint64_t size, void *value );
 void *lsmash_bs_export_data( lsmash_bs_t *bs, uint32_t* length );
 
 /*---- bytestream reader ----*/
@@ -110,6 +111,18 @@ struct lsmash_entry_tag
     void *data;
 };
 
+/* Chunk of entry slots for pooled lists.
+ * Each slot is an lsmash_entry_t immediately followed by its data, so appending to a pooled list
+ * costs no allocation in the common case and the entries of a table stay close to each other in memory. */
+typedef struct lsmash_entry_pool_tag lsmash_entry_pool_t;
+
+struct lsmash_entry_pool_tag
+{
+    lsmash_entry_pool_t *next;      /* previously filled chunk */
+    uint32_t capacity;              /* the number of slots in this chunk */
+    uint32_t used;                  /* the number of slots handed out from this chunk */
+};
+
 typedef struct
 {
     lsmash_entry_t *head;
@@ -117,13 +130,18 @@ typedef struct
     lsmash_entry_t *last_accessed_entry;
     uint32_t last_accessed_number;
     uint32_t entry_count;
+    uint32_t data_size;             /* size of the data stored inline in each slot; 0 for ordinary lists */
+    lsmash_entry_pool_t *pool;      /* the chunk currently being filled */
+    lsmash_entry_t *free_slots;     /* slots released by lsmash_remove_entry*() for reuse */
 } lsmash_entry_list_t;
 
 typedef void (*lsmash_entry_data_eliminator)(void* data); /* very same as free() of standard c lib; void free(void *); */
 
 void lsmash_init_entry_list( lsmash_entry_list_t *list );
 lsmash_entry_list_t *lsmash_create_entry_list( void );
+lsmash_entry_list_t *lsmash_create_pooled_entry_list( uint32_t data_size );
 int lsmash_add_entry( lsmash_entry_list_t *list, void *data );
+void *lsmash_add_pooled_entry( lsmash_entry_list_t *list );
 int lsmash_remove_entry_direct( lsmash_entry_list_t *list, lsmash_entry_t *entry, void* eliminator );
 int lsmash_remove_entry( lsmash_entry_list_t *list, uint32_t entry_number, void* eliminator );
 void lsmash_remove_entries( lsmash_entry_list_t *list, void* eliminator );
@@ -164,6 +164,7 @@ static void print_bench(void)
             if( k < j )
                 continue;
             printf( "%s_%s%s: %"PRId64"\n", benchs[i].name,
+                    b->cpu&X264_CPU_AVX512 ? "avx512" :
                     b->cpu&X264_CPU_AVX2 && b->cpu&X264_CPU_FMA3 ? "avx2_fma3" :
                     b->cpu&X264_CPU_AVX2 ? "avx2" :
                     b->cpu&X264_CPU_FMA3 ? "fma3" :
@@ -1524,6 +1525,58 @@ static int check_mc( int cpu_ref, int cpu_new )
         report( "mbtree propagate :" );
     }
 
+    if( mc_a.mbtree_propagate_list != mc_ref.mbtree_propagate_list )
+    {
+        ALIGNED_16( uint16_t ref_costsc[28*50] );
+        ALIGNED_16( uint16_t ref_costsa[28*50] );
+        ALIGNED_16( int16_t mvs[50][2] );
+        ALIGNED_16( int propagate_amount[56] );
+        ALIGNED_16( uint16_t lowres_costs[56] );
+        ALIGNED_16( int16_t output[56*6] );
+        x264_t h_buf;
+        x264_t *h = &h_buf;
+        memset( h, 0, sizeof(*h) );
+        h->scratch_buffer2 = output;
+        int bipred_weight = 32;
+        ok = 1; used_asm = 1;
+        set_func_name( "mbtree_propagate_list" );
+        for( int i = 0; i < 8 && ok; i++ )
+        {
+            /* odd widths exercise the remainder of the row */
+            h->mb.i_mb_width = h->mb.i_mb_stride = 43 + i;
+            h->mb.i_mb_height = 28;
+            bipred_weight = rand()%65;
+            for( int j = 0; j < 28*50; j++ )
+                ref_costsc[j] = ref_costsa[j] = rand()&1 ? 0xff00 + (rand()&0xff) : rand()&0x7fff;
+            for( int mb_y = 0; mb_y < h->mb.i_mb_height && ok; mb_y++ )
+            {
+                for( int j = 0; j < h->mb.i_mb_width; j++ )
+                {
+                    int mv_range = rand()&1 ? 32*4 : 32*64;
+                    mvs[j][0] = rand()&3 ? rand()%(2*mv_range+1) - mv_range : 0;
+                    mvs[j][1] = rand()&3 ? rand()%(2*mv_range+1) - mv_range : 0;
+                    propagate_amount[j] = rand()&7 ? rand()&((1<<(rand()%21))-1) : -(rand()&0xff);
+                    lowres_costs[j] = rand()&0xffff;
+                }
+                int list = mb_y&1;
+                call_c1( mc_c.mbtree_propagate_list, h, ref_costsc, mvs, propagate_amount, lowres_costs,
+                         bipred_weight, mb_y, h->mb.i_mb_width, list );
+                call_a1( mc_a.mbtree_propagate_list, h, ref_costsa, mvs, propagate_amount, lowres_costs,
+                         bipred_weight, mb_y, h->mb.i_mb_width, list );
+                if( memcmp( ref_costsc, ref_costsa, sizeof(ref_costsc) ) )
+                {
+                    ok = 0;
+                    fprintf( stderr, "mbtree_propagate_list FAILED: width=%d mb_y=%d list=%d\n", h->mb.i_mb_width, mb_y, list );
+                }
+            }
+        }
+        call_c2( mc_c.mbtree_propagate_list, h, ref_costsc, mvs, propagate_amount, lowres_costs,
+                 bipred_weight, 27, h->mb.i_mb_width, 0 );
+        call_a2( mc_a.mbtree_propagate_list, h, ref_costsa, mvs, propagate_amount, lowres_costs,
+                 bipred_weight, 27, h->mb.i_mb_width, 0 );
+        report( "mbtree propagate list :" );
+    }
+
     if( mc_a.memcpy_aligned != mc_ref.memcpy_aligned )
     {
         set_func_name( "memcpy_aligned" );
@@ -1630,6 +1683,32 @@ static int check_deblock( int cpu_ref, int cpu_new )
     TEST_DEBLOCK( deblock_chroma_422_intra_mbaff, 0 );
     TEST_DEBLOCK( deblock_chroma_intra[1], 1 );
 
+    /* 4:4:4 chroma versions of the luma filter, checked against the C luma filter on each plane */
+    for( int dir = 0; dir < 2; dir++ )
+    {
+        if( db_a.deblock_chroma_444[dir] == db_ref.deblock_chroma_444[dir] )
+            continue;
+        set_func_name( "deblock_chroma_444[%d]", dir );
+        used_asm = 1;
+        for( int i = 0; i < 36; i++ )
+        {
+            intptr_t off = 8*32 + (i&15)*4*!dir;
+            for( int j = 0; j < 2048; j++ )
+                pbuf3[j] = rand() & (i&1 ? 0xf : PIXEL_MAX );
+            memcpy( pbuf4, pbuf3, 2048 * sizeof(pixel) );
+            call_c1( db_c.deblock_luma[dir], pbuf3+off, (intptr_t)32, alphas[i], betas[i], tcs[i] );
+            call_c1( db_c.deblock_luma[dir], pbuf3+off+1024, (intptr_t)32, alphas[i], betas[i], tcs[i] );
+            call_a1( db_a.deblock_chroma_444[dir], pbuf4+off, pbuf4+off+1024, (intptr_t)32, alphas[i], betas[i], tcs[i] );
+            if( memcmp( pbuf3, pbuf4, 2048 * sizeof(pixel) ) )
+            {
+                ok = 0;
+                fprintf( stderr, "deblock_chroma_444[%d](a=%d, b=%d): [FAILED]\n", dir, alphas[i], betas[i] );
+                break;
+            }
+            call_a2( db_a.deblock_chroma_444[dir], pbuf4+off, pbuf4+off+1024, (intptr_t)32, alphas[i], betas[i], tcs[i] );
+        }
+    }
+
     if( db_a.deblock_strength != db_ref.deblock_strength )
     {
         for( int i = 0; i < 100; i++ )
@@ -1808,6 +1887,38 @@ static int check_quant( int cpu_ref, int cpu_new )
         TEST_QUANT_DC( quant_4x4_dc, **h->quant4_mf[CQM_4IY] );
         TEST_QUANT_DC( quant_2x2_dc, **h->quant4_mf[CQM_4IC] );
 
+#define TEST_QUANT_4x4x4( block ) \
+        if( qf_a.quant_4x4x4 != qf_ref.quant_4x4x4 ) \
+        { \
+            set_func_name( "quant_4x4x4" ); \
+            used_asms[0] = 1; \
+            for( int qp = h->param.rc.i_qp_max; qp >= h->param.rc.i_qp_min; qp-- ) \
+            { \
+                /* every combination of zero and nonzero blocks */ \
+                for( int j = 0; j < 16; j++ ) \
+                { \
+                    for( int k = 0; k < 4; k++ ) \
+                    { \
+                        INIT_QUANT4( (j>>k)&1 ) \
+                        memcpy( dct3[k], dct1, 16*sizeof(dctcoef) ); \
+                        memcpy( dct4[k], dct1, 16*sizeof(dctcoef) ); \
+                    } \
+                    int result_c = call_c1( qf_c.quant_4x4x4, dct3, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                    int result_a = call_a1( qf_a.quant_4x4x4, dct4, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                    if( memcmp( dct3, dct4, 4*16*sizeof(dctcoef) ) || result_c != result_a ) \
+                    { \
+                        oks[0] = 0; \
+                        fprintf( stderr, "quant_4x4x4(qp=%d, cqm=%d, block="#block", mask=%x): [FAILED]\n", qp, i_cqm, j ); \
+                        break; \
+                    } \
+                    call_c2( qf_c.quant_4x4x4, dct3, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                    call_a2( qf_a.quant_4x4x4, dct4, h->quant4_mf[block][qp], h->quant4_bias[block][qp] ); \
+                } \
+            } \
+        }
+
+        TEST_QUANT_4x4x4( CQM_4PY );
+
 #define TEST_DEQUANT( qname, dqname, block, w ) \
         if( qf_a.dqname != qf_ref.dqname ) \
         { \
@@ -2461,12 +2572,21 @@ static int check_all_flags( void )
         cpu1 &= ~X264_CPU_BMI1;
     }
     if( x264_cpu_detect() & X264_CPU_AVX2 )
+    {
         ret |= add_flags( &cpu0, &cpu1, X264_CPU_AVX2, "AVX2" );
+        if( x264_cpu_detect() & X264_CPU_LZCNT )
+        {
+            ret |= add_flags( &cpu0, &cpu1, X264_CPU_LZCNT, "AVX2_LZCNT" );
+            cpu1 &= ~X264_CPU_LZCNT;
+        }
+    }
     if( x264_cpu_detect() & X264_CPU_FMA3 )
     {
         ret |= add_flags( &cpu0, &cpu1, X264_CPU_FMA3, "FMA3" );
         cpu1 &= ~X264_CPU_FMA3;
     }
+    if( x264_cpu_detect() & X264_CPU_AVX512 )
+        ret |= add_flags( &cpu0, &cpu1, X264_CPU_FMA3 | X264_CPU_AVX512, "AVX512" );
 #elif ARCH_PPC
     if( x264_cpu_detect() & X264_CPU_ALTIVEC )
     {
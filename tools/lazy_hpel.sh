@@ -0,0 +1,44 @@
+#!/bin/bash
+# Measures what --lazy-hpel saves on a clip: for each preset, the user CPU time
+# of encodes with eager and with lazy half-pel planes, and the share of
+# reference rows the lazy mode filtered.  The half-pel planes of the other rows
+# are neither computed nor written, so that share is also what remains of the
+# filter's memory traffic.
+#
+# Usage: tools/lazy_hpel.sh <x264 binary> <input> [x264 options]
+#   e.g. tools/lazy_hpel.sh ./x264 foreman_cif.y4m --threads 1
+# The options are passed to every encode.  PRESETS sets the presets (default
+# ultrafast to fast) and RUNS the number of runs, of which the fastest is kept
+# (default 3).
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <x264 binary> <input> [x264 options]" >&2
+    exit 1
+fi
+X264=$1
+INPUT=$2
+shift 2
+OPTS=("$@")
+PRESETS=${PRESETS:-ultrafast superfast veryfast faster fast}
+RUNS=${RUNS:-3}
+TIMEFORMAT=%U
+
+# prints "<fastest user seconds> <filtered share>" of RUNS encodes
+encode() {
+    best=
+    for (( run = 0; run < RUNS; run++ )); do
+        t=$( { time "$X264" --no-progress "${OPTS[@]}" "$@" -o /dev/null "$INPUT" 2> /tmp/lazy_hpel.$$ ; } 2>&1 )
+        best=$(awk -v t=$t -v b=$best 'BEGIN { print b == "" || t < b ? t : b }')
+    done
+    share=$(awk '/lazy hpel: filtered/ { sub( /.*filtered /, "" ); print $1 }' /tmp/lazy_hpel.$$)
+    rm -f /tmp/lazy_hpel.$$
+    echo $best ${share:--}
+}
+
+printf "%-10s %9s %9s %7s %9s\n" preset "eager s" "lazy s" saved filtered
+for preset in $PRESETS; do
+    eager=($(encode --preset $preset))
+    lazy=($(encode --preset $preset --lazy-hpel))
+    saved=$(awk -v e=${eager[0]} -v l=${lazy[0]} 'BEGIN { printf "%.1f%%", 100 * (e - l) / e }')
+    printf "%-10s %9s %9s %7s %9s\n" $preset ${eager[0]} ${lazy[0]} $saved ${lazy[1]}
+done
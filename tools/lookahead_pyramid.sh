@@ -0,0 +1,36 @@
+#!/bin/bash
+# Measures what --lookahead-pyramid costs in quality and gains in speed on a clip:
+# for each level, bitrate and global PSNR at constant quality, global PSNR at a
+# fixed bitrate, and the time spent in the lookahead.
+#
+# Usage: tools/lookahead_pyramid.sh <x264 binary> <input> [x264 options]
+#   e.g. tools/lookahead_pyramid.sh ./x264 foreman_cif.y4m --preset medium
+# The options are passed to every encode; CRF and BITRATE set the rate control
+# (default 23 and 500 kb/s).
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <x264 binary> <input> [x264 options]" >&2
+    exit 1
+fi
+X264=$1
+INPUT=$2
+shift 2
+OPTS=("$@")
+CRF=${CRF:-23}
+BITRATE=${BITRATE:-500}
+
+# prints "<kb/s> <global PSNR> <lookahead busy seconds>" of an encode
+encode() {
+    "$X264" --no-progress --psnr "${OPTS[@]}" "$@" -o /dev/null "$INPUT" 2>&1 | awk '
+        /^encoded /        { for( i = 1; i <= NF; i++ ) if( $i == "kb/s" ) kbps = $(i-1) }
+        /PSNR Mean/        { sub( /.*Global:/, "" ); psnr = $1 }
+        /lookahead: busy / { sub( /.*busy /, "" ); sub( /s .*/, "" ); busy = $0 }
+        END                { print kbps, psnr, busy }'
+}
+
+printf "%-5s %9s %9s %9s %9s %9s\n" level "crf kb/s" "crf PSNR" "crf la s" "abr PSNR" "abr la s"
+for level in 0 1 2; do
+    crf=($(encode --lookahead-pyramid $level --crf $CRF))
+    abr=($(encode --lookahead-pyramid $level --bitrate $BITRATE))
+    printf "%-5s %9s %9s %9s %9s %9s\n" $level ${crf[0]} ${crf[1]} ${crf[2]} ${abr[1]} ${abr[2]}
+done
@@ -0,0 +1,111 @@
+/*****************************************************************************
+ * mp4_entry_list_bench.c: benchmark of the mp4 muxer's sample table lists
+ *****************************************************************************
+ * Copyright (C) 2026 x264 project
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02111, USA.
+ *****************************************************************************/
+
+/* Appends <samples> 8-byte entries to each of 4 tables, as the stts/ctts/stsz/sdtp
+ * tables grow during muxing, walks them, then frees them, and reports the time of
+ * each step and the peak RSS.  "plain" uses ordinary lists with one allocation per
+ * entry, "pooled" the chunked lists the sample tables are created with.
+ * Run each mode in its own process so that the peak RSS is not shared.
+ *
+ * Build from the top of the source tree, after configure:
+ *   gcc -O2 -I. -Ioutput/mp4 tools/mp4_entry_list_bench.c output/mp4/utils.c -o mp4_entry_list_bench
+ * Usage:
+ *   ./mp4_entry_list_bench <plain|pooled> <samples> */
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "utils.h"
+
+#define TABLES 4
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t value;
+} entry_t;
+
+static double now( void )
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main( int argc, char **argv )
+{
+    if( argc < 3 || (strcmp( argv[1], "plain" ) && strcmp( argv[1], "pooled" )) )
+    {
+        fprintf( stderr, "usage: %s <plain|pooled> <samples>\n", argv[0] );
+        return 1;
+    }
+    int pooled = !strcmp( argv[1], "pooled" );
+    uint32_t samples = strtoul( argv[2], NULL, 10 );
+    lsmash_entry_list_t *list[TABLES];
+
+    double t0 = now();
+    for( int t = 0; t < TABLES; t++ )
+    {
+        list[t] = pooled ? lsmash_create_pooled_entry_list( sizeof(entry_t) ) : lsmash_create_entry_list();
+        if( !list[t] )
+            return 1;
+    }
+    for( uint32_t i = 0; i < samples; i++ )
+        for( int t = 0; t < TABLES; t++ )
+        {
+            entry_t *data;
+            if( pooled )
+                data = lsmash_add_pooled_entry( list[t] );
+            else
+            {
+                data = malloc( sizeof(entry_t) );
+                if( data && lsmash_add_entry( list[t], data ) )
+                {
+                    free( data );
+                    data = NULL;
+                }
+            }
+            if( !data )
+                return 1;
+            data->count = 1;
+            data->value = i;
+        }
+
+    double t1 = now();
+    uint64_t sum = 0;
+    for( int t = 0; t < TABLES; t++ )
+        for( lsmash_entry_t *entry = list[t]->head; entry; entry = entry->next )
+            sum += ((entry_t *)entry->data)->value;
+
+    double t2 = now();
+    for( int t = 0; t < TABLES; t++ )
+        lsmash_remove_list( list[t], NULL );
+
+    double t3 = now();
+    struct rusage ru;
+    getrusage( RUSAGE_SELF, &ru );
+    printf( "%s %u samples: add %.3fs, walk %.3fs, free %.3fs, peak RSS %ldMB (checksum %"PRIu64")\n",
+            argv[1], samples, t1 - t0, t2 - t1, t3 - t2, ru.ru_maxrss >> 10, sum );
+    return 0;
+}
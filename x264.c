@@ -83,6 +83,12 @@ typedef struct {
     FILE *tcfile_out;
     double timebase_convert_multiplier;
     int i_pulldown;
+    /* kept for chunked encoding, which reopens the input once per chunk */
+    char *input_filename;
+    int b_chunk_input;
+    cli_input_t chunk_input;
+    cli_input_opt_t input_opt;
+    video_info_t input_info;
 } cli_opt_t;
 
 /* file i/o operation structs */
@@ -643,6 +649,8 @@ static void help( x264_param_t *defaults, int longhelp )
     H0( "  -B, --bitrate <integer>     Set bitrate (kbit/s)\n" );
     H0( "      --crf <float>           Quality-based VBR (%d-51) [%.1f]\n", 51 - QP_MAX_SPEC, defaults->rc.f_rf_constant );
     H1( "      --rc-lookahead <integer> Number of frames for frametype lookahead [%d]\n", defaults->rc.i_lookahead );
+    H2( "      --lookahead-pyramid <integer> Search lookahead motion at 1/2^(n+1) resolution [%d]\n"
+        "                                  Speeds up the lookahead, its costs stay at 1/2\n", defaults->rc.i_lookahead_pyramid );
     H0( "      --vbv-maxrate <integer> Max local bitrate (kbit/s) [%d]\n", defaults->rc.i_vbv_max_bitrate );
     H0( "      --vbv-bufsize <integer> Set size of the VBV buffer (kbit) [%d]\n", defaults->rc.i_vbv_buffer_size );
     H2( "      --vbv-init <float>      Initial VBV buffer occupancy [%.1f]\n", defaults->rc.f_vbv_buffer_init );
@@ -667,6 +675,12 @@ static void help( x264_param_t *defaults, int longhelp )
         "                                  - 2: Last pass, does not overwrite stats file\n" );
     H2( "                                  - 3: Nth pass, overwrites stats file\n" );
     H1( "      --stats <string>        Filename for 2 pass stats [\"%s\"]\n", defaults->rc.psz_stat_out );
+    H2( "      --stats-binary          Write 1st pass stats in binary format and\n"
+        "                                  MB-tree stats compressed and indexed\n" );
+    H2( "      --chunks <integer>      Split the last pass into N segments at IDR frames\n"
+        "                              and encode them in parallel [%d]\n"
+        "                                  Requires binary 1st pass stats\n"
+        "                                  and a raw or y4m input file\n", defaults->rc.i_chunks );
     H2( "      --no-mbtree             Disable mb-tree ratecontrol.\n");
     H2( "      --qcomp <float>         QP curve compression [%.2f]\n", defaults->rc.f_qcompress );
     H2( "      --cplxblur <float>      Reduce fluctuations in QP (before curve compression) [%.1f]\n", defaults->rc.f_complexity_blur );
@@ -720,6 +734,8 @@ static void help( x264_param_t *defaults, int longhelp )
         "                                  - 10: QP-RD - requires trellis=2, aq-mode>0\n"
         "                                  - 11: Full RD: disable all early terminations\n" );
     else H1( "                                  decision quality: 1=fast, 11=best\n" );
+    H2( "      --lazy-hpel             Filter the half-pel planes of references on demand\n"
+        "                                  Experimental, no measured speedup with asm\n" );
     H1( "      --psy-rd <float:float>  Strength of psychovisual optimization [\"%.1f:%.1f\"]\n"
         "                                  #1: RD (requires subme>=6)\n"
         "                                  #2: Trellis (requires trellis, experimental)\n",
@@ -852,14 +868,19 @@ static void help( x264_param_t *defaults, int longhelp )
     H2( "      --lookahead-threads <integer> Force a specific number of lookahead threads\n" );
     H2( "      --sliced-threads        Low-latency but lower-efficiency threading\n" );
     H2( "      --thread-input          Run Avisynth in its own thread\n" );
+    H2( "      --thread-input-depth <integer> Frames read ahead by threaded input [4]\n" );
     H2( "      --sync-lookahead <integer> Number of buffer frames for threaded lookahead\n" );
+    H2( "      --frame-pool <integer>  Share frame buffers with other encoders in the process,\n"
+        "                                  keeping up to <integer> MiB of idle buffers\n" );
     H2( "      --non-deterministic     Slightly improve quality of SMP, at the cost of repeatability\n" );
     H2( "      --cpu-independent       Ensure exact reproducibility across different cpus,\n"
         "                                  as opposed to letting them select different algorithms\n" );
     H2( "      --asm <integer>         Override CPU detection\n" );
     H2( "      --no-asm                Disable all CPU optimizations\n" );
+    H2( "      --asm-max <string>      Cap the SIMD tier used (e.g. \"AVX2\" to avoid AVX-512)\n" );
     H2( "      --visualize             Show MB types overlayed on the encoded video\n" );
     H2( "      --dump-yuv <string>     Save reconstructed frames\n" );
+    H2( "      --trace <string>        Save per-stage timings as a Chrome trace (JSON)\n" );
     H2( "      --sps-id <integer>      Set SPS and PPS id numbers [%d]\n", defaults->i_sps_id );
     H2( "      --aud                   Use access unit delimiters\n" );
     H2( "      --force-cfr             Force constant framerate timestamp generation\n" );
@@ -876,6 +897,9 @@ static void help( x264_param_t *defaults, int longhelp )
     H2( "      --language <string>     Set the language by ISO639-2/T language codes\n" );
     H2( "      --no-container-sar      Disable sample aspect ratio within the container\n" );
     H2( "      --no-remux              Inhibit auto-remuxing for progressive download\n" );
+    H2( "      --reserve-moov          Reserve space for the movie box in front of the media data\n"
+        "                                  estimated from the number of frames, so that\n"
+        "                                  no remuxing is needed if it is large enough\n" );
     H2( "      --force-display-size    Force display region size for video\n" );
     H2( "      --fragments             Enable movie fragments structure\n" );
     H2( "      --priming <integer>     Specify the number of priming samples for the copied audio\n" );
@@ -898,6 +922,7 @@ typedef enum
     OPT_SEEK,
     OPT_QPFILE,
     OPT_THREAD_INPUT,
+    OPT_THREAD_INPUT_DEPTH,
     OPT_QUIET,
     OPT_NOPROGRESS,
     OPT_VISUALIZE,
@@ -939,6 +964,7 @@ typedef enum
     OPT_LANGUAGE,
     OPT_NO_CONTAINER_SAR,
     OPT_NO_REMUX,
+    OPT_RESERVE_MOOV,
     OPT_FORCE_DISPLAY_SIZE,
     OPT_FRAGMENTS,
     OPT_PRIMING
@@ -985,9 +1011,11 @@ static struct option long_options[] =
     { "qpstep",      required_argument, NULL, 0 },
     { "crf",         required_argument, NULL, 0 },
     { "rc-lookahead",required_argument, NULL, 0 },
+    { "lookahead-pyramid", required_argument, NULL, 0 },
     { "ref",         required_argument, NULL, 'r' },
     { "asm",         required_argument, NULL, 0 },
     { "no-asm",            no_argument, NULL, 0 },
+    { "asm-max",     required_argument, NULL, 0 },
     { "sar",         required_argument, NULL, 0 },
     { "fps",         required_argument, NULL, OPT_FPS },
     { "frames",      required_argument, NULL, OPT_FRAMES },
@@ -1009,6 +1037,7 @@ static struct option long_options[] =
     { "mvrange",     required_argument, NULL, 0 },
     { "mvrange-thread", required_argument, NULL, 0 },
     { "subme",       required_argument, NULL, 'm' },
+    { "lazy-hpel",         no_argument, NULL, 0 },
     { "psy-rd",      required_argument, NULL, 0 },
     { "no-psy",            no_argument, NULL, 0 },
     { "psy",               no_argument, NULL, 0 },
@@ -1036,6 +1065,8 @@ static struct option long_options[] =
     { "chroma-qp-offset", required_argument, NULL, 0 },
     { "pass",        required_argument, NULL, 'p' },
     { "stats",       required_argument, NULL, 0 },
+    { "stats-binary",      no_argument, NULL, 0 },
+    { "chunks",      required_argument, NULL, 0 },
     { "qcomp",       required_argument, NULL, 0 },
     { "mbtree",            no_argument, NULL, 0 },
     { "no-mbtree",         no_argument, NULL, 0 },
@@ -1051,7 +1082,9 @@ static struct option long_options[] =
     { "slice-max-mbs",     required_argument, NULL, 0 },
     { "slices",            required_argument, NULL, 0 },
     { "thread-input",      no_argument, NULL, OPT_THREAD_INPUT },
+    { "thread-input-depth", required_argument, NULL, OPT_THREAD_INPUT_DEPTH },
     { "sync-lookahead",    required_argument, NULL, 0 },
+    { "frame-pool",  required_argument, NULL, 0 },
     { "non-deterministic", no_argument, NULL, 0 },
     { "cpu-independent",   no_argument, NULL, 0 },
     { "psnr",              no_argument, NULL, 0 },
@@ -1062,6 +1095,7 @@ static struct option long_options[] =
     { "no-progress",       no_argument, NULL, OPT_NOPROGRESS },
     { "visualize",         no_argument, NULL, OPT_VISUALIZE },
     { "dump-yuv",    required_argument, NULL, 0 },
+    { "trace",       required_argument, NULL, 0 },
     { "sps-id",      required_argument, NULL, 0 },
     { "aud",               no_argument, NULL, 0 },
     { "nr",          required_argument, NULL, 0 },
@@ -1116,6 +1150,7 @@ static struct option long_options[] =
     { "language",    required_argument, NULL, OPT_LANGUAGE },
     { "no-container-sar",  no_argument, NULL, OPT_NO_CONTAINER_SAR },
     { "no-remux",    no_argument, NULL, OPT_NO_REMUX },
+    { "reserve-moov", no_argument, NULL, OPT_RESERVE_MOOV },
     { "force-display-size", required_argument, NULL, OPT_FORCE_DISPLAY_SIZE },
     { "fragments",         no_argument, NULL, OPT_FRAGMENTS },
     { "priming",     required_argument, NULL, OPT_PRIMING },
@@ -1398,6 +1433,7 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
     memset( &input_opt, 0, sizeof(cli_input_opt_t) );
     memset( &output_opt, 0, sizeof(cli_output_opt_t) );
     input_opt.bit_depth = 8;
+    input_opt.thread_depth = 4;
     input_opt.input_range = input_opt.output_range = param->vui.b_fullrange = RANGE_AUTO;
     int output_csp = defaults.i_csp;
     opt->b_progress = 1;
@@ -1480,6 +1516,9 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
             case OPT_THREAD_INPUT:
                 b_thread_input = 1;
                 break;
+            case OPT_THREAD_INPUT_DEPTH:
+                input_opt.thread_depth = atoi( optarg );
+                break;
             case OPT_QUIET:
                 cli_log_level = param->i_log_level = X264_LOG_NONE;
                 break;
@@ -1626,6 +1665,9 @@ static int parse( int argc, char **argv, x264_param_t *param, cli_opt_t *opt )
             case OPT_NO_REMUX:
                 output_opt.no_remux = 1;
                 break;
+            case OPT_RESERVE_MOOV:
+                output_opt.reserve_moov = 1;
+                break;
             case OPT_FORCE_DISPLAY_SIZE:
                 FAIL_IF_ERROR( 2 != sscanf( optarg, "%lfx%lf", &output_opt.display_width, &output_opt.display_height ),
                                "invalid syntax for specifying display size: %s", optarg );
@@ -1700,6 +1742,7 @@ generic_option:
     input_opt.seek = opt->i_seek;
     input_opt.progress = opt->b_progress;
     input_opt.output_csp = output_csp;
+    opt->input_info = info;
 
     if( select_input( demuxer, demuxername, input_filename, &opt->hin, &info, &input_opt ) )
         return -1;
@@ -1707,6 +1750,11 @@ generic_option:
     FAIL_IF_ERROR( !opt->hin && cli_input.open_file( input_filename, &opt->hin, &info, &input_opt ),
                    "could not open input file `%s'\n", input_filename )
 
+    opt->input_filename = input_filename;
+    opt->input_opt = input_opt;
+    opt->chunk_input = cli_input;
+    opt->b_chunk_input = cli_input.open_file == raw_input.open_file || cli_input.open_file == y4m_input.open_file;
+
     if( audio_enable )
     {
         if( audio_filename )
@@ -1764,7 +1812,7 @@ generic_option:
     if( info.thread_safe && (b_thread_input || param->i_threads > 1
         || (param->i_threads == X264_THREADS_AUTO && x264_cpu_num_processors() > 1)) )
     {
-        if( thread_input.open_file( NULL, &opt->hin, &info, NULL ) )
+        if( thread_input.open_file( NULL, &opt->hin, &info, &input_opt ) )
         {
             fprintf( stderr, "x264 [error]: threaded input failed\n" );
             return -1;
@@ -1925,7 +1973,10 @@ static int encode_frame( x264_t *h, hnd_t hout, x264_picture_t *pic, int64_t *la
 
     if( i_frame_size )
     {
+        int b_trace = x264_trace_is_open();
+        int64_t trace_start = TRACE_START( b_trace );
         i_frame_size = cli_output.write_frame( hout, nal[0].p_payload, i_frame_size, &pic_out );
+        TRACE_END( b_trace, X264_TRACE_OUTPUT, trace_start );
         *last_dts = pic_out.i_dts;
     }
 
@@ -1979,6 +2030,249 @@ if( cond )\
     goto fail;\
 }
 
+#if HAVE_THREAD
+typedef struct
+{
+    x264_picture_t pic; /* timestamps and frame type as returned by the encoder */
+    int i_size;
+} cli_chunk_frame_t;
+
+typedef struct
+{
+    x264_param_t param;
+    x264_t *h;
+    cli_opt_t *opt;
+    int i_start;        /* first input frame of the chunk, relative to --seek */
+    int i_frames;
+    /* filled in by the worker */
+    FILE *spill;        /* encoded payloads, replayed into the muxer once the chunk is done */
+    cli_chunk_frame_t *frames;
+    int i_frame_output;
+    int ret;
+} cli_chunk_t;
+
+static int spill_frame( cli_chunk_t *c, x264_picture_t *pic_in )
+{
+    x264_picture_t pic_out;
+    x264_nal_t *nal;
+    int i_nal;
+    int i_frame_size = x264_encoder_encode( c->h, &nal, &i_nal, pic_in, &pic_out );
+
+    FAIL_IF_ERROR( i_frame_size < 0, "x264_encoder_encode failed\n" );
+
+    if( i_frame_size )
+    {
+        FAIL_IF_ERROR( fwrite( nal[0].p_payload, i_frame_size, 1, c->spill ) != 1, "error writing chunk spill file\n" );
+        cli_chunk_frame_t *frame = &c->frames[c->i_frame_output++];
+        frame->pic = pic_out;
+        frame->i_size = i_frame_size;
+    }
+    return 0;
+}
+
+static void *encode_chunk( void *arg )
+{
+    cli_chunk_t *c = arg;
+    cli_opt_t *opt = c->opt;
+    const cli_input_t *input = &opt->chunk_input;
+    cli_input_opt_t input_opt = opt->input_opt;
+    video_info_t info = opt->input_info;
+    hnd_t hin = NULL;
+    cli_pic_t cli_pic;
+    x264_picture_t pic;
+    int b_pic = 0;
+
+    c->ret = -1;
+    input_opt.progress = 0;
+    if( input->open_file( opt->input_filename, &hin, &info, &input_opt ) )
+    {
+        x264_cli_log( "x264", X264_LOG_ERROR, "could not reopen input file `%s'\n", opt->input_filename );
+        goto fail;
+    }
+    if( input->picture_alloc( &cli_pic, hin, info.csp, info.width, info.height ) )
+        goto fail;
+    b_pic = 1;
+    c->spill = tmpfile();
+    c->frames = malloc( c->i_frames * sizeof(cli_chunk_frame_t) );
+    if( !c->spill || !c->frames )
+    {
+        x264_cli_log( "x264", X264_LOG_ERROR, "could not allocate chunk buffers\n" );
+        goto fail;
+    }
+
+    for( int i = 0; !b_ctrl_c && i < c->i_frames; i++ )
+    {
+        int i_frame = c->i_start + i + opt->i_seek;
+        if( input->read_frame( &cli_pic, hin, i_frame ) )
+            break;
+        x264_picture_init( &pic );
+        convert_cli_to_lib_pic( &pic, &cli_pic );
+        pic.i_pts = c->i_start + i;
+        if( spill_frame( c, &pic ) < 0 )
+            goto fail;
+        if( input->release_frame && input->release_frame( &cli_pic, hin ) )
+            break;
+    }
+    while( !b_ctrl_c && x264_encoder_delayed_frames( c->h ) )
+        if( spill_frame( c, NULL ) < 0 )
+            goto fail;
+
+    c->ret = b_ctrl_c ? -1 : 0;
+fail:
+    if( b_pic )
+        input->picture_clean( &cli_pic, hin );
+    if( hin )
+        input->close_file( hin );
+    return NULL;
+}
+
+/* Encode the last pass as rc.i_chunks independent segments, one encoder per segment, and
+ * mux them back in order.  Every segment starts at an IDR frame, so the concatenation is a
+ * single conforming stream. */
+static int encode_chunks( x264_param_t *param, cli_opt_t *opt )
+{
+    int i_chunks = param->rc.i_chunks;
+    cli_chunk_t *chunks = NULL;
+    x264_threadpool_t *pool = NULL;
+    uint8_t *buf = NULL;
+    int i_buf = 0;
+    int i_frame_size;
+    int i_frame_output = 0;
+    int64_t i_file = 0;
+    int64_t i_start = x264_mdate(), i_end;
+    int64_t largest_pts = -1;
+    int64_t second_largest_pts = -1;
+    double  duration;
+    int     retval = 0;
+
+    FAIL_IF_ERROR( !opt->b_chunk_input || strcmp( filter.name, "source" ) || x264_is_regular_file_path( opt->input_filename ) != 1,
+                   "--chunks requires an unfiltered raw or y4m input file\n" )
+    FAIL_IF_ERROR( opt->i_pulldown || opt->qpfile || opt->tcfile_out || param->b_vfr_input || opt->timebase_convert_multiplier,
+                   "--chunks is incompatible with --pulldown, --qpfile, --tcfile-out and vfr input\n" )
+
+    chunks = calloc( i_chunks, sizeof(cli_chunk_t) );
+    FAIL_IF_ERROR2( !chunks, "malloc failed\n" )
+
+    int i_threads = param->i_threads;
+    if( i_threads == X264_THREADS_AUTO )
+        i_threads = X264_MAX( x264_cpu_num_processors() * 3 / 2 / i_chunks, 1 );
+
+    for( int i = 0; i < i_chunks; i++ )
+    {
+        cli_chunk_t *c = &chunks[i];
+        c->opt = opt;
+        c->param = *param;
+        c->param.rc.i_chunk = i;
+        c->param.i_threads = i_threads;
+        /* per-chunk encoder statistics would only be partial */
+        c->param.i_log_level = X264_MIN( param->i_log_level, X264_LOG_WARNING );
+        c->h = x264_encoder_open( &c->param );
+        FAIL_IF_ERROR2( !c->h, "x264_encoder_open failed\n" );
+        x264_encoder_parameters( c->h, &c->param );
+        c->i_start = c->param.rc.i_chunk_start;
+        c->i_frames = x264_clip3( c->param.i_frame_total, 0, X264_MAX( param->i_frame_total - c->i_start, 0 ) );
+        if( c->i_frames )
+            x264_cli_log( "x264", X264_LOG_INFO, "chunk %d: frames %d-%d\n", i, c->i_start, c->i_start + c->i_frames - 1 );
+        else
+            x264_cli_log( "x264", X264_LOG_WARNING, "chunk %d is empty, too few IDR frames to split at\n", i );
+    }
+
+    x264_param_t out_param = chunks[0].param;
+    out_param.i_frame_total = param->i_frame_total;
+    FAIL_IF_ERROR2( cli_output.set_param( opt->hout, &out_param ), "can't set outfile param\n" );
+
+    if( !param->b_repeat_headers )
+    {
+        x264_nal_t *headers;
+        int i_nal;
+
+        FAIL_IF_ERROR2( x264_encoder_headers( chunks[0].h, &headers, &i_nal ) < 0, "x264_encoder_headers failed\n" )
+        FAIL_IF_ERROR2( (i_file = cli_output.write_headers( opt->hout, headers )) < 0, "error writing headers to output file\n" );
+    }
+
+    FAIL_IF_ERROR2( x264_threadpool_init( &pool, i_chunks, NULL, NULL ), "threadpool init failed\n" )
+    for( int i = 0; i < i_chunks; i++ )
+        x264_threadpool_run( pool, encode_chunk, &chunks[i] );
+
+    /* mux the chunks in order as they complete; on failure keep waiting so that no worker is left running */
+    for( int i = 0; i < i_chunks; i++ )
+    {
+        cli_chunk_t *c = &chunks[i];
+        x264_threadpool_wait( pool, c );
+        if( retval || c->ret )
+        {
+            b_ctrl_c = 1; /* stop the other workers */
+            retval = -1;
+            continue;
+        }
+        rewind( c->spill );
+        for( int j = 0; j < c->i_frame_output && !retval; j++ )
+        {
+            cli_chunk_frame_t *frame = &c->frames[j];
+            if( frame->i_size > i_buf )
+            {
+                free( buf );
+                i_buf = frame->i_size;
+                buf = malloc( i_buf );
+            }
+            if( !buf || fread( buf, frame->i_size, 1, c->spill ) != 1 )
+            {
+                x264_cli_log( "x264", X264_LOG_ERROR, "error reading chunk spill file\n" );
+                retval = -1;
+            }
+            else if( (i_frame_size = cli_output.write_frame( opt->hout, buf, frame->i_size, &frame->pic )) < 0 )
+                retval = -1;
+            else
+            {
+                i_file += i_frame_size;
+                i_frame_output++;
+                if( frame->pic.i_pts > largest_pts )
+                {
+                    second_largest_pts = largest_pts;
+                    largest_pts = frame->pic.i_pts;
+                }
+                else if( frame->pic.i_pts > second_largest_pts )
+                    second_largest_pts = frame->pic.i_pts;
+            }
+        }
+        if( retval )
+            b_ctrl_c = 1;
+        else if( c->i_frame_output )
+            x264_cli_log( "x264", X264_LOG_INFO, "chunk %d: %d frames\n", i, c->i_frame_output );
+    }
+    x264_threadpool_delete( pool );
+
+fail:
+    i_end = x264_mdate();
+    if( chunks )
+        for( int i = 0; i < i_chunks; i++ )
+        {
+            if( chunks[i].h )
+                x264_encoder_close( chunks[i].h );
+            if( chunks[i].spill )
+                fclose( chunks[i].spill );
+            free( chunks[i].frames );
+        }
+    free( chunks );
+    free( buf );
+
+    if( b_ctrl_c && !retval )
+        fprintf( stderr, "aborted, output frame %d\n", i_frame_output );
+
+    cli_output.close_file( opt->hout, largest_pts, second_largest_pts );
+    opt->hout = NULL;
+
+    if( i_frame_output > 1 )
+    {
+        duration = (double)(2 * largest_pts - second_largest_pts) * param->i_timebase_num / param->i_timebase_den;
+        fprintf( stderr, "encoded %d frames, %.2f fps, %.2f kb/s\n", i_frame_output,
+                 (double)i_frame_output * 1000000 / (i_end - i_start), (double)i_file * 8 / (1000 * duration) );
+    }
+
+    return retval;
+}
+#endif
+
 static int encode( x264_param_t *param, cli_opt_t *opt )
 {
     x264_t *h = NULL;
@@ -2005,6 +2299,16 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
 
     opt->b_progress &= param->i_log_level < X264_LOG_DEBUG;
 
+    if( param->rc.i_chunks > 1 && param->rc.b_stat_read && !param->rc.b_stat_write )
+    {
+#if HAVE_THREAD
+        return encode_chunks( param, opt );
+#else
+        x264_cli_log( "x264", X264_LOG_ERROR, "--chunks requires threading support\n" );
+        return -1;
+#endif
+    }
+
     /* set up pulldown */
     if( opt->i_pulldown && !param->b_vfr_input )
     {
@@ -2047,8 +2351,11 @@ static int encode( x264_param_t *param, cli_opt_t *opt )
     /* Encode frames */
     for( ; !b_ctrl_c && (i_frame < param->i_frame_total || !param->i_frame_total); i_frame++ )
     {
+        int b_trace = x264_trace_is_open();
+        int64_t trace_start = TRACE_START( b_trace );
         if( filter.get_frame( opt->hin, &cli_pic, i_frame + opt->i_seek ) )
             break;
+        TRACE_END( b_trace, X264_TRACE_VFILTER, trace_start );
         x264_picture_init( &pic );
         convert_cli_to_lib_pic( &pic, &cli_pic );
 
@@ -41,7 +41,7 @@
 
 #include "x264_config.h"
 
-#define X264_BUILD 129
+#define X264_BUILD 137
 
 /* Application developers planning to link against a shared library version of
  * libx264 from a Microsoft Visual Studio or similar development environment
@@ -58,6 +58,10 @@
  *      opaque handler for encoder */
 typedef struct x264_t x264_t;
 
+/* x264_lookahead_share_t:
+ *      opaque handle through which encoders of the same content share one lookahead */
+typedef struct x264_lookahead_share_t x264_lookahead_share_t;
+
 /****************************************************************************
  * NAL structure and functions
  ****************************************************************************/
@@ -143,6 +147,7 @@ typedef struct
 #define X264_CPU_BMI1            0x8000000  /* BMI1 */
 #define X264_CPU_BMI2           0x10000000  /* BMI2 */
 #define X264_CPU_TBM            0x20000000  /* AMD TBM */
+#define X264_CPU_AVX512         0x40000000  /* AVX-512 F, CD, BW, DQ and VL: requires OS support for ZMM state */
 
 /* Analyse flags
  */
@@ -254,12 +259,18 @@ typedef struct x264_param_t
 {
     /* CPU flags */
     unsigned int cpu;
+    unsigned int cpu_max;            /* if nonzero, SIMD tiers above this set are masked out of cpu
+                                      * (e.g. to avoid AVX-512 frequency throttling) */
     int         i_threads;           /* encode multiple frames in parallel */
     int         i_lookahead_threads; /* multiple threads for lookahead analysis */
     int         b_sliced_threads;  /* Whether to use slice-based threading. */
     int         b_deterministic; /* whether to allow non-deterministic optimizations when threaded */
     int         b_cpu_independent; /* force canonical behavior rather than cpu-dependent optimal algorithms */
     int         i_sync_lookahead; /* threaded lookahead buffer */
+    int         i_frame_pool;     /* share frame buffers with the other encoders of this process,
+                                   * keeping up to this many MiB of idle buffers. 0 = disabled */
+    x264_lookahead_share_t *lookahead_share; /* see x264_lookahead_share_new, NULL = disabled */
+    int         b_lookahead_source; /* run the shared lookahead rather than consume it */
 
     /* Video Properties */
     int         i_width;
@@ -337,6 +348,7 @@ typedef struct x264_param_t
     int         b_visualize;
     int         b_full_recon;   /* fully reconstruct frames, even when not necessary for encoding.  Implied by psz_dump_yuv */
     char        *psz_dump_yuv;  /* filename for reconstructed frames */
+    char        *psz_trace_file; /* filename for a Chrome trace (JSON) of per-stage timings */
 
     /* Encoder analyser parameters */
     struct
@@ -355,6 +367,7 @@ typedef struct x264_param_t
         int          i_mv_range; /* maximum length of a mv (in pixels). -1 = auto, based on level */
         int          i_mv_range_thread; /* minimum space between threads. -1 = auto, based on number of threads. */
         int          i_subpel_refine; /* subpixel motion estimation quality */
+        int          b_lazy_hpel; /* filter the half-pel planes of a reference only where motion compensation reads them */
         int          b_chroma_me; /* chroma ME for subpel and mode decision in P-frames */
         int          b_mixed_references; /* allow each mb partition to have its own reference number */
         int          i_trellis;  /* trellis RD quantization */
@@ -399,12 +412,24 @@ typedef struct x264_param_t
         float       f_aq_strength;
         int         b_mb_tree;      /* Macroblock-tree ratecontrol. */
         int         i_lookahead;
+        int         i_lookahead_pyramid; /* Search lookahead motion this many halvings below the half-res plane.
+                                          * Costs are still measured on the half-res plane. */
 
         /* 2pass */
         int         b_stat_write;   /* Enable stat writing in psz_stat_out */
         char        *psz_stat_out;
         int         b_stat_read;    /* Read stat from psz_stat_in and use it */
         char        *psz_stat_in;
+        int         b_stat_binary;  /* Write 1st pass stats in binary format instead of text,
+                                     * and MB-tree stats compressed with a per-frame index */
+
+        /* Chunked 2nd pass: split the 1st pass stats into i_chunks segments starting at IDR
+         * frames and encode only segment i_chunk (0-based), as planned for the whole file.
+         * On open, i_chunk_start and i_frame_total are set to the segment's first input frame
+         * and length; the caller feeds exactly those frames. */
+        int         i_chunks;
+        int         i_chunk;
+        int         i_chunk_start;
 
         /* 2pass params (same as ffmpeg ones) */
         float       f_qcompress;    /* 0.0 => cbr, 1.0 => constant qp */
@@ -862,6 +887,20 @@ int     x264_encoder_encode( x264_t *, x264_nal_t **pp_nal, int *pi_nal, x264_pi
 /* x264_encoder_close:
  *      close an encoder handler */
 void    x264_encoder_close  ( x264_t * );
+/* x264_lookahead_share_new:
+ *      create a channel through which several encoders of the same content at different
+ *      resolutions (e.g. the renditions of an ABR ladder) run the lookahead only once.
+ *      The encoder opened with b_lookahead_source set (the source) publishes its frame types
+ *      and MB-tree offsets; the others given the same lookahead_share (the consumers) use them
+ *      instead of their own slicetype analysis, and take the source's keyint and B-frame settings.
+ *      The source must be opened before its consumers, and each picture must be passed to the
+ *      source before it is passed to the consumers, flushing included; consumers may block
+ *      until the source has decided a frame.  Not compatible with multipass or interlacing.
+ *      returns NULL on malloc failure. */
+x264_lookahead_share_t *x264_lookahead_share_new( void );
+/* x264_lookahead_share_delete:
+ *      free a lookahead share once all encoders using it have been closed */
+void    x264_lookahead_share_delete( x264_lookahead_share_t * );
 /* x264_encoder_delayed_frames:
  *      return the number of currently delayed (buffered) frames
  *      this should be used at the end of the stream, to know when you have all the encoded frames. */
@@ -0,0 +1,8 @@
+#define X264_BIT_DEPTH     8
+#define X264_GPL           1
+#define X264_INTERLACED    1
+#define X264_CHROMA_FORMAT 0
+#define X264_REV 0
+#define X264_REV_DIFF 7
+#define X264_VERSION " gate"
+#define X264_POINTVER "gate"